@@ -105,6 +105,10 @@
 
 #include <linux/kernel.h>
 #include <linux/init.h>
+#include <linux/async.h>
+#include <linux/boot_timeline.h>
+#include <linux/completion.h>
+#include <linux/moduleparam.h>
 #include <linux/platform_device.h>
 #include <linux/delay.h>
 #include <linux/err.h>
@@ -239,6 +243,9 @@
 #define J49_USB_VENDOR_ID				0x2464
 #define J49_USB_PRODUCT_ID				0x0002
 
+/* Bulk throughput benchmark, when it is the only function enabled */
+#define NEST_USB_BENCH_PRODUCT_ID		0x00F0
+
 /* NOTE: SCSI Inquiry (which is how USB Mass Storage Class (MSC)
  * vendor and product strings are queried), are limited to 8 and 16
  * ASCII characters, for vendor and product, respectively.
@@ -293,6 +300,8 @@ static struct omap_musb_board_data musb_board_data = {
 	.interface_type		= MUSB_INTERFACE_ULPI,
 	.mode			= MUSB_PERIPHERAL,
 	.power			= 50,
+	/* double-buffered bulk endpoints for mass storage */
+	.fifo_mode		= 6,
 };
 
 /* Function Prototypes */
@@ -936,7 +945,7 @@ static struct omap_nand_platform_data diamond_nand_data = {
 	.parts          = diamond_nand_partitions,
 	.nr_parts       = ARRAY_SIZE(diamond_nand_partitions),
 	.nand_setup     = NULL,
-	.dma_channel    = -1,           /* disable DMA in OMAP NAND driver */
+	.xfer_type      = NAND_OMAP_PREFETCH_DMA,
 	.dev_ready      = NULL,
 };
 
@@ -1435,12 +1444,23 @@ static struct i2c_board_info __initdata j49_backlight_i2c_info[] = {
 };
 
 #if defined(CONFIG_INPUT_GPIO_ROTARY_ENCODER_LITE)
+#if defined(CONFIG_INPUT_PWM_BEEPER)
+/* Click the piezo from the encoder IRQ, no trip through userspace. */
+static void diamond_rotary_edge(struct device *dev, int direction)
+{
+	pwm_beeper_click();
+}
+#endif
+
 static struct rotary_encoder_lite_platform_data rotary_enc = {
     .gpio_a             = DIAMOND_GPIO_ROTARY_VALID,
     .gpio_b             = DIAMOND_GPIO_ROTARY_DIR,
     .gpio_clear         = DIAMOND_GPIO_ROTARY_CLEAR,
     .steps              = 360,
-    .rollover           = 1
+    .rollover           = 1,
+#if defined(CONFIG_INPUT_PWM_BEEPER)
+    .edge               = diamond_rotary_edge,
+#endif
 };
 
 static struct platform_device diamond_rotary_device = {
@@ -1659,14 +1679,14 @@ static int diamond_development_enable_lcd(struct omap_dss_device *dssdev)
 
 	gpio_set_value(DIAMOND_GPIO_LCD_ENABLE_VDD, 1);
 
-	mdelay(30);
+	msleep(30);
 
 	// Second, enable (active low) the 1.8V to 3.3V signal buffer and
 	// wait a few milliseconds.
 
 	gpio_set_value(DIAMOND_GPIO_LCD_NENABLE_BUFFER, 0);
 
-	mdelay(30);
+	msleep(30);
 
 	lcd_enabled = true;
 
@@ -1838,16 +1858,42 @@ static const char *diamond_dynamic_usb_functions[] = {
 #if defined(CONFIG_USB_DYNAMIC_ACM)
 	"acm",
 #endif
+#if defined(CONFIG_USB_DYNAMIC_BULKBENCH)
+	"bulkbench",
+#endif
+};
+
+/* Functions enabled out of reset; the benchmark function starts off. */
+static const char *diamond_dynamic_usb_default_functions[] = {
+#if defined(CONFIG_USB_DYNAMIC_MASS_STORAGE)
+	"usb_mass_storage",
+#endif
+#if defined(CONFIG_USB_DYNAMIC_ACM)
+	"acm",
+#endif
+};
+
+#if defined(CONFIG_USB_DYNAMIC_BULKBENCH)
+static const char *diamond_dynamic_usb_bench_functions[] = {
+	"bulkbench",
 };
+#endif
 
 static char diamond_serial_number[DIAMOND_USB_SERIAL_STRING_SIZE] = "";
 
 static const struct dynamic_usb_product diamond_dynamic_usb_products[] = {
 	{
 		.product_id		= DIAMOND_USB_PRODUCT_ID,
-		.num_functions	= ARRAY_SIZE(diamond_dynamic_usb_functions),
-		.functions		= diamond_dynamic_usb_functions,
+		.num_functions	= ARRAY_SIZE(diamond_dynamic_usb_default_functions),
+		.functions		= diamond_dynamic_usb_default_functions,
 	},
+#if defined(CONFIG_USB_DYNAMIC_BULKBENCH)
+	{
+		.product_id		= NEST_USB_BENCH_PRODUCT_ID,
+		.num_functions	= ARRAY_SIZE(diamond_dynamic_usb_bench_functions),
+		.functions		= diamond_dynamic_usb_bench_functions,
+	},
+#endif
 };
 
 static struct dynamic_usb_platform_data diamond_dynamic_usb_data = {
@@ -1873,9 +1919,16 @@ static struct platform_device diamond_dynamic_usb_device = {
 static const struct dynamic_usb_product j49_dynamic_usb_products[] = {
 	{
 		.product_id		= J49_USB_PRODUCT_ID,
-		.num_functions	= ARRAY_SIZE(diamond_dynamic_usb_functions),
-		.functions		= diamond_dynamic_usb_functions,
+		.num_functions	= ARRAY_SIZE(diamond_dynamic_usb_default_functions),
+		.functions		= diamond_dynamic_usb_default_functions,
+	},
+#if defined(CONFIG_USB_DYNAMIC_BULKBENCH)
+	{
+		.product_id		= NEST_USB_BENCH_PRODUCT_ID,
+		.num_functions	= ARRAY_SIZE(diamond_dynamic_usb_bench_functions),
+		.functions		= diamond_dynamic_usb_bench_functions,
 	},
+#endif
 };
 
 static struct dynamic_usb_platform_data j49_dynamic_usb_data = {
@@ -2437,8 +2490,8 @@ static void __init diamond_development_i2c_init(void)
 {
 	omap_register_i2c_bus(1, 2600, diamond_tps65921_i2c_info,
 						  ARRAY_SIZE(diamond_tps65921_i2c_info));
-	omap_register_i2c_bus(2, 400, diamond_development_i2c_2_info,
-						  ARRAY_SIZE(diamond_development_i2c_2_info));
+	diamond_register_i2c_sensors(2, 400, diamond_development_i2c_2_info,
+								 ARRAY_SIZE(diamond_development_i2c_2_info));
 }
 
 static void __init diamond_1_4_i2c_init(void)
@@ -2455,8 +2508,8 @@ static void __init diamond_1_4_i2c_init(void)
 #endif /* defined(CONFIG_INPUT_ADBS_A330) */
 	omap_register_i2c_bus(1, 2600, diamond_tps65921_i2c_info,
 						  ARRAY_SIZE(diamond_tps65921_i2c_info));
-	omap_register_i2c_bus(2, 400, diamond_prototype_i2c_2_info,
-						  ARRAY_SIZE(diamond_prototype_i2c_2_info));
+	diamond_register_i2c_sensors(2, 400, diamond_prototype_i2c_2_info,
+								 ARRAY_SIZE(diamond_prototype_i2c_2_info));
 }
 
 static void __init diamond_1_5_i2c_init(void)
@@ -2474,8 +2527,8 @@ static void __init diamond_1_5_i2c_init(void)
 #endif /* defined(CONFIG_INPUT_ADBS_A330) */
 	omap_register_i2c_bus(1, 2600, diamond_tps65921_i2c_info,
 						  ARRAY_SIZE(diamond_tps65921_i2c_info));
-	omap_register_i2c_bus(2, 400, diamond_prototype_i2c_2_info,
-						  ARRAY_SIZE(diamond_prototype_i2c_2_info));
+	diamond_register_i2c_sensors(2, 400, diamond_prototype_i2c_2_info,
+								 ARRAY_SIZE(diamond_prototype_i2c_2_info));
 }
 
 static void __init diamond_1_6_i2c_init(void)
@@ -2493,8 +2546,8 @@ static void __init diamond_1_6_i2c_init(void)
 #endif /* defined(CONFIG_INPUT_ADBS_A330) */
 	omap_register_i2c_bus(1, 400, diamond_tps65921_i2c_info,
 						  ARRAY_SIZE(diamond_tps65921_i2c_info));
-	omap_register_i2c_bus(2, 400, diamond_prototype_i2c_2_info,
-						  ARRAY_SIZE(diamond_prototype_i2c_2_info));
+	diamond_register_i2c_sensors(2, 400, diamond_prototype_i2c_2_info,
+								 ARRAY_SIZE(diamond_prototype_i2c_2_info));
 }
 
 static void __init display_2_0_i2c_init(void)
@@ -2511,8 +2564,8 @@ static void __init display_2_0_i2c_init(void)
 #endif
     omap_register_i2c_bus(1, 400, j49_tps65921_i2c_info,
                           ARRAY_SIZE(j49_tps65921_i2c_info));
-    omap_register_i2c_bus(2, 400, j49_i2c_2_info,
-                          ARRAY_SIZE(j49_i2c_2_info));
+    diamond_register_i2c_sensors(2, 400, j49_i2c_2_info,
+                                 ARRAY_SIZE(j49_i2c_2_info));
     
     omap_register_i2c_bus(3, 400, j49_backlight_i2c_info,
                           ARRAY_SIZE(j49_backlight_i2c_info));
@@ -2530,20 +2583,229 @@ static void __init diamond_1_5_piezo_init(void)
 	diamond_1_4_piezo_init();
 }
 
+/*
+ * Asynchronous device bring-up
+ *
+ * Devices that are slow to probe and that nothing else in the kernel
+ * waits for are not registered from init_machine, where their probes
+ * would run one after another as each driver registers. Instead they
+ * are collected into groups that are registered at late_initcall time,
+ * once every built-in driver is in place, each group from its own
+ * async thread so that the probes overlap. A group first waits for the
+ * groups it depends on. The kernel waits for all of them before
+ * starting init, so user space sees the same set of devices as before.
+ *
+ * The display stays on the synchronous path: the first frame waits on
+ * it and omapfb expects omapdss to have probed by the time it does.
+ *
+ * Booting with diamond_async=0 registers everything synchronously.
+ */
+static bool diamond_async = true;
+core_param(diamond_async, diamond_async, bool, 0444);
+
+enum diamond_async_group_id {
+	DIAMOND_ASYNC_BACKPLATE,
+	DIAMOND_ASYNC_POWER,
+	DIAMOND_ASYNC_WLAN,
+	DIAMOND_ASYNC_ZIGBEE,
+	DIAMOND_ASYNC_SENSORS,
+	DIAMOND_ASYNC_PIEZO,
+	DIAMOND_ASYNC_GROUPS
+};
+
+struct diamond_async_group {
+	const char *name;
+	unsigned long after;
+	struct platform_device *devices[4];
+	unsigned int num_devices;
+	int i2c_bus;
+	struct i2c_board_info *i2c_info;
+	unsigned int num_i2c_info;
+	struct completion done;
+};
+
+static struct diamond_async_group diamond_async_groups[DIAMOND_ASYNC_GROUPS] __initdata = {
+	[DIAMOND_ASYNC_BACKPLATE] = {
+		.name	= "backplate",
+	},
+	[DIAMOND_ASYNC_POWER] = {
+		.name	= "power",
+		.after	= BIT(DIAMOND_ASYNC_BACKPLATE),
+	},
+	[DIAMOND_ASYNC_WLAN] = {
+		.name	= "wlan",
+	},
+	[DIAMOND_ASYNC_ZIGBEE] = {
+		.name	= "zigbee",
+	},
+	[DIAMOND_ASYNC_SENSORS] = {
+		.name	= "sensors",
+	},
+	[DIAMOND_ASYNC_PIEZO] = {
+		.name	= "piezo",
+	},
+};
+
+/* Devices are registered in the order listed within each group. */
+static const struct {
+	struct platform_device *device;
+	enum diamond_async_group_id group;
+} diamond_async_devices[] __initconst = {
+	{ &diamond_backplate_device,	DIAMOND_ASYNC_BACKPLATE	},
+	{ &diamond_battery_device,		DIAMOND_ASYNC_POWER		},
+#if defined(CONFIG_SENSORS_TWL4030_MADC)
+	{ &diamond_madc_hwmon_device,	DIAMOND_ASYNC_POWER		},
+#endif
+#if defined(CONFIG_WILINK) || defined(CONFIG_WILINK_MODULE)
+	{ &diamond_wl1271_device,		DIAMOND_ASYNC_WLAN		},
+#endif
+	{ &diamond_zigbee_device,		DIAMOND_ASYNC_ZIGBEE	},
+	{ &j49_zigbee_device,			DIAMOND_ASYNC_ZIGBEE	},
+	{ &diamond_piezo_pwm_device,	DIAMOND_ASYNC_PIEZO		},
+	{ &diamond_piezo_device,		DIAMOND_ASYNC_PIEZO		},
+};
+
+static bool __init diamond_async_queue(struct platform_device *pdev)
+{
+	struct diamond_async_group *group;
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(diamond_async_devices); i++) {
+		if (diamond_async_devices[i].device != pdev)
+			continue;
+
+		group = &diamond_async_groups[diamond_async_devices[i].group];
+
+		if (group->num_devices == ARRAY_SIZE(group->devices))
+			return false;
+
+		group->devices[group->num_devices++] = pdev;
+		return true;
+	}
+
+	return false;
+}
+
+static void __init diamond_add_devices(struct platform_device **devices,
+									   int num)
+{
+	int i;
+
+	for (i = 0; i < num; i++) {
+		if (diamond_async && diamond_async_queue(devices[i]))
+			continue;
+
+		platform_device_register(devices[i]);
+	}
+}
+
+/**
+ * diamond_register_i2c_sensors - register an I2C bus whose clients may probe late
+ *
+ * The bus itself is registered right away, the clients on it from the
+ * sensors group.
+ */
+static int __init diamond_register_i2c_sensors(int bus_id, u32 clkrate,
+											   struct i2c_board_info *info,
+											   unsigned len)
+{
+	struct diamond_async_group *group =
+		&diamond_async_groups[DIAMOND_ASYNC_SENSORS];
+
+	if (!diamond_async || !len)
+		return omap_register_i2c_bus(bus_id, clkrate, info, len);
+
+	group->i2c_bus = bus_id;
+	group->i2c_info = info;
+	group->num_i2c_info = len;
+
+	return omap_register_i2c_bus(bus_id, clkrate, NULL, 0);
+}
+
+static void __init diamond_async_register(void *data, async_cookie_t cookie)
+{
+	struct diamond_async_group *group = data;
+	struct i2c_adapter *adapter;
+	int i, status, event;
+
+	for (i = 0; i < DIAMOND_ASYNC_GROUPS; i++) {
+		if (group->after & BIT(i))
+			wait_for_completion(&diamond_async_groups[i].done);
+	}
+
+	event = boot_timeline_begin("board %s", group->name);
+
+	for (i = 0; i < group->num_devices; i++) {
+		status = platform_device_register(group->devices[i]);
+		if (status)
+			machine_warn("Could not register %s: %d\n",
+						 group->devices[i]->name, status);
+	}
+
+	if (group->num_i2c_info) {
+		adapter = i2c_get_adapter(group->i2c_bus);
+
+		if (adapter == NULL) {
+			machine_warn("No I2C bus %d for %s\n",
+						 group->i2c_bus, group->name);
+
+		} else {
+			for (i = 0; i < group->num_i2c_info; i++) {
+				if (i2c_new_device(adapter, &group->i2c_info[i]) == NULL)
+					machine_warn("Could not add I2C device %s\n",
+								 group->i2c_info[i].type);
+			}
+
+			i2c_put_adapter(adapter);
+		}
+	}
+
+	boot_timeline_end(event);
+
+	complete_all(&group->done);
+}
+
+static int __init diamond_async_init(void)
+{
+	struct diamond_async_group *group;
+	int i;
+
+	/* Every completion must be ready before any group waits on it. */
+
+	for (i = 0; i < DIAMOND_ASYNC_GROUPS; i++) {
+		group = &diamond_async_groups[i];
+
+		init_completion(&group->done);
+
+		if (!group->num_devices && !group->num_i2c_info)
+			complete_all(&group->done);
+	}
+
+	for (i = 0; i < DIAMOND_ASYNC_GROUPS; i++) {
+		group = &diamond_async_groups[i];
+
+		if (group->num_devices || group->num_i2c_info)
+			async_schedule(diamond_async_register, group);
+	}
+
+	return 0;
+}
+late_initcall(diamond_async_init);
+
 static void __init diamond_development_add_devices(void)
 {
-	platform_add_devices(diamond_common_devices,
-						 ARRAY_SIZE(diamond_common_devices));
-	platform_add_devices(diamond_development_devices,
-						 ARRAY_SIZE(diamond_development_devices));
+	diamond_add_devices(diamond_common_devices,
+						ARRAY_SIZE(diamond_common_devices));
+	diamond_add_devices(diamond_development_devices,
+						ARRAY_SIZE(diamond_development_devices));
 }
 
 static void __init diamond_1_4_add_devices(void)
 {
-	platform_add_devices(diamond_common_devices,
-						 ARRAY_SIZE(diamond_common_devices));
-	platform_add_devices(diamond_prototype_devices,
-						 ARRAY_SIZE(diamond_prototype_devices));
+	diamond_add_devices(diamond_common_devices,
+						ARRAY_SIZE(diamond_common_devices));
+	diamond_add_devices(diamond_prototype_devices,
+						ARRAY_SIZE(diamond_prototype_devices));
 }
 
 static void __init diamond_1_5_add_devices(void)
@@ -2553,10 +2815,10 @@ static void __init diamond_1_5_add_devices(void)
 
 static void __init diamond_1_6_add_devices(void)
 {
-	platform_add_devices(diamond_common_devices,
-						 ARRAY_SIZE(diamond_common_devices));
-	platform_add_devices(diamond_1_6_devices,
-						 ARRAY_SIZE(diamond_1_6_devices));
+	diamond_add_devices(diamond_common_devices,
+						ARRAY_SIZE(diamond_common_devices));
+	diamond_add_devices(diamond_1_6_devices,
+						ARRAY_SIZE(diamond_1_6_devices));
 }
 
 /**
@@ -2567,18 +2829,18 @@ static void __init diamond_1_6_add_devices(void)
  */
 static void __init diamond_1_7_add_devices(void)
 {
-	platform_add_devices(diamond_common_devices,
-						 ARRAY_SIZE(diamond_common_devices));
-	platform_add_devices(diamond_1_6_devices,
-						 ARRAY_SIZE(diamond_1_6_devices));
+	diamond_add_devices(diamond_common_devices,
+						ARRAY_SIZE(diamond_common_devices));
+	diamond_add_devices(diamond_1_6_devices,
+						ARRAY_SIZE(diamond_1_6_devices));
 }
 
 static void __init display_2_0_add_devices(void)
 {
-	platform_add_devices(diamond_common_devices,
-						 ARRAY_SIZE(diamond_common_devices));
-	platform_add_devices(display_2_0_devices,
-						 ARRAY_SIZE(display_2_0_devices));
+	diamond_add_devices(diamond_common_devices,
+						ARRAY_SIZE(diamond_common_devices));
+	diamond_add_devices(display_2_0_devices,
+						ARRAY_SIZE(display_2_0_devices));
 }
 
 static void __init diamond_development_spi_init(void)
@@ -2613,7 +2875,8 @@ static void __init display_2_0_spi_init(void)
 
 static void __init diamond_serial_init(void)
 {
-	omap_serial_init();
+	/* UART2 carries the ZigBee module; receive it through DMA */
+	omap_serial_init_dma(1 << 1);
 }
 
 static void __init diamond_development_mmc_init(void)
@@ -2823,71 +3086,43 @@ static void __init display_2_0_net_init(void)
 #endif /* defined(CONFIG_WL12XX) || defined(CONFIG_WL12XX_MODULE) */
 }
 
+/*
+ * Runs one model hook, recording it on the boot timeline. The order
+ * of the calls in diamond_model_init is their dependency order:
+ * supply fix-ups before the PMIC on I2C registers its regulators, the
+ * display selection before the DSS device is added, and the pin mux
+ * before anything requesting GPIOs or buses.
+ */
+#define diamond_model_step(didp, hook, ...)						\
+	do {														\
+		if ((didp)->hook) {										\
+			int event = boot_timeline_begin("board " #hook);	\
+			(didp)->hook(__VA_ARGS__);							\
+			boot_timeline_end(event);							\
+		}														\
+	} while (0)
+
 static void __init diamond_model_init(struct nlmodel *model,
 									  const struct diamond_init_data *didp)
 {
 	if (didp == NULL)
 		return;
 
-	if (didp->regulator_init) {
-		didp->regulator_init();
-	}
-
-	if (didp->power_init) {
-		didp->power_init();
-	}
-
-	if (didp->backplate_init) {
-		didp->backplate_init(model);
-	}
-
-	if (didp->display_init) {
-		didp->display_init();
-	}
-
-	if (didp->mux_init) {
-		didp->mux_init();
-	}
-
-	if (didp->i2c_init) {
-		didp->i2c_init();
-	}
-
-	if (didp->piezo_init) {
-		didp->piezo_init();
-	}
-
-	if (didp->add_devices) {
-		didp->add_devices();
-	}
-
-	if (didp->spi_init) {
-		didp->spi_init();
-	}
-
-	if (didp->serial_init) {
-		didp->serial_init();
-	}
-
-	if (didp->mmc_init) {
-		didp->mmc_init();
-	}
-
-	if (didp->usb_init) {
-		didp->usb_init();
-	}
-
-	if (didp->flash_init) {
-		didp->flash_init();
-	}
-
-	if (didp->net_init) {
-		didp->net_init();
-	}
-
-	if (didp->clk_init) {
-		didp->clk_init();
-	}
+	diamond_model_step(didp, regulator_init);
+	diamond_model_step(didp, power_init);
+	diamond_model_step(didp, backplate_init, model);
+	diamond_model_step(didp, display_init);
+	diamond_model_step(didp, mux_init);
+	diamond_model_step(didp, i2c_init);
+	diamond_model_step(didp, piezo_init);
+	diamond_model_step(didp, add_devices);
+	diamond_model_step(didp, spi_init);
+	diamond_model_step(didp, serial_init);
+	diamond_model_step(didp, mmc_init);
+	diamond_model_step(didp, usb_init);
+	diamond_model_step(didp, flash_init);
+	diamond_model_step(didp, net_init);
+	diamond_model_step(didp, clk_init);
 }
 
 const struct diamond_init_data * __init __diamond_init_data(const char *family, int product, int revision)
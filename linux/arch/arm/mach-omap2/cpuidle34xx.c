@@ -24,6 +24,10 @@
 
 #include <linux/sched.h>
 #include <linux/cpuidle.h>
+#include <linux/tick.h>
+#include <linux/ktime.h>
+#include <linux/kobject.h>
+#include <linux/sysfs.h>
 
 #include <plat/prcm.h>
 #include <plat/irqs.h>
@@ -63,6 +67,32 @@ struct omap3_processor_cx current_cx_state;
 struct powerdomain *mpu_pd, *core_pd, *per_pd;
 struct powerdomain *cam_pd;
 
+/*
+ * Per C-state bookkeeping, see /sys/power/cpuidle_stats.
+ *
+ * The wakeup latency of a state is measured whenever the timer that
+ * ended the idle period was the one programmed when going idle: how
+ * late we got back is what the state cost on the way out. Once a
+ * state has OMAP3_LATENCY_SAMPLES of these, and unless
+ * /sys/power/cpuidle_measured_latency is cleared, the worst one raises
+ * its exit latency when it is above the table. It never lowers it: the
+ * governor checks PM QoS limits against that value.
+ */
+#define OMAP3_LATENCY_SAMPLES	32
+
+struct omap3_idle_stats {
+	unsigned long usage;
+	u64 time_us;
+	unsigned long aborted;		/* IRQ pending on entry */
+	unsigned long demoted;		/* bus/CAM activity, went to C1 */
+	unsigned long samples;
+	u32 lat_avg;			/* us, running average */
+	u32 lat_max;			/* us */
+};
+
+static struct omap3_idle_stats omap3_idle_stats[OMAP3_MAX_STATES];
+static unsigned int omap3_idle_use_measured = 1;
+
 /*
  * The latencies/thresholds for various C states have
  * to be configured from the respective board files.
@@ -108,6 +138,24 @@ static int _cpuidle_deny_idle(struct powerdomain *pwrdm,
 	return 0;
 }
 
+static void omap3_idle_account_latency(struct cpuidle_state *state,
+		struct omap3_processor_cx *cx, struct omap3_idle_stats *st,
+		s64 late_us)
+{
+	u32 lat = min_t(s64, late_us, U32_MAX);
+
+	if (st->samples++)
+		st->lat_avg += ((s32)lat - (s32)st->lat_avg) / 8;
+	else
+		st->lat_avg = lat;
+	if (lat > st->lat_max)
+		st->lat_max = lat;
+
+	if (omap3_idle_use_measured && st->samples >= OMAP3_LATENCY_SAMPLES)
+		state->exit_latency = cx->sleep_latency +
+			max(st->lat_max, cx->wakeup_latency);
+}
+
 /**
  * omap3_enter_idle - Programs OMAP3 to enter the specified state
  * @dev: cpuidle device
@@ -120,8 +168,12 @@ static int omap3_enter_idle(struct cpuidle_device *dev,
 			struct cpuidle_state *state)
 {
 	struct omap3_processor_cx *cx = cpuidle_get_statedata(state);
+	struct omap3_idle_stats *st = &omap3_idle_stats[cx->type];
 	struct timespec ts_preidle, ts_postidle, ts_idle;
 	u32 mpu_state = cx->mpu_state, core_state = cx->core_state;
+	s64 late_us, idle_us;
+	ktime_t wakeup;
+	bool aborted = false;
 
 	current_cx_state = *cx;
 
@@ -131,11 +183,16 @@ static int omap3_enter_idle(struct cpuidle_device *dev,
 	local_irq_disable();
 	local_fiq_disable();
 
+	/* The timer we expect to wake us, as programmed at entry */
+	wakeup = tick_get_device(smp_processor_id())->evtdev->next_event;
+
 	pwrdm_set_next_pwrst(mpu_pd, mpu_state);
 	pwrdm_set_next_pwrst(core_pd, core_state);
 
-	if (omap_irq_pending() || need_resched())
+	if (omap_irq_pending() || need_resched()) {
+		aborted = true;
 		goto return_sleep_time;
+	}
 
 	if (cx->type == OMAP3_STATE_C1) {
 		pwrdm_for_each_clkdm(mpu_pd, _cpuidle_deny_idle);
@@ -153,11 +210,23 @@ static int omap3_enter_idle(struct cpuidle_device *dev,
 return_sleep_time:
 	getnstimeofday(&ts_postidle);
 	ts_idle = timespec_sub(ts_postidle, ts_preidle);
+	idle_us = ts_idle.tv_nsec / NSEC_PER_USEC +
+		(s64)ts_idle.tv_sec * USEC_PER_SEC;
+
+	st->usage++;
+	st->time_us += idle_us;
+	if (aborted) {
+		st->aborted++;
+	} else {
+		late_us = ktime_us_delta(ktime_get(), wakeup);
+		if (late_us >= 0)
+			omap3_idle_account_latency(state, cx, st, late_us);
+	}
 
 	local_irq_enable();
 	local_fiq_enable();
 
-	return ts_idle.tv_nsec / NSEC_PER_USEC + ts_idle.tv_sec * USEC_PER_SEC;
+	return idle_us;
 }
 
 /**
@@ -221,6 +290,11 @@ static struct cpuidle_state *next_valid_state(struct cpuidle_device *dev,
 	return next;
 }
 
+static inline u8 omap3_state_type(struct cpuidle_state *state)
+{
+	return ((struct omap3_processor_cx *)cpuidle_get_statedata(state))->type;
+}
+
 /**
  * omap3_enter_idle_bm - Checks for any bus activity
  * @dev: cpuidle device
@@ -242,6 +316,7 @@ static int omap3_enter_idle_bm(struct cpuidle_device *dev,
 	if ((state->flags & CPUIDLE_FLAG_CHECK_BM) && omap3_idle_bm_check()) {
 		BUG_ON(!dev->safe_state);
 		new_state = dev->safe_state;
+		omap3_idle_stats[omap3_state_type(state)].demoted++;
 		goto select_state;
 	}
 
@@ -263,6 +338,7 @@ static int omap3_enter_idle_bm(struct cpuidle_device *dev,
 	cam_state = pwrdm_read_pwrst(cam_pd);
 	if (cam_state == PWRDM_POWER_ON) {
 		new_state = dev->safe_state;
+		omap3_idle_stats[omap3_state_type(state)].demoted++;
 		goto select_state;
 	}
 
@@ -317,6 +393,102 @@ void omap3_cpuidle_update_states(u32 mpu_deepest_state, u32 core_deepest_state)
 	}
 }
 
+/* Back to the table latencies, e.g. after the measurements were reset */
+static void omap3_idle_table_latencies(void)
+{
+	struct cpuidle_device *dev = &per_cpu(omap3_idle_dev, 0);
+	int i;
+
+	for (i = 0; i < dev->state_count; i++) {
+		struct omap3_processor_cx *cx;
+
+		cx = cpuidle_get_statedata(&dev->states[i]);
+		dev->states[i].exit_latency =
+			cx->sleep_latency + cx->wakeup_latency;
+	}
+}
+
+static ssize_t cpuidle_stats_show(struct kobject *kobj,
+				  struct kobj_attribute *attr, char *buf)
+{
+	struct cpuidle_device *dev = &per_cpu(omap3_idle_dev, 0);
+	int i, len = 0;
+
+	len += sprintf(buf + len, "state usage time_us aborted demoted "
+		       "samples lat_avg lat_max exit_latency\n");
+
+	for (i = 0; i < dev->state_count; i++) {
+		struct cpuidle_state *state = &dev->states[i];
+		struct omap3_idle_stats *st;
+
+		st = &omap3_idle_stats[omap3_state_type(state)];
+		len += sprintf(buf + len, "%s %lu %llu %lu %lu %lu %u %u %u\n",
+			       state->name, st->usage, st->time_us,
+			       st->aborted, st->demoted, st->samples,
+			       st->lat_avg, st->lat_max, state->exit_latency);
+	}
+
+	return len;
+}
+
+/* any write resets the statistics and the measured latencies */
+static ssize_t cpuidle_stats_store(struct kobject *kobj,
+				   struct kobj_attribute *attr,
+				   const char *buf, size_t n)
+{
+	cpuidle_pause_and_lock();
+	memset(omap3_idle_stats, 0, sizeof(omap3_idle_stats));
+	omap3_idle_table_latencies();
+	cpuidle_resume_and_unlock();
+
+	return n;
+}
+
+static struct kobj_attribute cpuidle_stats = {
+	.attr = {
+		 .name = __stringify(cpuidle_stats),
+		 .mode = 0644,
+		 },
+	.show = cpuidle_stats_show,
+	.store = cpuidle_stats_store,
+};
+
+static ssize_t cpuidle_measured_latency_show(struct kobject *kobj,
+					     struct kobj_attribute *attr,
+					     char *buf)
+{
+	return sprintf(buf, "%u\n", omap3_idle_use_measured);
+}
+
+static ssize_t cpuidle_measured_latency_store(struct kobject *kobj,
+					      struct kobj_attribute *attr,
+					      const char *buf, size_t n)
+{
+	unsigned short value;
+
+	if (sscanf(buf, "%hu", &value) != 1 || (value > 1)) {
+		printk(KERN_ERR "cpuidle_measured_latency: Invalid value\n");
+		return -EINVAL;
+	}
+
+	cpuidle_pause_and_lock();
+	omap3_idle_use_measured = value;
+	if (!value)
+		omap3_idle_table_latencies();
+	cpuidle_resume_and_unlock();
+
+	return n;
+}
+
+static struct kobj_attribute cpuidle_measured_latency = {
+	.attr = {
+		 .name = __stringify(cpuidle_measured_latency),
+		 .mode = 0644,
+		 },
+	.show = cpuidle_measured_latency_show,
+	.store = cpuidle_measured_latency_store,
+};
+
 void omap3_pm_init_cpuidle(struct cpuidle_params *cpuidle_board_params)
 {
 	int i;
@@ -528,6 +700,10 @@ int __init omap3_idle_init(void)
 		return -EIO;
 	}
 
+	if (sysfs_create_file(power_kobj, &cpuidle_stats.attr) ||
+	    sysfs_create_file(power_kobj, &cpuidle_measured_latency.attr))
+		printk(KERN_ERR "%s: cannot create sysfs entries\n", __func__);
+
 	return 0;
 }
 #else
@@ -783,6 +783,7 @@ void __init omap_serial_init_port(struct omap_board_data *bdata)
 
 	name = DRIVER_NAME;
 
+	uart->dma_enabled = (bdata->flags & OMAP_UART_FLAG_DMA) ? 1 : 0;
 	omap_up.dma_enabled = uart->dma_enabled;
 	omap_up.uartclk = OMAP24XX_BASE_BAUD * 16;
 	omap_up.mapbase = oh->slaves[0]->addr->pa_start;
@@ -853,23 +854,36 @@ void __init omap_serial_init_port(struct omap_board_data *bdata)
 }
 
 /**
- * omap_serial_init() - intialize all supported serial ports
+ * omap_serial_init_dma() - intialize all supported serial ports
+ * @dma_mask: bit N set lets the driver use DMA on UART N + 1
  *
- * Initializes all available UARTs as serial ports. Platforms
- * can call this function when they want to have default behaviour
- * for serial ports (e.g initialize them all as serial ports).
+ * Like omap_serial_init(), for platforms which have a high-rate
+ * peripheral on some of the UARTs.
  */
-void __init omap_serial_init(void)
+void __init omap_serial_init_dma(u32 dma_mask)
 {
 	struct omap_uart_state *uart;
 	struct omap_board_data bdata;
 
 	list_for_each_entry(uart, &uart_list, node) {
 		bdata.id = uart->num;
-		bdata.flags = 0;
+		bdata.flags = (dma_mask & (1 << uart->num)) ?
+				OMAP_UART_FLAG_DMA : 0;
 		bdata.pads = NULL;
 		bdata.pads_cnt = 0;
 		omap_serial_init_port(&bdata);
 
 	}
 }
+
+/**
+ * omap_serial_init() - intialize all supported serial ports
+ *
+ * Initializes all available UARTs as serial ports. Platforms
+ * can call this function when they want to have default behaviour
+ * for serial ports (e.g initialize them all as serial ports).
+ */
+void __init omap_serial_init(void)
+{
+	omap_serial_init_dma(0);
+}
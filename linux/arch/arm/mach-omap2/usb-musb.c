@@ -374,6 +374,9 @@ void __init usb_musb_init(struct omap_musb_board_data *board_data)
 	else if (!cpu_is_ti81xx())
 		musb_resources[0].end = musb_resources[0].start + SZ_4K - 1;
 
+	if (board_data->fifo_mode)
+		musb_config.fifo_mode = board_data->fifo_mode;
+
 	/*
 	 * OMAP3630/AM35x platform has MUSB RTL-1.8 which has the fix for the
 	 * issue restricting active endpoints to use first 8K of FIFO space.
@@ -193,6 +193,9 @@ void omap_rfbi_write_data(const void *buf, u32 len);
 void omap_rfbi_write_pixels(const void __iomem *buf, int scr_width,
 		u16 x, u16 y,
 		u16 w, u16 h);
+int omap_rfbi_write_pixels_dma(u32 paddr, int scr_width,
+		u16 x, u16 y, u16 w, u16 h,
+		void (*callback)(void *data), void *data);
 int omap_rfbi_enable_te(bool enable, unsigned line);
 int omap_rfbi_setup_te(enum omap_rfbi_te_mode mode,
 			     unsigned hs_pulse_time, unsigned vs_pulse_time,
@@ -19,6 +19,7 @@
 
 #include <linux/serial_core.h>
 #include <linux/platform_device.h>
+#include <linux/pm_qos_params.h>
 
 #include <plat/mux.h>
 
@@ -51,7 +52,20 @@
 
 #define OMAP_UART_DMA_CH_FREE	-1
 
+/*
+ * RX FIFO level at which the UART raises a DMA request. The DMA never
+ * drains the FIFO below this minus one, so every burst ends with a few
+ * characters left behind, which is what fires the RX timeout interrupt.
+ */
+#define OMAP_UART_RX_DMA_TRIG	8
+
+/* Stop the RX DMA ring after this long without reception */
 #define RX_TIMEOUT		(3 * HZ)
+
+/* Interrupt type bits of IIR, UART_IIR_ID only covers the 16550 ones */
+#define OMAP_UART_IIR_ID	0x3e
+#define OMAP_UART_IIR_RX_TIMEOUT	0x0c
+
 #define OMAP_MAX_HSUART_PORTS	6
 
 #define MSR_SAVE_FLAGS		UART_MSR_ANY_DELTA
@@ -84,10 +98,17 @@ struct uart_omap_dma {
 	int			rx_dma_used;
 	spinlock_t		tx_lock;
 	spinlock_t		rx_lock;
-	/* timer to poll activity on rx dma */
+	/* stops the RX ring once the port goes quiet */
 	struct timer_list	rx_timer;
 	int			rx_buf_size;
-	int			rx_timeout;
+};
+
+struct uart_omap_stats {
+	unsigned long		irqs;		/* UART interrupts handled */
+	unsigned long		rx_dma_bytes;	/* received through the DMA ring */
+	unsigned long		rx_pio_bytes;	/* read from the FIFO by the CPU */
+	unsigned long		rx_wakeups;	/* pushes to the tty layer */
+	unsigned long		rx_dma_wraps;	/* RX DMA ring wrap-arounds */
 };
 
 struct uart_omap_port {
@@ -111,6 +132,12 @@ struct uart_omap_port {
 	unsigned char		msr_saved_flags;
 	char			name[20];
 	unsigned long		port_activity;
+	struct uart_omap_stats	stats;
+	/* DMA ports: keep CPU wakeups faster than the RX FIFO fills */
+	struct pm_qos_request_list pm_qos_request;
+	u32			latency;
+	/* follows the RX ring starting and stopping */
+	struct work_struct	qos_work;
 };
 
 #endif /* __OMAP_SERIAL_H__ */
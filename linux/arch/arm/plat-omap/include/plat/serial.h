@@ -110,8 +110,12 @@
 
 struct omap_board_data;
 
+/* omap_board_data.flags for UART ports */
+#define OMAP_UART_FLAG_DMA	(1 << 0)	/* omap-serial may use sDMA */
+
 extern void __init omap_serial_early_init(void);
 extern void omap_serial_init(void);
+extern void omap_serial_init_dma(u32 dma_mask);
 extern void omap_serial_init_port(struct omap_board_data *bdata);
 extern int omap_uart_can_sleep(void);
 extern void omap_uart_check_wakeup(void);
@@ -70,6 +70,7 @@ struct omap_musb_board_data {
 	u16	power;
 	unsigned extvbus:1;
 	u8	instances;
+	u8	fifo_mode;	/* 0 for the SoC default */
 	void	(*set_phy_power)(u8 id, u8 on);
 	void	(*clear_irq)(void);
 	void	(*set_mode)(u8 mode);
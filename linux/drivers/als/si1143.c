@@ -26,11 +26,16 @@
 #include <linux/gpio.h>
 #include <linux/interrupt.h>
 #include <linux/delay.h>
-#include <linux/workqueue.h>
+#include <linux/fs.h>
+#include <linux/miscdevice.h>
+#include <linux/poll.h>
+#include <linux/kfifo.h>
+#include <linux/ktime.h>
+#include <linux/uaccess.h>
 #include <linux/si1143.h>
 
 #define SI1143_DRV_NAME	"si1143"
-#define DRIVER_VERSION		"1.0"
+#define DRIVER_VERSION		"1.1"
 
 /*
  * Defines
@@ -72,7 +77,9 @@
 #define SI1143_PS_FORCE 0x05
 #define SI1143_ALS_FORCE 0x06
 
+#define SI1143_PSALS_PAUSE 0x0B
 #define SI1143_PS_AUTO 0x0D
+#define SI1143_PSALS_AUTO 0x0F
 
 #define SI1143_PARAM_SET 0xA0
 #define SI1143_PARAM_QUERY 0x80
@@ -103,22 +110,40 @@
 #define SI1143_ALS_IR_IM  0x03
 #define SI1143_ALS_IM_MASK  0x03
 
+#define SI1143_ALS_INT_MASK  0x03
+#define SI1143_PS1_INT  0x04
+
+// Default autonomous rate, compressed MEAS_RATE encoding (~100 ms)
+#define SI1143_DEFAULT_MEAS_RATE 0xB9
+
+// Samples buffered for /dev/si1143 readers; must be a power of two
+#define SI1143_SAMPLE_FIFO_SIZE 64
+
 /*
  * Structs
  */
 struct si1143_data {
 	struct i2c_client *client;
 	struct mutex update_lock;
-	struct delayed_work	dwork;
+	struct mutex read_lock;
 	spinlock_t		lock;
 
 	unsigned int power_state : 1;
 	unsigned int operating_mode : 1;
+	unsigned int autonomous : 1;
 
 	unsigned int als_interrupt_spectrum;
+	u8 meas_rate;
 
 	unsigned int irq;
 
+	/* Autonomous-mode event stream, protected by lock */
+	ktime_t irq_stamp;
+	struct si1143_sample last;
+	unsigned long overruns;
+	DECLARE_KFIFO(samples, struct si1143_sample, SI1143_SAMPLE_FIFO_SIZE);
+	wait_queue_head_t wait;
+	struct miscdevice miscdev;
 };
 
 /*
@@ -158,7 +183,10 @@ static ssize_t si1143_show_light(struct device *dev,
 	int ret;
 
 	mutex_lock(&data->update_lock);
-	ret = __si1143_show_light(client, buf);
+	if (data->autonomous)
+		ret = sprintf(buf, "%d\n", data->last.als_visible);
+	else
+		ret = __si1143_show_light(client, buf);
 	mutex_unlock(&data->update_lock);
 
 	return ret;
@@ -192,7 +220,10 @@ static ssize_t si1143_show_ir(struct device *dev,
 	int ret;
 
 	mutex_lock(&data->update_lock);
-	ret = __si1143_show_ir(client, buf);
+	if (data->autonomous)
+		ret = sprintf(buf, "%d\n", data->last.als_infrared);
+	else
+		ret = __si1143_show_ir(client, buf);
 	mutex_unlock(&data->update_lock);
 
 	return ret;
@@ -226,7 +257,10 @@ static ssize_t si1143_show_prox(struct device *dev,
 	int ret;
 
 	mutex_lock(&data->update_lock);
-	ret = __si1143_show_prox(client, buf);
+	if (data->autonomous)
+		ret = sprintf(buf, "%d\n", data->last.proximity);
+	else
+		ret = __si1143_show_prox(client, buf);
 	mutex_unlock(&data->update_lock);
 
 	return ret;
@@ -598,6 +632,139 @@ static ssize_t si1143_set_als_th_low(struct device *dev,
 	}
 }
 
+static int __si1143_set_autonomous(struct si1143_data *data, int enable)
+{
+	struct i2c_client *client = data->client;
+	int err;
+	u8 interrupt_val = 0;
+
+	err = i2c_smbus_read_i2c_block_data(client, SI1143_IRQ_ENABLE, 1, &interrupt_val);
+	if (err < 0)
+		return err;
+
+	if (!enable)
+	{
+		err = i2c_smbus_write_byte_data(client, SI1143_COMMAND, SI1143_PSALS_PAUSE);
+		if (err < 0)
+			return err;
+
+		err = i2c_smbus_write_byte_data(client, SI1143_MEAS_RATE, 0);
+		if (err < 0)
+			return err;
+
+		err = i2c_smbus_write_byte_data(client, SI1143_IRQ_ENABLE,
+						interrupt_val & ~(SI1143_ALS_IE | SI1143_PS1_IE));
+		if (err < 0)
+			return err;
+
+		data->autonomous = 0;
+		return 0;
+	}
+
+	// One ALS and one PS measurement per MEAS_RATE wakeup
+	err = i2c_smbus_write_byte_data(client, SI1143_MEAS_RATE, data->meas_rate);
+	if (err < 0)
+		return err;
+
+	err = i2c_smbus_write_byte_data(client, SI1143_ALS_RATE, 0x08);
+	if (err < 0)
+		return err;
+
+	err = i2c_smbus_write_byte_data(client, SI1143_PS_RATE, 0x08);
+	if (err < 0)
+		return err;
+
+	err = i2c_smbus_write_byte_data(client, SI1143_IRQ_ENABLE,
+					interrupt_val | SI1143_ALS_IE | SI1143_PS1_IE);
+	if (err < 0)
+		return err;
+
+	err = i2c_smbus_write_byte_data(client, SI1143_COMMAND, SI1143_PSALS_AUTO);
+	if (err < 0)
+		return err;
+
+	data->autonomous = 1;
+	return 0;
+}
+
+static ssize_t si1143_get_autonomous(struct device *dev,
+			struct device_attribute *attr, char *buf)
+{
+	struct i2c_client *client = to_i2c_client(dev);
+	struct si1143_data *data = i2c_get_clientdata(client);
+
+	return sprintf(buf, "%d\n", data->autonomous);
+}
+
+static ssize_t si1143_set_autonomous(struct device *dev,
+			struct device_attribute *attr, const char *buf, size_t len)
+{
+	struct i2c_client *client = to_i2c_client(dev);
+	struct si1143_data *data = i2c_get_clientdata(client);
+	int ret;
+	u32 enable = 0;
+
+	sscanf(buf, "%u", &enable);
+
+	mutex_lock(&data->update_lock);
+	ret = __si1143_set_autonomous(data, enable ? 1 : 0);
+	mutex_unlock(&data->update_lock);
+
+	if(ret < 0)
+	{
+		return ret;
+	}
+	else
+	{
+		return strnlen(buf, PAGE_SIZE);
+	}
+}
+
+static ssize_t si1143_get_meas_rate(struct device *dev,
+			struct device_attribute *attr, char *buf)
+{
+	struct i2c_client *client = to_i2c_client(dev);
+	struct si1143_data *data = i2c_get_clientdata(client);
+
+	return sprintf(buf, "%d\n", data->meas_rate);
+}
+
+static ssize_t si1143_set_meas_rate(struct device *dev,
+			struct device_attribute *attr, const char *buf, size_t len)
+{
+	struct i2c_client *client = to_i2c_client(dev);
+	struct si1143_data *data = i2c_get_clientdata(client);
+	int ret = 0;
+	u32 rate;
+
+	if (sscanf(buf, "%u", &rate) != 1 || rate == 0 || rate > 0xFF)
+		return -EINVAL;
+
+	mutex_lock(&data->update_lock);
+	data->meas_rate = rate;
+	if (data->autonomous)
+		ret = i2c_smbus_write_byte_data(client, SI1143_MEAS_RATE, data->meas_rate);
+	mutex_unlock(&data->update_lock);
+
+	if(ret < 0)
+	{
+		return ret;
+	}
+	else
+	{
+		return strnlen(buf, PAGE_SIZE);
+	}
+}
+
+static ssize_t si1143_show_overruns(struct device *dev,
+			struct device_attribute *attr, char *buf)
+{
+	struct i2c_client *client = to_i2c_client(dev);
+	struct si1143_data *data = i2c_get_clientdata(client);
+
+	return sprintf(buf, "%lu\n", data->overruns);
+}
+
 
 static DEVICE_ATTR(proximity, S_IRUGO, si1143_show_prox, NULL);
 static DEVICE_ATTR(illuminance_visible, S_IRUGO, si1143_show_light, NULL);
@@ -607,6 +774,9 @@ static DEVICE_ATTR(illuminance_threshold_high, (S_IRUGO | S_IWUGO ), si1143_get_
 static DEVICE_ATTR(illuminance_threshold_low, (S_IRUGO | S_IWUGO ), si1143_get_als_th_low, si1143_set_als_th_low);
 static DEVICE_ATTR(illuminance_interrupt_spectrum, (S_IRUGO | S_IWUGO ), si1143_get_als_spectrum, si1143_set_als_spectrum);
 static DEVICE_ATTR(proximity_adc_gain, (S_IRUGO | S_IWUGO ), si1143_get_prox_gain, si1143_set_prox_gain);
+static DEVICE_ATTR(autonomous, (S_IRUGO | S_IWUSR), si1143_get_autonomous, si1143_set_autonomous);
+static DEVICE_ATTR(measurement_rate, (S_IRUGO | S_IWUSR), si1143_get_meas_rate, si1143_set_meas_rate);
+static DEVICE_ATTR(sample_overruns, S_IRUGO, si1143_show_overruns, NULL);
 
 static struct attribute *si1143_attributes[] = {
 	&dev_attr_proximity.attr,
@@ -617,6 +787,9 @@ static struct attribute *si1143_attributes[] = {
 	&dev_attr_illuminance_threshold_low.attr,
 	&dev_attr_illuminance_interrupt_spectrum.attr,
 	&dev_attr_proximity_adc_gain.attr,
+	&dev_attr_autonomous.attr,
+	&dev_attr_measurement_rate.attr,
+	&dev_attr_sample_overruns.attr,
 	NULL
 };
 
@@ -757,48 +930,162 @@ static int si1143_init_client(struct i2c_client *client, struct si1143_platform_
 	return 0;
 }
 
-static void si1143_i2c_reschedule_work(struct si1143_data *data,
-					  unsigned long delay)
-{
-	unsigned long flags;
-
-	spin_lock_irqsave(&data->lock, flags);
-
-	/*
-	 * If work is already scheduled then subsequent schedules will not
-	 * change the scheduled time that's why we have to cancel it first.
-	 */
-	__cancel_delayed_work(&data->dwork);
-	schedule_delayed_work(&data->dwork, delay);
-
-	spin_unlock_irqrestore(&data->lock, flags);
-}
-
 static irqreturn_t si1143_irq(int irq, void *dev_id)
 {
 	struct si1143_data *data = dev_id;
 
-	si1143_i2c_reschedule_work(data, 0);
+	data->irq_stamp = ktime_get();
 
-	return IRQ_HANDLED;
+	return IRQ_WAKE_THREAD;
 }
 
-static void si1143_i2c_work_handler(struct work_struct *work)
+static irqreturn_t si1143_irq_thread(int irq, void *dev_id)
 {
-	struct si1143_data *data = container_of(work, struct si1143_data, dwork.work);
+	struct si1143_data *data = dev_id;
 	struct i2c_client *client = data->client;
+	struct si1143_sample sample;
+	struct timespec ts;
+	unsigned long flags;
+	u8 values[6];
 	int results;
-	
+	int err;
+
 	//Get the interrupts over i2c
 	results = i2c_smbus_read_byte_data(client, SI1143_IRQ_STATUS);
+	if (results < 0) {
+		/*
+		 * The line stays low until IRQ_STATUS is cleared, so try to
+		 * clear every source, and back off a little before the line
+		 * is unmasked in case the bus stays down.
+		 */
+		if (printk_ratelimit())
+			dev_err(&client->dev, "irq status read failed: %d\n",
+				results);
+		i2c_smbus_write_byte_data(client, SI1143_IRQ_STATUS, 0xff);
+		msleep(10);
+		return IRQ_HANDLED;
+	}
 
-	//Process interrupts
-	//printk("si1143 irq handler 0x%X\n", results);
+	if (results & (SI1143_ALS_INT_MASK | SI1143_PS1_INT))
+	{
+		// VIS, IR and PS1 data registers are contiguous; one burst read
+		err = i2c_smbus_read_i2c_block_data(client, SI1143_ALS_VIS_DATA0,
+						sizeof(values), values);
+		if (err == sizeof(values))
+		{
+			ts = ktime_to_timespec(data->irq_stamp);
+
+			sample.tv_sec = ts.tv_sec;
+			sample.tv_nsec = ts.tv_nsec;
+			sample.irq_status = results;
+			sample.reserved = 0;
+			sample.als_visible = (values[1] << 8) | values[0];
+			sample.als_infrared = (values[3] << 8) | values[2];
+			sample.proximity = (values[5] << 8) | values[4];
+
+			spin_lock_irqsave(&data->lock, flags);
+			data->last = sample;
+			if (!kfifo_put(&data->samples, &sample))
+				data->overruns++;
+			spin_unlock_irqrestore(&data->lock, flags);
+
+			wake_up_interruptible(&data->wait);
+		}
+	}
 
 	//Clear the interrupts
 	i2c_smbus_write_byte_data(client, SI1143_IRQ_STATUS, results);
+
+	return IRQ_HANDLED;
+}
+
+/*
+ * Sample stream character device
+ */
+
+static int si1143_open(struct inode *inode, struct file *file)
+{
+	struct miscdevice *misc = file->private_data;
+
+	file->private_data = container_of(misc, struct si1143_data, miscdev);
+
+	return nonseekable_open(inode, file);
+}
+
+static ssize_t si1143_read(struct file *file, char __user *buf,
+			   size_t count, loff_t *ppos)
+{
+	struct si1143_data *data = file->private_data;
+	struct si1143_sample samples[8];
+	unsigned int copied;
+	size_t total = 0;
+	int err;
+
+	if (count < sizeof(struct si1143_sample))
+		return -EINVAL;
+
+	if (mutex_lock_interruptible(&data->read_lock))
+		return -ERESTARTSYS;
+
+	while (kfifo_is_empty(&data->samples))
+	{
+		mutex_unlock(&data->read_lock);
+
+		if (file->f_flags & O_NONBLOCK)
+			return -EAGAIN;
+
+		err = wait_event_interruptible(data->wait,
+					       !kfifo_is_empty(&data->samples));
+		if (err)
+			return err;
+
+		if (mutex_lock_interruptible(&data->read_lock))
+			return -ERESTARTSYS;
+	}
+
+	while (count - total >= sizeof(struct si1143_sample))
+	{
+		copied = kfifo_out_spinlocked(&data->samples, samples,
+					      min_t(size_t, ARRAY_SIZE(samples),
+						    (count - total) / sizeof(struct si1143_sample)),
+					      &data->lock);
+		if (!copied)
+			break;
+
+		if (copy_to_user(buf + total, samples, copied * sizeof(struct si1143_sample)))
+		{
+			mutex_unlock(&data->read_lock);
+			return -EFAULT;
+		}
+
+		total += copied * sizeof(struct si1143_sample);
+	}
+
+	mutex_unlock(&data->read_lock);
+
+	return total;
+}
+
+static unsigned int si1143_poll(struct file *file, poll_table *wait)
+{
+	struct si1143_data *data = file->private_data;
+
+	poll_wait(file, &data->wait, wait);
+
+	if (!kfifo_is_empty(&data->samples))
+		return POLLIN | POLLRDNORM;
+
+	return 0;
 }
 
+static const struct file_operations si1143_fops = {
+	.owner		= THIS_MODULE,
+	.open		= si1143_open,
+	.read		= si1143_read,
+	.poll		= si1143_poll,
+	.llseek		= no_llseek,
+};
+
 /*
  * I2C init/probing/exit functions
  */
@@ -831,8 +1118,13 @@ static int __devinit si1143_probe(struct i2c_client *client,
 	platform_data = client->dev.platform_data;
 
 	mutex_init(&data->update_lock);
+	mutex_init(&data->read_lock);
+	spin_lock_init(&data->lock);
+	init_waitqueue_head(&data->wait);
+	INIT_KFIFO(data->samples);
 
 	data->als_interrupt_spectrum=0;
+	data->meas_rate = SI1143_DEFAULT_MEAS_RATE;
 
 	data->irq = gpio_to_irq(client->irq);
 
@@ -844,39 +1136,54 @@ static int __devinit si1143_probe(struct i2c_client *client,
 		goto exit_kfree;
 	}
 
-	/* request the IRQs */
-	err = request_irq(data->irq, &si1143_irq,
-			  IORESOURCE_IRQ_HIGHEDGE | IORESOURCE_IRQ_LOWEDGE,
-			  SI1143_DRV_NAME, data);
+	/* Initialize the SI1143 chip */
+	err = si1143_init_client(client, platform_data);
+	if (err)
+	{
+		goto exit_gpio;
+	}
+
+	/*
+	 * INT is held low until IRQ_STATUS is cleared, so a level-triggered
+	 * oneshot threaded handler services each measurement exactly once.
+	 */
+	err = request_threaded_irq(data->irq, si1143_irq, si1143_irq_thread,
+				   IRQF_TRIGGER_LOW | IRQF_ONESHOT,
+				   SI1143_DRV_NAME, data);
 	if (err) {
 		dev_err(&client->dev, "unable to request IRQ %d\n",
 			data->irq);
-		gpio_free(client->irq);
-		goto exit_kfree;
+		goto exit_gpio;
 	}
 
+	data->miscdev.minor = MISC_DYNAMIC_MINOR;
+	data->miscdev.name = SI1143_DRV_NAME;
+	data->miscdev.fops = &si1143_fops;
+	data->miscdev.parent = &client->dev;
 
-	/* Initialize the SI1143 chip */
-	err = si1143_init_client(client, platform_data);
+	err = misc_register(&data->miscdev);
 	if (err)
 	{
-		goto exit_kfree;
+		goto exit_irq;
 	}
 
-	INIT_DELAYED_WORK(&data->dwork, si1143_i2c_work_handler);
-	spin_lock_init(&data->lock);
-
 	/* Register sysfs hooks */
 	err = sysfs_create_group(&client->dev.kobj, &si1143_attr_group);
 	if (err)
 	{
-		goto exit_kfree;
+		goto exit_misc;
 	}
 
 	dev_info(&client->dev, "support ver. %s enabled\n", DRIVER_VERSION);
 
 	return 0;
 
+exit_misc:
+	misc_deregister(&data->miscdev);
+exit_irq:
+	free_irq(data->irq, data);
+exit_gpio:
+	gpio_free(client->irq);
 exit_kfree:
 	kfree(data);
 exit:
@@ -885,12 +1192,23 @@ exit:
 
 static int __devexit si1143_remove(struct i2c_client *client)
 {
+	struct si1143_data *data = i2c_get_clientdata(client);
+
 	sysfs_remove_group(&client->dev.kobj, &si1143_attr_group);
+	misc_deregister(&data->miscdev);
+
+	mutex_lock(&data->update_lock);
+	if (data->autonomous)
+		__si1143_set_autonomous(data, 0);
+	mutex_unlock(&data->update_lock);
+
+	free_irq(data->irq, data);
+	gpio_free(client->irq);
 
 	/* Power down the device */
   //  si1143_set_power_state(client, 0);
 
-	kfree(i2c_get_clientdata(client));
+	kfree(data);
 
 	return 0;
 }
@@ -900,15 +1218,31 @@ static int __devexit si1143_remove(struct i2c_client *client)
 static int si1143_suspend(struct i2c_client *client, pm_message_t mesg)
 {
 	struct si1143_data *data = i2c_get_clientdata(client);
+	int err = 0;
 
-	cancel_delayed_work_sync(&data->dwork);
+	/* Stop autonomous sampling but remember that it was requested */
+	mutex_lock(&data->update_lock);
+	if (data->autonomous)
+	{
+		err = __si1143_set_autonomous(data, 0);
+		data->autonomous = 1;
+	}
+	mutex_unlock(&data->update_lock);
 
-	return 0;//si1143_set_power_state(client, 0);
+	return err;//si1143_set_power_state(client, 0);
 }
 
 static int si1143_resume(struct i2c_client *client)
 {
-	return 0;//si1143_set_power_state(client, 1);
+	struct si1143_data *data = i2c_get_clientdata(client);
+	int err = 0;
+
+	mutex_lock(&data->update_lock);
+	if (data->autonomous)
+		err = __si1143_set_autonomous(data, 1);
+	mutex_unlock(&data->update_lock);
+
+	return err;//si1143_set_power_state(client, 1);
 }
 
 #else
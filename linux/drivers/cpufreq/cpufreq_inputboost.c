@@ -0,0 +1,604 @@
+/*
+ *  drivers/cpufreq/cpufreq_inputboost.c
+ *
+ *  Load tracking cpufreq governor that goes to the highest frequency as
+ *  soon as the user touches the device.
+ *
+ *  Based on cpufreq_ondemand.c.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/init.h>
+#include <linux/cpufreq.h>
+#include <linux/cpu.h>
+#include <linux/jiffies.h>
+#include <linux/math64.h>
+#include <linux/kernel_stat.h>
+#include <linux/mutex.h>
+#include <linux/slab.h>
+#include <linux/tick.h>
+#include <linux/input.h>
+#include <linux/workqueue.h>
+
+#define DEF_SAMPLING_RATE			(50 * 1000)
+#define MIN_SAMPLING_RATE			(10 * 1000)
+#define DEF_FREQUENCY_UP_THRESHOLD		(80)
+#define DEF_FREQUENCY_DOWN_THRESHOLD		(30)
+#define DEF_BOOST_HOLD_MS			(1500)
+#define TRANSITION_LATENCY_LIMIT		(10 * 1000 * 1000)
+
+/* enough for the OMAP3 OPP tables */
+#define IB_MAX_FREQS				8
+
+/*
+ * What made the governor pick the current frequency. A boost decays
+ * through a load sample, so it is accounted to "load" from then on.
+ */
+enum ib_trigger {
+	IB_TRIG_LOAD,
+	IB_TRIG_ROTARY,
+	IB_TRIG_OFN,
+	IB_NR_TRIGGERS,
+};
+
+static const char *ib_trigger_names[IB_NR_TRIGGERS] = {
+	[IB_TRIG_LOAD]		= "load",
+	[IB_TRIG_ROTARY]	= "rotary",
+	[IB_TRIG_OFN]		= "ofn",
+};
+
+/* input devices that boost, by name */
+static const struct {
+	const char *name;
+	enum ib_trigger trigger;
+} ib_input_devs[] = {
+	{ "rotary-encoder-lite",	IB_TRIG_ROTARY },
+	{ "avago-adbs-a330",		IB_TRIG_OFN },
+};
+
+static int cpufreq_governor_ib(struct cpufreq_policy *policy,
+			       unsigned int event);
+
+#ifndef CONFIG_CPU_FREQ_DEFAULT_GOV_INPUTBOOST
+static
+#endif
+struct cpufreq_governor cpufreq_gov_inputboost = {
+	.name			= "inputboost",
+	.governor		= cpufreq_governor_ib,
+	.max_transition_latency	= TRANSITION_LATENCY_LIMIT,
+	.owner			= THIS_MODULE,
+};
+
+/*
+ * Only one policy at a time: OMAP3 has a single core. ib_mutex
+ * serializes frequency changes from the sampling and boost work with
+ * governor start/stop/limits.
+ */
+static struct ib_info {
+	struct cpufreq_policy *policy;
+	struct cpufreq_frequency_table *freq_table;
+	u64 prev_idle;
+	u64 prev_wall;
+	struct delayed_work sample_work;	/* deferrable */
+	struct delayed_work unboost_work;	/* not deferrable */
+	struct work_struct boost_work;
+
+	unsigned long boost_until;		/* jiffies */
+	enum ib_trigger boost_trigger;
+
+	/* statistics */
+	enum ib_trigger cur_trigger;
+	u64 last_change;			/* jiffies */
+	unsigned long transitions[IB_NR_TRIGGERS];
+	unsigned long boosts[IB_NR_TRIGGERS];
+	u64 time_in_state[IB_NR_TRIGGERS][IB_MAX_FREQS];
+} ib_info;
+
+static DEFINE_MUTEX(ib_mutex);
+static struct workqueue_struct *kinputboost_wq;
+static bool ib_input_registered;
+
+static struct ib_tuners {
+	unsigned int sampling_rate;
+	unsigned int up_threshold;
+	unsigned int down_threshold;
+	unsigned int boost_hold_ms;
+} ib_tuners_ins = {
+	.sampling_rate = DEF_SAMPLING_RATE,
+	.up_threshold = DEF_FREQUENCY_UP_THRESHOLD,
+	.down_threshold = DEF_FREQUENCY_DOWN_THRESHOLD,
+	.boost_hold_ms = DEF_BOOST_HOLD_MS,
+};
+
+static inline u64 get_cpu_idle_time_jiffy(unsigned int cpu, u64 *wall)
+{
+	cputime64_t cur_wall_time;
+	cputime64_t busy_time;
+
+	cur_wall_time = jiffies64_to_cputime64(get_jiffies_64());
+	busy_time = cputime64_add(kstat_cpu(cpu).cpustat.user,
+			kstat_cpu(cpu).cpustat.system);
+
+	busy_time = cputime64_add(busy_time, kstat_cpu(cpu).cpustat.irq);
+	busy_time = cputime64_add(busy_time, kstat_cpu(cpu).cpustat.softirq);
+	busy_time = cputime64_add(busy_time, kstat_cpu(cpu).cpustat.steal);
+	busy_time = cputime64_add(busy_time, kstat_cpu(cpu).cpustat.nice);
+
+	*wall = jiffies_to_usecs(cur_wall_time);
+
+	return jiffies_to_usecs(cputime64_sub(cur_wall_time, busy_time));
+}
+
+static inline u64 get_cpu_idle_time(unsigned int cpu, u64 *wall)
+{
+	u64 idle_time = get_cpu_idle_time_us(cpu, wall);
+
+	if (idle_time == -1ULL)
+		return get_cpu_idle_time_jiffy(cpu, wall);
+
+	return idle_time;
+}
+
+static int ib_freq_index(unsigned int freq)
+{
+	struct cpufreq_frequency_table *table = ib_info.freq_table;
+	int i;
+
+	for (i = 0; table && i < IB_MAX_FREQS &&
+		     table[i].frequency != CPUFREQ_TABLE_END; i++)
+		if (table[i].frequency == freq)
+			return i;
+
+	return -1;
+}
+
+static void ib_account(void)
+{
+	u64 now = get_jiffies_64();
+	int i = ib_freq_index(ib_info.policy->cur);
+
+	if (i >= 0)
+		ib_info.time_in_state[ib_info.cur_trigger][i] +=
+			now - ib_info.last_change;
+	ib_info.last_change = now;
+}
+
+/* with ib_mutex held */
+static void ib_set_freq(unsigned int freq, unsigned int relation,
+			enum ib_trigger trigger)
+{
+	struct cpufreq_policy *policy = ib_info.policy;
+	unsigned int old = policy->cur;
+
+	if (freq == old)
+		return;
+
+	ib_account();
+	__cpufreq_driver_target(policy, freq, relation);
+	if (policy->cur != old) {
+		ib_info.transitions[trigger]++;
+		ib_info.cur_trigger = trigger;
+	}
+}
+
+static bool ib_boosted(void)
+{
+	return time_before(jiffies, ACCESS_ONCE(ib_info.boost_until));
+}
+
+/* with ib_mutex held */
+static void ib_check_cpu(void)
+{
+	struct cpufreq_policy *policy = ib_info.policy;
+	unsigned int load, freq_next;
+	u64 idle, wall;
+	u64 idle_delta, wall_delta;
+
+	idle = get_cpu_idle_time(policy->cpu, &wall);
+	idle_delta = idle - ib_info.prev_idle;
+	wall_delta = wall - ib_info.prev_wall;
+	ib_info.prev_idle = idle;
+	ib_info.prev_wall = wall;
+
+	if (ib_boosted())
+		return;
+
+	if (!wall_delta || wall_delta < idle_delta)
+		return;
+
+	load = div64_u64(100 * (wall_delta - idle_delta), wall_delta);
+
+	if (load > ib_tuners_ins.up_threshold) {
+		ib_set_freq(policy->max, CPUFREQ_RELATION_H, IB_TRIG_LOAD);
+		return;
+	}
+
+	/* No longer boosted or busy: drop to where the load is just below
+	 * up_threshold, but only once it has fallen far enough not to
+	 * bounce straight back. */
+	if (load < ib_tuners_ins.down_threshold ||
+	    ib_info.cur_trigger != IB_TRIG_LOAD) {
+		freq_next = policy->cur * load / ib_tuners_ins.up_threshold;
+		freq_next = max(freq_next, policy->min);
+		ib_set_freq(freq_next, CPUFREQ_RELATION_L, IB_TRIG_LOAD);
+	}
+}
+
+static void ib_sample_work(struct work_struct *work)
+{
+	int delay = usecs_to_jiffies(ib_tuners_ins.sampling_rate);
+
+	mutex_lock(&ib_mutex);
+	if (ib_info.policy) {
+		ib_check_cpu();
+		queue_delayed_work(kinputboost_wq, &ib_info.sample_work, delay);
+	}
+	mutex_unlock(&ib_mutex);
+}
+
+/*
+ * End of a boost. The sampling timer is deferrable, so without this an
+ * idle CPU would stay at the boost frequency until something else
+ * woke it up.
+ */
+static void ib_unboost_work(struct work_struct *work)
+{
+	mutex_lock(&ib_mutex);
+	if (ib_info.policy) {
+		if (ib_boosted())
+			queue_delayed_work(kinputboost_wq,
+					   &ib_info.unboost_work,
+					   ib_info.boost_until - jiffies);
+		else
+			ib_check_cpu();
+	}
+	mutex_unlock(&ib_mutex);
+}
+
+static void ib_boost_work(struct work_struct *work)
+{
+	mutex_lock(&ib_mutex);
+	if (ib_info.policy) {
+		ib_info.boosts[ib_info.boost_trigger]++;
+		ib_set_freq(ib_info.policy->max, CPUFREQ_RELATION_H,
+			    ib_info.boost_trigger);
+		queue_delayed_work(kinputboost_wq, &ib_info.unboost_work,
+				   msecs_to_jiffies(ib_tuners_ins.boost_hold_ms));
+	}
+	mutex_unlock(&ib_mutex);
+}
+
+/* input events come in atomic context, the switch is done by the work */
+static void ib_input_event(struct input_handle *handle, unsigned int type,
+			   unsigned int code, int value)
+{
+	bool was_boosted = ib_boosted();
+
+	ib_info.boost_until = jiffies +
+		msecs_to_jiffies(ib_tuners_ins.boost_hold_ms);
+
+	if (!was_boosted) {
+		ib_info.boost_trigger = (enum ib_trigger)handle->private;
+		queue_work(kinputboost_wq, &ib_info.boost_work);
+	}
+}
+
+static int ib_input_connect(struct input_handler *handler,
+			    struct input_dev *dev,
+			    const struct input_device_id *id)
+{
+	struct input_handle *handle;
+	int i, error;
+
+	for (i = 0; i < ARRAY_SIZE(ib_input_devs); i++)
+		if (dev->name && !strcmp(dev->name, ib_input_devs[i].name))
+			break;
+	if (i == ARRAY_SIZE(ib_input_devs))
+		return -ENODEV;
+
+	handle = kzalloc(sizeof(*handle), GFP_KERNEL);
+	if (!handle)
+		return -ENOMEM;
+
+	handle->dev = dev;
+	handle->handler = handler;
+	handle->name = "cpufreq_inputboost";
+	handle->private = (void *)ib_input_devs[i].trigger;
+
+	error = input_register_handle(handle);
+	if (error)
+		goto err_free;
+
+	error = input_open_device(handle);
+	if (error)
+		goto err_unregister;
+
+	return 0;
+
+err_unregister:
+	input_unregister_handle(handle);
+err_free:
+	kfree(handle);
+	return error;
+}
+
+static void ib_input_disconnect(struct input_handle *handle)
+{
+	input_close_device(handle);
+	input_unregister_handle(handle);
+	kfree(handle);
+}
+
+static const struct input_device_id ib_input_ids[] = {
+	{
+		.flags = INPUT_DEVICE_ID_MATCH_EVBIT,
+		.evbit = { BIT_MASK(EV_REL) },
+	},
+	{ },
+};
+
+static struct input_handler ib_input_handler = {
+	.event		= ib_input_event,
+	.connect	= ib_input_connect,
+	.disconnect	= ib_input_disconnect,
+	.name		= "cpufreq_inputboost",
+	.id_table	= ib_input_ids,
+};
+
+/************************** sysfs interface ************************/
+
+#define show_one(file_name, object)					\
+static ssize_t show_##file_name						\
+(struct kobject *kobj, struct attribute *attr, char *buf)		\
+{									\
+	return sprintf(buf, "%u\n", ib_tuners_ins.object);		\
+}
+show_one(sampling_rate, sampling_rate);
+show_one(up_threshold, up_threshold);
+show_one(down_threshold, down_threshold);
+show_one(boost_hold_ms, boost_hold_ms);
+
+static ssize_t store_sampling_rate(struct kobject *a, struct attribute *b,
+				   const char *buf, size_t count)
+{
+	unsigned int input;
+
+	if (sscanf(buf, "%u", &input) != 1)
+		return -EINVAL;
+
+	mutex_lock(&ib_mutex);
+	ib_tuners_ins.sampling_rate = max(input, (unsigned int)MIN_SAMPLING_RATE);
+	mutex_unlock(&ib_mutex);
+
+	return count;
+}
+
+static ssize_t store_up_threshold(struct kobject *a, struct attribute *b,
+				  const char *buf, size_t count)
+{
+	unsigned int input;
+
+	if (sscanf(buf, "%u", &input) != 1 || input > 100 ||
+	    input <= ib_tuners_ins.down_threshold)
+		return -EINVAL;
+
+	mutex_lock(&ib_mutex);
+	ib_tuners_ins.up_threshold = input;
+	mutex_unlock(&ib_mutex);
+
+	return count;
+}
+
+static ssize_t store_down_threshold(struct kobject *a, struct attribute *b,
+				    const char *buf, size_t count)
+{
+	unsigned int input;
+
+	if (sscanf(buf, "%u", &input) != 1 ||
+	    input >= ib_tuners_ins.up_threshold)
+		return -EINVAL;
+
+	mutex_lock(&ib_mutex);
+	ib_tuners_ins.down_threshold = input;
+	mutex_unlock(&ib_mutex);
+
+	return count;
+}
+
+static ssize_t store_boost_hold_ms(struct kobject *a, struct attribute *b,
+				   const char *buf, size_t count)
+{
+	unsigned int input;
+
+	if (sscanf(buf, "%u", &input) != 1)
+		return -EINVAL;
+
+	mutex_lock(&ib_mutex);
+	ib_tuners_ins.boost_hold_ms = input;
+	mutex_unlock(&ib_mutex);
+
+	return count;
+}
+
+/*
+ * One line per trigger: boosts started, frequency changes made and the
+ * time in ms spent at each frequency of the table since.
+ */
+static ssize_t show_stats(struct kobject *kobj, struct attribute *attr,
+			  char *buf)
+{
+	struct cpufreq_frequency_table *table;
+	ssize_t len = 0;
+	int t, i;
+
+	mutex_lock(&ib_mutex);
+	table = ib_info.freq_table;
+	if (ib_info.policy)
+		ib_account();
+
+	len += sprintf(buf + len, "trigger boosts transitions");
+	for (i = 0; table && i < IB_MAX_FREQS &&
+		     table[i].frequency != CPUFREQ_TABLE_END; i++)
+		len += sprintf(buf + len, " %u", table[i].frequency);
+	len += sprintf(buf + len, "\n");
+
+	for (t = 0; t < IB_NR_TRIGGERS; t++) {
+		len += sprintf(buf + len, "%s %lu %lu", ib_trigger_names[t],
+			       ib_info.boosts[t], ib_info.transitions[t]);
+		for (i = 0; table && i < IB_MAX_FREQS &&
+			     table[i].frequency != CPUFREQ_TABLE_END; i++)
+			len += sprintf(buf + len, " %u",
+				jiffies_to_msecs(ib_info.time_in_state[t][i]));
+		len += sprintf(buf + len, "\n");
+	}
+	mutex_unlock(&ib_mutex);
+
+	return len;
+}
+
+/* any write clears the statistics */
+static ssize_t store_stats(struct kobject *a, struct attribute *b,
+			   const char *buf, size_t count)
+{
+	mutex_lock(&ib_mutex);
+	memset(ib_info.transitions, 0, sizeof(ib_info.transitions));
+	memset(ib_info.boosts, 0, sizeof(ib_info.boosts));
+	memset(ib_info.time_in_state, 0, sizeof(ib_info.time_in_state));
+	ib_info.last_change = get_jiffies_64();
+	mutex_unlock(&ib_mutex);
+
+	return count;
+}
+
+define_one_global_rw(sampling_rate);
+define_one_global_rw(up_threshold);
+define_one_global_rw(down_threshold);
+define_one_global_rw(boost_hold_ms);
+define_one_global_rw(stats);
+
+static struct attribute *ib_attributes[] = {
+	&sampling_rate.attr,
+	&up_threshold.attr,
+	&down_threshold.attr,
+	&boost_hold_ms.attr,
+	&stats.attr,
+	NULL
+};
+
+static struct attribute_group ib_attr_group = {
+	.attrs = ib_attributes,
+	.name = "inputboost",
+};
+
+/************************** sysfs end ************************/
+
+static int cpufreq_governor_ib(struct cpufreq_policy *policy,
+			       unsigned int event)
+{
+	int rc;
+
+	switch (event) {
+	case CPUFREQ_GOV_START:
+		if ((!cpu_online(policy->cpu)) || (!policy->cur))
+			return -EINVAL;
+
+		mutex_lock(&ib_mutex);
+		if (ib_info.policy) {
+			mutex_unlock(&ib_mutex);
+			return -EBUSY;
+		}
+
+		rc = sysfs_create_group(cpufreq_global_kobject, &ib_attr_group);
+		if (rc) {
+			mutex_unlock(&ib_mutex);
+			return rc;
+		}
+
+		ib_info.policy = policy;
+		ib_info.freq_table = cpufreq_frequency_get_table(policy->cpu);
+		ib_info.prev_idle = get_cpu_idle_time(policy->cpu,
+						      &ib_info.prev_wall);
+		ib_info.boost_until = jiffies;
+		ib_info.cur_trigger = IB_TRIG_LOAD;
+		ib_info.last_change = get_jiffies_64();
+		queue_delayed_work(kinputboost_wq, &ib_info.sample_work,
+				usecs_to_jiffies(ib_tuners_ins.sampling_rate));
+		mutex_unlock(&ib_mutex);
+
+		ib_input_registered = !input_register_handler(&ib_input_handler);
+		if (!ib_input_registered)
+			pr_warning("cpufreq_inputboost: no input boost\n");
+		break;
+
+	case CPUFREQ_GOV_STOP:
+		if (ib_input_registered)
+			input_unregister_handler(&ib_input_handler);
+		ib_input_registered = false;
+
+		mutex_lock(&ib_mutex);
+		ib_account();
+		ib_info.policy = NULL;
+		mutex_unlock(&ib_mutex);
+
+		cancel_work_sync(&ib_info.boost_work);
+		cancel_delayed_work_sync(&ib_info.unboost_work);
+		cancel_delayed_work_sync(&ib_info.sample_work);
+
+		sysfs_remove_group(cpufreq_global_kobject, &ib_attr_group);
+		break;
+
+	case CPUFREQ_GOV_LIMITS:
+		mutex_lock(&ib_mutex);
+		if (policy->max < policy->cur)
+			ib_set_freq(policy->max, CPUFREQ_RELATION_H,
+				    ib_info.cur_trigger);
+		else if (policy->min > policy->cur)
+			ib_set_freq(policy->min, CPUFREQ_RELATION_L,
+				    ib_info.cur_trigger);
+		mutex_unlock(&ib_mutex);
+		break;
+	}
+	return 0;
+}
+
+static int __init cpufreq_gov_ib_init(void)
+{
+	int err;
+
+	INIT_DELAYED_WORK_DEFERRABLE(&ib_info.sample_work, ib_sample_work);
+	INIT_DELAYED_WORK(&ib_info.unboost_work, ib_unboost_work);
+	INIT_WORK(&ib_info.boost_work, ib_boost_work);
+
+	kinputboost_wq = create_singlethread_workqueue("kinputboost");
+	if (!kinputboost_wq) {
+		printk(KERN_ERR "Creation of kinputboost failed\n");
+		return -EFAULT;
+	}
+	err = cpufreq_register_governor(&cpufreq_gov_inputboost);
+	if (err)
+		destroy_workqueue(kinputboost_wq);
+
+	return err;
+}
+
+static void __exit cpufreq_gov_ib_exit(void)
+{
+	cpufreq_unregister_governor(&cpufreq_gov_inputboost);
+	destroy_workqueue(kinputboost_wq);
+}
+
+MODULE_DESCRIPTION("'cpufreq_inputboost' - load tracking cpufreq governor "
+	"with input boost");
+MODULE_LICENSE("GPL");
+
+#ifdef CONFIG_CPU_FREQ_DEFAULT_GOV_INPUTBOOST
+fs_initcall(cpufreq_gov_ib_init);
+#else
+module_init(cpufreq_gov_ib_init);
+#endif
+module_exit(cpufreq_gov_ib_exit);
@@ -40,6 +40,11 @@
 #include <linux/slab.h>
 #include <linux/i2c-omap.h>
 #include <linux/pm_runtime.h>
+#include <linux/dma-mapping.h>
+#include <linux/hrtimer.h>
+#include <linux/workqueue.h>
+
+#include <plat/dma.h>
 
 /* I2C controller revisions */
 #define OMAP_I2C_REV_2			0x20
@@ -52,6 +57,10 @@
 /* timeout waiting for the controller to respond */
 #define OMAP_I2C_TIMEOUT (msecs_to_jiffies(1000))
 
+/* messages from this size on go through sDMA instead of FIFO interrupts */
+#define OMAP_I2C_DMA_MIN_BYTES	16
+#define OMAP_I2C_DMA_BUF_SIZE	PAGE_SIZE
+
 /* For OMAP3 I2C_IV has changed to I2C_WE (wakeup enable) */
 enum {
 	OMAP_I2C_REV_REG = 0,
@@ -171,6 +180,22 @@ enum {
 #define I2C_OMAP_ERRATA_I207		(1 << 0)
 #define I2C_OMAP3_1P153			(1 << 1)
 
+/* Bus statistics, reset by writing to the "stats" attribute */
+struct omap_i2c_stats {
+	ktime_t		since;
+	u32		xfers;
+	u32		msgs;
+	u64		bytes;
+	u32		dma_msgs;
+	u32		errors;
+	u32		timeouts;
+	u64		busy_ns;	/* time spent in omap_i2c_xfer() */
+	u32		xfer_max_ns;
+	u32		async;		/* transfers from omap_i2c_submit() */
+	u64		wait_ns;	/* submit to start of the transfer */
+	u32		wait_max_ns;
+};
+
 struct omap_i2c_dev {
 	struct device		*dev;
 	void __iomem		*base;		/* virtual */
@@ -203,6 +228,25 @@ struct omap_i2c_dev {
 	u16			westate;
 	u16			errata;
 	u32			transfer_active;
+
+	unsigned long		phys;		/* physical, for sDMA */
+	int			dma_rx_req;
+	int			dma_tx_req;
+	int			dma_rx_ch;	/* -1 if no DMA that way */
+	int			dma_tx_ch;
+	u8			*dma_buf;	/* msgs may be on the stack */
+	dma_addr_t		dma_buf_phys;
+	struct completion	dma_complete;
+	unsigned		use_dma:1;	/* message in progress */
+
+	/* requests from omap_i2c_submit() */
+	struct workqueue_struct	*queue_wq;
+	struct work_struct	queue_work;
+	struct list_head	queue;
+	spinlock_t		queue_lock;
+	unsigned		queue_dead:1;
+
+	struct omap_i2c_stats	stats;
 };
 
 const static u8 reg_map[] = {
@@ -479,6 +523,7 @@ static int omap_i2c_init(struct omap_i2c_dev *dev)
 			(dev->fifo_size - 1) | OMAP_I2C_BUF_TXFIF_CLR;
 		omap_i2c_write_reg(dev, OMAP_I2C_BUF_REG, buf);
 	}
+	dev->bufstate = buf;
 
 	/* Take the I2C module out of reset: */
 	omap_i2c_write_reg(dev, OMAP_I2C_CON_REG, OMAP_I2C_CON_EN);
@@ -498,7 +543,6 @@ static int omap_i2c_init(struct omap_i2c_dev *dev)
 		dev->pscstate = psc;
 		dev->scllstate = scll;
 		dev->sclhstate = sclh;
-		dev->bufstate = buf;
 	}
 	return 0;
 }
@@ -522,6 +566,99 @@ static int omap_i2c_wait_for_bb(struct omap_i2c_dev *dev)
 	return 0;
 }
 
+static bool omap_i2c_use_dma(struct omap_i2c_dev *dev, struct i2c_msg *msg)
+{
+	if (msg->len < OMAP_I2C_DMA_MIN_BYTES ||
+	    msg->len > OMAP_I2C_DMA_BUF_SIZE)
+		return false;
+
+	if (msg->flags & I2C_M_RD)
+		return dev->dma_rx_ch >= 0;
+
+	return dev->dma_tx_ch >= 0;
+}
+
+/*
+ * Hand the data of msg over to sDMA: one byte per DMA request, with the
+ * FIFO thresholds at one byte, and the data interrupts masked so the
+ * CPU only hears about the end of the message.
+ */
+static void omap_i2c_dma_setup(struct omap_i2c_dev *dev, struct i2c_msg *msg)
+{
+	unsigned long data_reg = dev->phys +
+		(dev->regs[OMAP_I2C_DATA_REG] << dev->reg_shift);
+	u16 buf = OMAP_I2C_BUF_RXFIF_CLR | OMAP_I2C_BUF_TXFIF_CLR;
+
+	INIT_COMPLETION(dev->dma_complete);
+
+	if (msg->flags & I2C_M_RD) {
+		omap_set_dma_transfer_params(dev->dma_rx_ch,
+				OMAP_DMA_DATA_TYPE_S8, msg->len, 1,
+				OMAP_DMA_SYNC_ELEMENT, dev->dma_rx_req, 1);
+		omap_set_dma_src_params(dev->dma_rx_ch, 0,
+				OMAP_DMA_AMODE_CONSTANT, data_reg, 0, 0);
+		omap_set_dma_dest_params(dev->dma_rx_ch, 0,
+				OMAP_DMA_AMODE_POST_INC,
+				dev->dma_buf_phys, 0, 0);
+		omap_start_dma(dev->dma_rx_ch);
+		buf |= OMAP_I2C_BUF_RDMA_EN;
+	} else {
+		memcpy(dev->dma_buf, msg->buf, msg->len);
+		omap_set_dma_transfer_params(dev->dma_tx_ch,
+				OMAP_DMA_DATA_TYPE_S8, msg->len, 1,
+				OMAP_DMA_SYNC_ELEMENT, dev->dma_tx_req, 0);
+		omap_set_dma_src_params(dev->dma_tx_ch, 0,
+				OMAP_DMA_AMODE_POST_INC,
+				dev->dma_buf_phys, 0, 0);
+		omap_set_dma_dest_params(dev->dma_tx_ch, 0,
+				OMAP_DMA_AMODE_CONSTANT, data_reg, 0, 0);
+		omap_start_dma(dev->dma_tx_ch);
+		buf |= OMAP_I2C_BUF_XDMA_EN;
+	}
+
+	omap_i2c_write_reg(dev, OMAP_I2C_IE_REG, dev->iestate &
+			~(OMAP_I2C_IE_RRDY | OMAP_I2C_IE_RDR |
+			  OMAP_I2C_IE_XRDY | OMAP_I2C_IE_XDR));
+	omap_i2c_write_reg(dev, OMAP_I2C_BUF_REG, buf);
+
+	dev->stats.dma_msgs++;
+}
+
+/*
+ * ARDY can come before sDMA has moved the last bytes out of the RX
+ * FIFO, so wait for the channel too before the data is copied back.
+ */
+static int omap_i2c_dma_finish(struct omap_i2c_dev *dev, struct i2c_msg *msg,
+			       int retval)
+{
+	int ch = (msg->flags & I2C_M_RD) ? dev->dma_rx_ch : dev->dma_tx_ch;
+
+	if (retval == 0 && (msg->flags & I2C_M_RD)) {
+		if (wait_for_completion_timeout(&dev->dma_complete,
+						OMAP_I2C_TIMEOUT))
+			memcpy(msg->buf, dev->dma_buf, msg->len);
+		else {
+			dev_err(dev->dev, "DMA timed out\n");
+			retval = -ETIMEDOUT;
+		}
+	}
+
+	omap_stop_dma(ch);
+
+	omap_i2c_write_reg(dev, OMAP_I2C_BUF_REG, dev->bufstate);
+	omap_i2c_write_reg(dev, OMAP_I2C_IE_REG, dev->iestate);
+	dev->use_dma = 0;
+
+	return retval;
+}
+
+static void omap_i2c_dma_callback(int lch, u16 ch_status, void *data)
+{
+	struct omap_i2c_dev *dev = data;
+
+	complete(&dev->dma_complete);
+}
+
 /*
  * Low level master read/write transaction.
  */
@@ -552,14 +689,19 @@ static int omap_i2c_xfer_msg(struct i2c_adapter *adap,
 
     omap_i2c_write_reg(dev, OMAP_I2C_CNT_REG, dev->buf_len);
 
-    /* Clear the FIFO Buffers */
-    w = omap_i2c_read_reg(dev, OMAP_I2C_BUF_REG);
-    w |= OMAP_I2C_BUF_RXFIF_CLR | OMAP_I2C_BUF_TXFIF_CLR;
-    omap_i2c_write_reg(dev, OMAP_I2C_BUF_REG, w);
-
     init_completion(&dev->cmd_complete);
     dev->cmd_err = 0;
 
+    dev->use_dma = omap_i2c_use_dma(dev, msg);
+    if (dev->use_dma) {
+        omap_i2c_dma_setup(dev, msg);
+    } else {
+        /* Clear the FIFO Buffers */
+        w = omap_i2c_read_reg(dev, OMAP_I2C_BUF_REG);
+        w |= OMAP_I2C_BUF_RXFIF_CLR | OMAP_I2C_BUF_TXFIF_CLR;
+        omap_i2c_write_reg(dev, OMAP_I2C_BUF_REG, w);
+    }
+
     w = OMAP_I2C_CON_EN | OMAP_I2C_CON_MST | OMAP_I2C_CON_STT;
 
 	/* High speed configuration */
@@ -650,11 +792,37 @@ static int omap_i2c_xfer_msg(struct i2c_adapter *adap,
     }
     retval = -EIO;
 out:
+    if (dev->use_dma)
+        retval = omap_i2c_dma_finish(dev, msg, retval);
     dev->transfer_active = 0;
     return retval;
 }
 
 
+/* Called with the adapter locked, like omap_i2c_xfer() */
+static void omap_i2c_account(struct omap_i2c_dev *dev, struct i2c_msg msgs[],
+			     int num, int r, ktime_t start)
+{
+	struct omap_i2c_stats *stats = &dev->stats;
+	u32 ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+	int i;
+
+	stats->xfers++;
+	stats->msgs += num;
+	for (i = 0; i < num; i++)
+		stats->bytes += msgs[i].len;
+
+	if (r < 0) {
+		stats->errors++;
+		if (r == -ETIMEDOUT)
+			stats->timeouts++;
+	}
+
+	stats->busy_ns += ns;
+	if (ns > stats->xfer_max_ns)
+		stats->xfer_max_ns = ns;
+}
+
 /*
  * Prepare controller for a transaction and call omap_i2c_xfer_msg
  * to do the work during IRQ processing.
@@ -663,6 +831,7 @@ static int
 omap_i2c_xfer(struct i2c_adapter *adap, struct i2c_msg msgs[], int num)
 {
 	struct omap_i2c_dev *dev = i2c_get_adapdata(adap);
+	ktime_t start = ktime_get();
 	int i;
 	int r;
 
@@ -686,6 +855,7 @@ omap_i2c_xfer(struct i2c_adapter *adap, struct i2c_msg msgs[], int num)
 	omap_i2c_wait_for_bb(dev);
 out:
 	omap_i2c_idle(dev);
+	omap_i2c_account(dev, msgs, num, r, start);
 	return r;
 }
 
@@ -987,6 +1157,188 @@ static const struct i2c_algorithm omap_i2c_algo = {
 	.functionality	= omap_i2c_func,
 };
 
+/*
+ * Asynchronous requests: queued per adapter and run one after another
+ * from the adapter's own thread, so a driver can keep several in flight
+ * without a thread of its own blocked in i2c_transfer(), and a slow
+ * client on one bus never holds up another bus.
+ */
+static void omap_i2c_queue_work(struct work_struct *work)
+{
+	struct omap_i2c_dev *dev =
+		container_of(work, struct omap_i2c_dev, queue_work);
+	struct omap_i2c_stats *stats = &dev->stats;
+	struct omap_i2c_request *req;
+	u32 ns;
+
+	spin_lock_irq(&dev->queue_lock);
+	while (!list_empty(&dev->queue)) {
+		req = list_first_entry(&dev->queue, struct omap_i2c_request,
+				       node);
+		list_del(&req->node);
+
+		ns = ktime_to_ns(ktime_sub(ktime_get(), req->queued));
+		stats->async++;
+		stats->wait_ns += ns;
+		if (ns > stats->wait_max_ns)
+			stats->wait_max_ns = ns;
+
+		spin_unlock_irq(&dev->queue_lock);
+
+		req->status = i2c_transfer(&dev->adapter, req->msgs, req->num);
+		req->complete(req);
+
+		spin_lock_irq(&dev->queue_lock);
+	}
+	spin_unlock_irq(&dev->queue_lock);
+}
+
+/**
+ * omap_i2c_submit - queue a transfer on an OMAP I2C adapter
+ * @adap: the adapter, as from i2c_get_adapter() or client->adapter
+ * @req: the request, owned by the adapter until req->complete is called
+ *
+ * Never sleeps. req->complete is called from the adapter's thread with
+ * req->status set to what i2c_transfer() returned, and may submit the
+ * next request. Requests run in the order they were submitted.
+ */
+int omap_i2c_submit(struct i2c_adapter *adap, struct omap_i2c_request *req)
+{
+	struct omap_i2c_dev *dev;
+	unsigned long flags;
+	int r = 0;
+
+	if (adap->algo != &omap_i2c_algo || req->num <= 0 || !req->complete)
+		return -EINVAL;
+
+	dev = i2c_get_adapdata(adap);
+	req->queued = ktime_get();
+
+	spin_lock_irqsave(&dev->queue_lock, flags);
+	if (dev->queue_dead)
+		r = -ESHUTDOWN;
+	else
+		list_add_tail(&req->node, &dev->queue);
+	spin_unlock_irqrestore(&dev->queue_lock, flags);
+
+	if (r == 0)
+		queue_work(dev->queue_wq, &dev->queue_work);
+
+	return r;
+}
+EXPORT_SYMBOL_GPL(omap_i2c_submit);
+
+static ssize_t omap_i2c_stats_show(struct device *d,
+				   struct device_attribute *attr, char *buf)
+{
+	struct omap_i2c_dev *dev = dev_get_drvdata(d);
+	struct omap_i2c_stats stats;
+	u64 elapsed, busy, xfer_avg = 0, wait_avg = 0;
+	u32 busy_frac;
+
+	i2c_lock_adapter(&dev->adapter);
+	spin_lock_irq(&dev->queue_lock);
+	stats = dev->stats;
+	spin_unlock_irq(&dev->queue_lock);
+	i2c_unlock_adapter(&dev->adapter);
+
+	elapsed = ktime_to_ns(ktime_sub(ktime_get(), stats.since));
+	busy = div64_u64(stats.busy_ns * 1000, elapsed ? elapsed : 1);
+	busy_frac = do_div(busy, 10);
+	if (stats.xfers)
+		xfer_avg = div_u64(stats.busy_ns, stats.xfers);
+	if (stats.async)
+		wait_avg = div_u64(stats.wait_ns, stats.async);
+
+	return sprintf(buf,
+		"transfers: %u\nmessages: %u\nbytes: %llu\n"
+		"dma messages: %u\nerrors: %u\ntimeouts: %u\n"
+		"busy: %llu.%u%%\n"
+		"transfer avg: %llu us\ntransfer max: %u us\n"
+		"async transfers: %u\n"
+		"queue wait avg: %llu us\nqueue wait max: %u us\n",
+		stats.xfers, stats.msgs, stats.bytes,
+		stats.dma_msgs, stats.errors, stats.timeouts,
+		busy, busy_frac,
+		div_u64(xfer_avg, NSEC_PER_USEC),
+		stats.xfer_max_ns / (u32)NSEC_PER_USEC,
+		stats.async,
+		div_u64(wait_avg, NSEC_PER_USEC),
+		stats.wait_max_ns / (u32)NSEC_PER_USEC);
+}
+
+static ssize_t omap_i2c_stats_store(struct device *d,
+				    struct device_attribute *attr,
+				    const char *buf, size_t count)
+{
+	struct omap_i2c_dev *dev = dev_get_drvdata(d);
+
+	/* any write starts a new measurement */
+	i2c_lock_adapter(&dev->adapter);
+	spin_lock_irq(&dev->queue_lock);
+	memset(&dev->stats, 0, sizeof(dev->stats));
+	dev->stats.since = ktime_get();
+	spin_unlock_irq(&dev->queue_lock);
+	i2c_unlock_adapter(&dev->adapter);
+
+	return count;
+}
+
+static DEVICE_ATTR(stats, S_IRUGO | S_IWUSR, omap_i2c_stats_show,
+		   omap_i2c_stats_store);
+
+static void omap_i2c_free_dma(struct omap_i2c_dev *dev)
+{
+	if (dev->dma_rx_ch >= 0)
+		omap_free_dma(dev->dma_rx_ch);
+	if (dev->dma_tx_ch >= 0)
+		omap_free_dma(dev->dma_tx_ch);
+	if (dev->dma_buf)
+		dma_free_coherent(dev->dev, OMAP_I2C_DMA_BUF_SIZE,
+				  dev->dma_buf, dev->dma_buf_phys);
+}
+
+/*
+ * DMA is optional: without the request lines, a channel or the bounce
+ * buffer every message goes through the FIFO interrupts as before.
+ */
+static void omap_i2c_request_dma(struct platform_device *pdev,
+				 struct omap_i2c_dev *dev)
+{
+	struct resource *rx, *tx;
+
+	dev->dma_rx_ch = -1;
+	dev->dma_tx_ch = -1;
+	init_completion(&dev->dma_complete);
+
+	rx = platform_get_resource_byname(pdev, IORESOURCE_DMA, "rx");
+	tx = platform_get_resource_byname(pdev, IORESOURCE_DMA, "tx");
+	if (!dev->fifo_size || !rx || !tx)
+		return;
+
+	dev->dma_buf = dma_alloc_coherent(dev->dev, OMAP_I2C_DMA_BUF_SIZE,
+					  &dev->dma_buf_phys, GFP_KERNEL);
+	if (!dev->dma_buf)
+		return;
+
+	dev->dma_rx_req = rx->start;
+	if (omap_request_dma(dev->dma_rx_req, "I2C RX",
+			     omap_i2c_dma_callback, dev, &dev->dma_rx_ch))
+		dev->dma_rx_ch = -1;
+
+	/* Errata 1.153 needs the CPU to watch XUDF before each TX byte */
+	dev->dma_tx_req = tx->start;
+	if ((dev->errata & I2C_OMAP3_1P153) ||
+	    omap_request_dma(dev->dma_tx_req, "I2C TX",
+			     omap_i2c_dma_callback, dev, &dev->dma_tx_ch))
+		dev->dma_tx_ch = -1;
+
+	if (dev->dma_rx_ch < 0 && dev->dma_tx_ch < 0) {
+		omap_i2c_free_dma(dev);
+		dev->dma_buf = NULL;
+	}
+}
+
 static int __devinit
 omap_i2c_probe(struct platform_device *pdev)
 {
@@ -1035,6 +1387,7 @@ omap_i2c_probe(struct platform_device *pdev)
 	dev->idle = 1;
 	dev->dev = &pdev->dev;
 	dev->irq = irq->start;
+	dev->phys = mem->start;
 	dev->base = ioremap(mem->start, resource_size(mem));
 	if (!dev->base) {
 		r = -ENOMEM;
@@ -1091,16 +1444,30 @@ omap_i2c_probe(struct platform_device *pdev)
 	/* reset ASAP, clearing any IRQs */
 	omap_i2c_init(dev);
 
+	omap_i2c_request_dma(pdev, dev);
+
+	INIT_LIST_HEAD(&dev->queue);
+	spin_lock_init(&dev->queue_lock);
+	INIT_WORK(&dev->queue_work, omap_i2c_queue_work);
+	dev->stats.since = ktime_get();
+
+	dev->queue_wq = create_singlethread_workqueue(dev_name(&pdev->dev));
+	if (!dev->queue_wq) {
+		r = -ENOMEM;
+		goto err_free_dma;
+	}
+
 	isr = (dev->rev < OMAP_I2C_REV_2) ? omap_i2c_rev1_isr : omap_i2c_isr;
 	r = request_irq(dev->irq, isr, 0, pdev->name, dev);
 
 	if (r) {
 		dev_err(dev->dev, "failure requesting irq %i\n", dev->irq);
-		goto err_unuse_clocks;
+		goto err_destroy_wq;
 	}
 
-	dev_info(dev->dev, "bus %d rev%d.%d at %d kHz\n",
-		 pdev->id, dev->rev >> 4, dev->rev & 0xf, dev->speed);
+	dev_info(dev->dev, "bus %d rev%d.%d at %d kHz%s\n",
+		 pdev->id, dev->rev >> 4, dev->rev & 0xf, dev->speed,
+		 dev->dma_buf ? ", DMA" : "");
 
 	omap_i2c_idle(dev);
 
@@ -1120,11 +1487,17 @@ omap_i2c_probe(struct platform_device *pdev)
 		goto err_free_irq;
 	}
 
+	if (device_create_file(&pdev->dev, &dev_attr_stats))
+		dev_warn(dev->dev, "no stats attribute\n");
+
 	return 0;
 
 err_free_irq:
 	free_irq(dev->irq, dev);
-err_unuse_clocks:
+err_destroy_wq:
+	destroy_workqueue(dev->queue_wq);
+err_free_dma:
+	omap_i2c_free_dma(dev);
 	omap_i2c_write_reg(dev, OMAP_I2C_CON_REG, 0);
 	omap_i2c_idle(dev);
 	iounmap(dev->base);
@@ -1143,9 +1516,18 @@ omap_i2c_remove(struct platform_device *pdev)
 	struct omap_i2c_dev	*dev = platform_get_drvdata(pdev);
 	struct resource		*mem;
 
+	device_remove_file(&pdev->dev, &dev_attr_stats);
+
+	/* whatever was submitted already still runs */
+	spin_lock_irq(&dev->queue_lock);
+	dev->queue_dead = 1;
+	spin_unlock_irq(&dev->queue_lock);
+	destroy_workqueue(dev->queue_wq);
+
 	platform_set_drvdata(pdev, NULL);
 
 	free_irq(dev->irq, dev);
+	omap_i2c_free_dma(dev);
 	i2c_del_adapter(&dev->adapter);
 	omap_i2c_write_reg(dev, OMAP_I2C_CON_REG, 0);
 	iounmap(dev->base);
@@ -28,11 +28,17 @@
 #include <linux/i2c.h>
 #include <linux/platform_device.h>
 #include <linux/gpio.h>
+#include <linux/ktime.h>
 #include <linux/adbs-a330.h>
 #include <linux/regulator/consumer.h>
 
 #define DRV_NAME "avago-adbs-a330"
-#define ENCODER_REPORT_TIME (HZ/60)
+
+/* Motion gaps longer than this restart the velocity estimate */
+#define ADBS_A330_VELOCITY_IDLE_US	100000
+
+#define ADBS_A330_ACCEL_THRESHOLD_DEFAULT	400
+#define ADBS_A330_ACCEL_MAX_DEFAULT		400
 
 enum {
 	REG_PRODUCT_ID = 0x00,
@@ -171,18 +177,27 @@ struct adbs_a330_data {
 	struct input_dev *input;
 	struct i2c_client *client;
 	struct adbs_a330_platform_data *pdata;
-	struct delayed_work	dwork;
-	spinlock_t		lock;
-	struct timer_list timer;
 	struct regulator* vdd;
 	uint32_t irq_a;
-	int32_t accumulatedPosition;
-	int32_t lastPositionSent;
+	bool burst;
 	int direction;
 	int mode;
 	int reset_gpio;
 	int shutdown_gpio;
 	int motion_gpio;
+
+	/* Filter stage state, only touched from the IRQ thread */
+	ktime_t lastMotion;
+	int32_t remainder;
+	unsigned int accel_threshold;
+	unsigned int accel_slope;
+	unsigned int accel_max;
+	unsigned int velocity;
+
+	/* Statistics */
+	unsigned long irqs;
+	unsigned long reads;
+	unsigned long reports;
 };
 
 // forward declarations
@@ -190,13 +205,23 @@ static ssize_t adbs_a330_get_direction(struct device *dev, struct device_attribu
 static ssize_t adbs_a330_set_direction(struct device *dev, struct device_attribute *attr, const char *buf, size_t len);
 static ssize_t adbs_a330_get_mode(struct device *dev, struct device_attribute *attr, char *buf);
 static ssize_t adbs_a330_set_mode(struct device *dev, struct device_attribute *attr, const char *buf, size_t len);
+static ssize_t adbs_a330_get_accel(struct device *dev, struct device_attribute *attr, char *buf);
+static ssize_t adbs_a330_set_accel(struct device *dev, struct device_attribute *attr, const char *buf, size_t len);
+static ssize_t adbs_a330_get_velocity(struct device *dev, struct device_attribute *attr, char *buf);
+static ssize_t adbs_a330_get_stats(struct device *dev, struct device_attribute *attr, char *buf);
 
 static DEVICE_ATTR(direction, (S_IRUGO|S_IWUGO), adbs_a330_get_direction, adbs_a330_set_direction);
 static DEVICE_ATTR(mode, (S_IRUGO|S_IWUGO), adbs_a330_get_mode, adbs_a330_set_mode);
+static DEVICE_ATTR(acceleration, (S_IRUGO|S_IWUSR), adbs_a330_get_accel, adbs_a330_set_accel);
+static DEVICE_ATTR(velocity, S_IRUGO, adbs_a330_get_velocity, NULL);
+static DEVICE_ATTR(stats, S_IRUGO, adbs_a330_get_stats, NULL);
 
 static struct attribute *adbs_a330_attributes[] = {
 	&dev_attr_direction.attr,
 	&dev_attr_mode.attr,
+	&dev_attr_acceleration.attr,
+	&dev_attr_velocity.attr,
+	&dev_attr_stats.attr,
 	NULL
 };
 
@@ -244,87 +269,176 @@ static ssize_t adbs_a330_set_mode(struct device *dev, struct device_attribute *a
 	return strnlen(buf, PAGE_SIZE);
 }
 
-static void adbs_a330_i2c_reschedule_work(struct adbs_a330_data *data,
-					  unsigned long delay)
+/*
+ * The acceleration attribute reads and writes "<threshold> <slope> <max>";
+ * see struct adbs_a330_platform_data for their meaning.
+ */
+static ssize_t adbs_a330_get_accel(struct device *dev,
+			struct device_attribute *attr, char *buf)
+{
+	struct i2c_client *client = to_i2c_client(dev);
+	const struct adbs_a330_data *data = i2c_get_clientdata(client);
+
+	return sprintf(buf, "%u %u %u\n", data->accel_threshold,
+				   data->accel_slope, data->accel_max);
+}
+
+static ssize_t adbs_a330_set_accel(struct device *dev, struct device_attribute *attr, const char *buf, size_t len)
 {
-	unsigned long flags;
+	unsigned int threshold, slope, max;
+	struct i2c_client *client = to_i2c_client(dev);
+	struct adbs_a330_data *data = i2c_get_clientdata(client);
 
-	spin_lock_irqsave(&data->lock, flags);
+	if (sscanf(buf, "%u %u %u", &threshold, &slope, &max) != 3)
+		return -EINVAL;
 
-	/*
-	 * If work is already scheduled then subsequent schedules will not
-	 * change the scheduled time that's why we have to cancel it first.
-	 */
-	__cancel_delayed_work(&data->dwork);
-	schedule_delayed_work(&data->dwork, delay);
+	if (threshold == 0 || max < 100)
+		return -EINVAL;
 
-	spin_unlock_irqrestore(&data->lock, flags);
+	disable_irq(data->irq_a);
+	data->accel_threshold = threshold;
+	data->accel_slope = slope;
+	data->accel_max = max;
+	data->remainder = 0;
+	enable_irq(data->irq_a);
+
+	return strnlen(buf, PAGE_SIZE);
 }
 
-static irqreturn_t adbs_a330_irq(int irq, void *dev_id)
+static ssize_t adbs_a330_get_velocity(struct device *dev,
+			struct device_attribute *attr, char *buf)
 {
-	struct adbs_a330_data *data = dev_id;
-
-	pm_wakeup_event(&data->client->dev, 0);
-	adbs_a330_i2c_reschedule_work(data, 0);
+	struct i2c_client *client = to_i2c_client(dev);
+	const struct adbs_a330_data *data = i2c_get_clientdata(client);
 
-	return IRQ_HANDLED;
+	return sprintf(buf, "%u\n", data->velocity);
 }
 
+static ssize_t adbs_a330_get_stats(struct device *dev,
+			struct device_attribute *attr, char *buf)
+{
+	struct i2c_client *client = to_i2c_client(dev);
+	const struct adbs_a330_data *data = i2c_get_clientdata(client);
+
+	return sprintf(buf, "irqs %lu\nreads %lu\nreports %lu\n",
+				   data->irqs, data->reads, data->reports);
+}
 
-static void adbs_a330_timer(unsigned long private)
+/*
+ * Reads MOTION, DELTA_X and DELTA_Y. Reading MOTION latches the deltas,
+ * so a single auto-incrementing burst returns a consistent triple.
+ */
+static int adbs_a330_read_motion(struct adbs_a330_data *rot, int8_t *dx, int8_t *dy)
 {
-	struct adbs_a330_data* rot = (void*) private;
-	int32_t newPosition = rot->accumulatedPosition;
-	int32_t delta;
+	struct i2c_client *client = rot->client;
+	u8 regs[3];
+	int val;
 
-	if( newPosition != rot->lastPositionSent )
+	rot->reads++;
+
+	if (rot->burst)
 	{
-		delta = (newPosition - rot->lastPositionSent);
-		delta = (rot->direction == ADBS_A330_DIRECTION_NEG) ? -delta : delta;
+		val = i2c_smbus_read_i2c_block_data(client, REG_MOTION, sizeof(regs), regs);
+		if (val < 0)
+			return val;
+		if (val != sizeof(regs))
+			return -EIO;
+	}
+	else
+	{
+		val = i2c_smbus_read_byte_data(client, REG_DELTA_X);
+		if (val < 0)
+			return val;
+		regs[1] = val;
+
+		val = i2c_smbus_read_byte_data(client, REG_DELTA_Y);
+		if (val < 0)
+			return val;
+		regs[2] = val;
+	}
+
+	*dx = (int8_t) regs[1];
+	*dy = (int8_t) regs[2];
+
+	return 0;
+}
+
+/*
+ * Filter stage: estimate velocity from the time since the previous
+ * motion report and scale the delta by the configured acceleration
+ * curve, carrying the fractional part to the next report so that slow
+ * motion is never lost.
+ */
+static int32_t adbs_a330_filter(struct adbs_a330_data *rot, int32_t delta, ktime_t now)
+{
+	s64 elapsed = ktime_us_delta(now, rot->lastMotion);
+	unsigned int gain = 100;
+	unsigned int velocity;
+	int32_t scaled;
 
-		input_report_rel(rot->input, REL_X, delta);
-		input_sync(rot->input);
+	rot->lastMotion = now;
 
-		rot->lastPositionSent = newPosition;
+	if (elapsed <= 0 || elapsed > ADBS_A330_VELOCITY_IDLE_US)
+	{
+		rot->velocity = 0;
+		rot->remainder = 0;
+		return delta;
 	}
 
-	mod_timer( &rot->timer, jiffies + ENCODER_REPORT_TIME );
+	velocity = (unsigned int) div64_u64((u64) abs(delta) * USEC_PER_SEC, elapsed);
+	rot->velocity = velocity;
+
+	if (rot->accel_slope == 0)
+		return delta;
+
+	if (velocity > rot->accel_threshold)
+		gain += ((velocity - rot->accel_threshold) * rot->accel_slope) / 1000;
+	if (gain > rot->accel_max)
+		gain = rot->accel_max;
+
+	scaled = delta * (int32_t) gain + rot->remainder;
+	rot->remainder = scaled % 100;
+
+	return scaled / 100;
 }
 
-static void adbs_a330_i2c_work_handler(struct work_struct *work)
+static irqreturn_t adbs_a330_irq(int irq, void *dev_id)
 {
-	struct adbs_a330_data* rot = container_of(work, struct adbs_a330_data, dwork.work);
-	struct i2c_client *client = rot->client;
-	int val;
+	struct adbs_a330_data* rot = dev_id;
 	int8_t val_x, val_y;
 	int32_t delta_x = 0, delta_y = 0;
-	do 
+	int32_t delta;
+	ktime_t now = ktime_get();
+	int err;
+
+	pm_wakeup_event(&rot->client->dev, 0);
+	rot->irqs++;
+
+	do
 	{
-		val = i2c_smbus_read_byte_data(client,  REG_DELTA_X);
-		val_x = (int8_t) ((val << 24) >> 24);
-		delta_x += (int32_t) val_x;
-		if( val < 0 )
-			return;
+		err = adbs_a330_read_motion(rot, &val_x, &val_y);
+		if (err < 0)
+			return IRQ_HANDLED;
 
-		val = i2c_smbus_read_byte_data(client,  REG_DELTA_Y);
-		val_y = (int8_t) ((val << 24) >> 24);
+		delta_x += (int32_t) val_x;
 		delta_y += (int32_t) val_y;
-		if( val < 0 )
-			return;
 
-		if( ( val_x == 0 )
-			&& ( val_y == 0 ) )
-		{
-			break;
-		}
+	} while( ( val_x != 0 ) || ( val_y != 0 ) );
 
-	} while( 1 );
+	delta = ( rot->mode == ADBS_A330_DELTA_X ) ? delta_x : delta_y;
+	if( delta == 0 )
+		return IRQ_HANDLED;
 
-	if( rot->mode == ADBS_A330_DELTA_X )
-		rot->accumulatedPosition += delta_x;
-	else
-		rot->accumulatedPosition += delta_y;
+	delta = (rot->direction == ADBS_A330_DIRECTION_NEG) ? -delta : delta;
+	delta = adbs_a330_filter(rot, delta, now);
+	if( delta == 0 )
+		return IRQ_HANDLED;
+
+	input_report_rel(rot->input, REL_X, delta);
+	input_sync(rot->input);
+	rot->reports++;
+
+	return IRQ_HANDLED;
 }
 
 static int __devinit adbs_a330_gpio_input_request_and_export(unsigned gpio, const char *name, struct device *dev, const char *link)
@@ -760,30 +874,31 @@ static int __devinit adbs_a330_probe(struct i2c_client *client,
 		goto exit_unregister_input;
 	}
         
-	data->accumulatedPosition = 0;
-	data->lastPositionSent = 0;
 	data->direction = platform_data->direction;
 	data->mode = platform_data->mode;
+	data->burst = i2c_check_functionality(adapter, I2C_FUNC_SMBUS_READ_I2C_BLOCK);
 
-	INIT_DELAYED_WORK(&data->dwork, adbs_a330_i2c_work_handler);
-	spin_lock_init(&data->lock);
+	data->accel_threshold = platform_data->accel_threshold ?
+		platform_data->accel_threshold : ADBS_A330_ACCEL_THRESHOLD_DEFAULT;
+	data->accel_slope = platform_data->accel_slope;
+	data->accel_max = platform_data->accel_max ?
+		platform_data->accel_max : ADBS_A330_ACCEL_MAX_DEFAULT;
 
 	/* request the IRQs */
 	data->irq_a = gpio_to_irq(platform_data->motion_gpio);
 
-	err = request_irq(data->irq_a, &adbs_a330_irq,
-					  IORESOURCE_IRQ_LOWEDGE,
+	/*
+	 * Motion is drained and reported from the IRQ thread; there is no
+	 * polling while the finger is off the sensor.
+	 */
+	err = request_threaded_irq(data->irq_a, NULL, adbs_a330_irq,
+					  IRQF_TRIGGER_FALLING | IRQF_ONESHOT,
 					  DRV_NAME, data);
 	if (err) {
 		dev_err(&client->dev, "unable to request IRQ %d\n", data->irq_a);
 		goto exit_unregister_input;
 	}
 
-	init_timer(&data->timer);
-	data->timer.data = (long) data;
-	data->timer.function = adbs_a330_timer;
-	mod_timer( &data->timer, jiffies + ENCODER_REPORT_TIME );
-
 	/* Register sysfs hooks */
 	err = sysfs_create_group(&client->dev.kobj, &adbs_a330_attr_group);
 	if (err) {
@@ -793,7 +908,6 @@ static int __devinit adbs_a330_probe(struct i2c_client *client,
 	return 0;
 
 exit_free_irq:
-	del_timer_sync(&data->timer);
 	free_irq(data->irq_a, data);
 
 exit_unregister_input:
@@ -829,7 +943,6 @@ static int __devexit adbs_a330_remove(struct i2c_client *client)
 	struct adbs_a330_data *rot = i2c_get_clientdata(client);
 
 	sysfs_remove_group(&client->dev.kobj, &adbs_a330_attr_group);
-	del_timer_sync(&rot->timer);
 	free_irq(rot->irq_a, rot);
 	adbs_a330_gpio_unexport_and_free(rot->motion_gpio);
 	adbs_a330_gpio_unexport_and_free(rot->shutdown_gpio);
@@ -19,23 +19,317 @@
 #include <linux/platform_device.h>
 #include <linux/pwm.h>
 #include <linux/slab.h>
+#include <linux/ctype.h>
+#include <linux/hrtimer.h>
+#include <linux/spinlock.h>
 #include <linux/input/pwm-beeper.h>
 
+#define PWM_BEEPER_MAX_NOTES	32
+#define PWM_BEEPER_MAX_HZ	20000
+#define PWM_BEEPER_MAX_MS	10000
+#define PWM_BEEPER_DEF_DUTY	50
+
+/*
+ * A sequence is a list of notes played back to back from an hrtimer,
+ * hz == 0 being a rest. Notes change in the timer callback, so once a
+ * sequence is started nothing else has to run until it is over.
+ */
+struct pwm_beeper_note {
+	unsigned int hz;
+	unsigned int ms;
+	unsigned int duty;	/* percent */
+};
+
+struct pwm_beeper_seq {
+	unsigned int count;
+	struct pwm_beeper_note notes[PWM_BEEPER_MAX_NOTES];
+};
+
 struct pwm_beeper {
 	struct input_dev *input;
 	struct pwm_device *pwm;
 	unsigned long period;
 	struct platform_pwm_beeper_data pdata;
+
+	/* sequencer state, protected by lock */
+	spinlock_t lock;
+	struct hrtimer timer;
+	struct pwm_beeper_seq seq;
+	struct pwm_beeper_seq click;
+	const struct pwm_beeper_seq *playing;
+	unsigned int note;
 };
 
 #define HZ_TO_NANOSECONDS(x) (1000000000UL/(x))
 
+/* the one beeper pwm_beeper_click() plays on */
+static struct pwm_beeper *pwm_beeper_clicker;
+static DEFINE_SPINLOCK(pwm_beeper_clicker_lock);
+
+/*
+ * Programs the PWM for one tone, 0 Hz being silence. pwm_config() and
+ * friends only touch the dual-mode timer registers, so this is safe
+ * from the timer callback and from hard IRQ context.
+ */
+static int pwm_beeper_set(struct pwm_beeper *beeper, unsigned int hz,
+			  unsigned int duty)
+{
+	unsigned long period;
+	int ret;
+
+	if (beeper->pdata.notify) {
+		beeper->pdata.notify(&beeper->input->dev, hz);
+	}
+
+	period = ((hz == 0) ? 0 : HZ_TO_NANOSECONDS(hz));
+
+	ret = pwm_config(beeper->pwm, period / 100 * duty, period);
+	if (ret)
+		return ret;
+
+	if (period == 0) {
+		pwm_disable(beeper->pwm);
+	} else {
+		ret = pwm_enable(beeper->pwm);
+	}
+
+	beeper->period = period;
+
+	return ret;
+}
+
+/* Call with beeper->lock held. */
+static void pwm_beeper_stop_locked(struct pwm_beeper *beeper)
+{
+	if (beeper->playing) {
+		beeper->playing = NULL;
+		hrtimer_try_to_cancel(&beeper->timer);
+		pwm_beeper_set(beeper, 0, 0);
+	}
+}
+
+/* Call with beeper->lock held. */
+static void pwm_beeper_play_locked(struct pwm_beeper *beeper,
+				   const struct pwm_beeper_seq *seq)
+{
+	const struct pwm_beeper_note *note = &seq->notes[0];
+
+	if (!seq->count)
+		return;
+
+	beeper->playing = seq;
+	beeper->note = 0;
+
+	pwm_beeper_set(beeper, note->hz, note->duty);
+	hrtimer_start(&beeper->timer, ns_to_ktime((u64)note->ms * NSEC_PER_MSEC),
+		      HRTIMER_MODE_REL);
+}
+
+static enum hrtimer_restart pwm_beeper_timer(struct hrtimer *timer)
+{
+	struct pwm_beeper *beeper = container_of(timer, struct pwm_beeper, timer);
+	const struct pwm_beeper_note *note;
+	enum hrtimer_restart ret = HRTIMER_NORESTART;
+	unsigned long flags;
+
+	spin_lock_irqsave(&beeper->lock, flags);
+
+	if (!beeper->playing)
+		goto done;
+
+	if (++beeper->note >= beeper->playing->count) {
+		beeper->playing = NULL;
+		pwm_beeper_set(beeper, 0, 0);
+		goto done;
+	}
+
+	note = &beeper->playing->notes[beeper->note];
+	pwm_beeper_set(beeper, note->hz, note->duty);
+
+	/* relative to the expiry, so the notes do not drift */
+	hrtimer_add_expires_ns(timer, (u64)note->ms * NSEC_PER_MSEC);
+	ret = HRTIMER_RESTART;
+
+ done:
+	spin_unlock_irqrestore(&beeper->lock, flags);
+
+	return ret;
+}
+
+/**
+ * pwm_beeper_click - play the click sequence
+ *
+ * Meant to be called straight from the interrupt handler of an input
+ * device, e.g. through the edge hook of the rotary encoder, so the
+ * click goes out within microseconds of the event. Does nothing if no
+ * click has been uploaded or if the beeper is busy with anything else.
+ */
+void pwm_beeper_click(void)
+{
+	struct pwm_beeper *beeper;
+	unsigned long flags;
+
+	spin_lock_irqsave(&pwm_beeper_clicker_lock, flags);
+
+	beeper = pwm_beeper_clicker;
+	if (!beeper)
+		goto done;
+
+	spin_lock(&beeper->lock);
+	if (!beeper->playing && !beeper->period)
+		pwm_beeper_play_locked(beeper, &beeper->click);
+	spin_unlock(&beeper->lock);
+
+ done:
+	spin_unlock_irqrestore(&pwm_beeper_clicker_lock, flags);
+}
+EXPORT_SYMBOL(pwm_beeper_click);
+
+/*
+ * Sequences are written as whitespace separated "hz:ms[:duty]" notes,
+ * duty in percent and 50 if left out.
+ */
+static int pwm_beeper_parse(const char *buf, struct pwm_beeper_seq *seq)
+{
+	struct pwm_beeper_note *note;
+	int n;
+
+	seq->count = 0;
+
+	for (buf = skip_spaces(buf); *buf; buf = skip_spaces(buf)) {
+		if (seq->count == PWM_BEEPER_MAX_NOTES)
+			return -E2BIG;
+
+		note = &seq->notes[seq->count];
+		note->duty = PWM_BEEPER_DEF_DUTY;
+
+		if (sscanf(buf, "%u:%u:%u%n", &note->hz, &note->ms,
+				&note->duty, &n) != 3 &&
+		    sscanf(buf, "%u:%u%n", &note->hz, &note->ms, &n) != 2)
+			return -EINVAL;
+
+		buf += n;
+		if (*buf && !isspace(*buf))
+			return -EINVAL;
+
+		if (note->hz > PWM_BEEPER_MAX_HZ ||
+		    note->ms == 0 || note->ms > PWM_BEEPER_MAX_MS ||
+		    note->duty == 0 || note->duty > 100)
+			return -EINVAL;
+
+		seq->count++;
+	}
+
+	return 0;
+}
+
+static ssize_t pwm_beeper_show_seq(const struct pwm_beeper_seq *seq, char *buf)
+{
+	ssize_t len = 0;
+	unsigned int i;
+
+	for (i = 0; i < seq->count; i++)
+		len += sprintf(buf + len, "%s%u:%u:%u", i ? " " : "",
+			       seq->notes[i].hz, seq->notes[i].ms,
+			       seq->notes[i].duty);
+
+	return len + sprintf(buf + len, "\n");
+}
+
+static ssize_t pwm_beeper_store_seq(struct pwm_beeper *beeper,
+				    struct pwm_beeper_seq *seq,
+				    const char *buf, bool play)
+{
+	struct pwm_beeper_seq *new;
+	unsigned long flags;
+	int ret;
+
+	new = kmalloc(sizeof(*new), GFP_KERNEL);
+	if (!new)
+		return -ENOMEM;
+
+	ret = pwm_beeper_parse(buf, new);
+	if (ret)
+		goto done;
+
+	spin_lock_irqsave(&beeper->lock, flags);
+	if (beeper->playing == seq)
+		pwm_beeper_stop_locked(beeper);
+	*seq = *new;
+	if (play) {
+		pwm_beeper_stop_locked(beeper);
+		pwm_beeper_play_locked(beeper, seq);
+	}
+	spin_unlock_irqrestore(&beeper->lock, flags);
+
+ done:
+	kfree(new);
+
+	return ret;
+}
+
+static ssize_t pwm_beeper_show_sequence(struct device *dev,
+					struct device_attribute *attr, char *buf)
+{
+	struct pwm_beeper *beeper = dev_get_drvdata(dev);
+
+	return pwm_beeper_show_seq(&beeper->seq, buf);
+}
+
+static ssize_t pwm_beeper_store_sequence(struct device *dev,
+					 struct device_attribute *attr,
+					 const char *buf, size_t count)
+{
+	struct pwm_beeper *beeper = dev_get_drvdata(dev);
+	int ret;
+
+	ret = pwm_beeper_store_seq(beeper, &beeper->seq, buf, true);
+
+	return ret ? ret : count;
+}
+
+static ssize_t pwm_beeper_show_click(struct device *dev,
+				     struct device_attribute *attr, char *buf)
+{
+	struct pwm_beeper *beeper = dev_get_drvdata(dev);
+
+	return pwm_beeper_show_seq(&beeper->click, buf);
+}
+
+static ssize_t pwm_beeper_store_click(struct device *dev,
+				      struct device_attribute *attr,
+				      const char *buf, size_t count)
+{
+	struct pwm_beeper *beeper = dev_get_drvdata(dev);
+	int ret;
+
+	ret = pwm_beeper_store_seq(beeper, &beeper->click, buf, false);
+
+	return ret ? ret : count;
+}
+
+/* writing a sequence plays it, the click is only stored */
+static DEVICE_ATTR(sequence, S_IRUGO | S_IWUSR,
+		   pwm_beeper_show_sequence, pwm_beeper_store_sequence);
+static DEVICE_ATTR(click, S_IRUGO | S_IWUSR,
+		   pwm_beeper_show_click, pwm_beeper_store_click);
+
+static struct attribute *pwm_beeper_attributes[] = {
+	&dev_attr_sequence.attr,
+	&dev_attr_click.attr,
+	NULL
+};
+
+static const struct attribute_group pwm_beeper_attr_group = {
+	.attrs = pwm_beeper_attributes,
+};
+
 static int pwm_beeper_event(struct input_dev *input,
 			    unsigned int type, unsigned int code, int value)
 {
-	int ret = 0;
+	int ret;
 	struct pwm_beeper *beeper = input_get_drvdata(input);
-	unsigned long period;
+	unsigned long flags;
 
 	if (type != EV_SND || value < 0)
 		return -EINVAL;
@@ -50,25 +344,12 @@ static int pwm_beeper_event(struct input_dev *input,
 		return -EINVAL;
 	}
 
-	if (beeper->pdata.notify) {
-		beeper->pdata.notify(&input->dev, value);
-	}
-
-	period = ((value == 0) ? 0 : HZ_TO_NANOSECONDS(value));
-	
-	ret = pwm_config(beeper->pwm, period / 2, period);
-	if (ret)
-		goto done;
+	/* a plain tone takes over from any sequence */
+	spin_lock_irqsave(&beeper->lock, flags);
+	pwm_beeper_stop_locked(beeper);
+	ret = pwm_beeper_set(beeper, value, PWM_BEEPER_DEF_DUTY);
+	spin_unlock_irqrestore(&beeper->lock, flags);
 
-	if (period == 0) {
-		pwm_disable(beeper->pwm);
-	} else {
-		ret = pwm_enable(beeper->pwm);
-	}
-
-	beeper->period = period;
-
- done:
 	return ret;
 }
 
@@ -94,6 +375,10 @@ static int __devinit pwm_beeper_probe(struct platform_device *pdev)
 	beeper->pwm = pwm_request(pdata->pwm_id, "pwm beeper");
 	beeper->pdata = *pdata;
 
+	spin_lock_init(&beeper->lock);
+	hrtimer_init(&beeper->timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	beeper->timer.function = pwm_beeper_timer;
+
 	if (IS_ERR(beeper->pwm)) {
 		error = PTR_ERR(beeper->pwm);
 		dev_err(&pdev->dev, "Failed to request pwm device: %d\n", error);
@@ -146,6 +431,17 @@ static int __devinit pwm_beeper_probe(struct platform_device *pdev)
 
 	pwm_disable(beeper->pwm);
 
+	error = sysfs_create_group(&pdev->dev.kobj, &pwm_beeper_attr_group);
+	if (error) {
+		dev_err(&pdev->dev, "Failed to create sysfs group: %d\n", error);
+		goto err_input_free;
+	}
+
+	spin_lock_irq(&pwm_beeper_clicker_lock);
+	if (!pwm_beeper_clicker)
+		pwm_beeper_clicker = beeper;
+	spin_unlock_irq(&pwm_beeper_clicker_lock);
+
 	return 0;
 
 err_input_free:
@@ -162,6 +458,18 @@ static int __devexit pwm_beeper_remove(struct platform_device *pdev)
 {
 	struct pwm_beeper *beeper = platform_get_drvdata(pdev);
 
+	spin_lock_irq(&pwm_beeper_clicker_lock);
+	if (pwm_beeper_clicker == beeper)
+		pwm_beeper_clicker = NULL;
+	spin_unlock_irq(&pwm_beeper_clicker_lock);
+
+	sysfs_remove_group(&pdev->dev.kobj, &pwm_beeper_attr_group);
+
+	spin_lock_irq(&beeper->lock);
+	beeper->playing = NULL;
+	spin_unlock_irq(&beeper->lock);
+	hrtimer_cancel(&beeper->timer);
+
 	if (beeper->pdata.exit) {
 		beeper->pdata.exit(&pdev->dev);
 	}
@@ -183,6 +491,12 @@ static int pwm_beeper_suspend(struct device *dev)
 	struct pwm_beeper *beeper = dev_get_drvdata(dev);
 	int ret = 0;
 
+	/* a sequence cut short by suspend is not resumed */
+	spin_lock_irq(&beeper->lock);
+	pwm_beeper_stop_locked(beeper);
+	spin_unlock_irq(&beeper->lock);
+	hrtimer_cancel(&beeper->timer);
+
 	if (beeper->pdata.suspend) {
 		ret = beeper->pdata.suspend(dev);
 		if (ret)
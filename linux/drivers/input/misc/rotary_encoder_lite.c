@@ -3,6 +3,12 @@
  *
  *  XXX add copyright
  *
+ * Edges are accumulated in the IRQ handler. The first edge after the
+ * ring comes to rest arms a one-shot hrtimer; when the reporting window
+ * expires the accumulated motion is sent as a single REL event, preceded
+ * by one EV_MSC/MSC_RAW event per edge carrying the interval, in
+ * microseconds, since the previous edge (0 for the first edge after
+ * rest). Nothing is scheduled while the ring is idle.
  */
 
 #include <linux/slab.h>
@@ -14,18 +20,37 @@
 #include <linux/device.h>
 #include <linux/platform_device.h>
 #include <linux/gpio.h>
+#include <linux/hrtimer.h>
+#include <linux/ktime.h>
+#include <linux/spinlock.h>
 #include <linux/rotary_encoder_lite.h>
 
 #define DRV_NAME "rotary-encoder-lite"
-#define ENCODER_REPORT_TIME (HZ/60)
+#define ENCODER_REPORT_TIME_US (USEC_PER_SEC / 60)
+#define ENCODER_MAX_EDGES 32
+#define ENCODER_MAX_INTERVAL_US INT_MAX
 
 struct rotary_encoder_lite {
 	struct input_dev *input;
 	struct rotary_encoder_lite_platform_data *pdata;
-	struct timer_list timer;
+	struct hrtimer timer;
+	spinlock_t lock;
 	uint32_t irq_a;
 	uint8_t accumulatedPosition;
 	uint8_t lastPositionSent;
+
+	/* Coalescing window and per-edge timestamps, protected by lock */
+	ktime_t window;
+	ktime_t lastEdge;
+	ktime_t lastReport;
+	bool armed;
+	unsigned int edgeCount;
+	s32 edgeInterval[ENCODER_MAX_EDGES];
+
+	/* Statistics */
+	unsigned long reports;
+	unsigned long edges;
+	unsigned long wakeupsAvoided;
 };
 
 static irqreturn_t rotary_encoder_lite_irq(int irq, void *dev_id)
@@ -33,8 +58,41 @@ static irqreturn_t rotary_encoder_lite_irq(int irq, void *dev_id)
 	struct rotary_encoder_lite *encoder = dev_id;
 	struct rotary_encoder_lite_platform_data *pdata = encoder->pdata;
 	int direction = !!gpio_get_value(pdata->gpio_b);
+	ktime_t now = ktime_get();
+	s64 interval;
+
+	spin_lock(&encoder->lock);
+
 	encoder->accumulatedPosition += (direction ? -1 : 1 );
-	
+	encoder->edges++;
+
+	if (!encoder->armed) {
+		/*
+		 * First edge after rest: account for the periodic reports
+		 * that a free-running timer would have made while idle.
+		 */
+		if (encoder->lastReport.tv64)
+			encoder->wakeupsAvoided +=
+				div64_u64(ktime_to_ns(ktime_sub(now, encoder->lastReport)),
+						  ktime_to_ns(encoder->window));
+		interval = 0;
+		encoder->armed = true;
+		hrtimer_start(&encoder->timer, encoder->window, HRTIMER_MODE_REL);
+	} else {
+		interval = ktime_us_delta(now, encoder->lastEdge);
+		if (interval > ENCODER_MAX_INTERVAL_US)
+			interval = ENCODER_MAX_INTERVAL_US;
+	}
+
+	if (encoder->edgeCount < ENCODER_MAX_EDGES)
+		encoder->edgeInterval[encoder->edgeCount++] = direction ? -interval : interval;
+	encoder->lastEdge = now;
+
+	spin_unlock(&encoder->lock);
+
+	if (pdata->edge)
+		pdata->edge(encoder->input->dev.parent, direction);
+
 	// clear the flip-flop
 	gpio_set_value(encoder->pdata->gpio_clear, 0);
 	gpio_set_value(encoder->pdata->gpio_clear, 1);
@@ -42,22 +100,90 @@ static irqreturn_t rotary_encoder_lite_irq(int irq, void *dev_id)
 	return IRQ_HANDLED;
 }
 
-static void encoder_timer(unsigned long private)
+static enum hrtimer_restart encoder_timer(struct hrtimer *timer)
 {
-	struct rotary_encoder_lite* enc = (void*) private;
+	struct rotary_encoder_lite *enc =
+		container_of(timer, struct rotary_encoder_lite, timer);
+	s32 intervals[ENCODER_MAX_EDGES];
+	unsigned int count, i;
+	unsigned long flags;
+	uint8_t newPosition;
+
+	spin_lock_irqsave(&enc->lock, flags);
+	newPosition = enc->accumulatedPosition;
+	count = enc->edgeCount;
+	memcpy(intervals, enc->edgeInterval, count * sizeof(intervals[0]));
+	enc->edgeCount = 0;
+	enc->armed = false;
+	enc->lastReport = ktime_get();
+	spin_unlock_irqrestore(&enc->lock, flags);
 
-	uint8_t newPosition = enc->accumulatedPosition;
 	if( newPosition != enc->lastPositionSent )
 	{
+		/* Signed by direction, magnitude is the inter-edge interval */
+		for (i = 0; i < count; i++)
+			input_event( enc->input, EV_MSC, MSC_RAW, intervals[i] );
 		input_report_rel( enc->input,
 						  0, // axis
 						  (int8_t)(newPosition - enc->lastPositionSent));
 		input_sync( enc->input );
 		enc->lastPositionSent = newPosition;
+		enc->reports++;
 	}
-	mod_timer( &enc->timer, jiffies + ENCODER_REPORT_TIME );
+
+	/* One-shot: the next edge re-arms the timer */
+	return HRTIMER_NORESTART;
 }
 
+static ssize_t rotary_encoder_lite_show_window(struct device *dev,
+			struct device_attribute *attr, char *buf)
+{
+	struct rotary_encoder_lite *encoder = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%lld\n", ktime_to_us(encoder->window));
+}
+
+static ssize_t rotary_encoder_lite_store_window(struct device *dev,
+			struct device_attribute *attr, const char *buf, size_t count)
+{
+	struct rotary_encoder_lite *encoder = dev_get_drvdata(dev);
+	unsigned long flags;
+	unsigned long usecs;
+
+	if (strict_strtoul(buf, 0, &usecs) || usecs == 0 || usecs > USEC_PER_SEC)
+		return -EINVAL;
+
+	spin_lock_irqsave(&encoder->lock, flags);
+	encoder->window = ns_to_ktime((u64)usecs * NSEC_PER_USEC);
+	spin_unlock_irqrestore(&encoder->lock, flags);
+
+	return count;
+}
+
+static ssize_t rotary_encoder_lite_show_stats(struct device *dev,
+			struct device_attribute *attr, char *buf)
+{
+	struct rotary_encoder_lite *encoder = dev_get_drvdata(dev);
+
+	return sprintf(buf, "edges %lu\nreports %lu\nidle_wakeups_avoided %lu\n",
+				   encoder->edges, encoder->reports,
+				   encoder->wakeupsAvoided);
+}
+
+static DEVICE_ATTR(report_window_us, S_IRUGO | S_IWUSR,
+		   rotary_encoder_lite_show_window, rotary_encoder_lite_store_window);
+static DEVICE_ATTR(stats, S_IRUGO, rotary_encoder_lite_show_stats, NULL);
+
+static struct attribute *rotary_encoder_lite_attributes[] = {
+	&dev_attr_report_window_us.attr,
+	&dev_attr_stats.attr,
+	NULL
+};
+
+static const struct attribute_group rotary_encoder_lite_attr_group = {
+	.attrs = rotary_encoder_lite_attributes,
+};
+
 static int __devinit rotary_encoder_lite_probe(struct platform_device *pdev)
 {
 	struct rotary_encoder_lite_platform_data *pdata = pdev->dev.platform_data;
@@ -82,13 +208,21 @@ static int __devinit rotary_encoder_lite_probe(struct platform_device *pdev)
 	encoder->pdata = pdata;
 	encoder->irq_a = gpio_to_irq(pdata->gpio_a);
 
+	spin_lock_init(&encoder->lock);
+	hrtimer_init(&encoder->timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	encoder->timer.function = encoder_timer;
+	encoder->window = ns_to_ktime((u64)(pdata->report_window_us ?
+					    pdata->report_window_us :
+					    ENCODER_REPORT_TIME_US) * NSEC_PER_USEC);
+
 	/* create and register the input driver */
 	input->name = pdev->name;
 	input->id.bustype = BUS_HOST;
 	input->dev.parent = &pdev->dev;
 
-    input->evbit[0] = BIT_MASK(EV_REL);
+    input->evbit[0] = BIT_MASK(EV_REL) | BIT_MASK(EV_MSC);
     input->relbit[0] = BIT_MASK(0 /* axis */);
+    input->mscbit[0] = BIT_MASK(MSC_RAW);
 
 	err = input_register_device(input);
 	if (err) {
@@ -119,6 +253,11 @@ static int __devinit rotary_encoder_lite_probe(struct platform_device *pdev)
 	}
     gpio_set_value(pdata->gpio_clear, 1);
 
+	encoder->accumulatedPosition = 0;
+	encoder->lastPositionSent = 0;
+
+	platform_set_drvdata(pdev, encoder);
+
 	/* request the IRQs */
 	err = request_irq(encoder->irq_a, &rotary_encoder_lite_irq,
 			  IORESOURCE_IRQ_HIGHEDGE,
@@ -129,19 +268,19 @@ static int __devinit rotary_encoder_lite_probe(struct platform_device *pdev)
 		goto exit_free_gpio_b;
 	}
 
-	encoder->accumulatedPosition = 0;
-	encoder->lastPositionSent = 0;
-
-	init_timer(&encoder->timer);
-	encoder->timer.data = (long) encoder;
-	encoder->timer.function = encoder_timer;
-	mod_timer( &encoder->timer, jiffies + ENCODER_REPORT_TIME );
-	
-	platform_set_drvdata(pdev, encoder);
+	err = sysfs_create_group(&pdev->dev.kobj, &rotary_encoder_lite_attr_group);
+	if (err) {
+		dev_err(&pdev->dev, "unable to create sysfs attributes\n");
+		goto exit_free_irq;
+	}
 
 	return 0;
 
+exit_free_irq:
+	free_irq(encoder->irq_a, encoder);
+	hrtimer_cancel(&encoder->timer);
 exit_free_gpio_b:
+	platform_set_drvdata(pdev, NULL);
 	gpio_free(pdata->gpio_b);
 exit_free_gpio_a:
 	gpio_free(pdata->gpio_a);
@@ -159,8 +298,9 @@ static int __devexit rotary_encoder_lite_remove(struct platform_device *pdev)
 	struct rotary_encoder_lite *encoder = platform_get_drvdata(pdev);
 	struct rotary_encoder_lite_platform_data *pdata = pdev->dev.platform_data;
 
-	del_timer_sync(&encoder->timer);
+	sysfs_remove_group(&pdev->dev.kobj, &rotary_encoder_lite_attr_group);
 	free_irq(encoder->irq_a, encoder);
+	hrtimer_cancel(&encoder->timer);
 	gpio_free(pdata->gpio_a);
 	gpio_free(pdata->gpio_b);
 	input_unregister_device(encoder->input);
@@ -33,6 +33,9 @@
 #include <linux/platform_device.h>
 #include <linux/clk.h>
 #include <linux/err.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/uaccess.h>
 
 #include <linux/regulator/machine.h>
 
@@ -244,8 +247,24 @@ struct twl_client {
 	/* max numb of i2c_msg required is for read =2 */
 	struct i2c_msg xfer_msg[2];
 
-	/* To lock access to xfer_msg */
+	/* To lock access to xfer_msg, and to the register cache */
 	struct mutex xfer_lock;
+
+	/*
+	 * Register cache, indexed by address within the slave. vmask has
+	 * the bits of each register that change without being written,
+	 * 0xff for registers that are not cached at all.
+	 */
+	u8 cache[256];
+	u8 vmask[256];
+	DECLARE_BITMAP(valid, 256);
+	DECLARE_BITMAP(dirty, 256);
+
+	/* task between twl_i2c_cache_begin() and twl_i2c_cache_commit() */
+	struct task_struct *batch_owner;
+	u8 batch_buf[256 + 1];
+	unsigned batch_xfers;
+	unsigned batch_regs;
 };
 
 static struct twl_client twl_modules[TWL_NUM_SLAVES];
@@ -332,52 +351,217 @@ static struct twl_mapping twl6030_map[] = {
 
 /*----------------------------------------------------------------------*/
 
-/* Exported Functions */
-
-/**
- * twl_i2c_write - Writes a n bit register in TWL4030/TWL5030/TWL60X0
- * @mod_no: module number
- * @value: an array of num_bytes+1 containing data to write
- * @reg: register address (just offset will do)
- * @num_bytes: number of bytes to transfer
+/*
+ * Register cache
  *
- * IMPORTANT: for 'value' parameter: Allocate value num_bytes+1 and
- * valid data starts at Offset 1.
+ * Most registers of the TWL4030 family only change when we write them,
+ * yet the sub-drivers read-modify-write them all the time. The ranges
+ * below are kept in RAM: reads are served from the cache once it holds
+ * the register, writes go through to the chip unless they would not
+ * change anything. Registers outside them always go to the chip, as do
+ * reads of registers with bits that move on their own (the STATE
+ * nibble of the regulator DEV_GRP registers). Those bits must be read
+ * only, twl_i2c_update_bits() writes back whatever the cache has.
  *
- * Returns the result of operation - 0 is success
+ * Left out on purpose: status, interrupt status and data registers,
+ * the GPIO data outputs (changed through the SET/CLEAR registers), the
+ * USB PHY (ULPI set/clear aliases), the SMPS voltages (SmartReflex) and
+ * everything in PM_MASTER (protection keys, sequencer).
  */
-int twl_i2c_write(u8 mod_no, u8 *value, u8 reg, unsigned num_bytes)
+struct twl_cache_range {
+	u8 mod_no;
+	u8 first;
+	u8 last;
+	u8 volatile_bits;
+};
+
+/* DEV_GRP, TYPE, REMAP, DEDICATED */
+#define TWL4030_LDO_CACHE(base)						\
+	{ TWL4030_MODULE_PM_RECEIVER, (base), (base), 0x0f },		\
+	{ TWL4030_MODULE_PM_RECEIVER, (base) + 1, (base) + 3, 0 }
+
+static const struct twl_cache_range twl4030_cache_ranges[] = {
+	TWL4030_LDO_CACHE(0x17),	/* VAUX1 */
+	TWL4030_LDO_CACHE(0x1b),	/* VAUX2 */
+	TWL4030_LDO_CACHE(0x1f),	/* VAUX3 */
+	TWL4030_LDO_CACHE(0x23),	/* VAUX4 */
+	TWL4030_LDO_CACHE(0x27),	/* VMMC1 */
+	TWL4030_LDO_CACHE(0x2b),	/* VMMC2 */
+	TWL4030_LDO_CACHE(0x2f),	/* VPLL1 */
+	TWL4030_LDO_CACHE(0x33),	/* VPLL2 */
+	TWL4030_LDO_CACHE(0x37),	/* VSIM */
+	TWL4030_LDO_CACHE(0x3b),	/* VDAC */
+	TWL4030_LDO_CACHE(0x3f),	/* VINTANA1 */
+	TWL4030_LDO_CACHE(0x43),	/* VINTANA2 */
+	TWL4030_LDO_CACHE(0x47),	/* VINTDIG */
+	TWL4030_LDO_CACHE(0x4b),	/* VIO */
+
+	{ TWL4030_MODULE_GPIO, REG_GPIODATADIR1, REG_GPIODATADIR3, 0 },
+	{ TWL4030_MODULE_GPIO, REG_GPIO_DEBEN1, REG_GPIOPUPDCTR5, 0 },
+	{ TWL4030_MODULE_GPIO, REG_GPIO_IMR1A, REG_GPIO_IMR3A, 0 },
+	{ TWL4030_MODULE_GPIO, REG_GPIO_IMR1B, REG_GPIO_IMR3B, 0 },
+	{ TWL4030_MODULE_GPIO, REG_GPIO_EDR1, REG_GPIO_SIH_CTRL, 0 },
+
+	/* CTRL1, CTRL2, conversion selects and averaging */
+	{ TWL4030_MODULE_MADC, 0x00, 0x0d, 0 },
+
+	{ TWL4030_MODULE_INT, TWL4030_INT_PWR_IMR1, TWL4030_INT_PWR_IMR1, 0 },
+	{ TWL4030_MODULE_INT, TWL4030_INT_PWR_IMR2, TWL4030_INT_PWR_IMR2, 0 },
+	{ TWL4030_MODULE_INT, TWL4030_INT_PWR_EDR1, TWL4030_INT_PWR_SIH_CTRL, 0 },
+
+	/* alarm, interrupt enables, compensation */
+	{ TWL4030_MODULE_RTC, 0x07, 0x0c, 0 },
+	{ TWL4030_MODULE_RTC, 0x0f, 0x11, 0 },
+};
+
+/* Per module counters, in debugfs */
+struct twl_cache_stats {
+	unsigned hits;
+	unsigned misses;
+	unsigned writes;
+	unsigned writes_skipped;
+	unsigned writes_deferred;
+};
+
+static struct twl_cache_stats twl_cache_stats[TWL_MODULE_LAST + 1];
+
+static void twl_cache_init(void)
 {
-	int ret;
-	int sid;
+	const struct twl_cache_range *range;
 	struct twl_client *twl;
-	struct i2c_msg *msg;
+	unsigned i, addr;
 
-	if (unlikely(mod_no > TWL_MODULE_LAST)) {
-		pr_err("%s: invalid module number %d\n", DRIVER_NAME, mod_no);
-		return -EPERM;
+	for (i = 0; i < TWL_NUM_SLAVES; i++) {
+		twl = &twl_modules[i];
+		memset(twl->vmask, 0xff, sizeof(twl->vmask));
+		bitmap_zero(twl->valid, 256);
+		bitmap_zero(twl->dirty, 256);
 	}
-	sid = twl_map[mod_no].sid;
-	twl = &twl_modules[sid];
 
-	if (unlikely(!inuse)) {
-		pr_err("%s: client %d is not initialized\n", DRIVER_NAME, sid);
-		return -EPERM;
+	if (!twl_class_is_4030())
+		return;
+
+	for (i = 0; i < ARRAY_SIZE(twl4030_cache_ranges); i++) {
+		range = &twl4030_cache_ranges[i];
+		twl = &twl_modules[twl_map[range->mod_no].sid];
+		for (addr = range->first; addr <= range->last; addr++)
+			twl->vmask[twl_map[range->mod_no].base + addr] =
+				range->volatile_bits;
+	}
+}
+
+/* Everything in the cache, none of it moving */
+static bool twl_cache_read(struct twl_client *twl, u8 *value, u8 addr,
+			   unsigned num_bytes)
+{
+	unsigned i;
+
+	for (i = 0; i < num_bytes; i++) {
+		if (twl->vmask[(u8)(addr + i)] ||
+		    !test_bit((u8)(addr + i), twl->valid))
+			return false;
 	}
+
+	for (i = 0; i < num_bytes; i++)
+		value[i] = twl->cache[(u8)(addr + i)];
+
+	return true;
+}
+
+static void twl_cache_fill(struct twl_client *twl, const u8 *value, u8 addr,
+			   unsigned num_bytes)
+{
+	unsigned i;
+
+	for (i = 0; i < num_bytes; i++) {
+		if (twl->vmask[(u8)(addr + i)] == 0xff)
+			continue;
+
+		twl->cache[(u8)(addr + i)] = value[i];
+		set_bit((u8)(addr + i), twl->valid);
+		clear_bit((u8)(addr + i), twl->dirty);
+	}
+}
+
+/* Would writing value change any of the bits we own? */
+static bool twl_cache_same(struct twl_client *twl, const u8 *value, u8 addr,
+			   unsigned num_bytes)
+{
+	unsigned i;
+	u8 a;
+
+	for (i = 0; i < num_bytes; i++) {
+		a = addr + i;
+		if (twl->vmask[a] == 0xff || !test_bit(a, twl->valid) ||
+		    ((twl->cache[a] ^ value[i]) & ~twl->vmask[a]))
+			return false;
+	}
+
+	return true;
+}
+
+/* Only the bytes that change need to go out at twl_cache_commit() */
+static void twl_cache_defer(struct twl_client *twl, const u8 *value, u8 addr,
+			    unsigned num_bytes)
+{
+	unsigned i;
+	u8 a;
+
+	for (i = 0; i < num_bytes; i++) {
+		a = addr + i;
+		if (test_bit(a, twl->valid) && twl->cache[a] == value[i])
+			continue;
+
+		twl->cache[a] = value[i];
+		set_bit(a, twl->valid);
+		set_bit(a, twl->dirty);
+	}
+}
+
+/* Writes to these can wait in the cache for twl_cache_commit() */
+static bool twl_cache_deferrable(struct twl_client *twl, u8 addr,
+				 unsigned num_bytes)
+{
+	unsigned i;
+
+	if (twl->batch_owner != current)
+		return false;
+
+	for (i = 0; i < num_bytes; i++) {
+		if (twl->vmask[(u8)(addr + i)])
+			return false;
+	}
+
+	return true;
+}
+
+/* The owner of a batch already holds xfer_lock */
+static bool twl_lock(struct twl_client *twl)
+{
+	if (twl->batch_owner == current)
+		return false;
+
 	mutex_lock(&twl->xfer_lock);
-	/*
-	 * [MSG1]: fill the register address data
-	 * fill the data Tx buffer
-	 */
+	return true;
+}
+
+static void twl_unlock(struct twl_client *twl, bool locked)
+{
+	if (locked)
+		mutex_unlock(&twl->xfer_lock);
+}
+
+static int twl_xfer_write(struct twl_client *twl, u8 *buf, unsigned len)
+{
+	struct i2c_msg *msg;
+	int ret;
+
 	msg = &twl->xfer_msg[0];
 	msg->addr = twl->address;
-	msg->len = num_bytes + 1;
+	msg->len = len;
 	msg->flags = 0;
-	msg->buf = value;
-	/* over write the first byte of buffer with the register address */
-	*value = twl_map[mod_no].base + reg;
+	msg->buf = buf;
 	ret = i2c_transfer(twl->client->adapter, twl->xfer_msg, 1);
-	mutex_unlock(&twl->xfer_lock);
 
 	/* i2c_transfer returns number of messages transferred */
 	if (ret != 1) {
@@ -391,44 +575,19 @@ int twl_i2c_write(u8 mod_no, u8 *value, u8 reg, unsigned num_bytes)
 		return 0;
 	}
 }
-EXPORT_SYMBOL(twl_i2c_write);
 
-/**
- * twl_i2c_read - Reads a n bit register in TWL4030/TWL5030/TWL60X0
- * @mod_no: module number
- * @value: an array of num_bytes containing data to be read
- * @reg: register address (just offset will do)
- * @num_bytes: number of bytes to transfer
- *
- * Returns result of operation - num_bytes is success else failure.
- */
-int twl_i2c_read(u8 mod_no, u8 *value, u8 reg, unsigned num_bytes)
+static int twl_xfer_read(struct twl_client *twl, u8 *value, u8 addr,
+			 unsigned num_bytes)
 {
-	int ret;
-	u8 val;
-	int sid;
-	struct twl_client *twl;
 	struct i2c_msg *msg;
+	int ret;
 
-	if (unlikely(mod_no > TWL_MODULE_LAST)) {
-		pr_err("%s: invalid module number %d\n", DRIVER_NAME, mod_no);
-		return -EPERM;
-	}
-	sid = twl_map[mod_no].sid;
-	twl = &twl_modules[sid];
-
-	if (unlikely(!inuse)) {
-		pr_err("%s: client %d is not initialized\n", DRIVER_NAME, sid);
-		return -EPERM;
-	}
-	mutex_lock(&twl->xfer_lock);
 	/* [MSG1] fill the register address data */
 	msg = &twl->xfer_msg[0];
 	msg->addr = twl->address;
 	msg->len = 1;
 	msg->flags = 0;	/* Read the register value */
-	val = twl_map[mod_no].base + reg;
-	msg->buf = &val;
+	msg->buf = &addr;
 	/* [MSG2] fill the data rx buffer */
 	msg = &twl->xfer_msg[1];
 	msg->addr = twl->address;
@@ -436,7 +595,6 @@ int twl_i2c_read(u8 mod_no, u8 *value, u8 reg, unsigned num_bytes)
 	msg->len = num_bytes;	/* only n bytes */
 	msg->buf = value;
 	ret = i2c_transfer(twl->client->adapter, twl->xfer_msg, 2);
-	mutex_unlock(&twl->xfer_lock);
 
 	/* i2c_transfer returns number of messages transferred */
 	if (ret != 2) {
@@ -450,8 +608,368 @@ int twl_i2c_read(u8 mod_no, u8 *value, u8 reg, unsigned num_bytes)
 		return 0;
 	}
 }
+
+/*
+ * Write out the dirty registers of a slave, one transfer per run of
+ * consecutive addresses, the chip auto-increments within a transfer.
+ */
+static int twl_cache_commit(struct twl_client *twl)
+{
+	unsigned addr = 0, len;
+	int ret;
+
+	for (;;) {
+		addr = find_next_bit(twl->dirty, 256, addr);
+		if (addr >= 256)
+			return 0;
+
+		len = 0;
+		twl->batch_buf[0] = addr;
+		while (addr + len < 256 && test_bit(addr + len, twl->dirty)) {
+			twl->batch_buf[1 + len] = twl->cache[addr + len];
+			clear_bit(addr + len, twl->dirty);
+			len++;
+		}
+
+		ret = twl_xfer_write(twl, twl->batch_buf, len + 1);
+		if (ret < 0) {
+			/* the chip may have some of it, trust neither */
+			bitmap_clear(twl->valid, addr, len);
+			return ret;
+		}
+
+		twl->batch_xfers++;
+		twl->batch_regs += len;
+		addr += len;
+	}
+}
+
+static struct twl_client *twl_get_client(u8 mod_no)
+{
+	int sid;
+
+	if (unlikely(mod_no > TWL_MODULE_LAST)) {
+		pr_err("%s: invalid module number %d\n", DRIVER_NAME, mod_no);
+		return NULL;
+	}
+	sid = twl_map[mod_no].sid;
+
+	if (unlikely(!inuse)) {
+		pr_err("%s: client %d is not initialized\n", DRIVER_NAME, sid);
+		return NULL;
+	}
+
+	return &twl_modules[sid];
+}
+
+static int __twl_i2c_write(struct twl_client *twl, u8 mod_no, u8 *value,
+			   u8 reg, unsigned num_bytes)
+{
+	struct twl_cache_stats *stats = &twl_cache_stats[mod_no];
+	u8 addr = twl_map[mod_no].base + reg;
+	int ret;
+
+	stats->writes++;
+
+	if (twl_cache_same(twl, value + 1, addr, num_bytes)) {
+		stats->writes_skipped++;
+		return 0;
+	}
+
+	if (twl_cache_deferrable(twl, addr, num_bytes)) {
+		twl_cache_defer(twl, value + 1, addr, num_bytes);
+		stats->writes_deferred++;
+		return 0;
+	}
+
+	/* keep the order of writes for whatever is still waiting */
+	ret = twl_cache_commit(twl);
+	if (ret < 0)
+		return ret;
+
+	/* over write the first byte of buffer with the register address */
+	*value = addr;
+	ret = twl_xfer_write(twl, value, num_bytes + 1);
+	if (ret == 0)
+		twl_cache_fill(twl, value + 1, addr, num_bytes);
+	else
+		bitmap_clear(twl->valid, addr, num_bytes);
+
+	return ret;
+}
+
+static int __twl_i2c_read(struct twl_client *twl, u8 mod_no, u8 *value,
+			  u8 reg, unsigned num_bytes)
+{
+	struct twl_cache_stats *stats = &twl_cache_stats[mod_no];
+	u8 addr = twl_map[mod_no].base + reg;
+	int ret;
+
+	if (twl_cache_read(twl, value, addr, num_bytes)) {
+		stats->hits++;
+		return 0;
+	}
+
+	stats->misses++;
+
+	ret = twl_xfer_read(twl, value, addr, num_bytes);
+	if (ret == 0)
+		twl_cache_fill(twl, value, addr, num_bytes);
+
+	return ret;
+}
+
+/* Exported Functions */
+
+/**
+ * twl_i2c_write - Writes a n bit register in TWL4030/TWL5030/TWL60X0
+ * @mod_no: module number
+ * @value: an array of num_bytes+1 containing data to write
+ * @reg: register address (just offset will do)
+ * @num_bytes: number of bytes to transfer
+ *
+ * IMPORTANT: for 'value' parameter: Allocate value num_bytes+1 and
+ * valid data starts at Offset 1.
+ *
+ * Returns the result of operation - 0 is success
+ */
+int twl_i2c_write(u8 mod_no, u8 *value, u8 reg, unsigned num_bytes)
+{
+	struct twl_client *twl;
+	bool locked;
+	int ret;
+
+	twl = twl_get_client(mod_no);
+	if (!twl)
+		return -EPERM;
+
+	locked = twl_lock(twl);
+	ret = __twl_i2c_write(twl, mod_no, value, reg, num_bytes);
+	twl_unlock(twl, locked);
+
+	return ret;
+}
+EXPORT_SYMBOL(twl_i2c_write);
+
+/**
+ * twl_i2c_read - Reads a n bit register in TWL4030/TWL5030/TWL60X0
+ * @mod_no: module number
+ * @value: an array of num_bytes containing data to be read
+ * @reg: register address (just offset will do)
+ * @num_bytes: number of bytes to transfer
+ *
+ * Returns result of operation - num_bytes is success else failure.
+ */
+int twl_i2c_read(u8 mod_no, u8 *value, u8 reg, unsigned num_bytes)
+{
+	struct twl_client *twl;
+	bool locked;
+	int ret;
+
+	twl = twl_get_client(mod_no);
+	if (!twl)
+		return -EPERM;
+
+	locked = twl_lock(twl);
+	ret = __twl_i2c_read(twl, mod_no, value, reg, num_bytes);
+	twl_unlock(twl, locked);
+
+	return ret;
+}
 EXPORT_SYMBOL(twl_i2c_read);
 
+/**
+ * twl_i2c_update_bits - Read-modify-write a 8 bit register
+ * @mod_no: module number
+ * @reg: register address (just offset will do)
+ * @mask: bits to change
+ * @value: new value of those bits
+ *
+ * Atomic against other accessors of the chip. For cached registers the
+ * read comes from the cache and the write is skipped when nothing
+ * changes, so this costs at most one I2C transfer.
+ *
+ * Returns the result of operation - 0 is success
+ */
+int twl_i2c_update_bits(u8 mod_no, u8 reg, u8 mask, u8 value)
+{
+	struct twl_client *twl;
+	u8 buf[2];
+	u8 addr;
+	bool locked;
+	int ret = 0;
+
+	twl = twl_get_client(mod_no);
+	if (!twl)
+		return -EPERM;
+
+	addr = twl_map[mod_no].base + reg;
+
+	locked = twl_lock(twl);
+	if (twl->vmask[addr] != 0xff && !(twl->vmask[addr] & mask) &&
+	    test_bit(addr, twl->valid)) {
+		buf[1] = twl->cache[addr];
+		twl_cache_stats[mod_no].hits++;
+	} else {
+		ret = __twl_i2c_read(twl, mod_no, &buf[1], reg, 1);
+	}
+
+	if (ret == 0) {
+		buf[1] = (buf[1] & ~mask) | (value & mask);
+		ret = __twl_i2c_write(twl, mod_no, buf, reg, 1);
+	}
+	twl_unlock(twl, locked);
+
+	return ret;
+}
+EXPORT_SYMBOL(twl_i2c_update_bits);
+
+/**
+ * twl_i2c_cache_begin - start a batch of register writes
+ * @mod_no: module number
+ *
+ * Until twl_i2c_cache_commit(), writes from this task to cached
+ * registers of the module's slave only update the cache, and other
+ * tasks wait to access the slave. Writes to other registers flush the
+ * batch first, so the chip sees the writes in the order they were
+ * made. May sleep.
+ */
+void twl_i2c_cache_begin(u8 mod_no)
+{
+	struct twl_client *twl;
+
+	twl = twl_get_client(mod_no);
+	if (!twl)
+		return;
+
+	mutex_lock(&twl->xfer_lock);
+	twl->batch_owner = current;
+}
+EXPORT_SYMBOL(twl_i2c_cache_begin);
+
+/**
+ * twl_i2c_cache_commit - write out a batch of register writes
+ * @mod_no: module number, as passed to twl_i2c_cache_begin()
+ *
+ * Consecutive registers go out in a single transfer.
+ *
+ * Returns the result of operation - 0 is success
+ */
+int twl_i2c_cache_commit(u8 mod_no)
+{
+	struct twl_client *twl;
+	int ret;
+
+	twl = twl_get_client(mod_no);
+	if (!twl)
+		return -EPERM;
+
+	if (WARN_ON(twl->batch_owner != current))
+		return -EINVAL;
+
+	ret = twl_cache_commit(twl);
+	twl->batch_owner = NULL;
+	mutex_unlock(&twl->xfer_lock);
+
+	return ret;
+}
+EXPORT_SYMBOL(twl_i2c_cache_commit);
+
+#ifdef CONFIG_DEBUG_FS
+
+static const char *twl4030_module_names[TWL4030_MODULE_LAST + 1] = {
+	"usb", "audio_voice", "gpio", "intbr", "pih", "test",
+	"keypad", "madc", "interrupts", "led", "main_charge", "precharge",
+	"pwm0", "pwm1", "pwma", "pwmb", "accessory", "interrupts2",
+	"backup", "int", "pm_master", "pm_receiver", "rtc", "secured_reg",
+};
+
+static int twl_cache_show(struct seq_file *s, void *unused)
+{
+	struct twl_cache_stats *stats;
+	unsigned i;
+
+	seq_printf(s, "%-12s %8s %8s %8s %8s %8s\n", "module", "hits",
+		   "misses", "writes", "skipped", "deferred");
+
+	for (i = 0; i <= TWL_MODULE_LAST; i++) {
+		stats = &twl_cache_stats[i];
+		if (!stats->hits && !stats->misses && !stats->writes)
+			continue;
+
+		if (twl_class_is_4030())
+			seq_printf(s, "%-12s", twl4030_module_names[i]);
+		else
+			seq_printf(s, "%-12u", i);
+
+		seq_printf(s, " %8u %8u %8u %8u %8u\n", stats->hits,
+			   stats->misses, stats->writes,
+			   stats->writes_skipped, stats->writes_deferred);
+	}
+
+	seq_printf(s, "\n%-12s %8s %8s\n", "slave", "batches", "regs");
+	for (i = 0; i < TWL_NUM_SLAVES; i++)
+		seq_printf(s, "0x%02x%8s %8u %8u\n", twl_modules[i].address,
+			   "", twl_modules[i].batch_xfers,
+			   twl_modules[i].batch_regs);
+
+	return 0;
+}
+
+static int twl_cache_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, twl_cache_show, inode->i_private);
+}
+
+static ssize_t twl_cache_write(struct file *file, const char __user *buf,
+			       size_t count, loff_t *ppos)
+{
+	unsigned i;
+
+	/* any write clears the counters */
+	memset(twl_cache_stats, 0, sizeof(twl_cache_stats));
+	for (i = 0; i < TWL_NUM_SLAVES; i++) {
+		twl_modules[i].batch_xfers = 0;
+		twl_modules[i].batch_regs = 0;
+	}
+
+	return count;
+}
+
+static const struct file_operations twl_cache_fops = {
+	.open		= twl_cache_open,
+	.read		= seq_read,
+	.write		= twl_cache_write,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static struct dentry *twl_cache_dentry;
+
+static void twl_cache_debugfs_init(void)
+{
+	twl_cache_dentry = debugfs_create_file("twl_cache", S_IRUGO | S_IWUSR,
+					       NULL, NULL, &twl_cache_fops);
+}
+
+static void twl_cache_debugfs_exit(void)
+{
+	debugfs_remove(twl_cache_dentry);
+	twl_cache_dentry = NULL;
+}
+
+#else
+
+static inline void twl_cache_debugfs_init(void)
+{
+}
+
+static inline void twl_cache_debugfs_exit(void)
+{
+}
+
+#endif
+
 /**
  * twl_i2c_write_u8 - Writes a 8 bit register in TWL4030/TWL5030/TWL60X0
  * @mod_no: module number
@@ -978,6 +1496,29 @@ static int twl_remove(struct i2c_client *client)
 		twl_modules[i].client = NULL;
 	}
 	inuse = false;
+	twl_cache_debugfs_exit();
+	return 0;
+}
+
+/*
+ * The sleep scripts and the power state machine change registers while
+ * the system is down, so forget what the cache holds and read it back
+ * from the chip as it is asked for. Writes stay write-through across
+ * suspend: devices that suspend after us still reach the chip.
+ */
+static int twl_resume(struct i2c_client *client)
+{
+	struct twl_client *twl;
+	unsigned i;
+
+	for (i = 0; i < TWL_NUM_SLAVES; i++) {
+		twl = &twl_modules[i];
+
+		mutex_lock(&twl->xfer_lock);
+		bitmap_zero(twl->valid, 256);
+		mutex_unlock(&twl->xfer_lock);
+	}
+
 	return 0;
 }
 
@@ -1056,6 +1597,9 @@ static int twl_probe(struct i2c_client *client, const struct i2c_device_id *id)
 		twl_map = &twl4030_map[0];
 	}
 
+	twl_cache_init();
+	twl_cache_debugfs_init();
+
 	/* setup clock framework */
 	clocks_init(&client->dev, pdata->clock);
 
@@ -1107,6 +1651,7 @@ static struct i2c_driver twl_driver = {
 	.id_table	= twl_ids,
 	.probe		= twl_probe,
 	.remove		= twl_remove,
+	.resume		= twl_resume,
 };
 
 static int __init twl_init(void)
@@ -30,8 +30,12 @@
 #include <linux/init.h>
 #include <linux/interrupt.h>
 #include <linux/irq.h>
-#include <linux/kthread.h>
+#include <linux/ktime.h>
+#include <linux/mutex.h>
+#include <linux/sched.h>
 #include <linux/slab.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
 
 #include <linux/i2c/twl.h>
 
@@ -278,86 +282,81 @@ static const struct sih sih_modules_twl5031[8] = {
 
 static unsigned twl4030_irq_base;
 
-static struct completion irq_event;
-
 /*
- * This thread processes interrupts reported by the Primary Interrupt Handler.
+ * IRQ-to-handler latency, per source: from the PIH line going active to
+ * the nested handler being called.  That covers the irq thread wakeup
+ * and the PIH and SIH status reads in between.
  */
-static int twl4030_irq_thread(void *data)
-{
-	long irq = (long)data;
-	//static unsigned i2c_errors;                         Unused - quiet compiler
-	//static const unsigned max_i2c_errors = 100;         Unused - quiet compiler
+struct twl4030_irq_stats {
+	u32	count;
+	u32	max_ns;
+	u64	total_ns;
+};
 
+static struct twl4030_irq_stats twl4030_pih_stats[8];
 
-	current->flags |= PF_NOFREEZE;
+/* when the PIH line last went active */
+static ktime_t twl4030_irq_time;
 
-	while (!kthread_should_stop()) {
-		int ret;
-		int module_irq;
-		u8 pih_isr;
+/* the PIH irq thread, while it runs handlers */
+static struct task_struct *twl4030_irq_task;
 
-		/* Wait for IRQ, then read PIH irq status (also blocking) */
-		wait_for_completion_interruptible(&irq_event);
+static void twl4030_sih_flush(void);
 
-		ret = twl_i2c_read_u8(TWL4030_MODULE_PIH, &pih_isr,
-					  REG_PIH_ISR_P1);
-		if (ret) {
-			printk(KERN_ERR "twl4030: I2C error %d reading PIH ISR in %s\n",
-                               ret,
-                               __func__);
-			complete(&irq_event);
-			continue;
-		}
+static void twl4030_irq_dispatch(unsigned irq, struct twl4030_irq_stats *stats)
+{
+	u32 ns = ktime_to_ns(ktime_sub(ktime_get(), twl4030_irq_time));
 
-		/* these handlers deal with the relevant SIH irq status */
-		local_irq_disable();
-		for (module_irq = twl4030_irq_base;
-				pih_isr;
-				pih_isr >>= 1, module_irq++) {
-			if (pih_isr & 0x1) {
-				struct irq_desc *d = irq_to_desc(module_irq);
-
-				if (!d) {
-					pr_err("twl4030: Invalid SIH IRQ: %d\n",
-					       module_irq);
-                                        local_irq_enable();
-                                        enable_irq(irq);
-                                        continue;
-				}
-
-				/* These can't be masked ... always warn
-				 * if we get any surprises.
-				 */
-				if (d->status & IRQ_DISABLED)
-					note_interrupt(module_irq, d,
-							IRQ_NONE);
-				else
-					d->handle_irq(module_irq, d);
-			}
-		}
-		local_irq_enable();
+	stats->count++;
+	stats->total_ns += ns;
+	if (ns > stats->max_ns)
+		stats->max_ns = ns;
 
-		enable_irq(irq);
-	}
+	handle_nested_irq(irq);
+}
 
-	return 0;
+/*
+ * twl4030_pih_irq() is the hardirq half of the twl4030 interrupt.  We can't
+ * do i2c transactions in interrupt context, so all it does is note the time;
+ * IRQF_ONESHOT keeps the line masked until handle_twl4030_pih() is done.
+ */
+static irqreturn_t twl4030_pih_irq(int irq, void *devid)
+{
+	twl4030_irq_time = ktime_get();
+	return IRQ_WAKE_THREAD;
 }
 
 /*
- * handle_twl4030_pih() is the desc->handle method for the twl4030 interrupt.
- * This is a chained interrupt, so there is no desc->action method for it.
- * Now we need to query the interrupt controller in the twl4030 to determine
- * which module is generating the interrupt request.  However, we can't do i2c
- * transactions in interrupt context, so we must defer that work to a kernel
- * thread.  All we do here is acknowledge and mask the interrupt and wakeup
- * the kernel thread.
+ * handle_twl4030_pih() is the irq thread for the twl4030 interrupt.  It
+ * queries the PIH to determine which modules are generating the interrupt
+ * request and calls their handlers nested in this thread; the SIH handlers
+ * do the same for the interrupts of their module.
  */
 static irqreturn_t handle_twl4030_pih(int irq, void *devid)
 {
-	/* Acknowledge, clear *AND* mask the interrupt... */
-	disable_irq_nosync(irq);
-	complete(devid);
+	int	ret;
+	int	bit;
+	u8	pih_isr;
+
+	ret = twl_i2c_read_u8(TWL4030_MODULE_PIH, &pih_isr, REG_PIH_ISR_P1);
+	if (ret) {
+		pr_err("twl4030: I2C error %d reading PIH ISR\n", ret);
+		return IRQ_NONE;
+	}
+
+	twl4030_irq_task = current;
+	while (pih_isr) {
+		bit = __ffs(pih_isr);
+		pih_isr &= ~BIT(bit);
+
+		twl4030_irq_dispatch(twl4030_irq_base + bit,
+				&twl4030_pih_stats[bit]);
+	}
+	twl4030_irq_task = NULL;
+
+	/* mask and trigger changes the handlers made, one write each */
+	twl4030_sih_flush();
+
 	return IRQ_HANDLED;
 }
 /*----------------------------------------------------------------------*/
@@ -473,47 +472,40 @@ static inline void activate_irq(int irq)
 
 /*----------------------------------------------------------------------*/
 
-static DEFINE_SPINLOCK(sih_agent_lock);
-
-static struct workqueue_struct *wq;
-
 struct sih_agent {
 	int			irq_base;
 	const struct sih	*sih;
 
 	u32			imr;
 	bool			imr_change_pending;
-	struct work_struct	mask_work;
 
 	u32			edge_change;
-	struct work_struct	edge_work;
+
+	struct mutex		irq_lock;
+	char			*irq_name;
+
+	struct twl4030_irq_stats *stats;
 };
 
-static void twl4030_sih_do_mask(struct work_struct *work)
+/* indexed like sih_modules, NULL until twl4030_sih_setup() */
+static struct sih_agent *sih_agents[8];
+
+static void twl4030_sih_do_mask(struct sih_agent *agent)
 {
-	struct sih_agent	*agent;
-	const struct sih	*sih;
+	const struct sih	*sih = agent->sih;
 	union {
 		u8	bytes[4];
 		u32	word;
 	}			imr;
 	int			status;
 
-	agent = container_of(work, struct sih_agent, mask_work);
-
-	/* see what work we have */
-	spin_lock_irq(&sih_agent_lock);
-	if (agent->imr_change_pending) {
-		sih = agent->sih;
-		/* byte[0] gets overwritten as we write ... */
-		imr.word = cpu_to_le32(agent->imr << 8);
-		agent->imr_change_pending = false;
-	} else
-		sih = NULL;
-	spin_unlock_irq(&sih_agent_lock);
-	if (!sih)
+	if (!agent->imr_change_pending)
 		return;
 
+	/* byte[0] gets overwritten as we write ... */
+	imr.word = cpu_to_le32(agent->imr << 8);
+	agent->imr_change_pending = false;
+
 	/* write the whole mask ... simpler than subsetting it */
 	status = twl_i2c_write(sih->module, imr.bytes,
 			sih->mask[irq_line].imr_offset, sih->bytes_ixr);
@@ -522,29 +514,21 @@ static void twl4030_sih_do_mask(struct work_struct *work)
 				"write", status);
 }
 
-static void twl4030_sih_do_edge(struct work_struct *work)
+static void twl4030_sih_do_edge(struct sih_agent *agent)
 {
-	struct sih_agent	*agent;
-	const struct sih	*sih;
+	const struct sih	*sih = agent->sih;
 	u8			bytes[6];
-	u32			edge_change;
+	u32			edge_change = agent->edge_change;
 	int			status;
 
-	agent = container_of(work, struct sih_agent, edge_work);
+	if (!edge_change)
+		return;
 
-	/* see what work we have */
-	spin_lock_irq(&sih_agent_lock);
-	edge_change = agent->edge_change;
 	agent->edge_change = 0;
-	sih = edge_change ? agent->sih : NULL;
-	spin_unlock_irq(&sih_agent_lock);
-	if (!sih)
-		return;
 
-	/* Read, reserving first byte for write scratch.  Yes, this
-	 * could be cached for some speedup ... but be careful about
-	 * any processor on the other IRQ line, EDR registers are
-	 * shared.
+	/* Read, reserving first byte for write scratch.  twl-core answers
+	 * this from its register cache where it keeps one; be careful about
+	 * any processor on the other IRQ line, EDR registers are shared.
 	 */
 	status = twl_i2c_read(sih->module, bytes + 1,
 			sih->edr_offset, sih->bytes_edr);
@@ -587,69 +571,117 @@ static void twl4030_sih_do_edge(struct work_struct *work)
 				"write", status);
 }
 
+/*
+ * caller holds agent->irq_lock
+ *
+ * EDR and IMR are in twl-core's register cache, so as one batch only
+ * the bytes that actually changed reach the chip, in one go.
+ */
+static void twl4030_sih_sync(struct sih_agent *agent)
+{
+	int status;
+
+	if (!agent->edge_change && !agent->imr_change_pending)
+		return;
+
+	twl_i2c_cache_begin(agent->sih->module);
+	/* triggers first, so nothing gets unmasked with a stale one */
+	twl4030_sih_do_edge(agent);
+	twl4030_sih_do_mask(agent);
+	status = twl_i2c_cache_commit(agent->sih->module);
+	if (status)
+		pr_err("twl4030: %s, %s --> %d\n", __func__,
+				"commit", status);
+}
+
+static void twl4030_sih_flush(void)
+{
+	struct sih_agent	*agent;
+	int			i;
+
+	for (i = 0; i < ARRAY_SIZE(sih_agents); i++) {
+		agent = sih_agents[i];
+		if (!agent)
+			continue;
+
+		mutex_lock(&agent->irq_lock);
+		twl4030_sih_sync(agent);
+		mutex_unlock(&agent->irq_lock);
+	}
+}
+
 /*----------------------------------------------------------------------*/
 
 /*
  * All irq_chip methods get issued from code holding irq_desc[irq].lock,
  * which can't perform the underlying I2C operations (because they sleep).
- * So we must hand them off to a thread (workqueue) and cope with asynch
- * completion, potentially including some re-ordering, of these requests.
+ * They only update the agent's copy of IMR and EDR; the core brackets them
+ * with irq_bus_lock() and irq_bus_sync_unlock(), where the changes get
+ * written.  Changes made by handlers, which run nested in the PIH thread,
+ * are written once that thread is done with all of them.
  */
 
-static void twl4030_sih_mask(unsigned irq)
+static void twl4030_sih_mask(struct irq_data *data)
 {
-	struct sih_agent *sih = get_irq_chip_data(irq);
-	unsigned long flags;
-
-	spin_lock_irqsave(&sih_agent_lock, flags);
-	sih->imr |= BIT(irq - sih->irq_base);
-	sih->imr_change_pending = true;
-	queue_work(wq, &sih->mask_work);
-	spin_unlock_irqrestore(&sih_agent_lock, flags);
+	struct sih_agent *agent = irq_data_get_irq_chip_data(data);
+
+	agent->imr |= BIT(data->irq - agent->irq_base);
+	agent->imr_change_pending = true;
 }
 
-static void twl4030_sih_unmask(unsigned irq)
+static void twl4030_sih_unmask(struct irq_data *data)
 {
-	struct sih_agent *sih = get_irq_chip_data(irq);
-	unsigned long flags;
-
-	spin_lock_irqsave(&sih_agent_lock, flags);
-	sih->imr &= ~BIT(irq - sih->irq_base);
-	sih->imr_change_pending = true;
-	queue_work(wq, &sih->mask_work);
-	spin_unlock_irqrestore(&sih_agent_lock, flags);
+	struct sih_agent *agent = irq_data_get_irq_chip_data(data);
+
+	agent->imr &= ~BIT(data->irq - agent->irq_base);
+	agent->imr_change_pending = true;
 }
 
-static int twl4030_sih_set_type(unsigned irq, unsigned trigger)
+static int twl4030_sih_set_type(struct irq_data *data, unsigned trigger)
 {
-	struct sih_agent *sih = get_irq_chip_data(irq);
-	struct irq_desc *desc = irq_to_desc(irq);
-	unsigned long flags;
+	struct sih_agent *agent = irq_data_get_irq_chip_data(data);
+	struct irq_desc *desc = irq_to_desc(data->irq);
 
 	if (!desc) {
-		pr_err("twl4030: Invalid IRQ: %d\n", irq);
+		pr_err("twl4030: Invalid IRQ: %d\n", data->irq);
 		return -EINVAL;
 	}
 
 	if (trigger & ~(IRQ_TYPE_EDGE_FALLING | IRQ_TYPE_EDGE_RISING))
 		return -EINVAL;
 
-	spin_lock_irqsave(&sih_agent_lock, flags);
 	if ((desc->status & IRQ_TYPE_SENSE_MASK) != trigger) {
 		desc->status &= ~IRQ_TYPE_SENSE_MASK;
 		desc->status |= trigger;
-		sih->edge_change |= BIT(irq - sih->irq_base);
-		queue_work(wq, &sih->edge_work);
+		agent->edge_change |= BIT(data->irq - agent->irq_base);
 	}
-	spin_unlock_irqrestore(&sih_agent_lock, flags);
 	return 0;
 }
 
+static void twl4030_sih_bus_lock(struct irq_data *data)
+{
+	struct sih_agent *agent = irq_data_get_irq_chip_data(data);
+
+	mutex_lock(&agent->irq_lock);
+}
+
+static void twl4030_sih_bus_sync_unlock(struct irq_data *data)
+{
+	struct sih_agent *agent = irq_data_get_irq_chip_data(data);
+
+	/* from a handler: left for twl4030_sih_flush() */
+	if (current != twl4030_irq_task)
+		twl4030_sih_sync(agent);
+	mutex_unlock(&agent->irq_lock);
+}
+
 static struct irq_chip twl4030_sih_irq_chip = {
-	.name		= "twl4030",
-	.mask		= twl4030_sih_mask,
-	.unmask		= twl4030_sih_unmask,
-	.set_type	= twl4030_sih_set_type,
+	.name			= "twl4030",
+	.irq_mask		= twl4030_sih_mask,
+	.irq_unmask		= twl4030_sih_unmask,
+	.irq_set_type		= twl4030_sih_set_type,
+	.irq_bus_lock		= twl4030_sih_bus_lock,
+	.irq_bus_sync_unlock	= twl4030_sih_bus_sync_unlock,
 };
 
 /*----------------------------------------------------------------------*/
@@ -672,25 +704,22 @@ static inline int sih_read_isr(const struct sih *sih)
 }
 
 /*
- * Generic handler for SIH interrupts ... we "know" this is called
- * in task context, with IRQs enabled.
+ * Generic handler for SIH interrupts ... a nested irq thread, called
+ * from handle_twl4030_pih() in task context.
  */
-static void handle_twl4030_sih(unsigned irq, struct irq_desc *desc)
+static irqreturn_t handle_twl4030_sih(int irq, void *data)
 {
-	struct sih_agent *agent = get_irq_data(irq);
+	struct sih_agent *agent = data;
 	const struct sih *sih = agent->sih;
 	int isr;
 
 	/* reading ISR acks the IRQs, using clear-on-read mode */
-	local_irq_enable();
 	isr = sih_read_isr(sih);
-	local_irq_disable();
-
 	if (isr < 0) {
 		pr_err("twl4030: %s SIH, read ISR error %d\n",
 			sih->name, isr);
 		/* REVISIT:  recover; eventually mask it all, etc */
-		return;
+		return IRQ_NONE;
 	}
 
 	while (isr) {
@@ -699,11 +728,13 @@ static void handle_twl4030_sih(unsigned irq, struct irq_desc *desc)
 		isr &= ~BIT(irq);
 
 		if (irq < sih->bits)
-			generic_handle_irq(agent->irq_base + irq);
+			twl4030_irq_dispatch(agent->irq_base + irq,
+					&agent->stats[irq]);
 		else
 			pr_err("twl4030: %s SIH, invalid ISR bit %d\n",
 				sih->name, irq);
 	}
+	return IRQ_HANDLED;
 }
 
 static unsigned twl4030_irq_next;
@@ -740,13 +771,17 @@ int twl4030_sih_setup(int module)
 	if (!agent)
 		return -ENOMEM;
 
-	status = 0;
-
 	agent->irq_base = irq_base;
 	agent->sih = sih;
 	agent->imr = ~0;
-	INIT_WORK(&agent->mask_work, twl4030_sih_do_mask);
-	INIT_WORK(&agent->edge_work, twl4030_sih_do_edge);
+	mutex_init(&agent->irq_lock);
+
+	agent->stats = kcalloc(sih->bits, sizeof *agent->stats, GFP_KERNEL);
+	agent->irq_name = kasprintf(GFP_KERNEL, "twl4030_%s", sih->name);
+	if (!agent->stats || !agent->irq_name) {
+		status = -ENOMEM;
+		goto fail;
+	}
 
 	for (i = 0; i < sih->bits; i++) {
 		irq = irq_base + i;
@@ -754,26 +789,134 @@ int twl4030_sih_setup(int module)
 		set_irq_chip_and_handler(irq, &twl4030_sih_irq_chip,
 				handle_edge_irq);
 		set_irq_chip_data(irq, agent);
+		set_irq_nested_thread(irq, 1);
 		activate_irq(irq);
 	}
 
-	status = irq_base;
-	twl4030_irq_next += i;
+	sih_agents[sih_mod] = agent;
 
-	/* replace generic PIH handler (handle_simple_irq) */
+	/* the PIH irq for this module dispatches its IRQs */
 	irq = sih_mod + twl4030_irq_base;
-	set_irq_data(irq, agent);
-	set_irq_chained_handler(irq, handle_twl4030_sih);
+	status = request_threaded_irq(irq, NULL, handle_twl4030_sih, 0,
+			agent->irq_name, agent);
+	if (status < 0) {
+		pr_err("twl4030: could not claim %s irq %d: %d\n",
+				sih->name, irq, status);
+		sih_agents[sih_mod] = NULL;
+		for (i = 0; i < sih->bits; i++)
+			set_irq_chip_and_handler(irq_base + i, NULL, NULL);
+		goto fail;
+	}
+
+	twl4030_irq_next += sih->bits;
 
 	pr_info("twl4030: %s (irq %d) chaining IRQs %d..%d\n", sih->name,
 			irq, irq_base, twl4030_irq_next - 1);
 
+	return irq_base;
+
+fail:
+	kfree(agent->irq_name);
+	kfree(agent->stats);
+	kfree(agent);
 	return status;
 }
 
 /* FIXME need a call to reverse twl4030_sih_setup() ... */
 
 
+/*----------------------------------------------------------------------*/
+
+#ifdef CONFIG_DEBUG_FS
+
+static void twl4030_irq_show(struct seq_file *s, unsigned irq,
+			     struct twl4030_irq_stats *stats)
+{
+	struct irq_desc *desc = irq_to_desc(irq);
+	u64 avg_ns;
+
+	if (!stats->count)
+		return;
+
+	avg_ns = stats->total_ns;
+	do_div(avg_ns, stats->count);
+
+	seq_printf(s, "%4u %8u %8u %8u  %s\n", irq, stats->count,
+		   (u32)avg_ns / 1000, stats->max_ns / 1000,
+		   desc && desc->action ? desc->action->name : "-");
+}
+
+static int twl4030_irq_stats_show(struct seq_file *s, void *unused)
+{
+	struct sih_agent *agent;
+	unsigned i, j;
+
+	seq_printf(s, "%4s %8s %8s %8s  %s\n", "irq", "count", "avg_us",
+		   "max_us", "handler");
+
+	for (i = 0; i < ARRAY_SIZE(twl4030_pih_stats); i++)
+		twl4030_irq_show(s, twl4030_irq_base + i,
+				 &twl4030_pih_stats[i]);
+
+	for (i = 0; i < ARRAY_SIZE(sih_agents); i++) {
+		agent = sih_agents[i];
+		if (!agent)
+			continue;
+
+		for (j = 0; j < agent->sih->bits; j++)
+			twl4030_irq_show(s, agent->irq_base + j,
+					 &agent->stats[j]);
+	}
+
+	return 0;
+}
+
+static int twl4030_irq_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, twl4030_irq_stats_show, inode->i_private);
+}
+
+static ssize_t twl4030_irq_stats_write(struct file *file,
+				       const char __user *buf,
+				       size_t count, loff_t *ppos)
+{
+	struct sih_agent *agent;
+	unsigned i;
+
+	/* any write clears the counters */
+	memset(twl4030_pih_stats, 0, sizeof(twl4030_pih_stats));
+	for (i = 0; i < ARRAY_SIZE(sih_agents); i++) {
+		agent = sih_agents[i];
+		if (agent)
+			memset(agent->stats, 0,
+			       agent->sih->bits * sizeof(*agent->stats));
+	}
+
+	return count;
+}
+
+static const struct file_operations twl4030_irq_stats_fops = {
+	.open		= twl4030_irq_stats_open,
+	.read		= seq_read,
+	.write		= twl4030_irq_stats_write,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static void twl4030_irq_debugfs_init(void)
+{
+	debugfs_create_file("twl4030_irq", S_IRUGO | S_IWUSR, NULL, NULL,
+			    &twl4030_irq_stats_fops);
+}
+
+#else
+
+static inline void twl4030_irq_debugfs_init(void)
+{
+}
+
+#endif
+
 /*----------------------------------------------------------------------*/
 
 /* FIXME pass in which interrupt line we'll use ... */
@@ -785,7 +928,6 @@ int twl4030_init_irq(int irq_num, unsigned irq_base, unsigned irq_end)
 
 	int			status;
 	int			i;
-	struct task_struct	*task;
 
 	/*
 	 * Mask and clear all TWL4030 interrupts since initially we do
@@ -795,12 +937,6 @@ int twl4030_init_irq(int irq_num, unsigned irq_base, unsigned irq_end)
 	if (status < 0)
 		return status;
 
-	wq = create_singlethread_workqueue("twl4030-irqchip");
-	if (!wq) {
-		pr_err("twl4030: workqueue FAIL\n");
-		return -ESRCH;
-	}
-
 	twl4030_irq_base = irq_base;
 
 	/* install an irq handler for each of the SIH modules;
@@ -809,11 +945,10 @@ int twl4030_init_irq(int irq_num, unsigned irq_base, unsigned irq_end)
 	twl4030_irq_chip = dummy_irq_chip;
 	twl4030_irq_chip.name = "twl4030";
 
-	twl4030_sih_irq_chip.irq_ack = dummy_irq_chip.irq_ack;
-
 	for (i = irq_base; i < irq_end; i++) {
 		set_irq_chip_and_handler(i, &twl4030_irq_chip,
 				handle_simple_irq);
+		set_irq_nested_thread(i, 1);
 		activate_irq(i);
 	}
 	twl4030_irq_next = i;
@@ -828,34 +963,21 @@ int twl4030_init_irq(int irq_num, unsigned irq_base, unsigned irq_end)
 	}
 
 	/* install an irq handler to demultiplex the TWL4030 interrupt */
-
-
-	init_completion(&irq_event);
-
-	status = request_irq(irq_num, handle_twl4030_pih, IRQF_DISABLED,
-				"TWL4030-PIH", &irq_event);
+	status = request_threaded_irq(irq_num, twl4030_pih_irq,
+			handle_twl4030_pih, IRQF_ONESHOT, "TWL4030-PIH", NULL);
 	if (status < 0) {
 		pr_err("twl4030: could not claim irq%d: %d\n", irq_num, status);
 		goto fail_rqirq;
 	}
 
-	task = kthread_run(twl4030_irq_thread, (void *)(long)irq_num,
-								"twl4030-irq");
-	if (IS_ERR(task)) {
-		pr_err("twl4030: could not create irq %d thread!\n", irq_num);
-		status = PTR_ERR(task);
-		goto fail_kthread;
-	}
+	twl4030_irq_debugfs_init();
+
 	return status;
-fail_kthread:
-	free_irq(irq_num, &irq_event);
 fail_rqirq:
 	/* clean up twl4030_sih_setup */
 fail:
 	for (i = irq_base; i < irq_end; i++)
 		set_irq_chip_and_handler(i, NULL, NULL);
-	destroy_workqueue(wq);
-	wq = NULL;
 	return status;
 }
 
@@ -33,23 +33,58 @@
 #include <linux/delay.h>
 #include <linux/platform_device.h>
 #include <linux/slab.h>
+#include <linux/sched.h>
+#include <linux/completion.h>
+#include <linux/workqueue.h>
+#include <linux/kfifo.h>
+#include <linux/ktime.h>
+#include <linux/fs.h>
+#include <linux/miscdevice.h>
+#include <linux/poll.h>
+#include <linux/uaccess.h>
 #include <linux/i2c/twl.h>
 #include <linux/i2c/twl4030-madc.h>
 
+/* Upper bound for a synchronous conversion, including averaging */
+#define TWL4030_MADC_CONVERSION_TIMEOUT_MS	20
+
+/* Continuous-sampling results buffered for readers; power of two */
+#define TWL4030_MADC_SAMPLE_FIFO_SIZE		32
+
 /*
  * struct twl4030_madc_data - a container for madc info
  * @dev - pointer to device structure for madc
  * @lock - mutex protecting this data structire
+ * @sync_lock - Serializes synchronous callers of each method across their wait
  * @requests - Array of request struct corresponding to SW1, SW2 and RT
+ * @done - Signalled by the IRQ thread when a synchronous request completes
+ * @result - Channel count (or error) for a completed synchronous request
  * @imr - Interrupt mask register of MADC
  * @isr - Interrupt status register of MADC
+ * @sample_work - Deferrable work that issues continuous-sampling requests
+ * @sample_channels - Channel bitmap converted in continuous mode
+ * @sample_interval_ms - Continuous sampling period, 0 when stopped
+ * @samples - Continuous-sampling results awaiting userspace
  */
 struct twl4030_madc_data {
    struct device *dev;
    struct mutex lock;  /* mutex protecting this data structire */
+   struct mutex sync_lock[TWL4030_MADC_NUM_METHODS];
    struct twl4030_madc_request requests[TWL4030_MADC_NUM_METHODS];
+   struct completion done[TWL4030_MADC_NUM_METHODS];
+   int result[TWL4030_MADC_NUM_METHODS];
    int imr;
    int isr;
+
+   struct delayed_work sample_work;
+   u16 sample_channels;
+   unsigned int sample_interval_ms;
+   unsigned long sample_overruns;
+   spinlock_t sample_lock;
+   DECLARE_KFIFO(samples, struct twl4030_madc_sample,
+             TWL4030_MADC_SAMPLE_FIFO_SIZE);
+   wait_queue_head_t sample_wait;
+   struct miscdevice miscdev;
 };
 
 static struct twl4030_madc_data *twl4030_madc;
@@ -108,35 +143,6 @@ const struct twl4030_madc_conversion_method twl4030_conversion_methods[] = {
                  },
 };
 
-/*
- * Function to read a particular channel value.
- * @madc - pointer to struct twl4030_madc_data struct
- * @reg - lsb of ADC Channel
- * If the i2c read fails it returns an error else returns 0.
- */
-static int twl4030_madc_channel_raw_read(struct twl4030_madc_data *madc, u8 reg)
-{
-   u8 msb, lsb;
-   int ret;
-   /*
-    * For each ADC channel, we have MSB and LSB register pair. MSB address
-    * is always LSB address+1. reg parameter is the addr of LSB register
-    */
-   ret = twl_i2c_read_u8(TWL4030_MODULE_MADC, &msb, reg + 1);
-   if (ret) {
-       dev_err(madc->dev, "unable to read MSB register 0x%X\n",
-           reg + 1);
-       return ret;
-   }
-   ret = twl_i2c_read_u8(TWL4030_MODULE_MADC, &lsb, reg);
-   if (ret) {
-       dev_err(madc->dev, "unable to read LSB register 0x%X\n", reg);
-       return ret;
-   }
-
-   return (int)(((msb << 8) | lsb) >> 6);
-}
-
 /*
  * Function to read channel values
  * @madc - pointer to twl4030_madc_data struct
@@ -144,45 +150,66 @@ static int twl4030_madc_channel_raw_read(struct twl4030_madc_data *madc, u8 reg)
  * @Channel - 16 bit bitmap. If the bit is set channel value is read
  * @buf - The channel values are stored here. if read fails error
  * value is stored
+ * All requested channels are fetched with a single I2C burst spanning
+ * the lowest to the highest selected channel.
  * Returns the number of successfully read channels.
  */
 static int twl4030_madc_read_channels(struct twl4030_madc_data *madc,
                      u8 reg_base, u16 channels, int *buf)
 {
-   int count = 0, count_req = 0;
-   u8 reg, i;
+   u8 raw[2 * TWL4030_MADC_MAX_CHANNELS];
+   int count = 0;
+   int first, last;
+   int ret;
+   u8 i;
 
-   for (i = 0; i < TWL4030_MADC_MAX_CHANNELS; i++) {
+   if (!channels)
+       return 0;
+
+   first = __ffs(channels);
+   last = __fls(channels);
+
+   /*
+    * For each ADC channel, we have MSB and LSB register pair. MSB address
+    * is always LSB address+1, and consecutive channels are contiguous.
+    */
+   ret = twl_i2c_read(TWL4030_MODULE_MADC, raw, reg_base + 2 * first,
+              2 * (last - first + 1));
+   if (ret) {
+       dev_err(madc->dev, "unable to read registers 0x%X-0x%X\n",
+           reg_base + 2 * first, reg_base + 2 * last + 1);
+       for (i = first; i <= last; i++)
+           if (channels & (1 << i))
+               buf[i] = ret;
+       dev_dbg(madc->dev, "%d channel conversion failed\n",
+           hweight16(channels));
+       return 0;
+   }
+
+   for (i = first; i <= last; i++) {
        if (channels & (1 << i)) {
-           reg = reg_base + 2 * i;
-           buf[i] = twl4030_madc_channel_raw_read(madc, reg);
-           if (buf[i] < 0) {
-               dev_err(madc->dev,
-               "Unable to read register 0x%X\n", reg);
-               count_req++;
-           } else {
-               count++;
-               /* Analog Input (V) = conv_result *
-                *          step_size / R
-                * conv_result = decimal value
-                *       of 10-bit conversion
-                *       result
-                * step size = 1.5 / (2 ^ 10 -1)
-                * R = Prescaler ratio for input
-                *      channels
-                * Result given in mV hence multiplied
-                *  by 1000
-                */
-               buf[i] = (buf[i] * 3 * 1000 *
-               twl4030_divider_ratios[i].denominator)
-               / (2 * 1023 *
-               twl4030_divider_ratios[i].numerator);
-           }
+           u8 lsb = raw[2 * (i - first)];
+           u8 msb = raw[2 * (i - first) + 1];
+
+           buf[i] = ((msb << 8) | lsb) >> 6;
+           count++;
+           /* Analog Input (V) = conv_result *
+            *          step_size / R
+            * conv_result = decimal value
+            *       of 10-bit conversion
+            *       result
+            * step size = 1.5 / (2 ^ 10 -1)
+            * R = Prescaler ratio for input
+            *      channels
+            * Result given in mV hence multiplied
+            *  by 1000
+            */
+           buf[i] = (buf[i] * 3 * 1000 *
+           twl4030_divider_ratios[i].denominator)
+           / (2 * 1023 *
+           twl4030_divider_ratios[i].numerator);
        }
-
    }
-   if (count_req)
-       dev_dbg(madc->dev, "%d channel conversion failed\n", count_req);
 
    return count;
 }
@@ -289,14 +316,17 @@ static irqreturn_t twl4030_madc_threaded_irq_handler(int irq, void *_madc)
        /* Read results */
        len = twl4030_madc_read_channels(madc, method->rbase,
                         r->channels, r->rbuf);
+       /* Free request */
+       r->result_pending = 0;
+       r->active = 0;
        /* Return results to caller */
        if (r->func_cb != NULL) {
            r->func_cb(len, r->channels, r->rbuf);
            r->func_cb = NULL;
+       } else {
+           madc->result[i] = len;
+           complete(&madc->done[i]);
        }
-       /* Free request */
-       r->result_pending = 0;
-       r->active = 0;
    }
    mutex_unlock(&madc->lock);
 
@@ -315,14 +345,17 @@ err_i2c:
        /* Read results */
        len = twl4030_madc_read_channels(madc, method->rbase,
                         r->channels, r->rbuf);
+       /* Free request */
+       r->result_pending = 0;
+       r->active = 0;
        /* Return results to caller */
        if (r->func_cb != NULL) {
            r->func_cb(len, r->channels, r->rbuf);
            r->func_cb = NULL;
+       } else {
+           madc->result[i] = len;
+           complete(&madc->done[i]);
        }
-       /* Free request */
-       r->result_pending = 0;
-       r->active = 0;
    }
    mutex_unlock(&madc->lock);
 
@@ -379,42 +412,6 @@ static int twl4030_madc_start_conversion(struct twl4030_madc_data *madc,
    return 0;
 }
 
-/*
- * Function that waits for conversion to be ready
- * @madc - pointer to twl4030_madc_data struct
- * @timeout_ms - timeout value in mili seconds
- * @status_reg - ctrl register
- * returns 0 if succeeds else a negative error value
- */
-static int twl4030_madc_wait_conversion_ready(struct twl4030_madc_data *madc,
-                         unsigned int timeout_ms,
-                         u8 status_reg)
-{
-   unsigned long timeout;
-   int ret;
-
-   timeout = jiffies + msecs_to_jiffies(timeout_ms);
-   do {
-       u8 reg;
-
-       ret = twl_i2c_read_u8(TWL4030_MODULE_MADC, &reg, status_reg);
-       if (ret) {
-           dev_err(madc->dev,
-               "unable to read status register 0x%X\n",
-               status_reg);
-           return ret;
-       }
-       if (!(reg & TWL4030_MADC_BUSY) && (reg & TWL4030_MADC_EOC_SW))
-           return 0;
-       // XXX
-       // usleep_range(500, 2000);
-       udelay(2000);
-   } while (!time_after(jiffies, timeout));
-   dev_err(madc->dev, "conversion timeout!\n");
-
-   return -EAGAIN;
-}
-
 /*
  * An exported function which can be called from other kernel drivers.
  * @req twl4030_madc_request structure
@@ -427,15 +424,22 @@ int twl4030_madc_conversion(struct twl4030_madc_request *req)
 {
    const struct twl4030_madc_conversion_method *method;
    u8 ch_msb, ch_lsb;
+   bool sync;
    int ret;
 
    if (!req)
        return -EINVAL;
+   if (req->method < TWL4030_MADC_RT || req->method > TWL4030_MADC_SW2)
+       return -EINVAL;
+   /*
+    * Synchronous callers of a method wait their turn rather than
+    * seeing -EBUSY from one another; only callback requests are
+    * turned away while the method is in use.
+    */
+   sync = !(req->type == TWL4030_MADC_IRQ_ONESHOT && req->func_cb != NULL);
+   if (sync)
+       mutex_lock(&twl4030_madc->sync_lock[req->method]);
    mutex_lock(&twl4030_madc->lock);
-   if (req->method < TWL4030_MADC_RT || req->method > TWL4030_MADC_SW2) {
-       ret = -EINVAL;
-       goto out;
-   }
    /* Do we have a conversion request ongoing */
    if (twl4030_madc->requests[req->method].active) {
        ret = -EBUSY;
@@ -492,22 +496,46 @@ int twl4030_madc_conversion(struct twl4030_madc_request *req)
        ret = -EINVAL;
        goto out;
    }
-   ret = twl4030_madc_start_conversion(twl4030_madc, req->method);
+   /*
+    * Synchronous callers are completed by the IRQ thread as well; the
+    * lock is dropped while waiting so other requests can proceed.
+    */
+   req->func_cb = NULL;
+   INIT_COMPLETION(twl4030_madc->done[req->method]);
+   ret = twl4030_madc_set_irq(twl4030_madc, req);
    if (ret < 0)
        goto out;
-   twl4030_madc->requests[req->method].active = 1;
-   /* Wait until conversion is ready (ctrl register returns EOC) */
-   ret = twl4030_madc_wait_conversion_ready(twl4030_madc, 5, method->ctrl);
-   if (ret) {
-       twl4030_madc->requests[req->method].active = 0;
+   ret = twl4030_madc_start_conversion(twl4030_madc, req->method);
+   if (ret < 0) {
+       twl4030_madc_disable_irq(twl4030_madc, req->method);
        goto out;
    }
-   ret = twl4030_madc_read_channels(twl4030_madc, method->rbase,
-                    req->channels, req->rbuf);
-   twl4030_madc->requests[req->method].active = 0;
+   twl4030_madc->requests[req->method].active = 1;
+   mutex_unlock(&twl4030_madc->lock);
+
+   if (!wait_for_completion_timeout(&twl4030_madc->done[req->method],
+           msecs_to_jiffies(TWL4030_MADC_CONVERSION_TIMEOUT_MS))) {
+       mutex_lock(&twl4030_madc->lock);
+       /* The IRQ thread may have raced us to the result */
+       if (!completion_done(&twl4030_madc->done[req->method])) {
+           dev_err(twl4030_madc->dev, "conversion timeout!\n");
+           twl4030_madc_disable_irq(twl4030_madc, req->method);
+           twl4030_madc->requests[req->method].active = 0;
+           ret = -EAGAIN;
+           goto out;
+       }
+   } else {
+       mutex_lock(&twl4030_madc->lock);
+   }
+
+   ret = twl4030_madc->result[req->method];
+   memcpy(req->rbuf, twl4030_madc->requests[req->method].rbuf,
+          sizeof(req->rbuf));
 
 out:
    mutex_unlock(&twl4030_madc->lock);
+   if (sync)
+       mutex_unlock(&twl4030_madc->sync_lock[req->method]);
 
    return ret;
 }
@@ -537,6 +565,199 @@ int twl4030_get_madc_conversion(int channel_no)
 }
 EXPORT_SYMBOL_GPL(twl4030_get_madc_conversion);
 
+/*
+ * Continuous sampling: a deferrable work item issues an asynchronous SW1
+ * conversion every sample_interval_ms, and the IRQ thread queues the
+ * results for readers of /dev/twl4030-madc. SW2 stays available for
+ * synchronous callers.
+ */
+static void twl4030_madc_sample_cb(int len, int channels, int *buf)
+{
+   struct twl4030_madc_data *madc = twl4030_madc;
+   struct twl4030_madc_sample sample;
+   struct timespec ts;
+
+   ktime_get_ts(&ts);
+   sample.tv_sec = ts.tv_sec;
+   sample.tv_nsec = ts.tv_nsec;
+   sample.channels = channels;
+   sample.reserved = 0;
+   memcpy(sample.values, buf, sizeof(sample.values));
+
+   if (!kfifo_in_spinlocked(&madc->samples, &sample, 1, &madc->sample_lock))
+       madc->sample_overruns++;
+
+   wake_up_interruptible(&madc->sample_wait);
+}
+
+static void twl4030_madc_sample_work(struct work_struct *work)
+{
+   struct twl4030_madc_data *madc =
+       container_of(work, struct twl4030_madc_data, sample_work.work);
+   struct twl4030_madc_request req;
+   int ret;
+
+   memset(&req, 0, sizeof(req));
+   req.channels = madc->sample_channels;
+   req.method = TWL4030_MADC_SW1;
+   req.type = TWL4030_MADC_IRQ_ONESHOT;
+   req.func_cb = twl4030_madc_sample_cb;
+
+   ret = twl4030_madc_conversion(&req);
+   if (ret < 0 && ret != -EBUSY)
+       dev_dbg(madc->dev, "continuous conversion failed %d\n", ret);
+
+   if (madc->sample_interval_ms)
+       schedule_delayed_work(&madc->sample_work,
+                     msecs_to_jiffies(madc->sample_interval_ms));
+}
+
+static void twl4030_madc_sample_restart(struct twl4030_madc_data *madc)
+{
+   cancel_delayed_work_sync(&madc->sample_work);
+
+   if (madc->sample_interval_ms && madc->sample_channels)
+       schedule_delayed_work(&madc->sample_work, 0);
+}
+
+static int twl4030_madc_open(struct inode *inode, struct file *file)
+{
+   struct miscdevice *misc = file->private_data;
+
+   file->private_data = container_of(misc, struct twl4030_madc_data,
+                     miscdev);
+
+   return nonseekable_open(inode, file);
+}
+
+static ssize_t twl4030_madc_read(struct file *file, char __user *buf,
+                size_t count, loff_t *ppos)
+{
+   struct twl4030_madc_data *madc = file->private_data;
+   struct twl4030_madc_sample sample;
+   size_t total = 0;
+   int ret;
+
+   if (count < sizeof(sample))
+       return -EINVAL;
+
+   if (kfifo_is_empty(&madc->samples)) {
+       if (file->f_flags & O_NONBLOCK)
+           return -EAGAIN;
+
+       ret = wait_event_interruptible(madc->sample_wait,
+                          !kfifo_is_empty(&madc->samples));
+       if (ret)
+           return ret;
+   }
+
+   while (count - total >= sizeof(sample) &&
+          kfifo_out_spinlocked(&madc->samples, &sample, 1,
+                   &madc->sample_lock)) {
+       if (copy_to_user(buf + total, &sample, sizeof(sample)))
+           return -EFAULT;
+       total += sizeof(sample);
+   }
+
+   return total;
+}
+
+static unsigned int twl4030_madc_poll(struct file *file, poll_table *wait)
+{
+   struct twl4030_madc_data *madc = file->private_data;
+
+   poll_wait(file, &madc->sample_wait, wait);
+
+   if (!kfifo_is_empty(&madc->samples))
+       return POLLIN | POLLRDNORM;
+
+   return 0;
+}
+
+static const struct file_operations twl4030_madc_fops = {
+   .owner = THIS_MODULE,
+   .open = twl4030_madc_open,
+   .read = twl4030_madc_read,
+   .poll = twl4030_madc_poll,
+   .llseek = no_llseek,
+};
+
+static ssize_t show_sample_channels(struct device *dev,
+                   struct device_attribute *attr, char *buf)
+{
+   struct twl4030_madc_data *madc = dev_get_drvdata(dev);
+
+   return sprintf(buf, "0x%04x\n", madc->sample_channels);
+}
+
+static ssize_t store_sample_channels(struct device *dev,
+                    struct device_attribute *attr,
+                    const char *buf, size_t count)
+{
+   struct twl4030_madc_data *madc = dev_get_drvdata(dev);
+   unsigned long channels;
+
+   if (strict_strtoul(buf, 0, &channels) || channels > 0xffff)
+       return -EINVAL;
+
+   madc->sample_channels = channels;
+   twl4030_madc_sample_restart(madc);
+
+   return count;
+}
+
+static ssize_t show_sample_interval(struct device *dev,
+                   struct device_attribute *attr, char *buf)
+{
+   struct twl4030_madc_data *madc = dev_get_drvdata(dev);
+
+   return sprintf(buf, "%u\n", madc->sample_interval_ms);
+}
+
+static ssize_t store_sample_interval(struct device *dev,
+                    struct device_attribute *attr,
+                    const char *buf, size_t count)
+{
+   struct twl4030_madc_data *madc = dev_get_drvdata(dev);
+   unsigned long interval;
+
+   if (strict_strtoul(buf, 0, &interval) || interval > UINT_MAX)
+       return -EINVAL;
+
+   /* Stop first so the work item cannot re-arm with the old period */
+   madc->sample_interval_ms = 0;
+   cancel_delayed_work_sync(&madc->sample_work);
+   madc->sample_interval_ms = interval;
+   twl4030_madc_sample_restart(madc);
+
+   return count;
+}
+
+static ssize_t show_sample_overruns(struct device *dev,
+                   struct device_attribute *attr, char *buf)
+{
+   struct twl4030_madc_data *madc = dev_get_drvdata(dev);
+
+   return sprintf(buf, "%lu\n", madc->sample_overruns);
+}
+
+static DEVICE_ATTR(sample_channels, S_IRUGO | S_IWUSR,
+          show_sample_channels, store_sample_channels);
+static DEVICE_ATTR(sample_interval_ms, S_IRUGO | S_IWUSR,
+          show_sample_interval, store_sample_interval);
+static DEVICE_ATTR(sample_overruns, S_IRUGO, show_sample_overruns, NULL);
+
+static struct attribute *twl4030_madc_attributes[] = {
+   &dev_attr_sample_channels.attr,
+   &dev_attr_sample_interval_ms.attr,
+   &dev_attr_sample_overruns.attr,
+   NULL
+};
+
+static const struct attribute_group twl4030_madc_attr_group = {
+   .attrs = twl4030_madc_attributes,
+};
+
 /*
  * Function to enable or disable bias current for
  * main battery type reading or temperature sensing
@@ -618,6 +839,7 @@ static int __devinit twl4030_madc_probe(struct platform_device *pdev)
    struct twl4030_madc_data *madc;
    struct twl4030_madc_platform_data *pdata = pdev->dev.platform_data;
    int ret;
+   int i;
    u8 regval;
 
    printk("MADC driver.\n");
@@ -689,6 +911,17 @@ static int __devinit twl4030_madc_probe(struct platform_device *pdev)
 
    platform_set_drvdata(pdev, madc);
    mutex_init(&madc->lock);
+   for (i = 0; i < TWL4030_MADC_NUM_METHODS; i++) {
+       mutex_init(&madc->sync_lock[i]);
+       init_completion(&madc->done[i]);
+   }
+   spin_lock_init(&madc->sample_lock);
+   INIT_KFIFO(madc->samples);
+   init_waitqueue_head(&madc->sample_wait);
+   INIT_DELAYED_WORK_DEFERRABLE(&madc->sample_work,
+                    twl4030_madc_sample_work);
+   twl4030_madc = madc;
+
    ret = request_threaded_irq(platform_get_irq(pdev, 0), NULL,
                   twl4030_madc_threaded_irq_handler,
                   IRQF_TRIGGER_RISING, "twl4030_madc", madc);
@@ -696,9 +929,30 @@ static int __devinit twl4030_madc_probe(struct platform_device *pdev)
        dev_dbg(&pdev->dev, "could not request irq\n");
        goto err_irq;
    }
-   twl4030_madc = madc;
+
+   madc->miscdev.minor = MISC_DYNAMIC_MINOR;
+   madc->miscdev.name = "twl4030-madc";
+   madc->miscdev.fops = &twl4030_madc_fops;
+   madc->miscdev.parent = &pdev->dev;
+   ret = misc_register(&madc->miscdev);
+   if (ret) {
+       dev_err(&pdev->dev, "could not register misc device\n");
+       goto err_misc;
+   }
+
+   ret = sysfs_create_group(&pdev->dev.kobj, &twl4030_madc_attr_group);
+   if (ret) {
+       dev_err(&pdev->dev, "could not create sysfs attributes\n");
+       goto err_sysfs;
+   }
+
    return 0;
+err_sysfs:
+   misc_deregister(&madc->miscdev);
+err_misc:
+   free_irq(platform_get_irq(pdev, 0), madc);
 err_irq:
+   twl4030_madc = NULL;
    platform_set_drvdata(pdev, NULL);
 err_i2c:
    twl4030_madc_set_current_generator(madc, 0, 0);
@@ -714,7 +968,12 @@ static int __devexit twl4030_madc_remove(struct platform_device *pdev)
 {
    struct twl4030_madc_data *madc = platform_get_drvdata(pdev);
 
+   sysfs_remove_group(&pdev->dev.kobj, &twl4030_madc_attr_group);
+   madc->sample_interval_ms = 0;
+   cancel_delayed_work_sync(&madc->sample_work);
+   misc_deregister(&madc->miscdev);
    free_irq(platform_get_irq(pdev, 0), madc);
+   twl4030_madc = NULL;
    platform_set_drvdata(pdev, NULL);
    twl4030_madc_set_current_generator(madc, 0, 0);
    twl4030_madc_set_power(madc, 0);
@@ -199,6 +199,70 @@ static void mmc_wait_done(struct mmc_request *mrq)
 	complete(mrq->done_data);
 }
 
+static void mmc_pre_req(struct mmc_host *host, struct mmc_request *mrq,
+		 bool is_first_req)
+{
+	if (host->ops->pre_req)
+		host->ops->pre_req(host, mrq, is_first_req);
+}
+
+/**
+ *	mmc_post_req - release what the host prepared for a request
+ *	@host: MMC host the request was prepared on
+ *	@mrq: MMC request
+ *	@err: non-zero when the request was prepared but never issued
+ *
+ *	Called by mmc_wait_for_req_done(); callers of mmc_start_req()
+ *	that end up not issuing the request they passed as @next must
+ *	call it themselves.
+ */
+void mmc_post_req(struct mmc_host *host, struct mmc_request *mrq, int err)
+{
+	if (host->ops->post_req)
+		host->ops->post_req(host, mrq, err);
+}
+
+EXPORT_SYMBOL(mmc_post_req);
+
+/**
+ *	mmc_start_req - start a request without waiting for it
+ *	@host: MMC host to start command
+ *	@mrq: MMC request to start
+ *	@next: request that will be started next, or NULL
+ *
+ *	Start @mrq and, while it is in flight, let the host prepare
+ *	@next so that it can be issued with less latency once @mrq is
+ *	done. Wait for @mrq with mmc_wait_for_req_done().
+ */
+void mmc_start_req(struct mmc_host *host, struct mmc_request *mrq,
+		   struct mmc_request *next)
+{
+	init_completion(&mrq->completion);
+	mrq->done_data = &mrq->completion;
+	mrq->done = mmc_wait_done;
+
+	mmc_pre_req(host, mrq, true);
+	mmc_start_request(host, mrq);
+
+	if (next)
+		mmc_pre_req(host, next, false);
+}
+
+EXPORT_SYMBOL(mmc_start_req);
+
+/**
+ *	mmc_wait_for_req_done - wait for a request started by mmc_start_req
+ *	@host: MMC host the request was started on
+ *	@mrq: MMC request to wait for
+ */
+void mmc_wait_for_req_done(struct mmc_host *host, struct mmc_request *mrq)
+{
+	wait_for_completion(&mrq->completion);
+	mmc_post_req(host, mrq, 0);
+}
+
+EXPORT_SYMBOL(mmc_wait_for_req_done);
+
 /**
  *	mmc_wait_for_req - start a request and wait for completion
  *	@host: MMC host to start command
@@ -210,14 +274,8 @@ static void mmc_wait_done(struct mmc_request *mrq)
  */
 void mmc_wait_for_req(struct mmc_host *host, struct mmc_request *mrq)
 {
-	DECLARE_COMPLETION_ONSTACK(complete);
-
-	mrq->done_data = &complete;
-	mrq->done = mmc_wait_done;
-
-	mmc_start_request(host, mrq);
-
-	wait_for_completion(&complete);
+	mmc_start_req(host, mrq, NULL);
+	mmc_wait_for_req_done(host, mrq);
 }
 
 EXPORT_SYMBOL(mmc_wait_for_req);
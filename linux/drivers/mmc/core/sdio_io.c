@@ -9,6 +9,7 @@
  * your option) any later version.
  */
 
+#include <linux/dma-mapping.h>
 #include <linux/mmc/host.h>
 #include <linux/mmc/card.h>
 #include <linux/mmc/sdio.h>
@@ -295,58 +296,99 @@ unsigned int sdio_align_size(struct sdio_func *func, unsigned int sz)
 }
 EXPORT_SYMBOL_GPL(sdio_align_size);
 
+/* Set up the IO_RW_EXTENDED command for the next part of a transfer:
+ * block mode for the bulk of it (if supported), byte mode for the
+ * remainder. Advances buf, addr and remainder past it. */
+static int sdio_io_rw_ext_next(struct sdio_func *func,
+	struct mmc_io_rw_ext *io, int write, unsigned *addr, int incr_addr,
+	u8 **buf, unsigned *remainder, unsigned max_blocks)
+{
+	unsigned blocks, blksz, size;
+	int ret;
+
+	if (max_blocks && *remainder > func->cur_blksize) {
+		blocks = min(*remainder / func->cur_blksize, max_blocks);
+		blksz = func->cur_blksize;
+	} else {
+		blocks = 1;
+		blksz = min(*remainder, sdio_max_byte_size(func));
+	}
+
+	ret = mmc_io_rw_extended_prep(func->card, io, write, func->num,
+		*addr, incr_addr, *buf, blocks, blksz);
+	if (ret)
+		return ret;
+
+	size = blocks * blksz;
+	*remainder -= size;
+	*buf += size;
+	if (incr_addr)
+		*addr += size;
+	return 0;
+}
+
 /* Split an arbitrarily sized data transfer into several
- * IO_RW_EXTENDED commands. */
+ * IO_RW_EXTENDED commands. Each command is handed to the host while
+ * the one before it is still on the bus, so the host can have its
+ * DMA set up by the time it is issued. */
 static int sdio_io_rw_ext_helper(struct sdio_func *func, int write,
 	unsigned addr, int incr_addr, u8 *buf, unsigned size)
 {
+	struct mmc_host *host = func->card->host;
+	struct mmc_io_rw_ext io[2];
+	struct mmc_io_rw_ext *cur, *next;
 	unsigned remainder = size;
-	unsigned max_blocks;
+	unsigned max_blocks = 0;
 	int ret;
 
-	/* Do the bulk of the transfer using block mode (if supported). */
 	if (func->card->cccr.multi_block && (size > sdio_max_byte_size(func))) {
 		/* Blocks per command is limited by host count, host transfer
 		 * size (we only use a single sg entry) and the maximum for
 		 * IO_RW_EXTENDED of 511 blocks. */
-		max_blocks = min(func->card->host->max_blk_count,
-			func->card->host->max_seg_size / func->cur_blksize);
+		max_blocks = min(host->max_blk_count,
+			host->max_seg_size / func->cur_blksize);
 		max_blocks = min(max_blocks, 511u);
+	}
 
-		while (remainder > func->cur_blksize) {
-			unsigned blocks;
-
-			blocks = remainder / func->cur_blksize;
-			if (blocks > max_blocks)
-				blocks = max_blocks;
-			size = blocks * func->cur_blksize;
-
-			ret = mmc_io_rw_extended(func->card, write,
-				func->num, addr, incr_addr, buf,
-				blocks, func->cur_blksize);
-			if (ret)
-				return ret;
+	cur = &io[0];
+	ret = sdio_io_rw_ext_next(func, cur, write, &addr, incr_addr,
+		&buf, &remainder, max_blocks);
+	if (ret)
+		return ret;
 
-			remainder -= size;
-			buf += size;
-			if (incr_addr)
-				addr += size;
+	while (cur) {
+		next = NULL;
+
+		/* Only hand the next command over early when its buffer
+		 * starts on a cache line of its own, so mapping it cannot
+		 * touch the one being transferred. */
+		if (remainder && IS_ALIGNED((unsigned long)buf,
+					    dma_get_cache_alignment())) {
+			next = (cur == &io[0]) ? &io[1] : &io[0];
+			if (sdio_io_rw_ext_next(func, next, write, &addr,
+					incr_addr, &buf, &remainder, max_blocks))
+				next = NULL;
 		}
-	}
 
-	/* Write the remainder using byte mode. */
-	while (remainder > 0) {
-		size = min(remainder, sdio_max_byte_size(func));
+		mmc_start_req(host, &cur->mrq, next ? &next->mrq : NULL);
+		mmc_wait_for_req_done(host, &cur->mrq);
 
-		ret = mmc_io_rw_extended(func->card, write, func->num, addr,
-			 incr_addr, buf, 1, size);
-		if (ret)
+		ret = mmc_io_rw_extended_result(func->card, cur);
+		if (ret) {
+			if (next)
+				mmc_post_req(host, &next->mrq, ret);
 			return ret;
+		}
+
+		if (!next && remainder) {
+			next = (cur == &io[0]) ? &io[1] : &io[0];
+			ret = sdio_io_rw_ext_next(func, next, write, &addr,
+				incr_addr, &buf, &remainder, max_blocks);
+			if (ret)
+				return ret;
+		}
 
-		remainder -= size;
-		buf += size;
-		if (incr_addr)
-			addr += size;
+		cur = next;
 	}
 	return 0;
 }
@@ -122,13 +122,13 @@ int mmc_io_rw_direct(struct mmc_card *card, int write, unsigned fn,
 	return mmc_io_rw_direct_host(card->host, write, fn, addr, in, out);
 }
 
-int mmc_io_rw_extended(struct mmc_card *card, int write, unsigned fn,
-	unsigned addr, int incr_addr, u8 *buf, unsigned blocks, unsigned blksz)
+int mmc_io_rw_extended_prep(struct mmc_card *card, struct mmc_io_rw_ext *io,
+	int write, unsigned fn, unsigned addr, int incr_addr, u8 *buf,
+	unsigned blocks, unsigned blksz)
 {
-	struct mmc_request mrq;
-	struct mmc_command cmd;
-	struct mmc_data data;
-	struct scatterlist sg;
+	struct mmc_request *mrq = &io->mrq;
+	struct mmc_command *cmd = &io->cmd;
+	struct mmc_data *data = &io->data;
 
 	BUG_ON(!card);
 	BUG_ON(fn > 7);
@@ -140,55 +140,76 @@ int mmc_io_rw_extended(struct mmc_card *card, int write, unsigned fn,
 	if (addr & ~0x1FFFF)
 		return -EINVAL;
 
-	memset(&mrq, 0, sizeof(struct mmc_request));
-	memset(&cmd, 0, sizeof(struct mmc_command));
-	memset(&data, 0, sizeof(struct mmc_data));
+	memset(mrq, 0, sizeof(struct mmc_request));
+	memset(cmd, 0, sizeof(struct mmc_command));
+	memset(data, 0, sizeof(struct mmc_data));
 
-	mrq.cmd = &cmd;
-	mrq.data = &data;
+	mrq->cmd = cmd;
+	mrq->data = data;
 
-	cmd.opcode = SD_IO_RW_EXTENDED;
-	cmd.arg = write ? 0x80000000 : 0x00000000;
-	cmd.arg |= fn << 28;
-	cmd.arg |= incr_addr ? 0x04000000 : 0x00000000;
-	cmd.arg |= addr << 9;
+	cmd->opcode = SD_IO_RW_EXTENDED;
+	cmd->arg = write ? 0x80000000 : 0x00000000;
+	cmd->arg |= fn << 28;
+	cmd->arg |= incr_addr ? 0x04000000 : 0x00000000;
+	cmd->arg |= addr << 9;
 	if (blocks == 1 && blksz <= 512)
-		cmd.arg |= (blksz == 512) ? 0 : blksz;	/* byte mode */
+		cmd->arg |= (blksz == 512) ? 0 : blksz;	/* byte mode */
 	else
-		cmd.arg |= 0x08000000 | blocks;		/* block mode */
-	cmd.flags = MMC_RSP_SPI_R5 | MMC_RSP_R5 | MMC_CMD_ADTC;
+		cmd->arg |= 0x08000000 | blocks;	/* block mode */
+	cmd->flags = MMC_RSP_SPI_R5 | MMC_RSP_R5 | MMC_CMD_ADTC;
+
+	data->blksz = blksz;
+	data->blocks = blocks;
+	data->flags = write ? MMC_DATA_WRITE : MMC_DATA_READ;
+	data->sg = &io->sg;
+	data->sg_len = 1;
 
-	data.blksz = blksz;
-	data.blocks = blocks;
-	data.flags = write ? MMC_DATA_WRITE : MMC_DATA_READ;
-	data.sg = &sg;
-	data.sg_len = 1;
+	sg_init_one(&io->sg, buf, blksz * blocks);
 
-	sg_init_one(&sg, buf, blksz * blocks);
+	mmc_set_data_timeout(data, card);
 
-	mmc_set_data_timeout(&data, card);
+	return 0;
+}
 
-	mmc_wait_for_req(card->host, &mrq);
+int mmc_io_rw_extended_result(struct mmc_card *card, struct mmc_io_rw_ext *io)
+{
+	struct mmc_command *cmd = &io->cmd;
 
-	if (cmd.error)
-		return cmd.error;
-	if (data.error)
-		return data.error;
+	if (cmd->error)
+		return cmd->error;
+	if (io->data.error)
+		return io->data.error;
 
 	if (mmc_host_is_spi(card->host)) {
 		/* host driver already reported errors */
 	} else {
-		if (cmd.resp[0] & R5_ERROR)
+		if (cmd->resp[0] & R5_ERROR)
 			return -EIO;
-		if (cmd.resp[0] & R5_FUNCTION_NUMBER)
+		if (cmd->resp[0] & R5_FUNCTION_NUMBER)
 			return -EINVAL;
-		if (cmd.resp[0] & R5_OUT_OF_RANGE)
+		if (cmd->resp[0] & R5_OUT_OF_RANGE)
 			return -ERANGE;
 	}
 
 	return 0;
 }
 
+int mmc_io_rw_extended(struct mmc_card *card, int write, unsigned fn,
+	unsigned addr, int incr_addr, u8 *buf, unsigned blocks, unsigned blksz)
+{
+	struct mmc_io_rw_ext io;
+	int ret;
+
+	ret = mmc_io_rw_extended_prep(card, &io, write, fn, addr, incr_addr,
+		buf, blocks, blksz);
+	if (ret)
+		return ret;
+
+	mmc_wait_for_req(card->host, &io.mrq);
+
+	return mmc_io_rw_extended_result(card, &io);
+}
+
 int sdio_reset(struct mmc_host *host)
 {
 	int ret;
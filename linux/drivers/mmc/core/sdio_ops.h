@@ -12,11 +12,25 @@
 #ifndef _MMC_SDIO_OPS_H
 #define _MMC_SDIO_OPS_H
 
+#include <linux/scatterlist.h>
+
+/* One IO_RW_EXTENDED command, set up apart from issuing it. */
+struct mmc_io_rw_ext {
+	struct mmc_request	mrq;
+	struct mmc_command	cmd;
+	struct mmc_data		data;
+	struct scatterlist	sg;
+};
+
 int mmc_send_io_op_cond(struct mmc_host *host, u32 ocr, u32 *rocr);
 int mmc_io_rw_direct(struct mmc_card *card, int write, unsigned fn,
 	unsigned addr, u8 in, u8* out);
 int mmc_io_rw_extended(struct mmc_card *card, int write, unsigned fn,
 	unsigned addr, int incr_addr, u8 *buf, unsigned blocks, unsigned blksz);
+int mmc_io_rw_extended_prep(struct mmc_card *card, struct mmc_io_rw_ext *io,
+	int write, unsigned fn, unsigned addr, int incr_addr, u8 *buf,
+	unsigned blocks, unsigned blksz);
+int mmc_io_rw_extended_result(struct mmc_card *card, struct mmc_io_rw_ext *io);
 int sdio_reset(struct mmc_host *host);
 
 #endif
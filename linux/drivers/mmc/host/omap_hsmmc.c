@@ -25,10 +25,12 @@
 #include <linux/platform_device.h>
 #include <linux/workqueue.h>
 #include <linux/timer.h>
+#include <linux/ktime.h>
 #include <linux/clk.h>
 #include <linux/mmc/host.h>
 #include <linux/mmc/core.h>
 #include <linux/mmc/mmc.h>
+#include <linux/mmc/sdio.h>
 #include <linux/io.h>
 #include <linux/semaphore.h>
 #include <linux/gpio.h>
@@ -133,6 +135,15 @@
 #define OMAP_MMC_SLEEP_TIMEOUT		1000
 #define OMAP_MMC_OFF_TIMEOUT		8000
 
+/*
+ * CMD52 is polled for rather than waited on when the bus is at least
+ * this fast; give up polling and take the interrupt after this long.
+ */
+#define OMAP_HSMMC_POLL_MIN_CLOCK	12000000
+#define OMAP_HSMMC_POLL_US		50
+
+#define OMAP_HSMMC_OPCODES		64
+
 /*
  * One controller can have multiple slots, like on some omap boards using
  * omap.c controller driver. Luckily this is not currently done on any known
@@ -149,6 +160,23 @@
 #define OMAP_HSMMC_WRITE(base, reg, val) \
 	__raw_writel((val), (base) + OMAP_HSMMC_##reg)
 
+/* DMA set up by pre_req for the request after the one in flight */
+struct omap_hsmmc_next {
+	unsigned int	dma_len;
+	int		dma_ch;
+	s32		cookie;
+};
+
+/* Per-opcode request statistics, see the "opstats" debugfs file */
+struct omap_hsmmc_op_stats {
+	unsigned long	count;
+	unsigned long	errors;
+	unsigned long	polled;
+	u64		bytes;
+	u64		total_ns;
+	u32		max_ns;
+};
+
 struct omap_hsmmc_host {
 	struct	device		*dev;
 	struct	mmc_host	*mmc;
@@ -192,6 +220,12 @@ struct omap_hsmmc_host {
 	int			reqs_blocked;
 	int			use_reg;
 	int			req_in_progress;
+	int			polling;
+	struct	omap_hsmmc_next	next_data;
+	s32			next_cookie;
+	ktime_t			req_start;
+	unsigned long		dma_prepared;
+	struct	omap_hsmmc_op_stats	op_stats[OMAP_HSMMC_OPCODES];
 
 	struct	omap_mmc_platform_data	*pdata;
 };
@@ -619,7 +653,8 @@ static void omap_hsmmc_enable_irq(struct omap_hsmmc_host *host,
 		irq_mask &= ~DTO_ENABLE;
 
 	OMAP_HSMMC_WRITE(host->base, STAT, STAT_CLEAR);
-	OMAP_HSMMC_WRITE(host->base, ISE, irq_mask);
+	/* A polled command latches its status without raising the irq */
+	OMAP_HSMMC_WRITE(host->base, ISE, host->polling ? 0 : irq_mask);
 	OMAP_HSMMC_WRITE(host->base, IE, irq_mask);
 }
 
@@ -917,6 +952,32 @@ omap_hsmmc_get_dma_dir(struct omap_hsmmc_host *host, struct mmc_data *data)
 		return DMA_FROM_DEVICE;
 }
 
+/*
+ * Account the request in the per-opcode statistics and hand it back
+ * to the core.
+ */
+static void omap_hsmmc_mmc_done(struct omap_hsmmc_host *host,
+				struct mmc_request *mrq)
+{
+	struct omap_hsmmc_op_stats *stats;
+	s64 ns;
+
+	stats = &host->op_stats[mrq->cmd->opcode % OMAP_HSMMC_OPCODES];
+	ns = ktime_to_ns(ktime_sub(ktime_get(), host->req_start));
+
+	stats->count++;
+	if (mrq->cmd->error || (mrq->data && mrq->data->error) ||
+	    (mrq->stop && mrq->stop->error))
+		stats->errors++;
+	if (mrq->data)
+		stats->bytes += mrq->data->bytes_xfered;
+	stats->total_ns += ns;
+	if (ns > stats->max_ns)
+		stats->max_ns = ns;
+
+	mmc_request_done(host->mmc, mrq);
+}
+
 static void omap_hsmmc_request_done(struct omap_hsmmc_host *host, struct mmc_request *mrq)
 {
 	int dma_ch;
@@ -931,7 +992,7 @@ static void omap_hsmmc_request_done(struct omap_hsmmc_host *host, struct mmc_req
 	if (mrq->data && host->use_dma && dma_ch != -1)
 		return;
 	host->mrq = NULL;
-	mmc_request_done(host->mmc, mrq);
+	omap_hsmmc_mmc_done(host, mrq);
 }
 
 /*
@@ -1007,8 +1068,11 @@ static void omap_hsmmc_dma_cleanup(struct omap_hsmmc_host *host, int errno)
 	spin_unlock(&host->irq_lock);
 
 	if (host->use_dma && dma_ch != -1) {
-		dma_unmap_sg(mmc_dev(host->mmc), host->data->sg, host->dma_len,
-			omap_hsmmc_get_dma_dir(host, host->data));
+		/* Data prepared by pre_req is unmapped in post_req */
+		if (!host->data->host_cookie)
+			dma_unmap_sg(mmc_dev(host->mmc), host->data->sg,
+				host->dma_len,
+				omap_hsmmc_get_dma_dir(host, host->data));
 		omap_free_dma(dma_ch);
 	}
 	host->data = NULL;
@@ -1180,6 +1244,56 @@ static irqreturn_t omap_hsmmc_irq(int irq, void *dev_id)
 	return IRQ_HANDLED;
 }
 
+/*
+ * A CMD52 at full bus speed is done in a few microseconds, less than
+ * the interrupt round trip costs, so spin for it with its interrupt
+ * masked. If it takes longer, unmask the interrupt and let it finish
+ * the request as usual.
+ */
+static bool omap_hsmmc_can_poll(struct omap_hsmmc_host *host,
+				struct mmc_request *req)
+{
+	return req->cmd->opcode == SD_IO_RW_DIRECT && !req->data &&
+		host->mmc->ios.clock >= OMAP_HSMMC_POLL_MIN_CLOCK;
+}
+
+static void omap_hsmmc_poll_command(struct omap_hsmmc_host *host)
+{
+	struct mmc_request *mrq = host->mrq;
+	unsigned long flags;
+	ktime_t start;
+	u32 status;
+
+	start = ktime_get();
+	do {
+		status = OMAP_HSMMC_READ(host->base, STAT);
+		if (status & (CC | ERR))
+			break;
+		cpu_relax();
+	} while (ktime_us_delta(ktime_get(), start) < OMAP_HSMMC_POLL_US);
+
+	local_irq_save(flags);
+
+	host->polling = 0;
+
+	if (!(status & (CC | ERR))) {
+		OMAP_HSMMC_WRITE(host->base, ISE,
+				 OMAP_HSMMC_READ(host->base, IE));
+		local_irq_restore(flags);
+		return;
+	}
+
+	host->op_stats[mrq->cmd->opcode % OMAP_HSMMC_OPCODES].polled++;
+
+	do {
+		omap_hsmmc_do_irq(host, status, host->irq);
+		/* Flush posted write */
+		status = OMAP_HSMMC_READ(host->base, STAT);
+	} while (status & INT_EN_MASK);
+
+	local_irq_restore(flags);
+}
+
 static void set_sd_bus_power(struct omap_hsmmc_host *host)
 {
 	unsigned long i;
@@ -1338,14 +1452,13 @@ static int omap_hsmmc_get_dma_sync_dev(struct omap_hsmmc_host *host,
 }
 
 static void omap_hsmmc_config_dma_params(struct omap_hsmmc_host *host,
-				       struct mmc_data *data,
+				       struct mmc_data *data, int dma_ch,
 				       struct scatterlist *sgl)
 {
-	int blksz, nblk, dma_ch;
+	int blksz, nblk;
 	int bindex = 0, cindex = 0;
 
-	dma_ch = host->dma_ch;
-	blksz = host->data->blksz;
+	blksz = data->blksz;
 	nblk = sg_dma_len(sgl) / blksz;
 	if (cpu_is_ti81xx()) {
 		bindex = 4;
@@ -1368,8 +1481,6 @@ static void omap_hsmmc_config_dma_params(struct omap_hsmmc_host *host,
 			blksz / 4, nblk, OMAP_DMA_SYNC_FRAME,
 			omap_hsmmc_get_dma_sync_dev(host, data),
 			!(data->flags & MMC_DATA_WRITE));
-
-	omap_start_dma(dma_ch);
 }
 
 /*
@@ -1393,14 +1504,17 @@ static void omap_hsmmc_dma_cb(int lch, u16 ch_status, void *cb_data)
 	host->dma_sg_idx++;
 	if (host->dma_sg_idx < host->dma_len) {
 		/* Fire up the next transfer. */
-		omap_hsmmc_config_dma_params(host, data,
+		omap_hsmmc_config_dma_params(host, data, host->dma_ch,
 					   data->sg + host->dma_sg_idx);
+		omap_start_dma(host->dma_ch);
 		spin_unlock(&host->irq_lock);
 		return;
 	}
 
-	dma_unmap_sg(mmc_dev(host->mmc), data->sg, host->dma_len,
-		omap_hsmmc_get_dma_dir(host, data));
+	/* Data prepared by pre_req is unmapped in post_req */
+	if (!data->host_cookie)
+		dma_unmap_sg(mmc_dev(host->mmc), data->sg, host->dma_len,
+			omap_hsmmc_get_dma_dir(host, data));
 
 	req_in_progress = host->req_in_progress;
 	dma_ch = host->dma_ch;
@@ -1414,18 +1528,21 @@ static void omap_hsmmc_dma_cb(int lch, u16 ch_status, void *cb_data)
 		struct mmc_request *mrq = host->mrq;
 
 		host->mrq = NULL;
-		mmc_request_done(host->mmc, mrq);
+		omap_hsmmc_mmc_done(host, mrq);
 	}
 }
 
 /*
- * Routine to configure and start DMA for the MMC card
+ * Map the data and set up an sDMA channel for it, without starting it.
+ * With @next this is pre_req working ahead and the result is kept in
+ * @next until the request is issued, otherwise it is for the request
+ * being issued now.
  */
-static int omap_hsmmc_start_dma_transfer(struct omap_hsmmc_host *host,
-					struct mmc_request *req)
+static int omap_hsmmc_pre_dma_transfer(struct omap_hsmmc_host *host,
+				       struct mmc_data *data,
+				       struct omap_hsmmc_next *next)
 {
-	int dma_ch = 0, ret = 0, i;
-	struct mmc_data *data = req->data;
+	int dma_ch = 0, dma_len, ret = 0, i;
 
 	/* Sanity check: all the SG entries must be aligned by block size. */
 	for (i = 0; i < data->sg_len; i++) {
@@ -1441,8 +1558,6 @@ static int omap_hsmmc_start_dma_transfer(struct omap_hsmmc_host *host,
 		 */
 		return -EINVAL;
 
-	BUG_ON(host->dma_ch != -1);
-
 	ret = omap_request_dma(omap_hsmmc_get_dma_sync_dev(host, data),
 			       "MMC/SD", omap_hsmmc_dma_cb, host, &dma_ch);
 	if (ret != 0) {
@@ -1452,12 +1567,53 @@ static int omap_hsmmc_start_dma_transfer(struct omap_hsmmc_host *host,
 		return ret;
 	}
 
-	host->dma_len = dma_map_sg(mmc_dev(host->mmc), data->sg,
-			data->sg_len, omap_hsmmc_get_dma_dir(host, data));
-	host->dma_ch = dma_ch;
-	host->dma_sg_idx = 0;
+	/* A retried request that pre_req mapped is still mapped */
+	if (!next && data->host_cookie)
+		dma_len = host->dma_len;
+	else
+		dma_len = dma_map_sg(mmc_dev(host->mmc), data->sg,
+				data->sg_len, omap_hsmmc_get_dma_dir(host, data));
+
+	omap_hsmmc_config_dma_params(host, data, dma_ch, data->sg);
 
-	omap_hsmmc_config_dma_params(host, data, data->sg);
+	if (next) {
+		if (++host->next_cookie <= 0)
+			host->next_cookie = 1;
+		next->dma_len = dma_len;
+		next->dma_ch = dma_ch;
+		next->cookie = data->host_cookie = host->next_cookie;
+	} else {
+		host->dma_len = dma_len;
+		host->dma_ch = dma_ch;
+	}
+
+	return 0;
+}
+
+/*
+ * Routine to configure and start DMA for the MMC card
+ */
+static int omap_hsmmc_start_dma_transfer(struct omap_hsmmc_host *host,
+					struct mmc_request *req)
+{
+	struct mmc_data *data = req->data;
+	int ret;
+
+	BUG_ON(host->dma_ch != -1);
+
+	if (data->host_cookie && data->host_cookie == host->next_data.cookie) {
+		host->dma_len = host->next_data.dma_len;
+		host->dma_ch = host->next_data.dma_ch;
+		host->next_data.dma_ch = -1;
+		host->next_data.cookie = 0;
+	} else {
+		ret = omap_hsmmc_pre_dma_transfer(host, data, NULL);
+		if (ret != 0)
+			return ret;
+	}
+
+	host->dma_sg_idx = 0;
+	omap_start_dma(host->dma_ch);
 
 	return 0;
 }
@@ -1544,6 +1700,8 @@ static void omap_hsmmc_request(struct mmc_host *mmc, struct mmc_request *req)
 	struct omap_hsmmc_host *host = mmc_priv(mmc);
 	int err;
 
+	host->req_start = ktime_get();
+
 	BUG_ON(host->req_in_progress);
 	BUG_ON(host->dma_ch != -1);
 	if (host->protect_card) {
@@ -1561,7 +1719,7 @@ static void omap_hsmmc_request(struct mmc_host *mmc, struct mmc_request *req)
 		if (req->data)
 			req->data->error = -EBADF;
 		req->cmd->retries = 0;
-		mmc_request_done(mmc, req);
+		omap_hsmmc_mmc_done(host, req);
 		return;
 	} else if (host->reqs_blocked)
 		host->reqs_blocked = 0;
@@ -1573,11 +1731,59 @@ static void omap_hsmmc_request(struct mmc_host *mmc, struct mmc_request *req)
 		if (req->data)
 			req->data->error = err;
 		host->mrq = NULL;
-		mmc_request_done(mmc, req);
+		omap_hsmmc_mmc_done(host, req);
 		return;
 	}
 
+	host->polling = omap_hsmmc_can_poll(host, req);
 	omap_hsmmc_start_command(host, req->cmd, req->data);
+	if (host->polling)
+		omap_hsmmc_poll_command(host);
+}
+
+/*
+ * Map and set up the DMA for a request while the one before it is
+ * still in flight, so that omap_hsmmc_request() only has to start it.
+ */
+static void omap_hsmmc_pre_req(struct mmc_host *mmc, struct mmc_request *mrq,
+			       bool is_first_req)
+{
+	struct omap_hsmmc_host *host = mmc_priv(mmc);
+	struct mmc_data *data = mrq->data;
+
+	if (!host->use_dma || !data || data->host_cookie)
+		return;
+
+	/* Only one request can be prepared ahead */
+	if (host->next_data.cookie)
+		return;
+
+	if (omap_hsmmc_pre_dma_transfer(host, data, &host->next_data))
+		return;
+
+	if (!is_first_req)
+		host->dma_prepared++;
+}
+
+static void omap_hsmmc_post_req(struct mmc_host *mmc, struct mmc_request *mrq,
+				int err)
+{
+	struct omap_hsmmc_host *host = mmc_priv(mmc);
+	struct mmc_data *data = mrq->data;
+
+	if (!data || !data->host_cookie)
+		return;
+
+	/* Prepared but never issued: the channel is still ours */
+	if (data->host_cookie == host->next_data.cookie) {
+		omap_free_dma(host->next_data.dma_ch);
+		host->next_data.dma_ch = -1;
+		host->next_data.cookie = 0;
+	}
+
+	dma_unmap_sg(mmc_dev(host->mmc), data->sg, data->sg_len,
+		omap_hsmmc_get_dma_dir(host, data));
+	data->host_cookie = 0;
 }
 
 /* Routine to configure clock values. Exposed API to core */
@@ -1985,6 +2191,8 @@ static const struct mmc_host_ops omap_hsmmc_ops = {
 	.enable = omap_hsmmc_enable_fclk,
 	.disable = omap_hsmmc_disable_fclk,
 	.request = omap_hsmmc_request,
+	.pre_req = omap_hsmmc_pre_req,
+	.post_req = omap_hsmmc_post_req,
 	.set_ios = omap_hsmmc_set_ios,
 	.get_cd = omap_hsmmc_get_cd,
 	.get_ro = omap_hsmmc_get_ro,
@@ -1996,6 +2204,8 @@ static const struct mmc_host_ops omap_hsmmc_ps_ops = {
 	.enable = omap_hsmmc_enable,
 	.disable = omap_hsmmc_disable,
 	.request = omap_hsmmc_request,
+	.pre_req = omap_hsmmc_pre_req,
+	.post_req = omap_hsmmc_post_req,
 	.set_ios = omap_hsmmc_set_ios,
 	.get_cd = omap_hsmmc_get_cd,
 	.get_ro = omap_hsmmc_get_ro,
@@ -2066,11 +2276,70 @@ static const struct file_operations mmc_regs_fops = {
 	.release        = single_release,
 };
 
+static int omap_hsmmc_opstats_show(struct seq_file *s, void *data)
+{
+	struct mmc_host *mmc = s->private;
+	struct omap_hsmmc_host *host = mmc_priv(mmc);
+	struct omap_hsmmc_op_stats *stats;
+	u64 avg_ns;
+	int i;
+
+	seq_printf(s, "dma prepared ahead: %lu\n\n", host->dma_prepared);
+	seq_printf(s, "opcode    count   errors   polled   avg_us   max_us"
+			"        bytes\n");
+
+	for (i = 0; i < OMAP_HSMMC_OPCODES; i++) {
+		stats = &host->op_stats[i];
+		if (!stats->count)
+			continue;
+
+		avg_ns = stats->total_ns;
+		do_div(avg_ns, stats->count);
+
+		seq_printf(s, "CMD%-3d %8lu %8lu %8lu %8llu %8u %12llu\n",
+			   i, stats->count, stats->errors, stats->polled,
+			   (unsigned long long)avg_ns / NSEC_PER_USEC,
+			   stats->max_ns / (u32)NSEC_PER_USEC,
+			   (unsigned long long)stats->bytes);
+	}
+
+	return 0;
+}
+
+static int omap_hsmmc_opstats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, omap_hsmmc_opstats_show, inode->i_private);
+}
+
+/* Any write clears the counters */
+static ssize_t omap_hsmmc_opstats_write(struct file *file,
+		const char __user *buf, size_t count, loff_t *ppos)
+{
+	struct seq_file *s = file->private_data;
+	struct omap_hsmmc_host *host = mmc_priv(s->private);
+
+	host->dma_prepared = 0;
+	memset(host->op_stats, 0, sizeof(host->op_stats));
+
+	return count;
+}
+
+static const struct file_operations mmc_opstats_fops = {
+	.open           = omap_hsmmc_opstats_open,
+	.read           = seq_read,
+	.write          = omap_hsmmc_opstats_write,
+	.llseek         = seq_lseek,
+	.release        = single_release,
+};
+
 static void omap_hsmmc_debugfs(struct mmc_host *mmc)
 {
-	if (mmc->debugfs_root)
+	if (mmc->debugfs_root) {
 		debugfs_create_file("regs", S_IRUSR, mmc->debugfs_root,
 			mmc, &mmc_regs_fops);
+		debugfs_create_file("opstats", S_IRUSR | S_IWUSR,
+			mmc->debugfs_root, mmc, &mmc_opstats_fops);
+	}
 }
 
 #else
@@ -2128,6 +2397,7 @@ static int __init omap_hsmmc_probe(struct platform_device *pdev)
 	host->use_dma	= 1;
 	host->dev->dma_mask = &pdata->dma_mask;
 	host->dma_ch	= -1;
+	host->next_data.dma_ch = -1;
 	host->irq	= irq;
 	host->id	= pdev->id;
 	host->slot_id	= 0;
@@ -2264,12 +2534,11 @@ static int __init omap_hsmmc_probe(struct platform_device *pdev)
 
 	mmc->ocr_avail = mmc_slot(host).ocr_mask;
 
-	/* Request IRQ for card detect */
+	/* Request IRQ for card detect; threaded, it may be a TWL GPIO */
 	if ((mmc_slot(host).card_detect_irq)) {
-		ret = request_irq(mmc_slot(host).card_detect_irq,
-				  omap_hsmmc_cd_handler,
-				  IRQF_TRIGGER_RISING | IRQF_TRIGGER_FALLING
-					  | IRQF_DISABLED,
+		ret = request_threaded_irq(mmc_slot(host).card_detect_irq,
+				  NULL, omap_hsmmc_cd_handler,
+				  IRQF_TRIGGER_RISING | IRQF_TRIGGER_FALLING,
 				  mmc_hostname(mmc), host);
 		if (ret) {
 			dev_dbg(mmc_dev(host->mmc),
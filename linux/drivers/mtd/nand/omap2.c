@@ -19,6 +19,9 @@
 #include <linux/mtd/partitions.h>
 #include <linux/io.h>
 #include <linux/slab.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/vmalloc.h>
 
 #include <plat/dma.h>
 #include <plat/gpmc.h>
@@ -27,6 +30,10 @@
 #define	DRIVER_NAME	"omap2-nand"
 #define	OMAP_NAND_TIMEOUT_MS	5000
 
+/* sDMA moves 64 byte frames; anything shorter is not worth the setup */
+#define	OMAP_NAND_DMA_FRAME	64
+#define	OMAP_NAND_DMA_MIN_LEN	512
+
 #define NAND_Ecc_P1e		(1 << 0)
 #define NAND_Ecc_P2e		(1 << 1)
 #define NAND_Ecc_P4e		(1 << 2)
@@ -114,6 +121,25 @@ static struct nand_bbt_descr bb_descrip_flashbased = {
 };
 
 
+enum omap_nand_xfer {
+	OMAP_NAND_XFER_PIO = 0,		/* cpu driven prefetch */
+	OMAP_NAND_XFER_DMA,		/* sDMA straight to/from the buffer */
+	OMAP_NAND_XFER_BOUNCE,		/* sDMA through the bounce buffer */
+	OMAP_NAND_XFER_MAX
+};
+
+static const char *omap_nand_xfer_names[OMAP_NAND_XFER_MAX] = {
+	[OMAP_NAND_XFER_PIO]	= "pio",
+	[OMAP_NAND_XFER_DMA]	= "dma",
+	[OMAP_NAND_XFER_BOUNCE]	= "bounce",
+};
+
+struct omap_nand_xfer_stats {
+	unsigned long			count;
+	u64				bytes;
+	u64				ns;
+};
+
 struct omap_nand_info {
 	struct nand_hw_control		controller;
 	struct omap_nand_platform_data	*pdata;
@@ -134,6 +160,16 @@ struct omap_nand_info {
 	u_char				*buf;
 	int				buf_len;
 	int				ecc_opt;
+
+	/* bounce buffer for vmalloc'd buffers spanning several pages */
+	u_char				*bounce_buf;
+	unsigned int			bounce_len;
+
+	struct omap_nand_xfer_stats	stats[OMAP_NAND_XFER_MAX];
+	unsigned long			dma_timeouts;
+
+	/* a transfer of the current page stalled, fail the operation */
+	int				xfer_error;
 };
 
 /**
@@ -153,8 +189,12 @@ static void omap_hwcontrol(struct mtd_info *mtd, int cmd, unsigned int ctrl)
 					struct omap_nand_info, mtd);
 
 	if (cmd != NAND_CMD_NONE) {
-		if (ctrl & NAND_CLE)
+		if (ctrl & NAND_CLE) {
+			/* a new page operation starts with a clean slate */
+			if (cmd == NAND_CMD_READ0 || cmd == NAND_CMD_SEQIN)
+				info->xfer_error = 0;
 			gpmc_nand_write(info->gpmc_cs, GPMC_NAND_COMMAND, cmd);
+		}
 
 		else if (ctrl & NAND_ALE)
 			gpmc_nand_write(info->gpmc_cs, GPMC_NAND_ADDRESS, cmd);
@@ -349,11 +389,14 @@ static void omap_nand_dma_cb(int lch, u16 ch_status, void *data)
 /*
  * omap_nand_dma_transfer: configer and start dma transfer
  * @mtd: MTD device structure
- * @addr: virtual address in RAM of source/destination
- * @len: number of data bytes to be transferred
+ * @addr: lowmem virtual address in RAM of source/destination
+ * @len: number of data bytes to be transferred, multiple of 64
  * @is_write: flag for read/write operation
+ *
+ * Returns -EBUSY or -ENOMEM if nothing was transferred and the caller
+ * can still fall back to the cpu, -ETIMEDOUT if the transfer stalled.
  */
-static inline int omap_nand_dma_transfer(struct mtd_info *mtd, void *addr,
+static int omap_nand_dma_transfer(struct mtd_info *mtd, void *addr,
 					unsigned int len, int is_write)
 {
 	struct omap_nand_info *info = container_of(mtd,
@@ -368,25 +411,13 @@ static inline int omap_nand_dma_transfer(struct mtd_info *mtd, void *addr,
 	 * But configure the FIFO-threahold to 32 to get a sync at each frame
 	 * and frame length is 32 bytes.
 	 */
-	int buf_len = len >> 6;
-
-	if (addr >= high_memory) {
-		struct page *p1;
-
-		if (((size_t)addr & PAGE_MASK) !=
-			((size_t)(addr + len - 1) & PAGE_MASK))
-			goto out_copy;
-		p1 = vmalloc_to_page(addr);
-		if (!p1)
-			goto out_copy;
-		addr = page_address(p1) + ((size_t)addr & ~PAGE_MASK);
-	}
+	int buf_len = len / OMAP_NAND_DMA_FRAME;
 
 	dma_addr = dma_map_single(&info->pdev->dev, addr, len, dir);
 	if (dma_mapping_error(&info->pdev->dev, dma_addr)) {
 		dev_err(&info->pdev->dev,
 			"Couldn't DMA map a %d byte buffer\n", len);
-		goto out_copy;
+		return -ENOMEM;
 	}
 
 	if (is_write) {
@@ -409,16 +440,28 @@ static inline int omap_nand_dma_transfer(struct mtd_info *mtd, void *addr,
 	/*  configure and start prefetch transfer */
 	ret = gpmc_prefetch_enable(info->gpmc_cs,
 			PREFETCH_FIFOTHRESHOLD_MAX, 0x1, len, is_write);
-	if (ret)
-		/* PFPW engine is busy, use cpu copy method */
-		goto out_copy;
+	if (ret) {
+		/* PFPW engine is busy, let the caller use cpu copy method */
+		dma_unmap_single(&info->pdev->dev, dma_addr, len, dir);
+		return -EBUSY;
+	}
 
 	init_completion(&info->comp);
 
 	omap_start_dma(info->dma_ch);
 
 	/* setup and start DMA using dma_addr */
-	wait_for_completion(&info->comp);
+	if (!wait_for_completion_timeout(&info->comp,
+				msecs_to_jiffies(OMAP_NAND_TIMEOUT_MS))) {
+		omap_stop_dma(info->dma_ch);
+		gpmc_prefetch_reset(info->gpmc_cs);
+		dma_unmap_single(&info->pdev->dev, dma_addr, len, dir);
+		info->dma_timeouts++;
+		dev_err(&info->pdev->dev, "DMA %s of %d bytes timed out\n",
+				is_write ? "write" : "read", len);
+		return -ETIMEDOUT;
+	}
+
 	tim = 0;
 	limit = (loops_per_jiffy * msecs_to_jiffies(OMAP_NAND_TIMEOUT_MS));
 	while (gpmc_read_status(GPMC_PREFETCH_COUNT) && (tim++ < limit))
@@ -429,15 +472,96 @@ static inline int omap_nand_dma_transfer(struct mtd_info *mtd, void *addr,
 
 	dma_unmap_single(&info->pdev->dev, dma_addr, len, dir);
 	return 0;
+}
 
-out_copy:
-	if (info->nand.options & NAND_BUSWIDTH_16)
-		is_write == 0 ? omap_read_buf16(mtd, (u_char *) addr, len)
-			: omap_write_buf16(mtd, (u_char *) addr, len);
+/*
+ * omap_nand_account: update the throughput counters of a transfer mode
+ * @info: NAND device structure
+ * @mode: transfer mode the data went through
+ * @len: number of data bytes transferred
+ * @start: time the transfer was started
+ */
+static void omap_nand_account(struct omap_nand_info *info,
+			enum omap_nand_xfer mode, int len, ktime_t start)
+{
+	struct omap_nand_xfer_stats *stats = &info->stats[mode];
+
+	stats->count++;
+	stats->bytes += len;
+	stats->ns += ktime_to_ns(ktime_sub(ktime_get(), start));
+}
+
+/*
+ * omap_nand_xfer_dma: move a buffer with sDMA when it pays off
+ * @mtd: MTD device structure
+ * @buf: virtual address in RAM of source/destination
+ * @len: number of data bytes to be transferred
+ * @is_write: flag for read/write operation
+ *
+ * Short or unaligned transfers stay on the cpu prefetch path. vmalloc'd
+ * buffers (JFFS2 uses them for whole eraseblocks) are handed to the DMA
+ * directly when they sit in a single page and go through the bounce
+ * buffer otherwise. The chip is owned by the caller for the whole
+ * operation, so one bounce buffer per controller is enough.
+ */
+static void omap_nand_xfer_dma(struct mtd_info *mtd, u_char *buf, int len,
+					int is_write)
+{
+	struct omap_nand_info *info = container_of(mtd,
+					struct omap_nand_info, mtd);
+	enum omap_nand_xfer mode = OMAP_NAND_XFER_DMA;
+	ktime_t start = ktime_get();
+	void *addr = buf;
+	int ret;
+
+	if (len < OMAP_NAND_DMA_MIN_LEN || len <= mtd->oobsize ||
+	    (len & (OMAP_NAND_DMA_FRAME - 1)) || ((unsigned long)buf & 3))
+		goto out_pio;
+
+	if (addr >= high_memory) {
+		struct page *p1 = NULL;
+
+		if (((size_t)addr & PAGE_MASK) ==
+			((size_t)(addr + len - 1) & PAGE_MASK))
+			p1 = vmalloc_to_page(addr);
+		if (p1) {
+			addr = page_address(p1) + ((size_t)addr & ~PAGE_MASK);
+		} else if (info->bounce_buf && len <= info->bounce_len) {
+			addr = info->bounce_buf;
+			mode = OMAP_NAND_XFER_BOUNCE;
+		} else {
+			goto out_pio;
+		}
+	}
+
+	if (mode == OMAP_NAND_XFER_BOUNCE && is_write)
+		memcpy(addr, buf, len);
+
+	ret = omap_nand_dma_transfer(mtd, addr, len, is_write);
+	if (ret) {
+		/*
+		 * After a stall part of the buffer has already gone through
+		 * the prefetch engine, so redoing it on the cpu does not
+		 * give back the right data: make the ECC check or the
+		 * program status fail the page instead.
+		 */
+		if (ret == -ETIMEDOUT)
+			info->xfer_error = 1;
+		goto out_pio;
+	}
+
+	if (mode == OMAP_NAND_XFER_BOUNCE && !is_write)
+		memcpy(buf, addr, len);
+
+	omap_nand_account(info, mode, len, start);
+	return;
+
+out_pio:
+	if (is_write)
+		omap_write_buf_pref(mtd, buf, len);
 	else
-		is_write == 0 ? omap_read_buf8(mtd, (u_char *) addr, len)
-			: omap_write_buf8(mtd, (u_char *) addr, len);
-	return 0;
+		omap_read_buf_pref(mtd, buf, len);
+	omap_nand_account(info, OMAP_NAND_XFER_PIO, len, start);
 }
 
 /**
@@ -448,11 +572,7 @@ out_copy:
  */
 static void omap_read_buf_dma_pref(struct mtd_info *mtd, u_char *buf, int len)
 {
-	if (len <= mtd->oobsize)
-		omap_read_buf_pref(mtd, buf, len);
-	else
-		/* start transfer in DMA mode */
-		omap_nand_dma_transfer(mtd, buf, len, 0x0);
+	omap_nand_xfer_dma(mtd, buf, len, 0x0);
 }
 
 /**
@@ -464,11 +584,7 @@ static void omap_read_buf_dma_pref(struct mtd_info *mtd, u_char *buf, int len)
 static void omap_write_buf_dma_pref(struct mtd_info *mtd,
 					const u_char *buf, int len)
 {
-	if (len <= mtd->oobsize)
-		omap_write_buf_pref(mtd, buf, len);
-	else
-		/* start transfer in DMA mode */
-		omap_nand_dma_transfer(mtd, (u_char *) buf, len, 0x1);
+	omap_nand_xfer_dma(mtd, (u_char *) buf, len, 0x1);
 }
 
 /*
@@ -808,6 +924,11 @@ static int omap_correct_data(struct mtd_info *mtd, u_char *dat,
 	int j, eccsize, eccflag, count;
 	unsigned int err_loc[8];
 
+	if (info->xfer_error) {
+		info->xfer_error = 0;
+		return -1;
+	}
+
 	/* Ex NAND_ECC_HW12_2048 */
 	if ((info->nand.ecc.mode == NAND_ECC_HW) &&
 			(info->nand.ecc.size  == 2048))
@@ -940,6 +1061,11 @@ static int omap_wait(struct mtd_info *mtd, struct nand_chip *chip)
 	}
 
 	status = gpmc_nand_read(info->gpmc_cs, GPMC_NAND_DATA);
+
+	if (info->xfer_error && state == FL_WRITING) {
+		info->xfer_error = 0;
+		status |= NAND_STATUS_FAIL;
+	}
 	return status;
 }
 
@@ -971,6 +1097,50 @@ static int omap_dev_ready(struct mtd_info *mtd)
 	return 1;
 }
 
+static ssize_t omap_nand_show_xfer_stats(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct mtd_info *mtd = dev_get_drvdata(dev);
+	struct omap_nand_info *info = container_of(mtd, struct omap_nand_info,
+							mtd);
+	struct omap_nand_xfer_stats *stats;
+	ssize_t count = 0;
+	u64 kbps;
+	int i;
+
+	for (i = 0; i < OMAP_NAND_XFER_MAX; i++) {
+		stats = &info->stats[i];
+		kbps = stats->ns ?
+			div64_u64(stats->bytes * (NSEC_PER_SEC / 1024),
+					stats->ns) : 0;
+		count += sprintf(buf + count,
+			"%-6s %lu xfers %llu bytes %llu us %llu KiB/s\n",
+			omap_nand_xfer_names[i], stats->count,
+			(unsigned long long)stats->bytes,
+			(unsigned long long)div_u64(stats->ns, NSEC_PER_USEC),
+			(unsigned long long)kbps);
+	}
+	count += sprintf(buf + count, "timeouts %lu\n", info->dma_timeouts);
+
+	return count;
+}
+
+static ssize_t omap_nand_store_xfer_stats(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t count)
+{
+	struct mtd_info *mtd = dev_get_drvdata(dev);
+	struct omap_nand_info *info = container_of(mtd, struct omap_nand_info,
+							mtd);
+
+	memset(info->stats, 0, sizeof(info->stats));
+	info->dma_timeouts = 0;
+
+	return count;
+}
+
+static DEVICE_ATTR(xfer_stats, S_IRUGO | S_IWUSR,
+		omap_nand_show_xfer_stats, omap_nand_store_xfer_stats);
+
 static int __devinit omap_nand_probe(struct platform_device *pdev)
 {
 	struct omap_nand_info		*info;
@@ -997,6 +1167,7 @@ static int __devinit omap_nand_probe(struct platform_device *pdev)
 
 	info->gpmc_cs		= pdata->cs;
 	info->phys_base		= pdata->phys_base;
+	info->dma_ch		= -1;
 
 	info->mtd.priv		= &info->nand;
 	info->mtd.name		= dev_name(&pdev->dev);
@@ -1126,10 +1297,18 @@ static int __devinit omap_nand_probe(struct platform_device *pdev)
 		info->nand.options ^= NAND_BUSWIDTH_16;
 		if (nand_scan_ident(&info->mtd, 1, NULL)) {
 			err = -ENXIO;
-			goto out_release_mem_region;
+			goto out_free_dma;
 		}
 	}
 
+	if (info->dma_ch != -1) {
+		info->bounce_len = info->mtd.writesize;
+		info->bounce_buf = kmalloc(info->bounce_len, GFP_KERNEL);
+		if (!info->bounce_buf)
+			dev_warn(&pdev->dev, "no bounce buffer, vmalloc'd "
+					"buffers will use the cpu\n");
+	}
+
 	/* select ecc lyout */
 	if (info->nand.ecc.mode != NAND_ECC_SOFT) {
 
@@ -1169,7 +1348,7 @@ static int __devinit omap_nand_probe(struct platform_device *pdev)
 	/* second phase scan */
 	if (nand_scan_tail(&info->mtd)) {
 			err = -ENXIO;
-			goto out_release_mem_region;
+			goto out_free_bounce;
 	}
 
 #ifdef CONFIG_MTD_PARTITIONS
@@ -1184,8 +1363,18 @@ static int __devinit omap_nand_probe(struct platform_device *pdev)
 
 	platform_set_drvdata(pdev, &info->mtd);
 
+	if (device_create_file(&pdev->dev, &dev_attr_xfer_stats))
+		dev_warn(&pdev->dev, "could not create xfer_stats\n");
+
 	return 0;
 
+out_free_bounce:
+	kfree(info->bounce_buf);
+out_free_dma:
+	if (info->dma_ch != -1)
+		omap_free_dma(info->dma_ch);
+	if (info->gpmc_irq)
+		free_irq(info->gpmc_irq, info);
 out_release_mem_region:
 	release_mem_region(info->phys_base, NAND_IO_SIZE);
 out_free_info:
@@ -1200,9 +1389,11 @@ static int omap_nand_remove(struct platform_device *pdev)
 	struct omap_nand_info *info = container_of(mtd, struct omap_nand_info,
 							mtd);
 
+	device_remove_file(&pdev->dev, &dev_attr_xfer_stats);
 	platform_set_drvdata(pdev, NULL);
 	if (info->dma_ch != -1)
 		omap_free_dma(info->dma_ch);
+	kfree(info->bounce_buf);
 
 	if (info->gpmc_irq)
 		free_irq(info->gpmc_irq, info);
@@ -30,6 +30,7 @@
 #include <linux/spinlock.h>
 #include <linux/list.h>
 #include <linux/bitops.h>
+#include <linux/pm_qos_params.h>
 #include <net/mac80211.h>
 
 #include "wl1271_conf.h"
@@ -125,6 +126,13 @@ enum {
 #define WL1271_ELP_HW_STATE_ASLEEP 0
 #define WL1271_ELP_HW_STATE_IRQ    1
 
+/*
+ * CPU wakeup latency allowed while the chip is out of ELP, in us. This
+ * keeps the MPU out of OFF mode, whose context restore would otherwise
+ * be paid on every one of the IRQs an awake chip generates.
+ */
+#define WL1271_PM_QOS_LATENCY      2000
+
 #define WL1271_DEFAULT_BEACON_INT  100
 #define WL1271_DEFAULT_DTIM_PERIOD 1
 
@@ -172,6 +180,17 @@ struct wl1271_stats {
 
 	unsigned int retry_count;
 	unsigned int excessive_retries;
+
+	/* RX path, see wl1271_rx() */
+	u32 rx_frames;
+	u32 rx_reads;
+	u32 rx_copied;
+	u32 rx_page_recycled;
+	u32 rx_page_allocated;
+	u32 rx_page_busy;
+	u64 rx_latency_ns;
+	u32 rx_latency_max_ns;
+	u64 rx_path_ns;
 };
 
 struct wl1271_debugfs {
@@ -274,6 +293,7 @@ struct wl1271_debugfs {
 	struct dentry *retry_count;
 	struct dentry *excessive_retries;
 	struct dentry *gpio_power;
+	struct dentry *rx_path;
 };
 
 #define NUM_TX_QUEUES              4
@@ -413,6 +433,19 @@ struct wl1271 {
 	/* Intermediate buffer, used for packet aggregation */
 	u8 *aggr_buf;
 
+	/*
+	 * RX aggregation buffer, WL1271_AGGR_BUFFER_SIZE of pages that the
+	 * received frames point into, and reused once the stack has let
+	 * go of all of them.
+	 */
+	struct page *rx_page;
+
+	/* Preallocated skbs holding the headers of received frames */
+	struct sk_buff_head rx_skb_pool;
+
+	/* When the last interrupt came in */
+	ktime_t irq_time;
+
 	/* The target interrupt mask */
 	struct work_struct irq_work;
 
@@ -453,6 +486,9 @@ struct wl1271 {
 
 	struct completion *elp_compl;
 	struct delayed_work elp_work;
+
+	/* limits the CPU wakeup latency while the chip is awake */
+	struct pm_qos_request_list pm_qos_req;
 	struct delayed_work pspoll_work;
 
 	/* counter for ps-poll delivery failures */
@@ -298,6 +298,77 @@ static const struct file_operations gpio_power_ops = {
 	.llseek = default_llseek,
 };
 
+static void wl1271_debugfs_reset_rx_path(struct wl1271 *wl)
+{
+	wl->stats.rx_frames = 0;
+	wl->stats.rx_reads = 0;
+	wl->stats.rx_copied = 0;
+	wl->stats.rx_page_recycled = 0;
+	wl->stats.rx_page_allocated = 0;
+	wl->stats.rx_page_busy = 0;
+	wl->stats.rx_latency_ns = 0;
+	wl->stats.rx_latency_max_ns = 0;
+	wl->stats.rx_path_ns = 0;
+}
+
+static ssize_t rx_path_read(struct file *file, char __user *userbuf,
+			    size_t count, loff_t *ppos)
+{
+	struct wl1271 *wl = file->private_data;
+	u64 latency, path;
+	u32 frames;
+	char buf[320];
+	int res;
+
+	mutex_lock(&wl->mutex);
+
+	frames = wl->stats.rx_frames;
+	latency = wl->stats.rx_latency_ns;
+	path = wl->stats.rx_path_ns;
+	if (frames) {
+		do_div(latency, frames);
+		do_div(path, frames);
+	}
+
+	res = scnprintf(buf, sizeof(buf),
+			"frames: %u\nreads: %u\ncopied: %u\n"
+			"pages recycled: %u\npages allocated: %u\n"
+			"pages busy: %u\n"
+			"irq to stack avg: %llu us\nirq to stack max: %u us\n"
+			"rx path per frame: %llu ns\n",
+			frames, wl->stats.rx_reads, wl->stats.rx_copied,
+			wl->stats.rx_page_recycled,
+			wl->stats.rx_page_allocated,
+			wl->stats.rx_page_busy,
+			div_u64(latency, NSEC_PER_USEC),
+			(u32)(wl->stats.rx_latency_max_ns / NSEC_PER_USEC),
+			path);
+
+	mutex_unlock(&wl->mutex);
+
+	return simple_read_from_buffer(userbuf, count, ppos, buf, res);
+}
+
+static ssize_t rx_path_write(struct file *file, const char __user *user_buf,
+			     size_t count, loff_t *ppos)
+{
+	struct wl1271 *wl = file->private_data;
+
+	/* any write clears the counters */
+	mutex_lock(&wl->mutex);
+	wl1271_debugfs_reset_rx_path(wl);
+	mutex_unlock(&wl->mutex);
+
+	return count;
+}
+
+static const struct file_operations rx_path_ops = {
+	.read = rx_path_read,
+	.write = rx_path_write,
+	.open = wl1271_open_file_generic,
+	.llseek = default_llseek,
+};
+
 static void wl1271_debugfs_delete_files(struct wl1271 *wl)
 {
 	DEBUGFS_FWSTATS_DEL(tx, internal_desc_overflow);
@@ -394,6 +465,7 @@ static void wl1271_debugfs_delete_files(struct wl1271 *wl)
 	DEBUGFS_DEL(tx_queue_len);
 	DEBUGFS_DEL(retry_count);
 	DEBUGFS_DEL(excessive_retries);
+	DEBUGFS_DEL(rx_path);
 
 	DEBUGFS_DEL(gpio_power);
 }
@@ -496,6 +568,7 @@ static int wl1271_debugfs_add_files(struct wl1271 *wl)
 	DEBUGFS_ADD(tx_queue_len, wl->debugfs.rootdir);
 	DEBUGFS_ADD(retry_count, wl->debugfs.rootdir);
 	DEBUGFS_ADD(excessive_retries, wl->debugfs.rootdir);
+	DEBUGFS_ADD(rx_path, wl->debugfs.rootdir);
 
 	DEBUGFS_ADD(gpio_power, wl->debugfs.rootdir);
 
@@ -511,6 +584,7 @@ void wl1271_debugfs_reset(struct wl1271 *wl)
 	memset(wl->stats.fw_stats, 0, sizeof(*wl->stats.fw_stats));
 	wl->stats.retry_count = 0;
 	wl->stats.excessive_retries = 0;
+	wl1271_debugfs_reset_rx_path(wl);
 }
 
 int wl1271_debugfs_init(struct wl1271 *wl)
@@ -142,13 +142,16 @@ static inline void wl1271_power_off(struct wl1271 *wl)
 {
 	wl->if_ops->power(wl, false);
 	clear_bit(WL1271_FLAG_GPIO_POWER, &wl->flags);
+	pm_qos_update_request(&wl->pm_qos_req, PM_QOS_DEFAULT_VALUE);
 }
 
 static inline int wl1271_power_on(struct wl1271 *wl)
 {
 	int ret = wl->if_ops->power(wl, true);
-	if (ret == 0)
+	if (ret == 0) {
 		set_bit(WL1271_FLAG_GPIO_POWER, &wl->flags);
+		pm_qos_update_request(&wl->pm_qos_req, WL1271_PM_QOS_LATENCY);
+	}
 
 	return ret;
 }
@@ -168,5 +171,6 @@ void wl1271_unregister_hw(struct wl1271 *wl);
 int wl1271_init_ieee80211(struct wl1271 *wl);
 struct ieee80211_hw *wl1271_alloc_hw(void);
 int wl1271_free_hw(struct wl1271 *wl);
+irqreturn_t wl1271_irq_thread(int irq, void *cookie);
 
 #endif
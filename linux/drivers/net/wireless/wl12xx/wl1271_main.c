@@ -493,25 +493,29 @@ static void wl1271_fw_status(struct wl1271 *wl,
 
 #define WL1271_IRQ_MAX_LOOPS 10
 
-static void wl1271_irq_work(struct work_struct *work)
+/*
+ * Handles the chip interrupts flagged as pending, at most
+ * WL1271_IRQ_MAX_LOOPS rounds of them. Called with wl->mutex held;
+ * returns whether more are pending and should be handled after giving
+ * other users of the mutex a chance. WL1271_FLAG_IRQ_RUNNING, which
+ * only the work based handling uses, is cleared once none are.
+ */
+static bool wl1271_irq_locked(struct wl1271 *wl)
 {
 	int ret;
 	u32 intr;
 	int loopcount = WL1271_IRQ_MAX_LOOPS;
 	unsigned long flags;
-	struct wl1271 *wl =
-		container_of(work, struct wl1271, irq_work);
-
-	mutex_lock(&wl->mutex);
+	bool more;
 
 	wl1271_debug(DEBUG_IRQ, "IRQ work");
 
 	if (unlikely(wl->state == WL1271_STATE_OFF))
-		goto out;
+		return false;
 
 	ret = wl1271_ps_elp_wakeup(wl, true);
 	if (ret < 0)
-		goto out;
+		return false;
 
 	spin_lock_irqsave(&wl->wl_lock, flags);
 	while (test_bit(WL1271_FLAG_IRQ_PENDING, &wl->flags) && loopcount) {
@@ -559,19 +563,61 @@ static void wl1271_irq_work(struct work_struct *work)
 
 		spin_lock_irqsave(&wl->wl_lock, flags);
 	}
-
-	if (test_bit(WL1271_FLAG_IRQ_PENDING, &wl->flags))
-		ieee80211_queue_work(wl->hw, &wl->irq_work);
-	else
+	more = test_bit(WL1271_FLAG_IRQ_PENDING, &wl->flags);
+	if (!more)
 		clear_bit(WL1271_FLAG_IRQ_RUNNING, &wl->flags);
 	spin_unlock_irqrestore(&wl->wl_lock, flags);
 
 	wl1271_ps_elp_sleep(wl);
 
-out:
+	return more;
+}
+
+static void wl1271_irq_work(struct work_struct *work)
+{
+	struct wl1271 *wl =
+		container_of(work, struct wl1271, irq_work);
+
+	mutex_lock(&wl->mutex);
+
+	if (wl1271_irq_locked(wl))
+		ieee80211_queue_work(wl->hw, &wl->irq_work);
+
 	mutex_unlock(&wl->mutex);
 }
 
+/**
+ * wl1271_irq_thread - threaded interrupt handler
+ *
+ * For buses whose hard interrupt handler only flags the interrupt as
+ * pending and wakes this thread, which then runs at the RT priority of
+ * IRQ threads instead of waiting its turn on the mac80211 workqueue.
+ */
+irqreturn_t wl1271_irq_thread(int irq, void *cookie)
+{
+	struct wl1271 *wl = cookie;
+	bool more;
+
+	do {
+		mutex_lock(&wl->mutex);
+		more = wl1271_irq_locked(wl);
+		mutex_unlock(&wl->mutex);
+	} while (more);
+
+	return IRQ_HANDLED;
+}
+EXPORT_SYMBOL_GPL(wl1271_irq_thread);
+
+/*
+ * Waits for interrupt handling already under way, from either the
+ * work or the IRQ thread, to finish. wl->mutex must not be held.
+ */
+static void wl1271_flush_irq(struct wl1271 *wl)
+{
+	cancel_work_sync(&wl->irq_work);
+	synchronize_irq(wl->irq);
+}
+
 static int wl1271_fetch_firmware(struct wl1271 *wl)
 {
 	const struct firmware *fw;
@@ -799,7 +845,7 @@ irq_disable:
 		   work function will not do anything.) Also, any other
 		   possible concurrent operations will fail due to the
 		   current state, hence the wl1271 struct should be safe. */
-		cancel_work_sync(&wl->irq_work);
+		wl1271_flush_irq(wl);
 		mutex_lock(&wl->mutex);
 power_off:
 		wl1271_power_off(wl);
@@ -837,7 +883,7 @@ int wl1271_plt_stop(struct wl1271 *wl)
 out:
 	mutex_unlock(&wl->mutex);
 
-	cancel_work_sync(&wl->irq_work);
+	wl1271_flush_irq(wl);
 	cancel_work_sync(&wl->recovery_work);
 
 	return ret;
@@ -988,7 +1034,7 @@ irq_disable:
 		   work function will not do anything.) Also, any other
 		   possible concurrent operations will fail due to the
 		   current state, hence the wl1271 struct should be safe. */
-		cancel_work_sync(&wl->irq_work);
+		wl1271_flush_irq(wl);
 		mutex_lock(&wl->mutex);
 power_off:
 		wl1271_power_off(wl);
@@ -1035,7 +1081,7 @@ static void __wl1271_op_remove_interface(struct wl1271 *wl)
 	mutex_unlock(&wl->mutex);
 
 	cancel_delayed_work_sync(&wl->scan_complete_work);
-	cancel_work_sync(&wl->irq_work);
+	wl1271_flush_irq(wl);
 	cancel_work_sync(&wl->tx_work);
 	cancel_delayed_work_sync(&wl->pspoll_work);
 	cancel_delayed_work_sync(&wl->elp_work);
@@ -2496,6 +2542,7 @@ struct ieee80211_hw *wl1271_alloc_hw(void)
 	wl->plat_dev = plat_dev;
 
 	skb_queue_head_init(&wl->tx_queue);
+	skb_queue_head_init(&wl->rx_skb_pool);
 
 	INIT_DELAYED_WORK(&wl->elp_work, wl1271_elp_work);
 	INIT_DELAYED_WORK(&wl->pspoll_work, wl1271_pspoll_work);
@@ -2503,6 +2550,8 @@ struct ieee80211_hw *wl1271_alloc_hw(void)
 	INIT_WORK(&wl->tx_work, wl1271_tx_work);
 	INIT_WORK(&wl->recovery_work, wl1271_recovery_work);
 	INIT_DELAYED_WORK(&wl->scan_complete_work, wl1271_scan_complete_work);
+	pm_qos_add_request(&wl->pm_qos_req, PM_QOS_CPU_DMA_LATENCY,
+			   PM_QOS_DEFAULT_VALUE);
 	wl->channel = WL1271_DEFAULT_CHANNEL;
 	wl->beacon_int = WL1271_DEFAULT_BEACON_INT;
 	wl->default_key = 0;
@@ -2576,6 +2625,7 @@ err_aggr:
 
 err_hw:
 	wl1271_debugfs_exit(wl);
+	pm_qos_remove_request(&wl->pm_qos_req);
 	kfree(plat_dev);
 
 err_plat_alloc:
@@ -2592,6 +2642,9 @@ int wl1271_free_hw(struct wl1271 *wl)
 	platform_device_unregister(wl->plat_dev);
 	free_pages((unsigned long)wl->aggr_buf,
 			get_order(WL1271_AGGR_BUFFER_SIZE));
+	if (wl->rx_page)
+		put_page(wl->rx_page);
+	skb_queue_purge(&wl->rx_skb_pool);
 	kfree(wl->plat_dev);
 
 	wl1271_debugfs_exit(wl);
@@ -2604,6 +2657,7 @@ int wl1271_free_hw(struct wl1271 *wl)
 	kfree(wl->fw_status);
 	kfree(wl->tx_res_if);
 
+	pm_qos_remove_request(&wl->pm_qos_req);
 	ieee80211_free_hw(wl->hw);
 
 	return 0;
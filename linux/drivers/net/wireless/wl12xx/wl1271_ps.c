@@ -50,6 +50,7 @@ void wl1271_elp_work(struct work_struct *work)
 	wl1271_debug(DEBUG_PSM, "chip to elp");
 	wl1271_raw_write32(wl, HW_ACCESS_ELP_CTRL_REG_ADDR, ELPCTRL_SLEEP);
 	set_bit(WL1271_FLAG_IN_ELP, &wl->flags);
+	pm_qos_update_request(&wl->pm_qos_req, PM_QOS_DEFAULT_VALUE);
 
 out:
 	mutex_unlock(&wl->mutex);
@@ -86,7 +87,8 @@ int wl1271_ps_elp_wakeup(struct wl1271 *wl, bool chip_awake)
 	 * the completion variable in one entity.
 	 */
 	spin_lock_irqsave(&wl->wl_lock, flags);
-	if (work_pending(&wl->irq_work) || chip_awake)
+	if (work_pending(&wl->irq_work) ||
+	    test_bit(WL1271_FLAG_IRQ_PENDING, &wl->flags) || chip_awake)
 		pending = true;
 	else
 		wl->elp_compl = &compl;
@@ -109,6 +111,7 @@ int wl1271_ps_elp_wakeup(struct wl1271 *wl, bool chip_awake)
 	}
 
 	clear_bit(WL1271_FLAG_IN_ELP, &wl->flags);
+	pm_qos_update_request(&wl->pm_qos_req, WL1271_PM_QOS_LATENCY);
 
 	wl1271_debug(DEBUG_PSM, "wakeup time: %u ms",
 		     jiffies_to_msecs(jiffies - start_time));
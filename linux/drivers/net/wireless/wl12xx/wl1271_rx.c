@@ -22,6 +22,8 @@
  */
 
 #include <linux/gfp.h>
+#include <linux/hrtimer.h>
+#include <linux/mm.h>
 
 #include "wl1271.h"
 #include "wl1271_acx.h"
@@ -74,13 +76,96 @@ static void wl1271_rx_status(struct wl1271 *wl,
 	}
 }
 
-static int wl1271_rx_handle_data(struct wl1271 *wl, u8 *data, u32 length)
+/* Frames up to this size are copied whole, a page fragment isn't worth it */
+#define WL1271_RX_COPY_MAX	256
+
+/*
+ * How much of a larger data frame is copied to the skb head, the rest
+ * stays in the aggregation buffer: the 802.11 header, LLC/SNAP and
+ * the IP and TCP headers fit in it.
+ */
+#define WL1271_RX_COPY_HDR	128
+
+/* Frame head skbs kept allocated, refilled after each wl1271_rx() */
+#define WL1271_RX_SKB_POOL	16
+
+static struct sk_buff *wl1271_rx_get_skb(struct wl1271 *wl, u32 len)
+{
+	struct sk_buff *skb;
+
+	if (len <= WL1271_RX_COPY_MAX) {
+		skb = __skb_dequeue(&wl->rx_skb_pool);
+		if (skb)
+			return skb;
+
+		len = WL1271_RX_COPY_MAX;
+	}
+
+	return __dev_alloc_skb(len, GFP_KERNEL);
+}
+
+static void wl1271_rx_refill(struct wl1271 *wl)
+{
+	struct sk_buff *skb;
+
+	while (skb_queue_len(&wl->rx_skb_pool) < WL1271_RX_SKB_POOL) {
+		skb = __dev_alloc_skb(WL1271_RX_COPY_MAX, GFP_KERNEL);
+		if (!skb)
+			break;
+
+		__skb_queue_tail(&wl->rx_skb_pool, skb);
+	}
+}
+
+/*
+ * Returns the page to read the next aggregate into once all the frames
+ * pointing into it have been freed. While some are still held, returns
+ * NULL and the aggregate is copied out of wl->aggr_buf instead, rather
+ * than allocating a new page for every read. It is a compound page so
+ * that the last put_page() from whoever ends up holding a frame frees
+ * all of it.
+ */
+static struct page *wl1271_rx_get_page(struct wl1271 *wl)
+{
+	struct page *page = wl->rx_page;
+
+	if (page) {
+		if (page_count(page) == 1) {
+			wl->stats.rx_page_recycled++;
+			return page;
+		}
+
+		wl->stats.rx_page_busy++;
+		return NULL;
+	}
+
+	page = alloc_pages(GFP_KERNEL | __GFP_COMP | __GFP_NOWARN,
+			   get_order(WL1271_AGGR_BUFFER_SIZE));
+	if (page)
+		wl->stats.rx_page_allocated++;
+
+	wl->rx_page = page;
+
+	return page;
+}
+
+/*
+ * Hands one frame of the aggregate at data up to mac80211. With a page,
+ * data points into it and only the head of larger data frames is
+ * copied, the rest is attached as a fragment of the page and the frame
+ * is charged its share of it, since that is what it keeps allocated.
+ * Without one, data is in wl->aggr_buf and the frame is copied whole.
+ */
+static int wl1271_rx_handle_data(struct wl1271 *wl, struct page *page,
+				 u32 share, u8 *data, u32 length)
 {
 	struct wl1271_rx_descriptor *desc;
+	struct ieee80211_hdr *hdr;
 	struct sk_buff *skb;
+	u32 len, copy;
 	u16 *fc;
-	u8 *buf;
 	u8 beacon = 0;
+	s64 latency;
 
 	/*
 	 * In PLT mode we seem to get frames and mac80211 warns about them,
@@ -89,20 +174,43 @@ static int wl1271_rx_handle_data(struct wl1271 *wl, u8 *data, u32 length)
 	if (unlikely(wl->state == WL1271_STATE_PLT))
 		return -EINVAL;
 
-	skb = __dev_alloc_skb(length, GFP_KERNEL);
+	/* the data read starts with the descriptor */
+	desc = (struct wl1271_rx_descriptor *) data;
+
+	if (unlikely(length < sizeof(*desc) + desc->pad_len)) {
+		wl1271_warning("short RX frame: %u B", length);
+		return -EINVAL;
+	}
+
+	data += sizeof(*desc);
+	len = length - sizeof(*desc) - desc->pad_len;
+	hdr = (struct ieee80211_hdr *) data;
+
+	if (!page || len <= WL1271_RX_COPY_MAX ||
+	    !ieee80211_is_data(hdr->frame_control))
+		copy = len;
+	else
+		copy = WL1271_RX_COPY_HDR;
+
+	skb = wl1271_rx_get_skb(wl, copy);
 	if (!skb) {
 		wl1271_error("Couldn't allocate RX frame");
 		return -ENOMEM;
 	}
 
-	buf = skb_put(skb, length);
-	memcpy(buf, data, length);
-
-	/* the data read starts with the descriptor */
-	desc = (struct wl1271_rx_descriptor *) buf;
+	memcpy(skb_put(skb, copy), data, copy);
 
-	/* now we pull the descriptor out of the buffer */
-	skb_pull(skb, sizeof(*desc));
+	if (copy < len) {
+		get_page(page);
+		skb_fill_page_desc(skb, 0, page,
+				   data + copy - (u8 *) page_address(page),
+				   len - copy);
+		skb->len += len - copy;
+		skb->data_len += len - copy;
+		skb->truesize += share;
+	} else {
+		wl->stats.rx_copied++;
+	}
 
 	fc = (u16 *)skb->data;
 	if ((*fc & IEEE80211_FCTL_STYPE) == IEEE80211_STYPE_BEACON)
@@ -113,7 +221,10 @@ static int wl1271_rx_handle_data(struct wl1271 *wl, u8 *data, u32 length)
 	wl1271_debug(DEBUG_RX, "rx skb 0x%p: %d B %s", skb, skb->len,
 		     beacon ? "beacon" : "");
 
-	skb_trim(skb, skb->len - desc->pad_len);
+	latency = ktime_to_ns(ktime_sub(ktime_get(), wl->irq_time));
+	wl->stats.rx_latency_ns += latency;
+	if (latency > wl->stats.rx_latency_max_ns)
+		wl->stats.rx_latency_max_ns = latency;
 
 	ieee80211_rx_ni(wl->hw, skb);
 
@@ -130,15 +241,23 @@ void wl1271_rx(struct wl1271 *wl, struct wl1271_fw_status *status)
 	u32 mem_block;
 	u32 pkt_length;
 	u32 pkt_offset;
+	u32 frames = 0;
+	u32 aggr_frames;
+	u32 share;
+	struct page *page;
+	u8 *buf;
+	ktime_t start = ktime_get();
 
 	while (drv_rx_counter != fw_rx_counter) {
 		buf_size = 0;
+		aggr_frames = 0;
 		rx_counter = drv_rx_counter;
 		while (rx_counter != fw_rx_counter) {
 			pkt_length = wl1271_rx_get_buf_size(status, rx_counter);
 			if (buf_size + pkt_length > WL1271_AGGR_BUFFER_SIZE)
 				break;
 			buf_size += pkt_length;
+			aggr_frames++;
 			rx_counter++;
 			rx_counter &= NUM_RX_PKT_DESC_MOD_MASK;
 		}
@@ -148,6 +267,14 @@ void wl1271_rx(struct wl1271 *wl, struct wl1271_fw_status *status)
 			break;
 		}
 
+		/* frames are built in place, fall back to copying them */
+		page = wl1271_rx_get_page(wl);
+		buf = page ? page_address(page) : wl->aggr_buf;
+
+		/* the page stays allocated until its last frame is freed */
+		share = max_t(u32, PAGE_SIZE,
+			      WL1271_AGGR_BUFFER_SIZE / aggr_frames);
+
 		/*
 		 * Choose the block we want to read
 		 * For aggregated packets, only the first memory block should
@@ -162,19 +289,20 @@ void wl1271_rx(struct wl1271 *wl, struct wl1271_fw_status *status)
 				sizeof(wl->rx_mem_pool_addr), false);
 
 		/* Read all available packets at once */
-		wl1271_read(wl, WL1271_SLV_MEM_DATA, wl->aggr_buf,
-				buf_size, true);
+		wl1271_read(wl, WL1271_SLV_MEM_DATA, buf, buf_size, true);
+		wl->stats.rx_reads++;
 
 		/* Split data into separate packets */
 		pkt_offset = 0;
 		while (pkt_offset < buf_size) {
 			pkt_length = wl1271_rx_get_buf_size(status,
 					drv_rx_counter);
-			if (wl1271_rx_handle_data(wl,
-					wl->aggr_buf + pkt_offset,
+			if (wl1271_rx_handle_data(wl, page, share,
+					buf + pkt_offset,
 					pkt_length) < 0)
 				break;
 			wl->rx_counter++;
+			frames++;
 			drv_rx_counter++;
 			drv_rx_counter &= NUM_RX_PKT_DESC_MOD_MASK;
 			pkt_offset += pkt_length;
@@ -182,4 +310,10 @@ void wl1271_rx(struct wl1271 *wl, struct wl1271_fw_status *status)
 	}
 	wl1271_write32(wl, RX_DRIVER_COUNTER_ADDRESS,
 			cpu_to_le32(wl->rx_counter));
+
+	/* allocate for the next time, off the interrupt to RX path */
+	wl1271_rx_refill(wl);
+
+	wl->stats.rx_frames += frames;
+	wl->stats.rx_path_ns += ktime_to_ns(ktime_sub(ktime_get(), start));
 }
@@ -60,6 +60,11 @@ static struct device *wl1271_sdio_wl_to_dev(struct wl1271 *wl)
 	return &(wl_to_func(wl)->dev);
 }
 
+/*
+ * The bus accesses need a sleeping context, so this only completes a
+ * pending ELP wakeup, flags the interrupt and hands over to
+ * wl1271_irq_thread().
+ */
 static irqreturn_t wl1271_irq(int irq, void *cookie)
 {
 	struct wl1271 *wl = cookie;
@@ -67,6 +72,8 @@ static irqreturn_t wl1271_irq(int irq, void *cookie)
 
 	wl1271_debug(DEBUG_IRQ, "IRQ");
 
+	wl->irq_time = ktime_get();
+
 	/* complete the ELP completion */
 	spin_lock_irqsave(&wl->wl_lock, flags);
 	if (wl->elp_compl) {
@@ -74,17 +81,20 @@ static irqreturn_t wl1271_irq(int irq, void *cookie)
 		wl->elp_compl = NULL;
 	}
 
-	if (!test_and_set_bit(WL1271_FLAG_IRQ_RUNNING, &wl->flags))
-		ieee80211_queue_work(wl->hw, &wl->irq_work);
 	set_bit(WL1271_FLAG_IRQ_PENDING, &wl->flags);
 	spin_unlock_irqrestore(&wl->wl_lock, flags);
 
-	return IRQ_HANDLED;
+	return IRQ_WAKE_THREAD;
 }
 
+/*
+ * Called with wl->mutex held, which the IRQ thread may be waiting
+ * for, so don't wait for it here; wl1271_flush_irq() does once the
+ * mutex is released.
+ */
 static void wl1271_sdio_disable_interrupts(struct wl1271 *wl)
 {
-	disable_irq(wl->irq);
+	disable_irq_nosync(wl->irq);
 }
 
 static void wl1271_sdio_enable_interrupts(struct wl1271 *wl)
@@ -241,9 +251,10 @@ static int __devinit wl1271_probe(struct sdio_func *func,
 	wl->irq = wlan_data->irq;
 	wl->ref_clock = wlan_data->board_ref_clock;
 
-	ret = request_irq(wl->irq, wl1271_irq, 0, DRIVER_NAME, wl);
+	ret = request_threaded_irq(wl->irq, wl1271_irq, wl1271_irq_thread,
+				   0, DRIVER_NAME, wl);
 	if (ret < 0) {
-		wl1271_error("request_irq() failed: %d", ret);
+		wl1271_error("request_threaded_irq() failed: %d", ret);
 		goto out_free;
 	}
 
@@ -329,6 +329,8 @@ static irqreturn_t wl1271_irq(int irq, void *cookie)
 
 	wl = cookie;
 
+	wl->irq_time = ktime_get();
+
 	/* complete the ELP completion */
 	spin_lock_irqsave(&wl->wl_lock, flags);
 	if (wl->elp_compl) {
@@ -138,16 +138,13 @@ static int twlreg_enable(struct regulator_dev *rdev)
 	int			grp;
 	int			ret;
 
-	grp = twlreg_read(info, TWL_MODULE_PM_RECEIVER, VREG_GRP);
-	if (grp < 0)
-		return grp;
-
 	if (twl_class_is_4030())
-		grp |= P1_GRP_4030;
+		grp = P1_GRP_4030;
 	else
-		grp |= P1_GRP_6030;
+		grp = P1_GRP_6030;
 
-	ret = twlreg_write(info, TWL_MODULE_PM_RECEIVER, VREG_GRP, grp);
+	ret = twl_i2c_update_bits(TWL_MODULE_PM_RECEIVER,
+			info->base + VREG_GRP, grp, grp);
 
 	udelay(info->delay);
 
@@ -159,16 +156,13 @@ static int twlreg_disable(struct regulator_dev *rdev)
 	struct twlreg_info	*info = rdev_get_drvdata(rdev);
 	int			grp;
 
-	grp = twlreg_read(info, TWL_MODULE_PM_RECEIVER, VREG_GRP);
-	if (grp < 0)
-		return grp;
-
 	if (twl_class_is_4030())
-		grp &= ~(P1_GRP_4030 | P2_GRP_4030 | P3_GRP_4030);
+		grp = P1_GRP_4030 | P2_GRP_4030 | P3_GRP_4030;
 	else
-		grp &= ~(P1_GRP_6030 | P2_GRP_6030 | P3_GRP_6030);
+		grp = P1_GRP_6030 | P2_GRP_6030 | P3_GRP_6030;
 
-	return twlreg_write(info, TWL_MODULE_PM_RECEIVER, VREG_GRP, grp);
+	return twl_i2c_update_bits(TWL_MODULE_PM_RECEIVER,
+			info->base + VREG_GRP, grp, 0);
 }
 
 static int twlreg_get_status(struct regulator_dev *rdev)
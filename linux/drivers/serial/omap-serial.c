@@ -42,8 +42,10 @@ static struct uart_omap_port *ui[OMAP_MAX_HSUART_PORTS];
 
 /* Forward declaration of functions */
 static void uart_tx_dma_callback(int lch, u16 ch_status, void *data);
-static void serial_omap_rx_timeout(unsigned long uart_no);
 static int serial_omap_start_rxdma(struct uart_omap_port *up);
+static void serial_omap_rx_dma_flush(struct uart_omap_port *up, int lsr);
+static void serial_omap_rx_timeout(unsigned long data);
+static void serial_omap_qos_work(struct work_struct *work);
 
 static inline unsigned int serial_in(struct uart_omap_port *up, int offset)
 {
@@ -94,10 +96,13 @@ static void serial_omap_stop_rxdma(struct uart_omap_port *up)
 {
 	if (up->uart_dma.rx_dma_used) {
 		del_timer(&up->uart_dma.rx_timer);
+		up->uart_dma.rx_dma_used = false;
 		omap_stop_dma(up->uart_dma.rx_dma_channel);
+		omap_dma_unlink_lch(up->uart_dma.rx_dma_channel,
+				up->uart_dma.rx_dma_channel);
 		omap_free_dma(up->uart_dma.rx_dma_channel);
 		up->uart_dma.rx_dma_channel = OMAP_UART_DMA_CH_FREE;
-		up->uart_dma.rx_dma_used = false;
+		schedule_work(&up->qos_work);
 	}
 }
 
@@ -156,6 +161,7 @@ static inline void receive_chars(struct uart_omap_port *up, int *status)
 			ch = serial_in(up, UART_RX);
 		flag = TTY_NORMAL;
 		up->port.icount.rx++;
+		up->stats.rx_pio_bytes++;
 
 		if (unlikely(lsr & UART_LSR_BRK_ERROR_BITS)) {
 			/*
@@ -348,7 +354,7 @@ static unsigned int check_modem_status(struct uart_omap_port *up)
 static inline irqreturn_t serial_omap_irq(int irq, void *dev_id)
 {
 	struct uart_omap_port *up = dev_id;
-	unsigned int iir, lsr;
+	unsigned int iir, lsr, int_id;
 	unsigned long flags;
 
 	iir = serial_in(up, UART_IIR);
@@ -356,25 +362,34 @@ static inline irqreturn_t serial_omap_irq(int irq, void *dev_id)
 		return IRQ_NONE;
 
 	spin_lock_irqsave(&up->port.lock, flags);
-
+	up->stats.irqs++;
 
 	lsr = serial_in(up, UART_LSR);
-	if (iir & UART_IIR_RLSI) {
-		if (!up->use_dma) {
-			if (lsr & UART_LSR_DR)
-			{
-				receive_chars(up, &lsr);
-				pm_wakeup_event(&up->pdev->dev, 0);
-			}
-		} else {
-			up->ier &= ~(UART_IER_RDI | UART_IER_RLSI);
-			serial_out(up, UART_IER, up->ier);
-			if ((serial_omap_start_rxdma(up) != 0) &&
-					(lsr & UART_LSR_DR))
-			{
-				receive_chars(up, &lsr);
+	int_id = iir & OMAP_UART_IIR_ID;
+	if (int_id == UART_IIR_RLSI || int_id == UART_IIR_RDI ||
+	    int_id == OMAP_UART_IIR_RX_TIMEOUT) {
+		/*
+		 * Reception after the ring was stopped for inactivity, or
+		 * with no channel to be had at startup: (re)start it.
+		 */
+		if (up->use_dma && up->uart_dma.rx_buf &&
+				!up->uart_dma.rx_dma_used)
+			serial_omap_start_rxdma(up);
+
+		if (up->uart_dma.rx_dma_used) {
+			/*
+			 * RDI only says the FIFO crossed the DMA trigger,
+			 * the ring drains it; a burst ends with the RX
+			 * timeout or a line status interrupt.
+			 */
+			if (int_id != UART_IIR_RDI) {
+				serial_omap_rx_dma_flush(up, lsr);
 				pm_wakeup_event(&up->pdev->dev, 0);
 			}
+		} else if (lsr & UART_LSR_DR) {
+			receive_chars(up, &lsr);
+			up->stats.rx_wakeups++;
+			pm_wakeup_event(&up->pdev->dev, 0);
 		}
 	}
 
@@ -509,13 +524,25 @@ static int serial_omap_startup(struct uart_port *port)
 			UART_XMIT_SIZE,
 			(dma_addr_t *)&(up->uart_dma.tx_buf_dma_phys),
 			0);
-		init_timer(&(up->uart_dma.rx_timer));
-		up->uart_dma.rx_timer.function = serial_omap_rx_timeout;
-		up->uart_dma.rx_timer.data = up->pdev->id;
 		/* Currently the buffer size is 4KB. Can increase it */
 		up->uart_dma.rx_buf = dma_alloc_coherent(NULL,
 			up->uart_dma.rx_buf_size,
 			(dma_addr_t *)&(up->uart_dma.rx_buf_dma_phys), 0);
+		setup_timer(&up->uart_dma.rx_timer, serial_omap_rx_timeout,
+				(unsigned long)up);
+		INIT_WORK(&up->qos_work, serial_omap_qos_work);
+
+		/* the actual limit follows the baud rate, see set_termios() */
+		pm_qos_add_request(&up->pm_qos_request, PM_QOS_CPU_DMA_LATENCY,
+				PM_QOS_DEFAULT_VALUE);
+
+		/*
+		 * RX DMA runs while there is reception and stops after
+		 * RX_TIMEOUT without any. If there is no channel now, the
+		 * interrupt handler uses PIO and retries.
+		 */
+		if (up->uart_dma.rx_buf && serial_omap_start_rxdma(up))
+			dev_warn(up->port.dev, "no RX DMA channel, using PIO\n");
 	}
 	/*
 	 * Finally, enable interrupts. Note: Modem status interrupts
@@ -567,6 +594,9 @@ static void serial_omap_shutdown(struct uart_port *port)
 			up->uart_dma.rx_buf_size, up->uart_dma.rx_buf,
 			up->uart_dma.rx_buf_dma_phys);
 		up->uart_dma.rx_buf = NULL;
+		del_timer_sync(&up->uart_dma.rx_timer);
+		cancel_work_sync(&up->qos_work);
+		pm_qos_remove_request(&up->pm_qos_request);
 	}
 	free_irq(up->port.irq, up);
 }
@@ -673,10 +703,25 @@ serial_omap_set_termios(struct uart_port *port, struct ktermios *termios,
 	baud = uart_get_baud_rate(port, termios, old, 0, port->uartclk/13);
 	quot = serial_omap_get_divisor(port, baud);
 
-	up->fcr = UART_FCR_R_TRIG_01 | UART_FCR_T_TRIG_01 |
-			UART_FCR_ENABLE_FIFO | UART_FCR_CLEAR_RCVR | UART_FCR_CLEAR_XMIT;
+	/*
+	 * Deep C-states stop the DMA until the CPU has restored CORE, so
+	 * the wakeup has to be quicker than the FIFO space above the RX
+	 * trigger takes to fill up (10 bits per character).
+	 */
+	if (up->use_dma && pm_qos_request_active(&up->pm_qos_request)) {
+		up->latency = (up->port.fifosize - OMAP_UART_RX_DMA_TRIG) *
+			10 * USEC_PER_SEC / baud;
+		serial_omap_qos_work(&up->qos_work);
+	}
+
+	up->fcr = UART_FCR_T_TRIG_01 | UART_FCR_ENABLE_FIFO |
+			UART_FCR_CLEAR_RCVR | UART_FCR_CLEAR_XMIT;
 	if (up->use_dma)
-		up->fcr |= UART_FCR_DMA_SELECT;
+		/* low bits of the RX trigger; TLR holds the rest */
+		up->fcr |= UART_FCR_DMA_SELECT |
+			(OMAP_UART_RX_DMA_TRIG & 0x3) << 6;
+	else
+		up->fcr |= UART_FCR_R_TRIG_01;
 
 	/*
 	 * Ok, we're now changing the port state. Do it with
@@ -750,7 +795,8 @@ serial_omap_set_termios(struct uart_port *port, struct ktermios *termios,
 	serial_out(up, UART_LCR, UART_LCR_CONF_MODE_B);
 
 	if (up->use_dma) {
-		serial_out(up, UART_TI752_TLR, 0);
+		serial_out(up, UART_TI752_TLR,
+			(OMAP_UART_RX_DMA_TRIG >> 2) << 4);
 		serial_out(up, UART_OMAP_SCR,
 			(UART_FCR_TRIGGER_4 | UART_FCR_TRIGGER_8));
 	}
@@ -1061,65 +1107,149 @@ static int serial_omap_resume(struct platform_device *dev)
 	return 0;
 }
 
-static void serial_omap_rx_timeout(unsigned long uart_no)
+static void serial_omap_rx_dma_insert(struct uart_omap_port *up,
+				      unsigned int from, unsigned int to)
 {
-	struct uart_omap_port *up = ui[uart_no];
-	unsigned int curr_dma_pos, curr_transmitted_size;
-	int ret = 0;
+	unsigned int len = to - from;
 
-	curr_dma_pos = omap_get_dma_dst_pos(up->uart_dma.rx_dma_channel);
-	if ((curr_dma_pos == up->uart_dma.prev_rx_dma_pos) ||
-			     (curr_dma_pos == 0)) {
-		if (jiffies_to_msecs(jiffies - up->port_activity) <
-							RX_TIMEOUT) {
-			mod_timer(&up->uart_dma.rx_timer, jiffies +
-				usecs_to_jiffies(up->uart_dma.rx_timeout));
-		} else {
-			serial_omap_stop_rxdma(up);
-			up->ier |= (UART_IER_RDI | UART_IER_RLSI);
-			serial_out(up, UART_IER, up->ier);
-		}
+	if (!len)
 		return;
-	}
 
-	curr_transmitted_size = curr_dma_pos -
-					up->uart_dma.prev_rx_dma_pos;
-	up->port.icount.rx += curr_transmitted_size;
 	tty_insert_flip_string(up->port.state->port.tty,
 			up->uart_dma.rx_buf +
-			(up->uart_dma.prev_rx_dma_pos -
-			up->uart_dma.rx_buf_dma_phys),
-			curr_transmitted_size);
-	tty_flip_buffer_push(up->port.state->port.tty);
-	up->uart_dma.prev_rx_dma_pos = curr_dma_pos;
-	if (up->uart_dma.rx_buf_size +
-			up->uart_dma.rx_buf_dma_phys == curr_dma_pos) {
-		ret = serial_omap_start_rxdma(up);
-		if (ret < 0) {
+			(from - up->uart_dma.rx_buf_dma_phys), len);
+	up->port.icount.rx += len;
+	up->stats.rx_dma_bytes += len;
+}
+
+/*
+ * Queue whatever the RX DMA ring received since the last call for the
+ * tty layer, without pushing it. Called with the port lock held.
+ */
+static void serial_omap_rx_dma_harvest(struct uart_omap_port *up)
+{
+	struct uart_omap_dma *dma = &up->uart_dma;
+	unsigned int start = dma->rx_buf_dma_phys;
+	unsigned int end = start + dma->rx_buf_size;
+	unsigned int pos;
+
+	/* CDAC reads 0 until the first byte after starting the channel */
+	pos = omap_get_dma_dst_pos(dma->rx_dma_channel);
+	if (pos < start || pos > end)
+		return;
+
+	if (pos < dma->prev_rx_dma_pos) {
+		/* The link restarted the channel at the top of the ring */
+		serial_omap_rx_dma_insert(up, dma->prev_rx_dma_pos, end);
+		dma->prev_rx_dma_pos = start;
+	}
+	serial_omap_rx_dma_insert(up, dma->prev_rx_dma_pos, pos);
+	dma->prev_rx_dma_pos = pos;
+}
+
+/*
+ * End of a burst: the RX timeout (or a line status) interrupt fired with
+ * fewer than OMAP_UART_RX_DMA_TRIG characters left in the FIFO. Stop
+ * the ring so it cannot race with us, take what it received, read the
+ * rest of the FIFO by hand and wake the reader once for all of it.
+ * Called with the port lock held.
+ */
+static void serial_omap_rx_dma_flush(struct uart_omap_port *up, int lsr)
+{
+	struct uart_omap_dma *dma = &up->uart_dma;
+
+	omap_stop_dma(dma->rx_dma_channel);
+	serial_omap_rx_dma_harvest(up);
+
+	/*
+	 * The DMA may have emptied the FIFO since @lsr was read; only keep
+	 * the error bits, reading an empty FIFO aborts on some revisions.
+	 */
+	lsr = (lsr & UART_LSR_BRK_ERROR_BITS) | serial_in(up, UART_LSR);
+	if (lsr & (UART_LSR_DR | UART_LSR_BI)) {
+		/* pushes everything queued so far */
+		receive_chars(up, &lsr);
+	} else {
+		spin_unlock(&up->port.lock);
+		tty_flip_buffer_push(up->port.state->port.tty);
+		spin_lock(&up->port.lock);
+	}
+	up->stats.rx_wakeups++;
+
+	dma->prev_rx_dma_pos = dma->rx_buf_dma_phys;
+	omap_start_dma(dma->rx_dma_channel);
+	up->port_activity = jiffies;
+}
+
+/*
+ * Nothing received for RX_TIMEOUT: stop the ring so that sDMA and CORE
+ * can idle. The next RX interrupt starts it again.
+ */
+static void serial_omap_rx_timeout(unsigned long data)
+{
+	struct uart_omap_port *up = (struct uart_omap_port *)data;
+	unsigned long flags;
+	bool stopped = false;
+
+	spin_lock_irqsave(&up->port.lock, flags);
+	if (up->uart_dma.rx_dma_used) {
+		if (time_before(jiffies, up->port_activity + RX_TIMEOUT)) {
+			mod_timer(&up->uart_dma.rx_timer,
+				  up->port_activity + RX_TIMEOUT);
+		} else {
+			omap_stop_dma(up->uart_dma.rx_dma_channel);
+			serial_omap_rx_dma_harvest(up);
 			serial_omap_stop_rxdma(up);
-			up->ier |= (UART_IER_RDI | UART_IER_RLSI);
-			serial_out(up, UART_IER, up->ier);
+			stopped = true;
 		}
-	} else  {
-		mod_timer(&up->uart_dma.rx_timer, jiffies +
-			usecs_to_jiffies(up->uart_dma.rx_timeout));
 	}
-	up->port_activity = jiffies;
+	spin_unlock_irqrestore(&up->port.lock, flags);
+
+	if (stopped)
+		tty_flip_buffer_push(up->port.state->port.tty);
+}
+
+/*
+ * The latency limit only matters while the ring runs: with it stopped
+ * the first characters come in through the FIFO and the RX interrupt.
+ * Blocking notifiers, so not from the interrupt or timer directly.
+ */
+static void serial_omap_qos_work(struct work_struct *work)
+{
+	struct uart_omap_port *up = container_of(work, struct uart_omap_port,
+						 qos_work);
+
+	pm_qos_update_request(&up->pm_qos_request,
+			up->uart_dma.rx_dma_used ? up->latency :
+			PM_QOS_DEFAULT_VALUE);
 }
 
 static void uart_rx_dma_callback(int lch, u16 ch_status, void *data)
 {
-	return;
+	struct uart_omap_port *up = data;
+	unsigned long flags;
+
+	/*
+	 * Block interrupt: the ring wrapped in the middle of a long burst.
+	 * Move the data out of the way; the RX timeout at the end of the
+	 * burst pushes it.
+	 */
+	spin_lock_irqsave(&up->port.lock, flags);
+	if (up->uart_dma.rx_dma_used) {
+		serial_omap_rx_dma_harvest(up);
+		up->stats.rx_dma_wraps++;
+	}
+	spin_unlock_irqrestore(&up->port.lock, flags);
 }
 
 static int serial_omap_start_rxdma(struct uart_omap_port *up)
 {
 	int ret = 0;
 
-	if (up->uart_dma.rx_dma_channel == -1) {
+	if (up->uart_dma.rx_dma_channel == OMAP_UART_DMA_CH_FREE) {
 		ret = omap_request_dma(up->uart_dma.uart_dma_rx,
 				"UART Rx DMA",
-				(void *)uart_rx_dma_callback, up,
+				uart_rx_dma_callback, up,
 				&(up->uart_dma.rx_dma_channel));
 		if (ret < 0)
 			return ret;
@@ -1135,13 +1265,19 @@ static int serial_omap_start_rxdma(struct uart_omap_port *up)
 				up->uart_dma.rx_buf_size, 1,
 				OMAP_DMA_SYNC_ELEMENT,
 				up->uart_dma.uart_dma_rx, 0);
+		/*
+		 * Link the channel with itself so that the ring keeps
+		 * filling without being reprogrammed.
+		 */
+		omap_dma_link_lch(up->uart_dma.rx_dma_channel,
+				up->uart_dma.rx_dma_channel);
 	}
 	up->uart_dma.prev_rx_dma_pos = up->uart_dma.rx_buf_dma_phys;
-	/* FIXME: Cache maintenance needed here? */
 	omap_start_dma(up->uart_dma.rx_dma_channel);
-	mod_timer(&up->uart_dma.rx_timer, jiffies +
-				usecs_to_jiffies(up->uart_dma.rx_timeout));
 	up->uart_dma.rx_dma_used = true;
+	up->port_activity = jiffies;
+	mod_timer(&up->uart_dma.rx_timer, jiffies + RX_TIMEOUT);
+	schedule_work(&up->qos_work);
 	return ret;
 }
 
@@ -1203,6 +1339,34 @@ static void uart_tx_dma_callback(int lch, u16 ch_status, void *data)
 	return;
 }
 
+static ssize_t serial_omap_show_stats(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct uart_omap_port *up = dev_get_drvdata(dev);
+	struct uart_omap_stats *stats = &up->stats;
+
+	return sprintf(buf, "irqs %lu\nrx_dma_bytes %lu\nrx_pio_bytes %lu\n"
+			"rx_wakeups %lu\nrx_dma_wraps %lu\n",
+			stats->irqs, stats->rx_dma_bytes, stats->rx_pio_bytes,
+			stats->rx_wakeups, stats->rx_dma_wraps);
+}
+
+static ssize_t serial_omap_store_stats(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t count)
+{
+	struct uart_omap_port *up = dev_get_drvdata(dev);
+	unsigned long flags;
+
+	spin_lock_irqsave(&up->port.lock, flags);
+	memset(&up->stats, 0, sizeof(up->stats));
+	spin_unlock_irqrestore(&up->port.lock, flags);
+
+	return count;
+}
+
+static DEVICE_ATTR(stats, S_IRUGO | S_IWUSR,
+		serial_omap_show_stats, serial_omap_store_stats);
+
 static int serial_omap_probe(struct platform_device *pdev)
 {
 	struct uart_omap_port	*up;
@@ -1269,7 +1433,6 @@ static int serial_omap_probe(struct platform_device *pdev)
 		up->uart_dma.uart_dma_rx = dma_rx->start;
 		up->use_dma = 1;
 		up->uart_dma.rx_buf_size = 4096;
-		up->uart_dma.rx_timeout = 2;
 		spin_lock_init(&(up->uart_dma.tx_lock));
 		spin_lock_init(&(up->uart_dma.rx_lock));
 		up->uart_dma.tx_dma_channel = OMAP_UART_DMA_CH_FREE;
@@ -1285,6 +1448,9 @@ static int serial_omap_probe(struct platform_device *pdev)
 
 	platform_set_drvdata(pdev, up);
 
+	if (device_create_file(&pdev->dev, &dev_attr_stats))
+		dev_warn(&pdev->dev, "could not create stats attribute\n");
+
 	device_init_wakeup(&up->pdev->dev, true);
 	return 0;
 err:
@@ -1299,6 +1465,7 @@ static int serial_omap_remove(struct platform_device *dev)
 {
 	struct uart_omap_port *up = platform_get_drvdata(dev);
 
+	device_remove_file(&dev->dev, &dev_attr_stats);
 	platform_set_drvdata(dev, NULL);
 	if (up) {
 		uart_remove_one_port(&serial_omap_reg, &up->port);
@@ -33,6 +33,11 @@
 #include <linux/clk.h>
 #include <linux/io.h>
 #include <linux/slab.h>
+#include <linux/gcd.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
 
 #include <linux/spi/spi.h>
 
@@ -53,6 +58,7 @@
 #define OMAP2_MCSPI_WAKEUPENABLE	0x20
 #define OMAP2_MCSPI_SYST		0x24
 #define OMAP2_MCSPI_MODULCTRL		0x28
+#define OMAP2_MCSPI_XFERLEVEL		0x7c
 
 /* per-channel banks, 0x14 bytes each, first is: */
 #define OMAP2_MCSPI_CHCONF0		0x2c
@@ -70,6 +76,9 @@
 
 #define OMAP2_MCSPI_SYSSTATUS_RESETDONE	BIT(0)
 
+#define OMAP2_MCSPI_IRQSTATUS_TX_EMPTY(ch)	BIT((ch) * 4)
+#define OMAP2_MCSPI_IRQSTATUS_RX_FULL(ch)	BIT((ch) * 4 + 2)
+
 #define OMAP2_MCSPI_MODULCTRL_SINGLE	BIT(0)
 #define OMAP2_MCSPI_MODULCTRL_MS	BIT(2)
 #define OMAP2_MCSPI_MODULCTRL_STEST	BIT(3)
@@ -89,10 +98,17 @@
 #define OMAP2_MCSPI_CHCONF_IS		BIT(18)
 #define OMAP2_MCSPI_CHCONF_TURBO	BIT(19)
 #define OMAP2_MCSPI_CHCONF_FORCE	BIT(20)
+#define OMAP2_MCSPI_CHCONF_FFET		BIT(27)
+#define OMAP2_MCSPI_CHCONF_FFER		BIT(28)
 
 #define OMAP2_MCSPI_CHSTAT_RXS		BIT(0)
 #define OMAP2_MCSPI_CHSTAT_TXS		BIT(1)
 #define OMAP2_MCSPI_CHSTAT_EOT		BIT(2)
+#define OMAP2_MCSPI_CHSTAT_TXFFE	BIT(3)
+#define OMAP2_MCSPI_CHSTAT_RXFFF	BIT(6)
+
+#define OMAP2_MCSPI_XFERLEVEL_AFL_SHIFT	8
+#define OMAP2_MCSPI_XFERLEVEL_WCNT_SHIFT	16
 
 #define OMAP2_MCSPI_CHCTRL_EN		BIT(0)
 
@@ -119,6 +135,26 @@ struct omap2_mcspi_dma {
 #define DMA_MIN_BYTES			160
 #endif
 
+/* OMAP3 and later have a 64 byte FIFO, shared by TX and RX when both are
+ * enabled.  PIO transfers too short for DMA go through it when they are
+ * at least FIFO_MIN_BYTES long, refilling and draining it a threshold's
+ * worth of words at a time instead of polling for every word.
+ */
+#define OMAP2_MCSPI_MAX_FIFODEPTH	64
+#define OMAP2_MCSPI_MAX_FIFOWCNT	0xffff
+#define FIFO_MIN_BYTES			8
+
+struct omap2_mcspi_stats {
+	u32			messages;
+	u32			pipelined;	/* CS kept from the previous one */
+	u32			pio;		/* transfers, per path */
+	u32			fifo;
+	u32			dma;
+	u32			max_ns;		/* longest message */
+	u64			bytes;
+	u64			busy_ns;
+	ktime_t			since;
+};
 
 struct omap2_mcspi {
 	struct work_struct	work;
@@ -133,6 +169,11 @@ struct omap2_mcspi {
 	unsigned long		phys;
 	/* SPI1 has 4 channels, while SPI2 has 2 */
 	struct omap2_mcspi_dma	*dma_channels;
+	bool			has_fifo;
+	/* bytes per FIFO threshold while a transfer uses the FIFO */
+	unsigned		fifo_depth;
+	struct omap2_mcspi_stats stats;
+	struct dentry		*debugfs;
 };
 
 struct omap2_mcspi_cs {
@@ -313,6 +354,92 @@ static int mcspi_wait_for_reg_bit(void __iomem *reg, unsigned long bit)
 	return 0;
 }
 
+/* wait for a FIFO threshold event, or a FIFO state that implies it */
+static int mcspi_wait_for_fifo(struct omap2_mcspi *mcspi,
+		void __iomem *chstat_reg, u32 event, u32 state)
+{
+	void __iomem	*irqstat_reg = mcspi->base + OMAP2_MCSPI_IRQSTATUS;
+	unsigned long	timeout;
+
+	timeout = jiffies + msecs_to_jiffies(1000);
+	while (!(__raw_readl(irqstat_reg) & event)
+			&& !(__raw_readl(chstat_reg) & state)) {
+		if (time_after(jiffies, timeout))
+			return -1;
+		cpu_relax();
+	}
+	__raw_writel(event, irqstat_reg);
+	return 0;
+}
+
+static inline unsigned mcspi_bytes_per_word(int word_len)
+{
+	if (word_len <= 8)
+		return 1;
+	else if (word_len <= 16)
+		return 2;
+	else /* word_len <= 32 */
+		return 4;
+}
+
+/*
+ * Give the FIFO to the channel for transfer @t, or take it back.  Only one
+ * channel can use it at a time and the channel must be disabled while it
+ * changes.  Returns the bytes per threshold event, 0 when @t can't use the
+ * FIFO: its length must be a whole number of thresholds of two words or more.
+ */
+static unsigned omap2_mcspi_set_fifo(struct spi_device *spi,
+		struct spi_transfer *t, int enable)
+{
+	struct spi_master	*master = spi->master;
+	struct omap2_mcspi	*mcspi = spi_master_get_devdata(master);
+	struct omap2_mcspi_cs	*cs = spi->controller_state;
+	unsigned		bytes_per_word, max_depth, depth = 0;
+	u32			chconf, xferlevel = 0;
+
+	chconf = mcspi_cached_chconf0(spi);
+	chconf &= ~(OMAP2_MCSPI_CHCONF_FFET | OMAP2_MCSPI_CHCONF_FFER);
+
+	if (enable) {
+		bytes_per_word = mcspi_bytes_per_word(cs->word_len);
+
+		/* half of our share, so the FIFO refills while it shifts */
+		max_depth = OMAP2_MCSPI_MAX_FIFODEPTH / 2;
+		if (t->tx_buf != NULL && t->rx_buf != NULL)
+			max_depth /= 2;
+
+		depth = gcd(t->len, max_depth);
+		if (depth < 2 * bytes_per_word || depth % bytes_per_word
+				|| t->len / bytes_per_word
+					> OMAP2_MCSPI_MAX_FIFOWCNT)
+			return 0;
+
+		xferlevel = (t->len / bytes_per_word)
+				<< OMAP2_MCSPI_XFERLEVEL_WCNT_SHIFT;
+		if (t->rx_buf != NULL) {
+			chconf |= OMAP2_MCSPI_CHCONF_FFER;
+			xferlevel |= (depth - 1)
+					<< OMAP2_MCSPI_XFERLEVEL_AFL_SHIFT;
+		}
+		if (t->tx_buf != NULL) {
+			chconf |= OMAP2_MCSPI_CHCONF_FFET;
+			xferlevel |= depth - 1;
+		}
+	}
+
+	omap2_mcspi_set_enable(spi, 0);
+	mcspi_write_reg(master, OMAP2_MCSPI_XFERLEVEL, xferlevel);
+	mcspi_write_chconf0(spi, chconf);
+	/* drop threshold events left from an earlier transfer */
+	mcspi_write_reg(master, OMAP2_MCSPI_IRQSTATUS,
+			OMAP2_MCSPI_IRQSTATUS_TX_EMPTY(spi->chip_select) |
+			OMAP2_MCSPI_IRQSTATUS_RX_FULL(spi->chip_select));
+	omap2_mcspi_set_enable(spi, 1);
+
+	mcspi->fifo_depth = depth;
+	return depth;
+}
+
 static unsigned
 omap2_mcspi_txrx_dma(struct spi_device *spi, struct spi_transfer *xfer)
 {
@@ -655,6 +782,95 @@ out:
 	return count - c;
 }
 
+/* PIO through the FIFO, set up by omap2_mcspi_set_fifo() */
+static unsigned
+omap2_mcspi_txrx_fifo(struct spi_device *spi, struct spi_transfer *xfer)
+{
+	struct omap2_mcspi	*mcspi;
+	struct omap2_mcspi_cs	*cs = spi->controller_state;
+	unsigned int		bytes_per_word, burst, words, i;
+	unsigned int		tx_words, rx_words;
+	void __iomem		*tx_reg;
+	void __iomem		*rx_reg;
+	void __iomem		*chstat_reg;
+	u32			tx_empty, rx_full;
+	const u8		*tx;
+	u8			*rx;
+
+	mcspi = spi_master_get_devdata(spi->master);
+
+	tx_reg		= cs->base + OMAP2_MCSPI_TX0;
+	rx_reg		= cs->base + OMAP2_MCSPI_RX0;
+	chstat_reg	= cs->base + OMAP2_MCSPI_CHSTAT0;
+	tx_empty	= OMAP2_MCSPI_IRQSTATUS_TX_EMPTY(spi->chip_select);
+	rx_full		= OMAP2_MCSPI_IRQSTATUS_RX_FULL(spi->chip_select);
+
+	bytes_per_word = mcspi_bytes_per_word(cs->word_len);
+	burst = mcspi->fifo_depth / bytes_per_word;
+	words = xfer->len / bytes_per_word;
+
+	tx = xfer->tx_buf;
+	rx = xfer->rx_buf;
+	tx_words = tx ? words : 0;
+	rx_words = rx ? words : 0;
+
+	while (tx_words || rx_words) {
+		/* TX runs at most one threshold ahead of RX, which is all
+		 * the RX half of the FIFO is sure to hold on top of the
+		 * threshold we are waiting for.
+		 */
+		if (tx_words && (rx == NULL || rx_words - tx_words <= burst)) {
+			if (mcspi_wait_for_fifo(mcspi, chstat_reg, tx_empty,
+					OMAP2_MCSPI_CHSTAT_TXFFE) < 0) {
+				dev_err(&spi->dev, "TX FIFO timed out\n");
+				goto out;
+			}
+			for (i = 0; i < burst; i++, tx += bytes_per_word) {
+				if (bytes_per_word == 1)
+					__raw_writel(*tx, tx_reg);
+				else if (bytes_per_word == 2)
+					__raw_writel(*(const u16 *)tx, tx_reg);
+				else
+					__raw_writel(*(const u32 *)tx, tx_reg);
+			}
+			tx_words -= burst;
+			continue;
+		}
+
+		if (mcspi_wait_for_fifo(mcspi, chstat_reg, rx_full,
+				OMAP2_MCSPI_CHSTAT_RXFFF) < 0) {
+			dev_err(&spi->dev, "RX FIFO timed out\n");
+			goto out;
+		}
+		for (i = 0; i < burst; i++, rx += bytes_per_word) {
+			if (bytes_per_word == 1)
+				*rx = __raw_readl(rx_reg);
+			else if (bytes_per_word == 2)
+				*(u16 *)rx = __raw_readl(rx_reg);
+			else
+				*(u32 *)rx = __raw_readl(rx_reg);
+		}
+		rx_words -= burst;
+	}
+
+	/* for TX_ONLY mode, be sure all words have shifted out */
+	if (xfer->rx_buf == NULL) {
+		if (mcspi_wait_for_reg_bit(chstat_reg,
+				OMAP2_MCSPI_CHSTAT_TXFFE) < 0)
+			dev_err(&spi->dev, "TXFFE timed out\n");
+		else if (mcspi_wait_for_reg_bit(chstat_reg,
+				OMAP2_MCSPI_CHSTAT_EOT) < 0)
+			dev_err(&spi->dev, "EOT timed out\n");
+	}
+out:
+	/* disabling the channel also purges RX data of TX_ONLY transfers */
+	omap2_mcspi_set_fifo(spi, xfer, 0);
+
+	if (xfer->rx_buf != NULL)
+		return (words - rx_words) * bytes_per_word;
+	return (words - tx_words) * bytes_per_word;
+}
+
 /* called only when no transfer is active to this device */
 static int omap2_mcspi_setup_transfer(struct spi_device *spi,
 		struct spi_transfer *t)
@@ -864,8 +1080,12 @@ static void omap2_mcspi_cleanup(struct spi_device *spi)
 static void omap2_mcspi_work(struct work_struct *work)
 {
 	struct omap2_mcspi	*mcspi;
+	struct omap2_mcspi_stats *stats;
+	struct spi_device	*active = NULL;
+	int			cs_active = 0;
 
 	mcspi = container_of(work, struct omap2_mcspi, work);
+	stats = &mcspi->stats;
 	spin_lock_irq(&mcspi->lock);
 
 	if (omap2_mcspi_enable_clocks(mcspi))
@@ -876,17 +1096,23 @@ static void omap2_mcspi_work(struct work_struct *work)
 	 * arbitrate among multiple channels.  This corresponds to "single
 	 * channel" master mode.  As a side effect, we need to manage the
 	 * chipselect with the FORCE bit ... CS != channel enable.
+	 *
+	 * Messages queued back to back for one device share the channel
+	 * enable, and if the last transfer of one sets cs_change the
+	 * chipselect stays asserted into the next, as that hint asks.
 	 */
 	while (!list_empty(&mcspi->msg_queue)) {
-		struct spi_message		*m;
+		struct spi_message		*m, *next;
 		struct spi_device		*spi;
 		struct spi_transfer		*t = NULL;
-		int				cs_active = 0;
 		struct omap2_mcspi_cs		*cs;
 		struct omap2_mcspi_device_config *cd;
 		int				par_override = 0;
 		int				status = 0;
+		int				keep_cs = 0;
 		u32				chconf;
+		ktime_t				start;
+		u32				ns;
 
 		m = container_of(mcspi->msg_queue.next, struct spi_message,
 				 queue);
@@ -894,11 +1120,18 @@ static void omap2_mcspi_work(struct work_struct *work)
 		list_del_init(&m->queue);
 		spin_unlock_irq(&mcspi->lock);
 
+		start = ktime_get();
+
 		spi = m->spi;
 		cs = spi->controller_state;
 		cd = spi->controller_data;
 
-		omap2_mcspi_set_enable(spi, 1);
+		if (spi != active)
+			omap2_mcspi_set_enable(spi, 1);
+		else if (cs_active)
+			stats->pipelined++;
+		active = spi;
+
 		list_for_each_entry(t, &m->transfers, transfer_list) {
 			if (t->tx_buf == NULL && t->rx_buf == NULL && t->len) {
 				status = -EINVAL;
@@ -937,16 +1170,29 @@ static void omap2_mcspi_work(struct work_struct *work)
 
 			if (t->len) {
 				unsigned	count;
+				unsigned	fifo = 0;
+
+				if (mcspi->has_fifo && !m->is_dma_mapped
+						&& t->len >= FIFO_MIN_BYTES
+						&& t->len < DMA_MIN_BYTES
+						&& !(chconf & OMAP2_MCSPI_CHCONF_TURBO))
+					fifo = omap2_mcspi_set_fifo(spi, t, 1);
 
 				/* RX_ONLY mode needs dummy data in TX reg */
 				if (t->tx_buf == NULL)
 					__raw_writel(0, cs->base
 							+ OMAP2_MCSPI_TX0);
 
-				if (m->is_dma_mapped || t->len >= DMA_MIN_BYTES)
+				if (m->is_dma_mapped || t->len >= DMA_MIN_BYTES) {
 					count = omap2_mcspi_txrx_dma(spi, t);
-				else
+					stats->dma++;
+				} else if (fifo) {
+					count = omap2_mcspi_txrx_fifo(spi, t);
+					stats->fifo++;
+				} else {
 					count = omap2_mcspi_txrx_pio(spi, t);
+					stats->pio++;
+				}
 				m->actual_length += count;
 
 				if (count != t->len) {
@@ -958,10 +1204,15 @@ static void omap2_mcspi_work(struct work_struct *work)
 			if (t->delay_usecs)
 				udelay(t->delay_usecs);
 
-			/* ignore the "leave it on after last xfer" hint */
+			/* after the last xfer, cs_change means "leave it on" */
 			if (t->cs_change) {
-				omap2_mcspi_force_cs(spi, 0);
-				cs_active = 0;
+				if (list_is_last(&t->transfer_list,
+						&m->transfers)) {
+					keep_cs = 1;
+				} else {
+					omap2_mcspi_force_cs(spi, 0);
+					cs_active = 0;
+				}
 			}
 		}
 
@@ -971,10 +1222,31 @@ static void omap2_mcspi_work(struct work_struct *work)
 			status = omap2_mcspi_setup_transfer(spi, NULL);
 		}
 
-		if (cs_active)
+		/* only we take messages off the queue, so its head stays */
+		spin_lock_irq(&mcspi->lock);
+		next = list_empty(&mcspi->msg_queue) ? NULL :
+			container_of(mcspi->msg_queue.next, struct spi_message,
+				     queue);
+		if (next && next->spi != spi)
+			next = NULL;
+		spin_unlock_irq(&mcspi->lock);
+
+		if (cs_active && (!next || !keep_cs || status)) {
 			omap2_mcspi_force_cs(spi, 0);
+			cs_active = 0;
+		}
 
-		omap2_mcspi_set_enable(spi, 0);
+		if (!next) {
+			omap2_mcspi_set_enable(spi, 0);
+			active = NULL;
+		}
+
+		ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+		stats->messages++;
+		stats->bytes += m->actual_length;
+		stats->busy_ns += ns;
+		if (ns > stats->max_ns)
+			stats->max_ns = ns;
 
 		m->status = status;
 		m->complete(m->context);
@@ -1066,6 +1338,97 @@ static int omap2_mcspi_transfer(struct spi_device *spi, struct spi_message *m)
 	return 0;
 }
 
+#ifdef CONFIG_DEBUG_FS
+
+static struct dentry *omap2_mcspi_debugfs_root;
+
+static int omap2_mcspi_stats_show(struct seq_file *s, void *unused)
+{
+	struct omap2_mcspi		*mcspi = s->private;
+	struct omap2_mcspi_stats	*stats = &mcspi->stats;
+	u64				busy_us, elapsed_us;
+	u64				busy_rate = 0, rate = 0;
+	u32				avg_us = 0;
+
+	busy_us = div_u64(stats->busy_ns, NSEC_PER_USEC);
+	elapsed_us = ktime_us_delta(ktime_get(), stats->since);
+
+	if (stats->messages)
+		avg_us = div_u64(busy_us, stats->messages);
+	if (busy_us)
+		busy_rate = div64_u64(stats->bytes * USEC_PER_SEC, busy_us);
+	if (elapsed_us)
+		rate = div64_u64(stats->bytes * USEC_PER_SEC, elapsed_us);
+
+	seq_printf(s, "messages:   %u (%u with CS kept)\n",
+		   stats->messages, stats->pipelined);
+	seq_printf(s, "transfers:  %u pio, %u fifo, %u dma\n",
+		   stats->pio, stats->fifo, stats->dma);
+	seq_printf(s, "bytes:      %llu\n", (unsigned long long)stats->bytes);
+	seq_printf(s, "us/message: %u avg, %u max\n",
+		   avg_us, stats->max_ns / 1000);
+	seq_printf(s, "bytes/s:    %llu while busy, %llu over %llu ms\n",
+		   (unsigned long long)busy_rate, (unsigned long long)rate,
+		   (unsigned long long)div_u64(elapsed_us, 1000));
+
+	return 0;
+}
+
+static int omap2_mcspi_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, omap2_mcspi_stats_show, inode->i_private);
+}
+
+/* any write clears the counters and starts a new measurement window */
+static ssize_t omap2_mcspi_stats_write(struct file *file,
+		const char __user *buf, size_t count, loff_t *ppos)
+{
+	struct seq_file		*s = file->private_data;
+	struct omap2_mcspi	*mcspi = s->private;
+
+	memset(&mcspi->stats, 0, sizeof(mcspi->stats));
+	mcspi->stats.since = ktime_get();
+
+	return count;
+}
+
+static const struct file_operations omap2_mcspi_stats_fops = {
+	.open		= omap2_mcspi_stats_open,
+	.read		= seq_read,
+	.write		= omap2_mcspi_stats_write,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static void omap2_mcspi_debugfs_init(struct omap2_mcspi *mcspi)
+{
+	if (!omap2_mcspi_debugfs_root)
+		omap2_mcspi_debugfs_root = debugfs_create_dir("omap2_mcspi",
+							      NULL);
+
+	mcspi->debugfs = debugfs_create_file(dev_name(&mcspi->master->dev),
+			S_IRUGO | S_IWUSR, omap2_mcspi_debugfs_root, mcspi,
+			&omap2_mcspi_stats_fops);
+}
+
+static void omap2_mcspi_debugfs_exit(struct omap2_mcspi *mcspi)
+{
+	debugfs_remove(mcspi->debugfs);
+	mcspi->debugfs = NULL;
+}
+
+#else
+
+static inline void omap2_mcspi_debugfs_init(struct omap2_mcspi *mcspi)
+{
+}
+
+static inline void omap2_mcspi_debugfs_exit(struct omap2_mcspi *mcspi)
+{
+}
+
+#endif
+
 static int __init omap2_mcspi_reset(struct omap2_mcspi *mcspi)
 {
 	struct spi_master	*master = mcspi->master;
@@ -1203,6 +1566,8 @@ static int __init omap2_mcspi_probe(struct platform_device *pdev)
 
 	mcspi = spi_master_get_devdata(master);
 	mcspi->master = master;
+	mcspi->has_fifo = cpu_is_omap34xx();
+	mcspi->stats.since = ktime_get();
 
 	r = platform_get_resource(pdev, IORESOURCE_MEM, 0);
 	if (r == NULL) {
@@ -1263,6 +1628,8 @@ static int __init omap2_mcspi_probe(struct platform_device *pdev)
 	if (status < 0)
 		goto err4;
 
+	omap2_mcspi_debugfs_init(mcspi);
+
 	return status;
 
 err4:
@@ -1292,6 +1659,8 @@ static int __exit omap2_mcspi_remove(struct platform_device *pdev)
 	mcspi = spi_master_get_devdata(master);
 	dma_channels = mcspi->dma_channels;
 
+	omap2_mcspi_debugfs_exit(mcspi);
+
 	clk_put(mcspi->fck);
 	clk_put(mcspi->ick);
 
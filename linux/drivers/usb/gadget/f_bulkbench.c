@@ -0,0 +1,437 @@
+/*
+ *    Copyright (c) 2012 Nest Labs, Inc.
+ *
+ *    This program is free software; you can redistribute it and/or
+ *    modify it under the terms of the GNU General Public License
+ *    version 2 as published by the Free Software Foundation.
+ *
+ *    Description:
+ *      Bulk throughput benchmark function for the dynamic
+ *      multi-function composite USB gadget driver.
+ *
+ *      Like the source/sink function used by gadget zero, this sinks
+ *      everything the host sends OUT and sources zeroes IN, but it
+ *      keeps several large requests queued on each endpoint so that
+ *      what gets measured is the controller and its DMA, not the
+ *      request turnaround. Byte counts and rates since the last reset
+ *      are in the "stats" attribute of the function device; writing
+ *      anything to it starts a new measurement.
+ *
+ *      The function starts disabled so the normal product enumerates
+ *      as before. Enabling it (and disabling the others) switches the
+ *      gadget to the benchmark product ID of the board's product table.
+ */
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/device.h>
+#include <linux/hrtimer.h>
+#include <linux/spinlock.h>
+
+#include <linux/usb/ch9.h>
+#include <linux/usb/composite.h>
+#include <linux/usb/dynamic.h>
+#include <linux/usb/gadget.h>
+
+#define FUNCTION_NAME		"bulkbench"
+
+static unsigned qlen = 4;
+module_param(qlen, uint, S_IRUGO);
+MODULE_PARM_DESC(qlen, "requests queued per endpoint");
+
+static unsigned buflen = 65536;
+module_param(buflen, uint, S_IRUGO);
+MODULE_PARM_DESC(buflen, "bytes per request");
+
+#define BULKBENCH_MAX_QLEN	8
+
+struct bulkbench_stats {
+	u64			bytes;
+	unsigned long		requests;
+	unsigned long		errors;
+	ktime_t			first;
+	ktime_t			last;
+};
+
+struct f_bulkbench {
+	struct usb_function	function;
+
+	struct usb_ep		*in_ep;
+	struct usb_ep		*out_ep;
+	struct usb_request	*in_req[BULKBENCH_MAX_QLEN];
+	struct usb_request	*out_req[BULKBENCH_MAX_QLEN];
+	unsigned		nreqs;
+
+	spinlock_t		lock;
+	struct bulkbench_stats	in;
+	struct bulkbench_stats	out;
+};
+
+static inline struct f_bulkbench *func_to_bb(struct usb_function *f)
+{
+	return container_of(f, struct f_bulkbench, function);
+}
+
+/*-------------------------------------------------------------------------*/
+
+static struct usb_interface_descriptor bulkbench_intf = {
+	.bLength =		sizeof bulkbench_intf,
+	.bDescriptorType =	USB_DT_INTERFACE,
+
+	.bNumEndpoints =	2,
+	.bInterfaceClass =	USB_CLASS_VENDOR_SPEC,
+};
+
+static struct usb_endpoint_descriptor fs_bulkbench_in_desc = {
+	.bLength =		USB_DT_ENDPOINT_SIZE,
+	.bDescriptorType =	USB_DT_ENDPOINT,
+
+	.bEndpointAddress =	USB_DIR_IN,
+	.bmAttributes =		USB_ENDPOINT_XFER_BULK,
+};
+
+static struct usb_endpoint_descriptor fs_bulkbench_out_desc = {
+	.bLength =		USB_DT_ENDPOINT_SIZE,
+	.bDescriptorType =	USB_DT_ENDPOINT,
+
+	.bEndpointAddress =	USB_DIR_OUT,
+	.bmAttributes =		USB_ENDPOINT_XFER_BULK,
+};
+
+static struct usb_descriptor_header *fs_bulkbench_descs[] = {
+	(struct usb_descriptor_header *) &bulkbench_intf,
+	(struct usb_descriptor_header *) &fs_bulkbench_out_desc,
+	(struct usb_descriptor_header *) &fs_bulkbench_in_desc,
+	NULL,
+};
+
+static struct usb_endpoint_descriptor hs_bulkbench_in_desc = {
+	.bLength =		USB_DT_ENDPOINT_SIZE,
+	.bDescriptorType =	USB_DT_ENDPOINT,
+
+	.bmAttributes =		USB_ENDPOINT_XFER_BULK,
+	.wMaxPacketSize =	cpu_to_le16(512),
+};
+
+static struct usb_endpoint_descriptor hs_bulkbench_out_desc = {
+	.bLength =		USB_DT_ENDPOINT_SIZE,
+	.bDescriptorType =	USB_DT_ENDPOINT,
+
+	.bmAttributes =		USB_ENDPOINT_XFER_BULK,
+	.wMaxPacketSize =	cpu_to_le16(512),
+};
+
+static struct usb_descriptor_header *hs_bulkbench_descs[] = {
+	(struct usb_descriptor_header *) &bulkbench_intf,
+	(struct usb_descriptor_header *) &hs_bulkbench_out_desc,
+	(struct usb_descriptor_header *) &hs_bulkbench_in_desc,
+	NULL,
+};
+
+/*-------------------------------------------------------------------------*/
+
+static void bulkbench_account(struct f_bulkbench *bb,
+		struct bulkbench_stats *st, struct usb_request *req)
+{
+	unsigned long flags;
+	ktime_t now = ktime_get();
+
+	spin_lock_irqsave(&bb->lock, flags);
+	if (req->status) {
+		st->errors++;
+	} else {
+		if (!st->requests)
+			st->first = now;
+		st->requests++;
+		st->bytes += req->actual;
+		st->last = now;
+	}
+	spin_unlock_irqrestore(&bb->lock, flags);
+}
+
+static void bulkbench_complete(struct usb_ep *ep, struct usb_request *req)
+{
+	struct f_bulkbench *bb = ep->driver_data;
+	int status;
+
+	switch (req->status) {
+	case -ECONNABORTED:		/* hardware forced ep reset */
+	case -ECONNRESET:		/* request dequeued */
+	case -ESHUTDOWN:		/* disconnect from host */
+		return;
+	}
+
+	bulkbench_account(bb, ep == bb->in_ep ? &bb->in : &bb->out, req);
+
+	status = usb_ep_queue(ep, req, GFP_ATOMIC);
+	if (status)
+		pr_err("%s: requeue on %s failed: %d\n",
+				FUNCTION_NAME, ep->name, status);
+}
+
+static int bulkbench_start_ep(struct f_bulkbench *bb, struct usb_ep *ep,
+		const struct usb_endpoint_descriptor *desc,
+		struct usb_request **reqs)
+{
+	int status;
+	unsigned i;
+
+	status = usb_ep_enable(ep, desc);
+	if (status)
+		return status;
+	ep->driver_data = bb;
+
+	for (i = 0; i < bb->nreqs; i++) {
+		reqs[i]->length = buflen;
+		status = usb_ep_queue(ep, reqs[i], GFP_ATOMIC);
+		if (status) {
+			usb_ep_disable(ep);
+			return status;
+		}
+	}
+
+	return 0;
+}
+
+static void bulkbench_stop(struct f_bulkbench *bb)
+{
+	if (bb->in_ep->driver_data == bb) {
+		usb_ep_disable(bb->in_ep);
+		bb->in_ep->driver_data = NULL;
+	}
+	if (bb->out_ep->driver_data == bb) {
+		usb_ep_disable(bb->out_ep);
+		bb->out_ep->driver_data = NULL;
+	}
+}
+
+static int bulkbench_set_alt(struct usb_function *f,
+		unsigned intf, unsigned alt)
+{
+	struct f_bulkbench *bb = func_to_bb(f);
+	struct usb_gadget *gadget = f->config->cdev->gadget;
+	int status;
+
+	bulkbench_stop(bb);
+
+	status = bulkbench_start_ep(bb, bb->in_ep,
+			ep_choose(gadget, &hs_bulkbench_in_desc,
+				&fs_bulkbench_in_desc),
+			bb->in_req);
+	if (status)
+		return status;
+
+	status = bulkbench_start_ep(bb, bb->out_ep,
+			ep_choose(gadget, &hs_bulkbench_out_desc,
+				&fs_bulkbench_out_desc),
+			bb->out_req);
+	if (status) {
+		bulkbench_stop(bb);
+		return status;
+	}
+
+	return 0;
+}
+
+static void bulkbench_disable(struct usb_function *f)
+{
+	bulkbench_stop(func_to_bb(f));
+}
+
+/*-------------------------------------------------------------------------*/
+
+static ssize_t bulkbench_show_one(char *buf, const char *name,
+		const struct bulkbench_stats *st)
+{
+	s64 us = ktime_us_delta(st->last, st->first);
+	u64 kbps = 0;
+
+	if (us > 0)
+		kbps = div64_u64(st->bytes * 1000, us);
+
+	return sprintf(buf, "%s: %llu bytes %lu requests %lu errors "
+			"%lld us %llu kB/s\n", name,
+			(unsigned long long)st->bytes, st->requests,
+			st->errors, (long long)us, (unsigned long long)kbps);
+}
+
+static ssize_t bulkbench_show_stats(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct usb_function *f = dev_get_drvdata(dev);
+	struct f_bulkbench *bb = func_to_bb(f);
+	struct bulkbench_stats in, out;
+	unsigned long flags;
+	ssize_t len;
+
+	spin_lock_irqsave(&bb->lock, flags);
+	in = bb->in;
+	out = bb->out;
+	spin_unlock_irqrestore(&bb->lock, flags);
+
+	len = bulkbench_show_one(buf, "in", &in);
+	len += bulkbench_show_one(buf + len, "out", &out);
+
+	return len;
+}
+
+static ssize_t bulkbench_store_stats(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t size)
+{
+	struct usb_function *f = dev_get_drvdata(dev);
+	struct f_bulkbench *bb = func_to_bb(f);
+	unsigned long flags;
+
+	spin_lock_irqsave(&bb->lock, flags);
+	memset(&bb->in, 0, sizeof(bb->in));
+	memset(&bb->out, 0, sizeof(bb->out));
+	spin_unlock_irqrestore(&bb->lock, flags);
+
+	return size;
+}
+
+static DEVICE_ATTR(stats, S_IRUGO | S_IWUSR,
+		bulkbench_show_stats, bulkbench_store_stats);
+
+/*-------------------------------------------------------------------------*/
+
+static void bulkbench_free_reqs(struct usb_ep *ep, struct usb_request **reqs)
+{
+	unsigned i;
+
+	for (i = 0; i < BULKBENCH_MAX_QLEN; i++) {
+		if (!reqs[i])
+			continue;
+		kfree(reqs[i]->buf);
+		usb_ep_free_request(ep, reqs[i]);
+		reqs[i] = NULL;
+	}
+}
+
+static int bulkbench_alloc_reqs(struct f_bulkbench *bb, struct usb_ep *ep,
+		struct usb_request **reqs)
+{
+	unsigned i;
+
+	for (i = 0; i < bb->nreqs; i++) {
+		reqs[i] = usb_ep_alloc_request(ep, GFP_KERNEL);
+		if (!reqs[i])
+			return -ENOMEM;
+
+		reqs[i]->buf = kzalloc(buflen, GFP_KERNEL);
+		if (!reqs[i]->buf)
+			return -ENOMEM;
+
+		reqs[i]->complete = bulkbench_complete;
+	}
+
+	return 0;
+}
+
+static int bulkbench_bind(struct usb_configuration *c, struct usb_function *f)
+{
+	struct usb_composite_dev *cdev = c->cdev;
+	struct f_bulkbench *bb = func_to_bb(f);
+	int id, status;
+
+	id = usb_interface_id(c, f);
+	if (id < 0)
+		return id;
+	bulkbench_intf.bInterfaceNumber = id;
+
+	bb->in_ep = usb_ep_autoconfig(cdev->gadget, &fs_bulkbench_in_desc);
+	if (!bb->in_ep)
+		goto autoconf_fail;
+	bb->in_ep->driver_data = cdev;	/* claim */
+
+	bb->out_ep = usb_ep_autoconfig(cdev->gadget, &fs_bulkbench_out_desc);
+	if (!bb->out_ep)
+		goto autoconf_fail;
+	bb->out_ep->driver_data = cdev;	/* claim */
+
+	if (gadget_is_dualspeed(cdev->gadget)) {
+		hs_bulkbench_in_desc.bEndpointAddress =
+				fs_bulkbench_in_desc.bEndpointAddress;
+		hs_bulkbench_out_desc.bEndpointAddress =
+				fs_bulkbench_out_desc.bEndpointAddress;
+		f->hs_descriptors = hs_bulkbench_descs;
+	}
+
+	bb->nreqs = clamp_t(unsigned, qlen, 1, BULKBENCH_MAX_QLEN);
+
+	status = bulkbench_alloc_reqs(bb, bb->in_ep, bb->in_req);
+	if (!status)
+		status = bulkbench_alloc_reqs(bb, bb->out_ep, bb->out_req);
+	if (!status)
+		status = device_create_file(f->dev, &dev_attr_stats);
+	if (status) {
+		bulkbench_free_reqs(bb->in_ep, bb->in_req);
+		bulkbench_free_reqs(bb->out_ep, bb->out_req);
+		return status;
+	}
+
+	bb->in_ep->driver_data = NULL;
+	bb->out_ep->driver_data = NULL;
+
+	pr_info("%s: IN/%s, OUT/%s, %u x %u bytes\n", FUNCTION_NAME,
+			bb->in_ep->name, bb->out_ep->name, bb->nreqs, buflen);
+
+	return 0;
+
+autoconf_fail:
+	pr_err("%s: can't autoconfigure on %s\n",
+			FUNCTION_NAME, cdev->gadget->name);
+	return -ENODEV;
+}
+
+static void bulkbench_unbind(struct usb_configuration *c,
+		struct usb_function *f)
+{
+	struct f_bulkbench *bb = func_to_bb(f);
+
+	device_remove_file(f->dev, &dev_attr_stats);
+	bulkbench_free_reqs(bb->in_ep, bb->in_req);
+	bulkbench_free_reqs(bb->out_ep, bb->out_req);
+	kfree(bb);
+}
+
+static int bulkbench_bind_config(struct usb_configuration *c)
+{
+	struct f_bulkbench *bb;
+	int status;
+
+	bb = kzalloc(sizeof(*bb), GFP_KERNEL);
+	if (!bb)
+		return -ENOMEM;
+
+	spin_lock_init(&bb->lock);
+
+	bb->function.name = FUNCTION_NAME;
+	bb->function.descriptors = fs_bulkbench_descs;
+	bb->function.bind = bulkbench_bind;
+	bb->function.unbind = bulkbench_unbind;
+	bb->function.set_alt = bulkbench_set_alt;
+	bb->function.disable = bulkbench_disable;
+
+	/* off until asked for, the normal product enumerates as before */
+	bb->function.disabled = 1;
+
+	status = usb_add_function(c, &bb->function);
+	if (status)
+		kfree(bb);
+
+	return status;
+}
+
+static struct dynamic_usb_function bulkbench_function = {
+	.name = FUNCTION_NAME,
+	.bind_config = bulkbench_bind_config,
+};
+
+static int __init init(void)
+{
+	dynamic_register_function(&bulkbench_function);
+	return 0;
+}
+module_init(init);
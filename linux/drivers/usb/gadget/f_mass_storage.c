@@ -325,6 +325,15 @@ static const char fsg_string_interface[] = "Mass Storage";
 #define FSG_NO_OTG               1
 #define FSG_NO_INTR_EP           1
 
+#ifdef CONFIG_USB_DYNAMIC_MASS_STORAGE
+/* Four 64 KiB buffers rather than two of 16 KiB: file I/O on one buffer
+ * overlaps the USB transfers of the others, and the controller always
+ * has the next request queued behind the current one.
+ */
+#define FSG_NUM_BUFFERS		4
+#define FSG_BUFLEN		((u32)65536)
+#endif /* CONFIG_USB_DYNAMIC_MASS_STORAGE */
+
 #include "storage_common.c"
 
 
@@ -263,10 +263,14 @@ static struct fsg_lun *fsg_lun_from_dev(struct device *dev)
 #define DELAYED_STATUS	(EP0_BUFSIZE + 999)	/* An impossibly large value */
 
 /* Number of buffers we will use.  2 is enough for double-buffering */
+#ifndef FSG_NUM_BUFFERS
 #define FSG_NUM_BUFFERS	2
+#endif
 
 /* Default size of buffer length. */
+#ifndef FSG_BUFLEN
 #define FSG_BUFLEN	((u32)16384)
+#endif
 
 /* Maximal number of LUNs supported in mass storage function */
 #define FSG_MAX_LUNS	8
@@ -514,6 +514,18 @@ void musb_g_tx(struct musb *musb, u8 epnum)
 		}
 
 		if (request->actual == request->length) {
+			/*
+			 * With DMA, get the next queued request moving before
+			 * the completion callback runs so the FIFO (the second
+			 * half of it, when double buffered) doesn't sit idle
+			 * while the class driver refills its buffer. txstate()
+			 * ignores the call below if this one got things going.
+			 */
+			if (dma && request->list.next != &musb_ep->req_list)
+				txstate(musb, to_musb_request(list_entry(
+						request->list.next,
+						struct usb_request, list)));
+
 			musb_g_giveback(musb_ep, request, 0);
 			request = musb_ep->desc ? next_request(musb_ep) : NULL;
 			if (!request) {
@@ -556,6 +568,30 @@ void musb_g_tx(struct musb *musb, u8 epnum)
  * Non-Mentor DMA engines can of course work differently.
  */
 
+/*
+ * Mode 1 is worth it when the rest of the request is at least two
+ * whole packets, the first of which is sitting in the FIFO, and the
+ * class driver has promised that the host sends exactly that much.
+ * Unaligned buffers go through system DMA, which only does mode 0.
+ */
+static bool musb_rx_use_mode1(struct musb *musb, struct musb_ep *musb_ep,
+		struct usb_request *request, u16 len)
+{
+	unsigned	left = request->length - request->actual;
+
+#ifdef CONFIG_MUSB_USE_SYSTEM_DMA_WORKAROUND
+	/* RTL 1.4 does all of its RX through system DMA */
+	if (musb->hwvers < MUSB_HWVERS_1800)
+		return false;
+#endif
+	if (!request->short_not_ok || musb_ep->hb_mult)
+		return false;
+	if (len != musb_ep->packet_sz || left < 2 * musb_ep->packet_sz)
+		return false;
+
+	return !((request->dma + request->actual) & 0x3);
+}
+
 /*
  * Context: controller locked, IRQs blocked, endpoint selected
  */
@@ -625,11 +661,17 @@ static void rxstate(struct musb *musb, struct musb_request *req)
 				struct dma_controller	*c;
 				struct dma_channel	*channel;
 				int			use_dma = 0;
+				int			transfer_size = 0;
 
 				c = musb->dma_controller;
 				channel = musb_ep->dma;
 
-	/* We use DMA Req mode 0 in rx_csr, and DMA controller operates in
+	/* Requests with short_not_ok set (mass storage OUT data) tell us
+	 * up front how much the host will send, so those use mode 1 and
+	 * move the whole remainder with AUTOCLEAR and one DMA interrupt;
+	 * see musb_rx_use_mode1(). Everything else goes packet by packet:
+	 *
+	 * We use DMA Req mode 0 in rx_csr, and DMA controller operates in
 	 * mode 0 only. So we do not get endpoint interrupts due to DMA
 	 * completion. We only get interrupts from DMA controller.
 	 *
@@ -645,11 +687,45 @@ static void rxstate(struct musb *musb, struct musb_request *req)
 	 * Theoretically, we could enable DMAReq irq (MUSB_RXCSR_DMAMODE = 1),
 	 * to get endpoint interrupt on every DMA req, but that didn't seem
 	 * to work reliably.
-	 *
-	 * REVISIT an updated g_file_storage can set req->short_not_ok, which
-	 * then becomes usable as a runtime "use mode 1" hint...
 	 */
 
+				if (musb_rx_use_mode1(musb, musb_ep, request, len)) {
+					csr |= MUSB_RXCSR_AUTOCLEAR;
+					musb_writew(epio, MUSB_RXCSR, csr);
+					csr |= MUSB_RXCSR_DMAENAB;
+					musb_writew(epio, MUSB_RXCSR, csr);
+
+					/* enabling and then disabling DMAMODE
+					 * is what gets DMAReq going
+					 */
+					musb_writew(epio, MUSB_RXCSR,
+						csr | MUSB_RXCSR_DMAMODE);
+					musb_writew(epio, MUSB_RXCSR, csr);
+
+					/* only whole packets in mode 1 */
+					transfer_size = min_t(u32,
+							request->length
+							- request->actual,
+							channel->max_len);
+					transfer_size -= transfer_size
+							% musb_ep->packet_sz;
+					channel->desired_mode = 1;
+
+					use_dma = c->channel_program(
+							channel,
+							musb_ep->packet_sz,
+							1,
+							request->dma
+							+ request->actual,
+							transfer_size);
+					if (use_dma)
+						return;
+
+					csr &= ~(MUSB_RXCSR_AUTOCLEAR
+							| MUSB_RXCSR_DMAENAB);
+					musb_writew(epio, MUSB_RXCSR, csr);
+				}
+
 				csr |= MUSB_RXCSR_DMAENAB;
 #ifdef USE_MODE1
 				csr |= MUSB_RXCSR_AUTOCLEAR;
@@ -669,7 +745,6 @@ static void rxstate(struct musb *musb, struct musb_request *req)
 				musb_writew(epio, MUSB_RXCSR, csr);
 
 				if (request->actual < request->length) {
-					int transfer_size = 0;
 #ifdef USE_MODE1
 					transfer_size = min(request->length - request->actual,
 							channel->max_len);
@@ -823,8 +898,9 @@ void musb_g_rx(struct musb *musb, u8 epnum)
 
 			/* incomplete, and not short? wait for next IN packet */
 			if ((request->actual < request->length)
-					&& (musb_ep->dma->actual_len
-						== musb_ep->packet_sz)) {
+					&& musb_ep->dma->actual_len
+					&& !(musb_ep->dma->actual_len
+						& (musb_ep->packet_sz - 1))) {
 				/* In double buffer case, continue to unload fifo if
 				 * there is Rx packet in FIFO.
 				 **/
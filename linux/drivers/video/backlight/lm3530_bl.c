@@ -32,6 +32,9 @@
 #include <linux/module.h>
 #include <linux/backlight.h>
 #include <linux/delay.h>
+#include <linux/mutex.h>
+#include <linux/hrtimer.h>
+#include <linux/workqueue.h>
 #include <linux/lm3530_bl.h>
 #include <linux/gpio.h>
 #include <linux/fb.h>
@@ -99,26 +102,71 @@
 #define LM3530_DEF_ZT_3			(0x33)
 #define LM3530_DEF_ZT_4			(0x19)
 
+/*
+ * Time the ramp generator spends on each brightness code, per ramp
+ * rate setting. The LM3530_RAMP_TIME_* names are these times 127.
+ */
+static const unsigned int lm3530_ramp_step_us[] = {
+	8, 1048, 2048, 4096, 8192, 16384, 32768, 65538,
+};
+
+/* the hardware ramp must land within 1/LM3530_FADE_SLACK of the request */
+#define LM3530_FADE_SLACK		4
+/* shortest period of the software stepper */
+#define LM3530_FADE_MIN_STEP_US		16384
+
 /* Default brightness from kernel boot arguments, if provided */
 static int default_brightness = -1;
 
+/**
+ * struct lm3530_fade
+ * @timer: fires the next step of a software fade
+ * @work: does the I2C write for a step
+ * @next: expiry of @timer
+ * @interval: time between steps
+ * @from: brightness the fade started at
+ * @to: target brightness
+ * @step: steps done so far
+ * @nsteps: steps in total, 0 when no fade is running
+ */
+struct lm3530_fade {
+	struct hrtimer timer;
+	struct work_struct work;
+	ktime_t next;
+	ktime_t interval;
+	int from;
+	int to;
+	unsigned int step;
+	unsigned int nsteps;
+};
+
 /**
  * struct lm3530_data
  * @led_dev: led class device
  * @client: i2c client
  * @pdata: LM3530 platform data
+ * @bl: backlight device
  * @mode: mode of operation - manual, ALS, PWM
  * @regulator: regulator
  * @brighness: previous brightness value
  * @enable: regulator is enabled
+ * @lock: serializes register access
+ * @regs: last value written to each register in lm3530_reg
+ * @regs_cached: bitmask of the @regs entries that are valid
+ * @fade: software fade state
  */
 struct lm3530_data {
 	struct i2c_client *client;
 	struct lm3530_platform_data *pdata;
+	struct backlight_device *bl;
 	enum lm3530_mode mode;
         int brightness;
 	bool enable;
         int enable_gpio;
+	struct mutex lock;
+	u8 regs[LM3530_REG_MAX];
+	u16 regs_cached;
+	struct lm3530_fade fade;
 };
 
 static const u8 lm3530_reg[LM3530_REG_MAX] = {
@@ -148,14 +196,18 @@ static ssize_t lm3530_set_ramp_fall_rate(struct device *dev, struct device_attri
 static ssize_t lm3530_get_ramp_law(struct device *dev, struct device_attribute *attr, char *buf);
 static ssize_t lm3530_set_ramp_law(struct device *dev, struct device_attribute *attr, const char *buf, size_t len);
 
+static ssize_t lm3530_set_fade(struct device *dev, struct device_attribute *attr, const char *buf, size_t len);
+
 static DEVICE_ATTR(ramp_rise_rate, (S_IRUGO|S_IWUGO), lm3530_get_ramp_rise_rate, lm3530_set_ramp_rise_rate);
 static DEVICE_ATTR(ramp_fall_rate, (S_IRUGO|S_IWUGO), lm3530_get_ramp_fall_rate, lm3530_set_ramp_fall_rate);
 static DEVICE_ATTR(ramp_law, (S_IRUGO|S_IWUGO), lm3530_get_ramp_law, lm3530_set_ramp_law);
+static DEVICE_ATTR(fade, S_IWUGO, NULL, lm3530_set_fade);
  
 static struct attribute *lm3530_attributes[] = {
 	&dev_attr_ramp_rise_rate.attr,
 	&dev_attr_ramp_fall_rate.attr,
 	&dev_attr_ramp_law.attr,
+	&dev_attr_fade.attr,
 	NULL
 };
 
@@ -163,6 +215,66 @@ static const struct attribute_group lm3530_attr_group = {
 	.attrs = lm3530_attributes,
 };
 
+static int lm3530_reg_index(u8 reg)
+{
+	int i;
+
+	for (i = 0; i < LM3530_REG_MAX; i++)
+		if (lm3530_reg[i] == reg)
+			return i;
+
+	BUG();
+	return 0;
+}
+
+/*
+ * The chip is never written behind our back, so the last value written
+ * to a register is what it holds until the enable GPIO drops. Writes of
+ * that same value are skipped. Call with drvdata->lock held.
+ */
+static int lm3530_write_reg(struct lm3530_data *drvdata, u8 reg, u8 val)
+{
+	int i = lm3530_reg_index(reg);
+	int ret;
+
+	if ((drvdata->regs_cached & (1 << i)) && drvdata->regs[i] == val)
+		return 0;
+
+	ret = i2c_smbus_write_byte_data(drvdata->client, reg, val);
+	if (ret) {
+		drvdata->regs_cached &= ~(1 << i);
+		return ret;
+	}
+
+	drvdata->regs[i] = val;
+	drvdata->regs_cached |= (1 << i);
+
+	return 0;
+}
+
+static int lm3530_update_reg(struct lm3530_data *drvdata, u8 reg,
+		u8 mask, u8 val)
+{
+	int i = lm3530_reg_index(reg);
+	int old;
+
+	if (drvdata->regs_cached & (1 << i)) {
+		old = drvdata->regs[i];
+	} else {
+		old = i2c_smbus_read_byte_data(drvdata->client, reg);
+		if (old < 0)
+			return old;
+	}
+
+	return lm3530_write_reg(drvdata, reg, (old & ~mask) | (val & mask));
+}
+
+static u8 lm3530_ramp_rate(struct lm3530_platform_data *pdata)
+{
+	return (pdata->brt_ramp_fall << LM3530_BRT_RAMP_FALL_SHIFT) |
+		(pdata->brt_ramp_rise << LM3530_BRT_RAMP_RISE_SHIFT);
+}
+
 static int __init lm3530_set_default_brightness(char *brightness)
 { 
     if (brightness != NULL)
@@ -183,20 +295,21 @@ static ssize_t lm3530_get_ramp_rise_rate(struct device *dev, struct device_attri
 
 static ssize_t lm3530_set_ramp_rise_rate(struct device *dev, struct device_attribute *attr, const char *buf, size_t len)
 {
-    u8 ramp_reg_val;
     u8 new_ramp_rate;
     struct i2c_client *client = to_i2c_client(dev);
     struct lm3530_platform_data *pdata = client->dev.platform_data;
+    struct lm3530_data *drvdata = i2c_get_clientdata(client);
 
     sscanf(buf, "%hhu", &new_ramp_rate);
 
     if (new_ramp_rate <= LM3530_RAMP_TIME_8s) {
+        mutex_lock(&drvdata->lock);
         pdata->brt_ramp_rise = new_ramp_rate;
-        ramp_reg_val = i2c_smbus_read_byte_data(client, LM3530_BRT_RAMP_RATE);
-
-        ramp_reg_val = (ramp_reg_val & ~(LM3530_BRT_RAMP_RISE)) | (new_ramp_rate << LM3530_BRT_RAMP_RISE_SHIFT);
-
-		i2c_smbus_write_byte_data(client, LM3530_BRT_RAMP_RATE, ramp_reg_val);
+        if (drvdata->enable)
+            lm3530_update_reg(drvdata, LM3530_BRT_RAMP_RATE,
+                    LM3530_BRT_RAMP_RISE,
+                    new_ramp_rate << LM3530_BRT_RAMP_RISE_SHIFT);
+        mutex_unlock(&drvdata->lock);
     }
 
     return strnlen(buf, PAGE_SIZE);
@@ -212,20 +325,21 @@ static ssize_t lm3530_get_ramp_fall_rate(struct device *dev, struct device_attri
 
 static ssize_t lm3530_set_ramp_fall_rate(struct device *dev, struct device_attribute *attr, const char *buf, size_t len)
 {
-    u8 ramp_reg_val;
     u8 new_ramp_rate;
     struct i2c_client *client = to_i2c_client(dev);
     struct lm3530_platform_data *pdata = client->dev.platform_data;
+    struct lm3530_data *drvdata = i2c_get_clientdata(client);
 
     sscanf(buf, "%hhu", &new_ramp_rate);
 
     if (new_ramp_rate <= LM3530_RAMP_TIME_8s) {
+        mutex_lock(&drvdata->lock);
         pdata->brt_ramp_fall = new_ramp_rate;
-        ramp_reg_val = i2c_smbus_read_byte_data(client, LM3530_BRT_RAMP_RATE);
-
-        ramp_reg_val = (ramp_reg_val & ~(LM3530_BRT_RAMP_FALL)) | (new_ramp_rate << LM3530_BRT_RAMP_FALL_SHIFT);
-
-		i2c_smbus_write_byte_data(client, LM3530_BRT_RAMP_RATE, ramp_reg_val);
+        if (drvdata->enable)
+            lm3530_update_reg(drvdata, LM3530_BRT_RAMP_RATE,
+                    LM3530_BRT_RAMP_FALL,
+                    new_ramp_rate << LM3530_BRT_RAMP_FALL_SHIFT);
+        mutex_unlock(&drvdata->lock);
     }
 
     return strnlen(buf, PAGE_SIZE);
@@ -241,26 +355,45 @@ static ssize_t lm3530_get_ramp_law(struct device *dev, struct device_attribute *
 
 static ssize_t lm3530_set_ramp_law(struct device *dev, struct device_attribute *attr, const char *buf, size_t len)
 {
-    u8 gen_config_reg;
     u8 new_ramp_law;
     struct i2c_client *client = to_i2c_client(dev);
     struct lm3530_platform_data *pdata = client->dev.platform_data;
+    struct lm3530_data *drvdata = i2c_get_clientdata(client);
 
     sscanf(buf, "%hhu", &new_ramp_law);
 
     if ((new_ramp_law == LM3530_RAMP_LAW_EXP) || 
             (new_ramp_law == LM3530_RAMP_LAW_LIN)) {
+        mutex_lock(&drvdata->lock);
         pdata->brt_ramp_law = new_ramp_law;
-
-        gen_config_reg = i2c_smbus_read_byte_data(client, LM3530_GEN_CONFIG);
-        gen_config_reg &= (~(0x1 << LM3530_RAMP_LAW_SHIFT));
-        gen_config_reg |= (new_ramp_law << LM3530_RAMP_LAW_SHIFT);
-		i2c_smbus_write_byte_data(client,  LM3530_GEN_CONFIG, gen_config_reg);
+        if (drvdata->enable)
+            lm3530_update_reg(drvdata, LM3530_GEN_CONFIG,
+                    0x1 << LM3530_RAMP_LAW_SHIFT,
+                    new_ramp_law << LM3530_RAMP_LAW_SHIFT);
+        mutex_unlock(&drvdata->lock);
     }
 
     return strnlen(buf, PAGE_SIZE);
 }
 
+static ssize_t lm3530_set_fade(struct device *dev, struct device_attribute *attr, const char *buf, size_t len)
+{
+    int brightness;
+    unsigned int duration_ms;
+    int err;
+    struct i2c_client *client = to_i2c_client(dev);
+    struct lm3530_data *drvdata = i2c_get_clientdata(client);
+
+    if (sscanf(buf, "%d %u", &brightness, &duration_ms) != 2)
+        return -EINVAL;
+
+    err = lm3530_fade(drvdata->bl, brightness, duration_ms);
+    if (err)
+        return err;
+
+    return strnlen(buf, PAGE_SIZE);
+}
+
 __setup("brightness=", lm3530_set_default_brightness);
 
 static int lm3530_init_registers(struct lm3530_data *drvdata)
@@ -275,7 +408,6 @@ static int lm3530_init_registers(struct lm3530_data *drvdata)
 	u8 zones[LM3530_ALS_ZB_MAX];
 	u32 als_vmin, als_vmax, als_vstep;
 	struct lm3530_platform_data *pltfm = drvdata->pdata;
-	struct i2c_client *client = drvdata->client;
 
 	memset(zones, 0, LM3530_ALS_ZB_MAX);
 
@@ -319,8 +451,7 @@ static int lm3530_init_registers(struct lm3530_data *drvdata)
 				(pltfm->pwm_pol_hi << LM3530_PWM_POL_SHIFT) |
 				(LM3530_ENABLE_PWM_SIMPLE);
 
-	brt_ramp = (pltfm->brt_ramp_fall << LM3530_BRT_RAMP_FALL_SHIFT) |
-			(pltfm->brt_ramp_rise << LM3530_BRT_RAMP_RISE_SHIFT);
+	brt_ramp = lm3530_ramp_rate(pltfm);
 
 	reg_val[0] = gen_config;	/* LM3530_GEN_CONFIG */
 	reg_val[1] = als_config;	/* LM3530_ALS_CONFIG */
@@ -342,11 +473,11 @@ static int lm3530_init_registers(struct lm3530_data *drvdata)
                 gpio_set_value(pltfm->enable_gpio, 1);
                 mdelay(3);
 		drvdata->enable = true;
+		drvdata->regs_cached = 0;
 	}
 
 	for (i = 0; i < LM3530_REG_MAX; i++) {
-		ret = i2c_smbus_write_byte_data(client,
-				lm3530_reg[i], reg_val[i]);
+		ret = lm3530_write_reg(drvdata, lm3530_reg[i], reg_val[i]);
 		if (ret)
 			break;
 	}
@@ -356,13 +487,224 @@ static int lm3530_init_registers(struct lm3530_data *drvdata)
 		drvdata->mode == LM3530_BL_MODE_ALS) {
 		gen_config |= (LM3530_ENABLE_I2C);
 
-		ret = i2c_smbus_write_byte_data(client,
-						LM3530_GEN_CONFIG, gen_config);
+		ret = lm3530_write_reg(drvdata, LM3530_GEN_CONFIG, gen_config);
 	}
         
 	return ret;
 }
 
+static int lm3530_set_brightness(struct lm3530_data *drvdata, int brightness)
+{
+	int err;
+
+	err = lm3530_write_reg(drvdata, LM3530_BRT_CTRL_REG, brightness);
+	if (err)
+		dev_err(&drvdata->client->dev,
+			"Unable to set brightness: %d\n", err);
+	else
+		drvdata->brightness = brightness;
+
+	return err;
+}
+
+/* nearest ramp rate to @step_us, in the log sense */
+static unsigned int lm3530_ramp_rate_nearest(unsigned int step_us)
+{
+	unsigned int rate;
+
+	for (rate = 0; rate < LM3530_RAMP_TIME_8s; rate++)
+		if ((u64)step_us * step_us < (u64)lm3530_ramp_step_us[rate] *
+				lm3530_ramp_step_us[rate + 1])
+			break;
+
+	return rate;
+}
+
+/* slowest ramp rate that finishes a code within @step_us */
+static unsigned int lm3530_ramp_rate_floor(unsigned int step_us)
+{
+	unsigned int rate = LM3530_RAMP_TIME_8s;
+
+	while (rate > 0 && lm3530_ramp_step_us[rate] > step_us)
+		rate--;
+
+	return rate;
+}
+
+/*
+ * Fades only ever touch the ramp field for their direction and leave
+ * it there. The next plain brightness change puts back the rates from
+ * the platform data.
+ */
+static int lm3530_set_fade_rate(struct lm3530_data *drvdata, bool rising,
+		unsigned int rate)
+{
+	if (rising)
+		return lm3530_update_reg(drvdata, LM3530_BRT_RAMP_RATE,
+				LM3530_BRT_RAMP_RISE,
+				rate << LM3530_BRT_RAMP_RISE_SHIFT);
+
+	return lm3530_update_reg(drvdata, LM3530_BRT_RAMP_RATE,
+			LM3530_BRT_RAMP_FALL,
+			rate << LM3530_BRT_RAMP_FALL_SHIFT);
+}
+
+/* Call with drvdata->lock held. Returns true if more steps are due. */
+static bool lm3530_fade_step(struct lm3530_data *drvdata)
+{
+	struct lm3530_fade *fade = &drvdata->fade;
+	int brightness;
+
+	if (!fade->nsteps)
+		return false;
+
+	fade->step++;
+	brightness = fade->from + (fade->to - fade->from) *
+		(int)fade->step / (int)fade->nsteps;
+
+	if (lm3530_set_brightness(drvdata, brightness) ||
+			fade->step == fade->nsteps) {
+		fade->nsteps = 0;
+		return false;
+	}
+
+	fade->next = ktime_add(fade->next, fade->interval);
+	return true;
+}
+
+static void lm3530_fade_work(struct work_struct *work)
+{
+	struct lm3530_data *drvdata =
+		container_of(work, struct lm3530_data, fade.work);
+
+	mutex_lock(&drvdata->lock);
+	if (lm3530_fade_step(drvdata))
+		hrtimer_start(&drvdata->fade.timer, drvdata->fade.next,
+				HRTIMER_MODE_ABS);
+	mutex_unlock(&drvdata->lock);
+}
+
+static enum hrtimer_restart lm3530_fade_timer(struct hrtimer *timer)
+{
+	struct lm3530_data *drvdata =
+		container_of(timer, struct lm3530_data, fade.timer);
+
+	schedule_work(&drvdata->fade.work);
+
+	return HRTIMER_NORESTART;
+}
+
+static void lm3530_fade_cancel(struct lm3530_data *drvdata)
+{
+	mutex_lock(&drvdata->lock);
+	drvdata->fade.nsteps = 0;
+	mutex_unlock(&drvdata->lock);
+
+	hrtimer_cancel(&drvdata->fade.timer);
+	cancel_work_sync(&drvdata->fade.work);
+}
+
+/**
+ * lm3530_fade - move the backlight to a new brightness over time
+ * @bl: backlight device of an LM3530
+ * @brightness: target brightness
+ * @duration_ms: length of the transition
+ *
+ * If one of the ramp rates of the chip gets close enough to
+ * @duration_ms the whole fade is left to it, at the cost of at most
+ * two register writes. Otherwise the brightness is stepped from an
+ * hrtimer, with the ramp generator smoothing out every step. Any other
+ * brightness change cancels a fade in progress.
+ *
+ * Only manual mode is supported.
+ */
+int lm3530_fade(struct backlight_device *bl, int brightness,
+		unsigned int duration_ms)
+{
+	struct lm3530_data *drvdata = bl_get_data(bl);
+	struct lm3530_fade *fade = &drvdata->fade;
+	unsigned int delta, step_us, rate, nsteps;
+	unsigned long duration_us;
+	bool rising;
+	int err = 0;
+
+	if (drvdata->mode != LM3530_BL_MODE_MANUAL)
+		return -EINVAL;
+
+	if (brightness < 0 || brightness > bl->props.max_brightness)
+		return -EINVAL;
+
+	/* keep the multiplications below in range */
+	if (duration_ms > 60 * MSEC_PER_SEC)
+		return -EINVAL;
+
+	mutex_lock(&bl->update_lock);
+
+	lm3530_fade_cancel(drvdata);
+	bl->props.brightness = brightness;
+
+	/* blanked: the new level is picked up on unblank */
+	if (bl->props.power != FB_BLANK_UNBLANK ||
+			bl->props.fb_blank != FB_BLANK_UNBLANK)
+		goto out_bl;
+
+	mutex_lock(&drvdata->lock);
+
+	if (!drvdata->enable) {
+		err = lm3530_init_registers(drvdata);
+		if (err) {
+			dev_err(&drvdata->client->dev,
+				"Register Init failed: %d\n", err);
+			goto out;
+		}
+	}
+
+	delta = abs(brightness - drvdata->brightness);
+	if (!delta)
+		goto out;
+
+	rising = brightness > drvdata->brightness;
+	duration_us = duration_ms * USEC_PER_MSEC;
+	step_us = duration_us / delta;
+
+	rate = lm3530_ramp_rate_nearest(step_us);
+	if (step_us <= lm3530_ramp_step_us[0] ||
+			abs((int)lm3530_ramp_step_us[rate] - (int)step_us) *
+			LM3530_FADE_SLACK <= step_us) {
+		err = lm3530_set_fade_rate(drvdata, rising, rate);
+		if (!err)
+			err = lm3530_set_brightness(drvdata, brightness);
+		goto out;
+	}
+
+	nsteps = clamp_t(unsigned int, duration_us / LM3530_FADE_MIN_STEP_US,
+			1, delta);
+
+	err = lm3530_set_fade_rate(drvdata, rising,
+			lm3530_ramp_rate_floor(step_us));
+	if (err)
+		goto out;
+
+	fade->from = drvdata->brightness;
+	fade->to = brightness;
+	fade->step = 0;
+	fade->nsteps = nsteps;
+	fade->interval = ns_to_ktime((u64)(duration_us / nsteps) *
+			NSEC_PER_USEC);
+	fade->next = ktime_get();
+
+	if (lm3530_fade_step(drvdata))
+		hrtimer_start(&fade->timer, fade->next, HRTIMER_MODE_ABS);
+
+out:
+	mutex_unlock(&drvdata->lock);
+out_bl:
+	mutex_unlock(&bl->update_lock);
+
+	return err;
+}
+EXPORT_SYMBOL(lm3530_fade);
+
 static int lm3530_update_status(struct backlight_device *bl)
 {
     int brightness = bl->props.brightness;
@@ -382,23 +724,30 @@ static int lm3530_update_status(struct backlight_device *bl)
 
 		BUG_ON(brightness > bl->props.max_brightness);
 
+		lm3530_fade_cancel(drvdata);
+		mutex_lock(&drvdata->lock);
+
 		if (!drvdata->enable) {
 			err = lm3530_init_registers(drvdata);
 			if (err) {
 				dev_err(&drvdata->client->dev,
 					"Register Init failed: %d\n", err);
+				mutex_unlock(&drvdata->lock);
 				break;
 			}
 		}
 
-		/* set the brightness in brightness control register */
-		err = i2c_smbus_write_byte_data(drvdata->client,
-				LM3530_BRT_CTRL_REG, brightness);
+		/* drop whatever ramp rate the last fade left behind */
+		err = lm3530_write_reg(drvdata, LM3530_BRT_RAMP_RATE,
+				lm3530_ramp_rate(drvdata->pdata));
 		if (err)
 			dev_err(&drvdata->client->dev,
-				"Unable to set brightness: %d\n", err);
-		else
-			drvdata->brightness = brightness;
+				"Unable to set ramp rate: %d\n", err);
+
+		/* set the brightness in brightness control register */
+		lm3530_set_brightness(drvdata, brightness);
+
+		mutex_unlock(&drvdata->lock);
 
             // Leaving this out for now.  It will cut off any automatic
             // fade down.  We may want it, though, if we're doing manual
@@ -484,6 +833,10 @@ static int __devinit lm3530_probe(struct i2c_client *client,
 	drvdata->client = client;
 	drvdata->pdata = pdata;
 	drvdata->enable = false;
+	mutex_init(&drvdata->lock);
+	hrtimer_init(&drvdata->fade.timer, CLOCK_MONOTONIC, HRTIMER_MODE_ABS);
+	drvdata->fade.timer.function = lm3530_fade_timer;
+	INIT_WORK(&drvdata->fade.work, lm3530_fade_work);
 
 	i2c_set_clientdata(client, drvdata);
 
@@ -529,6 +882,7 @@ static int __devinit lm3530_probe(struct i2c_client *client,
 	}
 
 	bl->props.max_brightness = pdata->max_brightness;
+	drvdata->bl = bl;
 
         /* If a default was provided at the kernal command line,
          * use that.  Otherwise, take the platform data default.
@@ -570,8 +924,9 @@ static int __devexit lm3530_remove(struct i2c_client *client)
 	struct lm3530_data *drvdata = i2c_get_clientdata(client);
 	struct backlight_device *bl = platform_get_drvdata(client);
 
-	gpio_set_value(drvdata->enable_gpio, 0);
 	sysfs_remove_group(&client->dev.kobj, &lm3530_attr_group);
+	lm3530_fade_cancel(drvdata);
+	gpio_set_value(drvdata->enable_gpio, 0);
 	backlight_device_unregister(bl);
 	gpio_unexport(drvdata->enable_gpio);
 	gpio_free(drvdata->enable_gpio);
@@ -588,8 +943,12 @@ static int lm3530_suspend(struct device *dev)
 	struct backlight_device *bl = platform_get_drvdata(pdev);
 	struct lm3530_data *drvdata = bl_get_data(bl);
 
+	lm3530_fade_cancel(drvdata);
+
+	mutex_lock(&drvdata->lock);
 	gpio_set_value(drvdata->enable_gpio, 0);
     drvdata->enable = false;
+	mutex_unlock(&drvdata->lock);
 
     return 0;
 }
@@ -33,6 +33,10 @@
 #include <linux/gpio.h>
 #include <linux/r61529a1.h>
 #include <linux/time.h>
+#include <linux/spinlock.h>
+#include <linux/sched.h>
+#include <linux/wait.h>
+#include <linux/workqueue.h>
 
 #include <plat/display.h>
 
@@ -134,13 +138,43 @@ static u16 line=0;
 static struct timespec last_frame;
 static int32_t fps;
 
+/*
+ * Frame updates. In manual mode (the default, set up by omapfb) only
+ * the union of the areas passed to update() since the last transfer
+ * is sent, on the next TE, and nothing at all when nothing changed.
+ * Auto mode keeps streaming full frames back to back.
+ */
+static DEFINE_SPINLOCK(update_lock);
+static enum omap_dss_update_mode update_mode = OMAP_DSS_UPDATE_MANUAL;
+static bool update_busy;		/* a transfer is in flight */
+static u16 dirty_x, dirty_y, dirty_w, dirty_h;	/* dirty_w == 0: clean */
+static u32 frames_pushed;
+static u64 pixels_pushed;
+static u32 frames_skipped;		/* updates merged into a pending one */
+static DECLARE_WAIT_QUEUE_HEAD(update_wait);	/* woken by update_done() */
+
+/* How long sync() waits for the pending damage to reach the panel */
+#define SYNC_TIMEOUT	msecs_to_jiffies(500)
+
+/* Damage that could not be sent is retried after this long */
+#define RETRY_DELAY	msecs_to_jiffies(20)
+static struct omap_dss_device *retry_dssdev;
+static void retry_push(struct work_struct *work);
+static DECLARE_DELAYED_WORK(retry_work, retry_push);
+
 static ssize_t  r61529a1_test_pixel_read(struct device *unused, struct device_attribute *attr, char *buf);
 static ssize_t  r61529a1_display_id_read(struct device *unused, struct device_attribute *attr, char *buf);
 static ssize_t  r61529a1_get_fps(struct device *unused, struct device_attribute *attr, char *buf);
+static ssize_t  r61529a1_get_frames_pushed(struct device *unused, struct device_attribute *attr, char *buf);
+static ssize_t  r61529a1_get_pixels_pushed(struct device *unused, struct device_attribute *attr, char *buf);
+static ssize_t  r61529a1_get_frames_skipped(struct device *unused, struct device_attribute *attr, char *buf);
 
 static DEVICE_ATTR(test_pixel, S_IRUGO, r61529a1_test_pixel_read, NULL);
 static DEVICE_ATTR(display_id, S_IRUGO, r61529a1_display_id_read, NULL);
 static DEVICE_ATTR(fps, S_IRUGO, r61529a1_get_fps, NULL);
+static DEVICE_ATTR(frames_pushed, S_IRUGO, r61529a1_get_frames_pushed, NULL);
+static DEVICE_ATTR(pixels_pushed, S_IRUGO, r61529a1_get_pixels_pushed, NULL);
+static DEVICE_ATTR(frames_skipped, S_IRUGO, r61529a1_get_frames_skipped, NULL);
 
 static int renesas_r61529a1_update(struct omap_dss_device *dssdev,
 		u16 x, u16 y, u16 w, u16 h);
@@ -149,6 +183,9 @@ static struct attribute *r61529a1_attributes[] = {
 	&dev_attr_test_pixel.attr,
 	&dev_attr_display_id.attr,
 	&dev_attr_fps.attr,
+	&dev_attr_frames_pushed.attr,
+	&dev_attr_pixels_pushed.attr,
+	&dev_attr_frames_skipped.attr,
 	NULL
 };
 
@@ -422,6 +459,21 @@ static ssize_t  r61529a1_get_fps(struct device *unused, struct device_attribute
 {
 	return sprintf(buf, "%d\n", fps);
 }
+
+static ssize_t  r61529a1_get_frames_pushed(struct device *unused, struct device_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", frames_pushed);
+}
+
+static ssize_t  r61529a1_get_pixels_pushed(struct device *unused, struct device_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%llu\n", (unsigned long long)pixels_pushed);
+}
+
+static ssize_t  r61529a1_get_frames_skipped(struct device *unused, struct device_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", frames_skipped);
+}
 static int renesas_r61529a1_power_on(struct omap_dss_device *dssdev)
 {
 	int r = 0;
@@ -458,6 +510,12 @@ static int renesas_r61529a1_power_on(struct omap_dss_device *dssdev)
 	getrawmonotonic(&last_frame);
 	fps = -1;
 
+	/* a transfer cut short by the last power off never completed */
+	spin_lock_irq(&update_lock);
+	update_busy = false;
+	dirty_w = 0;
+	spin_unlock_irq(&update_lock);
+
 	r = init_display(dssdev);
 
 	return r;
@@ -528,6 +586,8 @@ static int renesas_r61529a1_probe(struct omap_dss_device *dssdev)
 
 	if (status) goto err2;
 
+	retry_dssdev = dssdev;
+
 	return 0;
 
 err2:
@@ -544,6 +604,9 @@ static void renesas_r61529a1_remove(struct omap_dss_device *dssdev)
 {
 
 	struct r61529a1_platform_data *pdata = (struct r61529a1_platform_data *)dssdev->data;
+
+	cancel_delayed_work_sync(&retry_work);
+
 	if (reg){
 		regulator_put(reg);
 	}
@@ -571,29 +634,35 @@ static int renesas_r61529a1_enable(struct omap_dss_device *dssdev)
 static void renesas_r61529a1_disable(struct omap_dss_device *dssdev)
 {
 	dev_printk(KERN_INFO, &dssdev->dev, "r61529a1 disable\n");
+	cancel_delayed_work_sync(&retry_work);
 	renesas_r61529a1_power_off(dssdev);
 
 	dssdev->state = OMAP_DSS_DISPLAY_DISABLED;
+	wake_up_all(&update_wait);
 }
 static enum omap_dss_update_mode generic_get_update_mode(
 		struct omap_dss_device *dssdev)
 {
-	return OMAP_DSS_UPDATE_AUTO;
+	return update_mode;
 }
 
-static void update_done(void* data){
+static int renesas_r61529a1_set_update_mode(struct omap_dss_device *dssdev,
+		enum omap_dss_update_mode mode)
+{
+	u16 w, h;
 
-	u16 w,h;
-	struct omap_dss_device *dssdev = (struct omap_dss_device *) data;
+	if (mode != OMAP_DSS_UPDATE_AUTO && mode != OMAP_DSS_UPDATE_MANUAL)
+		return -EINVAL;
 
-	//queue up another frame
-	if(dssdev->state == OMAP_DSS_DISPLAY_ACTIVE)
-	{
+	update_mode = mode;
+
+	/* get the full frame loop going again */
+	if (mode == OMAP_DSS_UPDATE_AUTO) {
 		dssdev->driver->get_resolution(dssdev, &w, &h);
-		renesas_r61529a1_update(dssdev, 0 , 0 , w, h);
+		renesas_r61529a1_update(dssdev, 0, 0, w, h);
 	}
-	//printk("r61529a1 update_done\n");
 
+	return 0;
 }
 
 static int renesas_r61529a1_enable_te(struct omap_dss_device * dssdev, bool en)
@@ -610,12 +679,85 @@ static int renesas_r61529a1_enable_te(struct omap_dss_device * dssdev, bool en)
 	return 0;
 }
 
-static int renesas_r61529a1_update(struct omap_dss_device *dssdev,
-		u16 x, u16 y, u16 w, u16 h)
+static void set_window(u16 x, u16 y, u16 w, u16 h)
 {
+	WriteCommand(SET_COLUMN_ADDRESS);
+	WriteData((x & 0x100) >> 8);
+	WriteData(x & 0xFF);
+	WriteData(((x + w - 1) & 0x100) >> 8);
+	WriteData((x + w - 1) & 0xFF);
 
-	if (dssdev->state != OMAP_DSS_DISPLAY_ACTIVE)
-		return -1;
+	WriteCommand(SET_PAGE_ADDRESS);
+	WriteData((y & 0x100) >> 8);
+	WriteData(y & 0xFF);
+	WriteData(((y + h - 1) & 0x100) >> 8);
+	WriteData((y + h - 1) & 0xFF);
+}
+
+static void update_done(void *data);
+
+/* Grows the pending damage to cover an area, update_lock held */
+static void add_dirty(u16 x, u16 y, u16 w, u16 h)
+{
+	u16 x2, y2;
+
+	if (dirty_w) {
+		x2 = max(x + w, dirty_x + dirty_w);
+		y2 = max(y + h, dirty_y + dirty_h);
+		dirty_x = min(x, dirty_x);
+		dirty_y = min(y, dirty_y);
+		dirty_w = x2 - dirty_x;
+		dirty_h = y2 - dirty_y;
+	} else {
+		dirty_x = x;
+		dirty_y = y;
+		dirty_w = w;
+		dirty_h = h;
+	}
+}
+
+/*
+ * Start a transfer of the pending damage unless one is already in
+ * flight; update_done() picks up whatever arrived meanwhile. Also
+ * called from the frame done interrupt.
+ */
+static void push_frame(struct omap_dss_device *dssdev)
+{
+	unsigned long flags;
+	u16 x, y, w, h, dw, dh;
+
+	spin_lock_irqsave(&update_lock, flags);
+	if (update_busy || !dirty_w) {
+		spin_unlock_irqrestore(&update_lock, flags);
+		return;
+	}
+	x = dirty_x;
+	y = dirty_y;
+	w = dirty_w;
+	h = dirty_h;
+	dirty_w = 0;
+	update_busy = true;
+	spin_unlock_irqrestore(&update_lock, flags);
+
+	/* RFBI can't send a single column, take its neighbour along */
+	if (w == 1) {
+		dssdev->driver->get_resolution(dssdev, &dw, &dh);
+		if (x + 2 > dw)
+			x--;
+		w = 2;
+	}
+
+	/* may grow the area to cover scaled overlays */
+	if (omap_rfbi_prepare_update(dssdev, &x, &y, &w, &h)) {
+		/* keep the damage and try again shortly, nothing else
+		   will if the screen stays static */
+		spin_lock_irqsave(&update_lock, flags);
+		add_dirty(x, y, w, h);
+		update_busy = false;
+		spin_unlock_irqrestore(&update_lock, flags);
+		schedule_delayed_work(&retry_work, RETRY_DELAY);
+		return;
+	}
 
 #ifdef DISPLAY_PERFORMANCE
 	{
@@ -641,10 +783,102 @@ static int renesas_r61529a1_update(struct omap_dss_device *dssdev,
 	
 #endif
 
-	//dev_printk(KERN_INFO, &dssdev->dev, "update\n");
+	frames_pushed++;
+	pixels_pushed += w * h;
+
+	set_window(x, y, w, h);
 	WriteCommand(WRITE_MEMORY_START);
 	renesas_r61529a1_enable_te(dssdev, 1);
 	omap_rfbi_update(dssdev, x, y, w, h, update_done, dssdev);
+}
+
+static void retry_push(struct work_struct *work)
+{
+	if (retry_dssdev->state == OMAP_DSS_DISPLAY_ACTIVE)
+		push_frame(retry_dssdev);
+}
+
+static void update_done(void* data){
+
+	u16 w,h;
+	struct omap_dss_device *dssdev = (struct omap_dss_device *) data;
+
+	if (dssdev->state != OMAP_DSS_DISPLAY_ACTIVE)
+		return;
+
+	spin_lock(&update_lock);
+	update_busy = false;
+	spin_unlock(&update_lock);
+	wake_up_all(&update_wait);
+
+	//queue up another frame
+	if (update_mode == OMAP_DSS_UPDATE_AUTO)
+	{
+		dssdev->driver->get_resolution(dssdev, &w, &h);
+		renesas_r61529a1_update(dssdev, 0 , 0 , w, h);
+	}
+	else
+		push_frame(dssdev);
+}
+
+static int renesas_r61529a1_update(struct omap_dss_device *dssdev,
+		u16 x, u16 y, u16 w, u16 h)
+{
+	unsigned long flags;
+	u16 dw, dh;
+
+	if (dssdev->state != OMAP_DSS_DISPLAY_ACTIVE)
+		return -1;
+
+	/* off-screen damage would fail every transfer attempt */
+	dssdev->driver->get_resolution(dssdev, &dw, &dh);
+	if (x >= dw || y >= dh || !w || !h)
+		return -EINVAL;
+	w = min_t(u16, w, dw - x);
+	h = min_t(u16, h, dh - y);
+
+	spin_lock_irqsave(&update_lock, flags);
+	/* still waiting for the last one; send the union instead */
+	if (dirty_w)
+		frames_skipped++;
+	add_dirty(x, y, w, h);
+	spin_unlock_irqrestore(&update_lock, flags);
+
+	push_frame(dssdev);
+
+	return 0;
+}
+
+/* Nothing left to send: no transfer in flight and no pending damage */
+static bool update_idle(struct omap_dss_device *dssdev)
+{
+	unsigned long flags;
+	bool idle;
+
+	if (dssdev->state != OMAP_DSS_DISPLAY_ACTIVE)
+		return true;
+
+	spin_lock_irqsave(&update_lock, flags);
+	idle = !update_busy && !dirty_w;
+	spin_unlock_irqrestore(&update_lock, flags);
+
+	return idle;
+}
+
+/*
+ * Wait until everything passed to update() so far is on the panel. In
+ * auto mode frames stream back to back, so there is nothing to wait for.
+ */
+static int renesas_r61529a1_sync(struct omap_dss_device *dssdev)
+{
+	if (update_mode == OMAP_DSS_UPDATE_AUTO)
+		return 0;
+
+	if (!wait_event_timeout(update_wait, update_idle(dssdev),
+				SYNC_TIMEOUT)) {
+		dev_warn(&dssdev->dev, "sync timed out\n");
+		return -ETIMEDOUT;
+	}
 
 	return 0;
 }
@@ -652,8 +886,10 @@ static int renesas_r61529a1_update(struct omap_dss_device *dssdev,
 static int renesas_r61529a1_suspend(struct omap_dss_device *dssdev)
 {
 	dev_printk(KERN_INFO, &dssdev->dev, "r61529a1 suspend\n");
+	cancel_delayed_work_sync(&retry_work);
 	renesas_r61529a1_power_off(dssdev);
 	dssdev->state = OMAP_DSS_DISPLAY_SUSPENDED;
+	wake_up_all(&update_wait);
 
 	return 0;
 }
@@ -696,7 +932,9 @@ static struct omap_dss_driver generic_driver = {
 	.enable_te 	= renesas_r61529a1_enable_te,
 
     .get_update_mode = generic_get_update_mode,
+	.set_update_mode = renesas_r61529a1_set_update_mode,
 	.update         = renesas_r61529a1_update,
+	.sync           = renesas_r61529a1_sync,
 
 	.driver         = {
 		.name   = "renesas_r61529a1",
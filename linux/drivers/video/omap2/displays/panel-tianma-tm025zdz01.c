@@ -32,6 +32,11 @@
 #include <linux/spi/spi.h>
 #include <linux/fb.h>
 #include <linux/slab.h>
+#include <linux/workqueue.h>
+#include <linux/completion.h>
+#include <linux/ktime.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
 
 #include <plat/display.h>
 
@@ -736,21 +741,76 @@
 #define FFRAMEHZ							60
 #define	TFRAMEMS							(1000 / FFRAMEHZ)
 
-#define fdelay(frames)						mdelay(frames * TFRAMEMS)
+#define fdelay(frames)						msleep(frames * TFRAMEMS)
+
+/*
+ * Batched command transfer limits. The full power-on register table is
+ * 16 commands and 124 words, so it fits in a single SPI message.
+ */
+#define S6D05A1_BATCH_MAX_XFERS			32
+#define S6D05A1_BATCH_MAX_WORDS			128
+
+/*
+ * Upper bound on how long a frame sync may wait for the panel to come
+ * out of reset and sleep.
+ */
+#define S6D05A1_READY_TIMEOUT_MS		500
 
 /* Type Definitions */
 
+typedef u16 s6d05a1_word;
+
+/*
+ * Power-on sequencing states. Each state performs its step and then
+ * schedules the next one after the required settling time, so no
+ * context is held busy-waiting while the panel powers up.
+ */
+enum s6d05a1_power_state {
+	S6D05A1_POWER_OFF,
+	S6D05A1_POWER_START,
+	S6D05A1_POWER_RESET_ASSERT,
+	S6D05A1_POWER_RESET_RELEASE,
+	S6D05A1_POWER_INIT,
+	S6D05A1_POWER_DISPLAY_ON,
+	S6D05A1_POWER_READY
+};
+
+struct s6d05a1_batch {
+	struct spi_message			m;
+	struct spi_transfer			xfer[S6D05A1_BATCH_MAX_XFERS];
+	s6d05a1_word				words[S6D05A1_BATCH_MAX_WORDS];
+	unsigned int				nxfers;
+	unsigned int				nwords;
+};
+
+struct s6d05a1_stats {
+	unsigned long				count;
+	u32							last_us;
+	u32							min_us;
+	u32							max_us;
+	u64							total_us;
+};
+
 struct s6d05a1_device {
 	int 						enabled:1,
-								suspended:1;
+								suspended:1,
+								reset_short:1,
+								identified:1;
 	spinlock_t                  device_lock;
 	struct spi_device *			spi;
 	struct omap_dss_device *	dssdev;
 	struct regulator *			vcc_reg;
+	struct s6d05a1_batch *		batch;
+	enum s6d05a1_power_state	state;
+	struct delayed_work			power_work;
+	struct completion			ready;
+	ktime_t						power_start;
+	struct s6d05a1_stats		resume_stats;
+	struct s6d05a1_stats		enable_stats;
+	bool						resuming;
+	struct dentry *				debugfs_dir;
 };
 
-typedef u16 s6d05a1_word;
-
 /* Function Prototypes */
 
 static int	tm025zdz01_dss_probe(struct omap_dss_device *dssdev);
@@ -761,6 +821,7 @@ static void	tm025zdz01_dss_disable(struct omap_dss_device *dssdev);
 static void	tm025zdz01_dss_power_off(struct omap_dss_device *dssdev);
 static int	tm025zdz01_dss_suspend(struct omap_dss_device *dssdev);
 static int	tm025zdz01_dss_resume(struct omap_dss_device *dssdev);
+static int	tm025zdz01_dss_sync(struct omap_dss_device *dssdev);
 
 static int	s6d05a1_spi_probe(struct spi_device *spi);
 static int	s6d05a1_spi_remove(struct spi_device *spi);
@@ -814,6 +875,7 @@ static struct omap_dss_driver tianma_tm025zdz01_driver = {
 	.disable		= tm025zdz01_dss_disable,
 	.suspend		= tm025zdz01_dss_suspend,
 	.resume			= tm025zdz01_dss_resume,
+	.sync			= tm025zdz01_dss_sync,
 
 	.driver         = {
 		.name   		= "tianma_tm025zdz01",
@@ -925,11 +987,6 @@ static void s6d05a1_transfer(struct s6d05a1_device * id, u8 operation,
 	return;
 }
 
-static void s6d05a1_command(struct s6d05a1_device * id, u8 operation)
-{
-	s6d05a1_transfer(id, operation, NULL, 0, NULL, 0);
-}
-
 static void __used s6d05a1_read(struct s6d05a1_device * id, u8 operation,
 								u8 *buffer, unsigned int length)
 {
@@ -970,81 +1027,106 @@ static ssize_t s6d05a1_spi_display_id_read(struct device *unused,
     return sprintf(buf, "%02x %02x %02x\n", displayId[0], displayId[1], displayId[2]);
 }
 
-static void s6d05a1_write(struct s6d05a1_device * id, u8 operation,
-						  const u8 *buffer, unsigned int length)
+static void s6d05a1_batch_init(struct s6d05a1_batch *b)
 {
-	s6d05a1_transfer(id, operation, buffer, length, NULL, 0);
+	spi_message_init(&b->m);
+	memset(b->xfer, 0, sizeof(b->xfer));
+	b->nxfers = 0;
+	b->nwords = 0;
 }
 
-static void s6d05a1_reset(unsigned long gpio, bool inverted, bool sleeping)
+static int s6d05a1_batch_sync(struct s6d05a1_device * id, struct s6d05a1_batch *b)
 {
-	const bool asserted = inverted;
-	
-	// First, ensure the reset line is deasserted for a "sufficiently
-	// long" time as we don't know it's initial condition. Then,
-	// assert it for at least the required time. Finally, deassert it
-	// again for at least the required time.
-
-	gpio_set_value(gpio, !asserted);
-	mdelay(1 * 2);
-
-	gpio_set_value(gpio, asserted);
-	mdelay(S6D05A1_TRES_LOW_MS_MIN);
-
-	gpio_set_value(gpio, !asserted);
-    
-	if (sleeping)
-    {
-        mdelay(S6D05A1_TRES_LOW_MS_MIN);
-    }
-    else
-    {
-        mdelay(S6D05A1_TRES_HIGH_MS_MIN);
-    }
+	int status = 0;
+
+	if (b->nxfers == 0)
+		goto done;
+
+	// Chip select toggles between commands but must stay asserted
+	// for the tail of the message.
+
+	b->xfer[b->nxfers - 1].cs_change = 0;
+
+	status = spi_sync(id->spi, &b->m);
+
+	if (status < 0) {
+		dev_warn(&id->spi->dev, "S6D05A1 SPI batch of %u transfers failed "
+				 "with status %d\n", b->nxfers, status);
+	}
+
+	s6d05a1_batch_init(b);
+
+ done:
+	return status;
+}
+
+// Queue a command and its parameters. The whole batch is sent in one
+// spi_sync() by s6d05a1_batch_sync(), flushing early if it fills up.
+
+static void s6d05a1_batch_add(struct s6d05a1_device * id, struct s6d05a1_batch *b,
+							  u8 operation, const s6d05a1_word *params,
+							  unsigned int nparams)
+{
+	struct spi_transfer *x;
+
+	if ((b->nxfers + 2 > S6D05A1_BATCH_MAX_XFERS) ||
+		(b->nwords + 1 + nparams > S6D05A1_BATCH_MAX_WORDS)) {
+		s6d05a1_batch_sync(id, b);
+	}
+
+	BUG_ON(1 + nparams > S6D05A1_BATCH_MAX_WORDS);
+
+	x = &b->xfer[b->nxfers++];
+
+	b->words[b->nwords] = S6D05A1_COMMAND_ENCODE(operation);
+
+	x->tx_buf					= &b->words[b->nwords];
+	x->bits_per_word			= S6D05A1_SPI_BITS_PER_WORD;
+	x->len						= S6D05A1_SPI_BYTES_PER_WORD;
+
+	b->nwords++;
+
+	spi_message_add_tail(x, &b->m);
+
+	if (nparams > 0) {
+		x = &b->xfer[b->nxfers++];
+
+		memcpy(&b->words[b->nwords], params, S6D05A1_PARAMS_TO_BYTES(nparams));
+
+		x->tx_buf				= &b->words[b->nwords];
+		x->bits_per_word		= S6D05A1_SPI_BITS_PER_WORD;
+		x->len					= S6D05A1_PARAMS_TO_BYTES(nparams);
+
+		b->nwords += nparams;
+
+		spi_message_add_tail(x, &b->m);
+	}
+
+	x->cs_change				= 1;
 }
 
 // Per Section 4.1.7, Figure 136, Page 171 of "S6D05A1 Ref. Specification,
 // P.03".
 
-static void s6d05a1_power_on(struct s6d05a1_device * id)
+static void s6d05a1_power_init(struct s6d05a1_device * id)
 {
-	int status = 0;
 	const unsigned int maxparam = 20;
 	s6d05a1_word params[maxparam];
 	unsigned int nparams;
 	u8 operation;
 	struct omap_dss_device *dss;
 	struct s6d05a1_platform_data *pdata;
+	struct s6d05a1_batch *batch;
 	u32 width, height;
-	uint8_t display_id[3];
 
 	dss = id->dssdev;
 	pdata = id->spi->dev.platform_data;
+	batch = id->batch;
 
 	width = dss->panel.timings.x_res;
 	height = dss->panel.timings.y_res;
 
-	// First, allow the platform to do any necessary steps (turn on
-	// rails, etc.).
-
-	if (dss->platform_enable) {
-		status = dss->platform_enable(dss);
-
-		if (status) {
-			dev_err(&dss->dev, "The platform failed to enable the display.\n");
-			goto done;
-		}
-	}
-
-	// Then, wait at least 1 ms.
-
-	mdelay(1 * 2);
-
-	// Next, issue the power-on reset.
-
-	s6d05a1_reset(pdata->reset.gpio, 
-                  pdata->reset.inverted,
-				  (!id->enabled || id->suspended));
+	s6d05a1_batch_init(batch);
 
 	// Establish the memory address control (MADCTL) mode as dictated
 	// by platform data in accordance with Section 4.5.1, Figure 149,
@@ -1067,10 +1149,7 @@ static void s6d05a1_power_on(struct s6d05a1_device * id)
 		 S6D05A1_ADDRESS_MODE_VERT_REFR_ORDER_TTOB)		|
 		S6D05A1_ADDRESS_MODE_PIXEL_ORDER_RGB);
 	nparams = 1;
-	s6d05a1_write(id,
-				  operation,
-				  (const u8 *)params,
-				  S6D05A1_PARAMS_TO_BYTES(nparams));
+	s6d05a1_batch_add(id, batch, operation, params, nparams);
 
 	// Enter the "passwords" to enable level two command input.
 
@@ -1079,20 +1158,14 @@ static void s6d05a1_power_on(struct s6d05a1_device * id)
 	params[0] = S6D05A1_PARAM_ENCODE(U32_B1_DECODE(S6D05A1_PASSWD1_L2_ENABLE));
 	params[1] = S6D05A1_PARAM_ENCODE(U32_B0_DECODE(S6D05A1_PASSWD1_L2_ENABLE));
 	nparams = 2;
-	s6d05a1_write(id,
-				  operation,
-				  (const u8 *)params,
-				  S6D05A1_PARAMS_TO_BYTES(nparams));
+	s6d05a1_batch_add(id, batch, operation, params, nparams);
 
 	operation = S6D05A1_OP_SET_PASSWD2;
 
 	params[0] = S6D05A1_PARAM_ENCODE(U32_B1_DECODE(S6D05A1_PASSWD2_L2_ENABLE));
 	params[1] = S6D05A1_PARAM_ENCODE(U32_B0_DECODE(S6D05A1_PASSWD2_L2_ENABLE));
 	nparams = 2;
-	s6d05a1_write(id,
-				  operation,
-				  (const u8 *)params,
-				  S6D05A1_PARAMS_TO_BYTES(nparams));
+	s6d05a1_batch_add(id, batch, operation, params, nparams);
 
 	// Then, program the display control settings
 
@@ -1126,10 +1199,7 @@ static void s6d05a1_power_on(struct s6d05a1_device * id)
 									  dss->panel.timings.vsw);	// RGB_NVBP
     params[18] = S6D05A1_PARAM_ENCODE(dss->panel.timings.vfp);	// RGB_NVFP
 	nparams = 19;
-	s6d05a1_write(id,
-				  operation,
-				  (const u8 *)params,
-				  S6D05A1_PARAMS_TO_BYTES(nparams));
+	s6d05a1_batch_add(id, batch, operation, params, nparams);
 
 	// Then, program the power control settings.
 
@@ -1154,10 +1224,7 @@ static void s6d05a1_power_on(struct s6d05a1_device * id)
     params[12] = S6D05A1_PARAM_ENCODE(S6D05A1_PWRCTL_GVD_4v10);				// PIGVD
     params[13] = S6D05A1_PARAM_ENCODE(S6D05A1_PWRCTL_BT_16v50_NEG_8v25);	// PIBT
 	nparams = 14;
-	s6d05a1_write(id,
-				  operation,
-				  (const u8 *)params,
-				  S6D05A1_PARAMS_TO_BYTES(nparams));
+	s6d05a1_batch_add(id, batch, operation, params, nparams);
 
 	// Then, program the VCOM control settings.
 
@@ -1176,10 +1243,7 @@ static void s6d05a1_power_on(struct s6d05a1_device * id)
     params[10] = S6D05A1_PARAM_ENCODE(S6D05A1_VCMCTL_VCMH_3v30);	// PIVCMH
     params[11] = S6D05A1_PARAM_ENCODE(S6D05A1_VCMCTL_VML_3v900);	// PIVML
 	nparams = 12;
-	s6d05a1_write(id,
-				  operation,
-				  (const u8 *)params,
-				  S6D05A1_PARAMS_TO_BYTES(nparams));
+	s6d05a1_batch_add(id, batch, operation, params, nparams);
 
 	// Then, program the source control settings.
 
@@ -1197,10 +1261,7 @@ static void s6d05a1_power_on(struct s6d05a1_device * id)
     params[ 7] = S6D05A1_PARAM_ENCODE(S6D05A1_SRCCTL_PISR_BLK_ENCODE(S6D05A1_SRCCTL_SR_BLK_AMPLIFIER_DRIVE));
 	params[ 8] = S6D05A1_PARAM_ENCODE(0x00);
 	nparams = 9;
-	s6d05a1_write(id,
-				  operation,
-				  (const u8 *)params,
-				  S6D05A1_PARAMS_TO_BYTES(nparams));
+	s6d05a1_batch_add(id, batch, operation, params, nparams);
 
 	// Then, program the interface control settings.
 
@@ -1233,10 +1294,7 @@ static void s6d05a1_power_on(struct s6d05a1_device * id)
 									  S6D05A1_IFCTL_RGB_DIV_ENCODE(4));
     params[ 4] = S6D05A1_PARAM_ENCODE(S6D05A1_IFCTL_SDO_ENABLE);
 	nparams = 5;
-	s6d05a1_write(id,
-				  operation,
-				  (const u8 *)params,
-				  S6D05A1_PARAMS_TO_BYTES(nparams));
+	s6d05a1_batch_add(id, batch, operation, params, nparams);
 
 	// Then, program the panel control settings.
 
@@ -1246,10 +1304,7 @@ static void s6d05a1_power_on(struct s6d05a1_device * id)
 									  S6D05A1_PANELCTL_PNO_ENCODE(S6D05A1_PANELCTL_NON_OVERLAP_4));
     params[ 1] = S6D05A1_PARAM_ENCODE(S6D05A1_PANELCTL_SCN_ENCODE(1));
 	nparams = 2;
-	s6d05a1_write(id,
-				  operation,
-				  (const u8 *)params,
-				  S6D05A1_PARAMS_TO_BYTES(nparams));
+	s6d05a1_batch_add(id, batch, operation, params, nparams);
 
 	// Then, program the gamma selection settings.
 
@@ -1258,10 +1313,7 @@ static void s6d05a1_power_on(struct s6d05a1_device * id)
     params[ 0] = S6D05A1_PARAM_ENCODE(S6D05A1_GAMMASEL_NGF_NEGATIVE |
 									  S6D05A1_GAMMASEL_RGB_GMA_SELECT);
 	nparams = 1;
-	s6d05a1_write(id,
-				  operation,
-				  (const u8 *)params,
-				  S6D05A1_PARAMS_TO_BYTES(nparams));
+	s6d05a1_batch_add(id, batch, operation, params, nparams);
 
 	// Then, program the positive gamma control settings.
 
@@ -1284,10 +1336,7 @@ static void s6d05a1_power_on(struct s6d05a1_device * id)
     params[14] = S6D05A1_PARAM_ENCODE(0x00);
     params[15] = S6D05A1_PARAM_ENCODE(0x00);	// GLP
 	nparams = 16;
-	s6d05a1_write(id,
-				  operation,
-				  (const u8 *)params,
-				  S6D05A1_PARAMS_TO_BYTES(nparams));
+	s6d05a1_batch_add(id, batch, operation, params, nparams);
 
 	// Then, program the negative gamma control settings.
 
@@ -1310,10 +1359,7 @@ static void s6d05a1_power_on(struct s6d05a1_device * id)
     params[14] = S6D05A1_PARAM_ENCODE(0x00);
     params[15] = S6D05A1_PARAM_ENCODE(0x00);	// GLN
 	nparams = 16;
-	s6d05a1_write(id,
-				  operation,
-				  (const u8 *)params,
-				  S6D05A1_PARAMS_TO_BYTES(nparams));
+	s6d05a1_batch_add(id, batch, operation, params, nparams);
 
 	// Then, program the pixel format settings.
 
@@ -1321,10 +1367,7 @@ static void s6d05a1_power_on(struct s6d05a1_device * id)
 
 	params[0] = S6D05A1_PARAM_ENCODE(S6D05A1_PIXEL_FORMAT_24BPP);
 	nparams = 1;
-	s6d05a1_write(id,
-				  operation,
-				  (const u8 *)params,
-				  S6D05A1_PARAMS_TO_BYTES(nparams));
+	s6d05a1_batch_add(id, batch, operation, params, nparams);
 
 	// Then, program the column and page addresses to the display
 	// extents.
@@ -1336,10 +1379,7 @@ static void s6d05a1_power_on(struct s6d05a1_device * id)
 	params[2] = S6D05A1_PARAM_ENCODE(U32_B1_DECODE(width - 1));
 	params[3] = S6D05A1_PARAM_ENCODE(U32_B0_DECODE(width - 1));
 	nparams = 4;
-	s6d05a1_write(id,
-				  operation,
-				  (const u8 *)params,
-				  S6D05A1_PARAMS_TO_BYTES(nparams));
+	s6d05a1_batch_add(id, batch, operation, params, nparams);
 
 	operation = S6D05A1_OP_SET_PAGE_ADDRESS;
 
@@ -1348,37 +1388,147 @@ static void s6d05a1_power_on(struct s6d05a1_device * id)
 	params[2] = S6D05A1_PARAM_ENCODE(U32_B1_DECODE(height - 1));
 	params[3] = S6D05A1_PARAM_ENCODE(U32_B0_DECODE(height - 1));
 	nparams = 4;
-	s6d05a1_write(id,
-				  operation,
-				  (const u8 *)params,
-				  S6D05A1_PARAMS_TO_BYTES(nparams));
+	s6d05a1_batch_add(id, batch, operation, params, nparams);
+
+	// Then, send the exit sleep mode command. The caller waits at
+	// least 120 ms before the next step.
+
+	s6d05a1_batch_add(id, batch, S6D05A1_OP_CMD_EXIT_SLEEP_MODE, NULL, 0);
+
+	s6d05a1_batch_sync(id, batch);
+}
+
+static void s6d05a1_power_next(struct s6d05a1_device * id,
+							   enum s6d05a1_power_state state,
+							   unsigned int delay_ms)
+{
+	id->state = state;
+	schedule_delayed_work(&id->power_work, msecs_to_jiffies(delay_ms));
+}
 
-	// Then, send the exit sleep mode command and wait at least 120 ms.
+static void s6d05a1_stats_update(struct s6d05a1_stats *stats, u32 us)
+{
+	stats->last_us = us;
+	stats->total_us += us;
 
-	s6d05a1_command(id, S6D05A1_OP_CMD_EXIT_SLEEP_MODE);
+	if (stats->count == 0 || us < stats->min_us)
+		stats->min_us = us;
+	if (us > stats->max_us)
+		stats->max_us = us;
 
-	mdelay(120);
+	stats->count++;
+}
 
-	// Then, send the exit idle mode command.
+// Per Section 4.1.7, Figure 136, Page 171 of "S6D05A1 Ref. Specification,
+// P.03".
+//
+// The power-on sequence runs as a state machine from delayed work so
+// that the enable and resume paths return immediately. Frame syncs
+// block on id->ready until the panel is on.
 
-	s6d05a1_command(id, S6D05A1_OP_CMD_EXIT_IDLE_MODE);
+static void s6d05a1_power_work(struct work_struct *work)
+{
+	struct s6d05a1_device * id =
+		container_of(work, struct s6d05a1_device, power_work.work);
+	struct omap_dss_device *dss = id->dssdev;
+	struct s6d05a1_platform_data *pdata = id->spi->dev.platform_data;
+	const bool asserted = pdata->reset.inverted;
+	uint8_t display_id[3];
+	u32 us;
+	int status;
 
-	// Then, send the display on command.
+	switch (id->state) {
 
-	s6d05a1_command(id, S6D05A1_OP_CMD_DISPLAY_ON);
+	case S6D05A1_POWER_START:
+		// First, allow the platform to do any necessary steps (turn on
+		// rails, etc.).
 
-	// Finally, wait at least 10 ms before writing data to the
-	// display.
+		if (dss->platform_enable) {
+			status = dss->platform_enable(dss);
 
-	mdelay(10);
+			if (status) {
+				dev_err(&dss->dev, "The platform failed to enable the display.\n");
+				id->state = S6D05A1_POWER_OFF;
+				complete_all(&id->ready);
+				break;
+			}
+		}
 
-	// Read and log the display ID
-	s6d05a1_spi_display_id_read_fields(id, display_id);
-	dev_printk(KERN_INFO, &dss->dev, "display ID: %02x %02x %02x\n", 
-				display_id[0], display_id[1], display_id[2]);
+		// Then, ensure the reset line is deasserted for a
+		// "sufficiently long" time as we don't know it's initial
+		// condition.
 
- done:
-	return;
+		gpio_set_value(pdata->reset.gpio, !asserted);
+		s6d05a1_power_next(id, S6D05A1_POWER_RESET_ASSERT, 1 * 2);
+		break;
+
+	case S6D05A1_POWER_RESET_ASSERT:
+		// Next, assert reset for at least the required time.
+
+		gpio_set_value(pdata->reset.gpio, asserted);
+		s6d05a1_power_next(id, S6D05A1_POWER_RESET_RELEASE,
+						   S6D05A1_TRES_LOW_MS_MIN);
+		break;
+
+	case S6D05A1_POWER_RESET_RELEASE:
+		// Then, deassert it again for at least the required time.
+
+		gpio_set_value(pdata->reset.gpio, !asserted);
+		s6d05a1_power_next(id, S6D05A1_POWER_INIT,
+						   (id->reset_short ?
+							S6D05A1_TRES_LOW_MS_MIN :
+							S6D05A1_TRES_HIGH_MS_MIN));
+		break;
+
+	case S6D05A1_POWER_INIT:
+		// Send the register table and exit sleep mode, then wait at
+		// least 120 ms.
+
+		s6d05a1_power_init(id);
+		s6d05a1_power_next(id, S6D05A1_POWER_DISPLAY_ON, 120);
+		break;
+
+	case S6D05A1_POWER_DISPLAY_ON:
+		// Then, send the exit idle mode and display on commands and
+		// wait at least 10 ms before writing data to the display.
+
+		s6d05a1_batch_add(id, id->batch, S6D05A1_OP_CMD_EXIT_IDLE_MODE, NULL, 0);
+		s6d05a1_batch_add(id, id->batch, S6D05A1_OP_CMD_DISPLAY_ON, NULL, 0);
+		s6d05a1_batch_sync(id, id->batch);
+		s6d05a1_power_next(id, S6D05A1_POWER_READY, 10);
+		break;
+
+	case S6D05A1_POWER_READY:
+		us = (u32)ktime_us_delta(ktime_get(), id->power_start);
+
+		s6d05a1_stats_update(id->resuming ? &id->resume_stats :
+							 &id->enable_stats, us);
+
+		// Read and log the display ID on first bring-up only.
+
+		if (!id->identified) {
+			s6d05a1_spi_display_id_read_fields(id, display_id);
+			dev_printk(KERN_INFO, &dss->dev, "display ID: %02x %02x %02x\n",
+					   display_id[0], display_id[1], display_id[2]);
+			id->identified = true;
+		}
+
+		complete_all(&id->ready);
+		break;
+
+	default:
+		break;
+	}
+}
+
+static void s6d05a1_power_on(struct s6d05a1_device * id, bool resuming)
+{
+	id->power_start = ktime_get();
+	id->resuming = resuming;
+	id->reset_short = (!id->enabled || id->suspended);
+
+	INIT_COMPLETION(id->ready);
+	s6d05a1_power_next(id, S6D05A1_POWER_START, 0);
 }
 
 // Per Section 4.10.1, Figure 169, Page 240 of "S6D05A1
@@ -1394,17 +1544,33 @@ static void s6d05a1_power_on(struct s6d05a1_device * id)
 
 static void s6d05a1_power_off(struct s6d05a1_device * id)
 {
-	// First, run the display off command
+	enum s6d05a1_power_state state;
 
-	s6d05a1_command(id, S6D05A1_OP_CMD_DISPLAY_OFF);
+	// Stop any power-on sequence still in flight.
 
-	// Next, enter sleep mode
+	cancel_delayed_work_sync(&id->power_work);
 
-	s6d05a1_command(id, S6D05A1_OP_CMD_ENTER_SLEEP_MODE);
+	state = id->state;
+	id->state = S6D05A1_POWER_OFF;
+	complete_all(&id->ready);
 
-	// Wait at least 2 frames
+	if (state == S6D05A1_POWER_OFF || state == S6D05A1_POWER_START)
+		return;
 
-	fdelay(2 * 2);
+	if (state > S6D05A1_POWER_INIT) {
+		// First, run the display off command
+
+		s6d05a1_batch_add(id, id->batch, S6D05A1_OP_CMD_DISPLAY_OFF, NULL, 0);
+
+		// Next, enter sleep mode
+
+		s6d05a1_batch_add(id, id->batch, S6D05A1_OP_CMD_ENTER_SLEEP_MODE, NULL, 0);
+		s6d05a1_batch_sync(id, id->batch);
+
+		// Wait at least 2 frames
+
+		fdelay(2 * 2);
+	}
 
 	// Finally, allow the platform to do any necessary steps (turn off
 	// rails, etc.)
@@ -1594,7 +1760,7 @@ static int tm025zdz01_dss_power_on(struct omap_dss_device *dssdev)
 	    }
         }
 
-        s6d05a1_power_on(id);
+        s6d05a1_power_on(id, false);
 
         dssdev->state = OMAP_DSS_DISPLAY_ACTIVE;
     }
@@ -1678,7 +1844,7 @@ static int tm025zdz01_dss_resume(struct omap_dss_device *dssdev)
 	    }
         }
 
-	s6d05a1_power_on(id);
+	s6d05a1_power_on(id, true);
 
 	id->suspended = false;
 	dssdev->state = OMAP_DSS_DISPLAY_ACTIVE;
@@ -1688,14 +1854,84 @@ static int tm025zdz01_dss_resume(struct omap_dss_device *dssdev)
 	return (status);
 }
 
+// Gate the first frame after enable or resume on the panel having
+// completed its power-on sequence.
+
+static int tm025zdz01_dss_sync(struct omap_dss_device *dssdev)
+{
+	struct s6d05a1_device * id = &s6d05a1_dev;
+	unsigned long timeout = msecs_to_jiffies(S6D05A1_READY_TIMEOUT_MS);
+
+	if (!wait_for_completion_timeout(&id->ready, timeout))
+		return -ETIMEDOUT;
+
+	// A panel that is off has nothing to wait for.
+
+	return ((id->state == S6D05A1_POWER_READY) ||
+			(id->state == S6D05A1_POWER_OFF)) ? 0 : -EIO;
+}
+
+#ifdef CONFIG_DEBUG_FS
+static void s6d05a1_stats_show(struct seq_file *s, const char *name,
+							   const struct s6d05a1_stats *stats)
+{
+	seq_printf(s, "%s: count %lu last %u us min %u us max %u us avg %llu us\n",
+			   name, stats->count, stats->last_us, stats->min_us,
+			   stats->max_us,
+			   stats->count ? div64_u64(stats->total_us, stats->count) : 0);
+}
+
+static int s6d05a1_latency_show(struct seq_file *s, void *unused)
+{
+	struct s6d05a1_device * id = s->private;
+
+	s6d05a1_stats_show(s, "enable", &id->enable_stats);
+	s6d05a1_stats_show(s, "resume", &id->resume_stats);
+
+	return 0;
+}
+
+static int s6d05a1_latency_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, s6d05a1_latency_show, inode->i_private);
+}
+
+static const struct file_operations s6d05a1_latency_fops = {
+	.open		= s6d05a1_latency_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static void s6d05a1_debugfs_init(struct s6d05a1_device * id)
+{
+	id->debugfs_dir = debugfs_create_dir("tm025zdz01", NULL);
+
+	if (IS_ERR_OR_NULL(id->debugfs_dir)) {
+		id->debugfs_dir = NULL;
+		return;
+	}
+
+	debugfs_create_file("resume_latency", S_IRUGO, id->debugfs_dir,
+						id, &s6d05a1_latency_fops);
+}
+
+static void s6d05a1_debugfs_exit(struct s6d05a1_device * id)
+{
+	debugfs_remove_recursive(id->debugfs_dir);
+	id->debugfs_dir = NULL;
+}
+#else
+static inline void s6d05a1_debugfs_init(struct s6d05a1_device * id) { }
+static inline void s6d05a1_debugfs_exit(struct s6d05a1_device * id) { }
+#endif /* CONFIG_DEBUG_FS */
+
 static int s6d05a1_spi_probe(struct spi_device *spi)
 {
 	struct device *dev = &spi->dev;
 	struct s6d05a1_device *id = NULL;
 	int status = 0;
 
-	id->device_lock = SPIN_LOCK_UNLOCKED;
-
 	// Check to ensure the specified platform SPI clock doesn't exceed
 	// the allowed maximum.
 
@@ -1712,7 +1948,22 @@ static int s6d05a1_spi_probe(struct spi_device *spi)
 	id = &s6d05a1_dev;
 	id->spi = spi;
 
-  
+	spin_lock_init(&id->device_lock);
+	INIT_DELAYED_WORK(&id->power_work, s6d05a1_power_work);
+	init_completion(&id->ready);
+	complete_all(&id->ready);
+	id->state = S6D05A1_POWER_OFF;
+
+	// The batch holds the SPI words handed to the controller, so it
+	// must not live in static data.
+
+	id->batch = kzalloc(sizeof(*id->batch), GFP_KERNEL);
+
+	if (id->batch == NULL) {
+		status = -ENOMEM;
+		goto done;
+	}
+
 	// The Samsung S6D05A1 SPI interface requires mode 3. Bits-per-word
 	// is variable and is set on a per-transfer basis.
 
@@ -1726,7 +1977,7 @@ static int s6d05a1_spi_probe(struct spi_device *spi)
 
 	if (status < 0) {
 		dev_err(dev, "Failed to setup SPI controller with error %d\n", status);
-		goto done;
+		goto free_batch;
 	}
 
 	// Register our device private data with the SPI driver.
@@ -1740,16 +1991,29 @@ static int s6d05a1_spi_probe(struct spi_device *spi)
 
     status = sysfs_create_group(&spi->dev.kobj, &s6d05a1_attr_group);
 
+	s6d05a1_debugfs_init(id);
+
+	goto done;
+
+ free_batch:
+	kfree(id->batch);
+	id->batch = NULL;
+
  done:
 	return (status);
 }
 
 static int s6d05a1_spi_remove(struct spi_device *spi)
 {
+	struct s6d05a1_device *id = &s6d05a1_dev;
 	int status = 0;
 
+	s6d05a1_debugfs_exit(id);
 	sysfs_remove_group(&spi->dev.kobj, &s6d05a1_attr_group);
 	omap_dss_unregister_driver(&tianma_tm025zdz01_driver);
+	cancel_delayed_work_sync(&id->power_work);
+	kfree(id->batch);
+	id->batch = NULL;
 
 	return (status);
 }
@@ -467,6 +467,8 @@ static int dss_initialize_debugfs(void)
 #ifdef CONFIG_OMAP2_DSS_RFBI
 	debugfs_create_file("rfbi", S_IRUGO, dss_debugfs_dir,
 			&rfbi_dump_regs, &dss_debug_fops);
+	debugfs_create_file("rfbi_bench", S_IRUSR, dss_debugfs_dir,
+			&rfbi_bench, &dss_debug_fops);
 #endif
 #ifdef CONFIG_OMAP2_DSS_DSI
 	debugfs_create_file("dsi", S_IRUGO, dss_debugfs_dir,
@@ -32,8 +32,10 @@
 #include <linux/ktime.h>
 #include <linux/hrtimer.h>
 #include <linux/seq_file.h>
+#include <linux/completion.h>
 
 #include <plat/display.h>
+#include <plat/dma.h>
 #include "dss.h"
 
 #define RFBI_BASE               0x48050800
@@ -70,6 +72,9 @@ struct rfbi_reg { u16 idx; };
 /* To work around an RFBI transfer rate limitation */
 #define OMAP_RFBI_RATE_LIMIT    1
 
+/* Bounce buffer of the DMA pixel path, in RFBI_PARAM writes */
+#define RFBI_DMA_BUF_WORDS	8192
+
 enum omap_rfbi_cycleformat {
 	OMAP_DSS_RFBI_CYCLEFORMAT_1_1 = 0,
 	OMAP_DSS_RFBI_CYCLEFORMAT_2_1 = 1,
@@ -119,6 +124,29 @@ static struct {
 	spinlock_t        cmd_lock;
 	struct completion cmd_done;
 	atomic_t          refresh_pending;
+
+	/* omap_rfbi_write_pixels_dma() */
+	struct {
+		int		fetch_ch;	/* framebuffer -> buf, one pixel
+						   component per word */
+		int		push_ch;	/* buf -> RFBI_PARAM */
+		u32		*buf;
+		dma_addr_t	buf_phys;
+		spinlock_t	lock;
+		bool		busy;
+
+		int		data_type;	/* of fetch_ch */
+		int		nelem;		/* words per pixel */
+		int		bytespp;	/* in the framebuffer */
+		u32		src;		/* next line */
+		int		stride;
+		u16		w;
+		u16		lines_left;
+		u16		pass_lines;
+
+		void		(*callback)(void *data);
+		void		*data;
+	} dma;
 } rfbi;
 
 struct update_region {
@@ -287,6 +315,263 @@ void omap_rfbi_write_pixels(const void __iomem *buf, int scr_width,
 }
 EXPORT_SYMBOL(omap_rfbi_write_pixels);
 
+/*
+ * DMA pixel path. The RFBI only takes 32-bit register writes, so each
+ * pixel component has to end up in a word of its own: one channel
+ * picks the components out of the framebuffer in the order the panel
+ * wants them (most significant first on an 8-bit bus) and spreads them
+ * over a zeroed bounce buffer, a second channel linked to it then
+ * writes the buffer into RFBI_PARAM. The buffer holds a few lines;
+ * every pass ends with an interrupt which starts the next one.
+ */
+static void rfbi_dma_start_pass(void)
+{
+	int fetch = rfbi.dma.fetch_ch;
+	int push = rfbi.dma.push_ch;
+	int esize = rfbi.dma.data_type == OMAP_DMA_DATA_TYPE_S8 ? 1 : 2;
+	int pixels, src_ei, src_fi;
+	u32 src;
+
+	rfbi.dma.pass_lines = min_t(int, rfbi.dma.lines_left,
+			rfbi.dma.stride == rfbi.dma.w * rfbi.dma.bytespp ?
+			RFBI_DMA_BUF_WORDS / (rfbi.dma.w * rfbi.dma.nelem) : 1);
+	pixels = rfbi.dma.pass_lines * rfbi.dma.w;
+
+	/*
+	 * One frame per pixel. Within it walk the components backwards,
+	 * then jump to the last component of the next pixel. In 16-bit
+	 * mode a frame is simply the whole 16-bit pixel.
+	 */
+	src = rfbi.dma.src + (rfbi.dma.nelem - 1) * esize;
+	if (rfbi.dma.nelem > 1) {
+		src_ei = -1;
+		src_fi = rfbi.dma.bytespp + rfbi.dma.nelem - 1;
+	} else {
+		src_ei = 1;
+		src_fi = 1;
+	}
+
+	omap_set_dma_transfer_params(fetch, rfbi.dma.data_type,
+			rfbi.dma.nelem, pixels, OMAP_DMA_SYNC_ELEMENT,
+			OMAP_DMA_NO_DEVICE, 0);
+	omap_set_dma_src_params(fetch, 0, OMAP_DMA_AMODE_DOUBLE_IDX,
+			src, src_ei, src_fi);
+	/* every element lands in the low bits of the next word */
+	omap_set_dma_dest_params(fetch, 0, OMAP_DMA_AMODE_DOUBLE_IDX,
+			rfbi.dma.buf_phys, 5 - esize, 5 - esize);
+
+	omap_set_dma_transfer_params(push, OMAP_DMA_DATA_TYPE_S32,
+			pixels * rfbi.dma.nelem, 1, OMAP_DMA_SYNC_ELEMENT,
+			OMAP_DMA_NO_DEVICE, 0);
+
+	omap_start_dma(fetch);
+}
+
+static void rfbi_dma_callback(int lch, u16 ch_status, void *data)
+{
+	void (*callback)(void *data);
+
+	if (ch_status & ~OMAP_DMA_BLOCK_IRQ)
+		DSSERR("pixel DMA error, status 0x%x\n", ch_status);
+
+	rfbi.dma.lines_left -= rfbi.dma.pass_lines;
+	rfbi.dma.src += rfbi.dma.pass_lines * rfbi.dma.stride;
+	if (rfbi.dma.lines_left && !(ch_status & ~OMAP_DMA_BLOCK_IRQ)) {
+		rfbi_dma_start_pass();
+		return;
+	}
+
+	rfbi_enable_clocks(0);
+
+	callback = rfbi.dma.callback;
+	data = rfbi.dma.data;
+	spin_lock(&rfbi.dma.lock);
+	rfbi.dma.busy = false;
+	spin_unlock(&rfbi.dma.lock);
+
+	if (callback)
+		callback(data);
+}
+
+/**
+ * omap_rfbi_write_pixels_dma - DMA version of omap_rfbi_write_pixels()
+ * @paddr: physical address of the framebuffer
+ * @scr_width: framebuffer line length in pixels
+ * @x, @y, @w, @h: area to send
+ * @callback: called from interrupt context once everything is written
+ * @data: argument to @callback
+ *
+ * Returns 0 if the transfer was started. Otherwise, e.g. while a
+ * display update or another write is going on or if there are no DMA
+ * channels, nothing has been done and the caller can use the CPU path.
+ */
+int omap_rfbi_write_pixels_dma(u32 paddr, int scr_width,
+		u16 x, u16 y, u16 w, u16 h,
+		void (*callback)(void *data), void *data)
+{
+	unsigned long flags;
+
+	if (rfbi.dma.push_ch < 0 || !w || !h)
+		return -ENODEV;
+
+	if (rfbi.datatype == OMAP_DSS_RFBI_DATATYPE_16 &&
+	    rfbi.parallelmode == OMAP_DSS_RFBI_PARALLELMODE_8) {
+		rfbi.dma.data_type = OMAP_DMA_DATA_TYPE_S8;
+		rfbi.dma.nelem = 2;
+		rfbi.dma.bytespp = 2;
+	} else if (rfbi.datatype == OMAP_DSS_RFBI_DATATYPE_24 &&
+		   rfbi.parallelmode == OMAP_DSS_RFBI_PARALLELMODE_8) {
+		rfbi.dma.data_type = OMAP_DMA_DATA_TYPE_S8;
+		rfbi.dma.nelem = 3;
+		rfbi.dma.bytespp = 4;
+	} else if (rfbi.datatype == OMAP_DSS_RFBI_DATATYPE_16 &&
+		   rfbi.parallelmode == OMAP_DSS_RFBI_PARALLELMODE_16) {
+		rfbi.dma.data_type = OMAP_DMA_DATA_TYPE_S16;
+		rfbi.dma.nelem = 1;
+		rfbi.dma.bytespp = 2;
+	} else {
+		return -EINVAL;
+	}
+
+	if (w * rfbi.dma.nelem > RFBI_DMA_BUF_WORDS)
+		return -EINVAL;
+
+	spin_lock_irqsave(&rfbi.dma.lock, flags);
+	if (rfbi.dma.busy || atomic_read(&rfbi.refresh_pending)) {
+		spin_unlock_irqrestore(&rfbi.dma.lock, flags);
+		return -EBUSY;
+	}
+	rfbi.dma.busy = true;
+	spin_unlock_irqrestore(&rfbi.dma.lock, flags);
+
+	rfbi.dma.stride = scr_width * rfbi.dma.bytespp;
+	rfbi.dma.src = paddr + y * rfbi.dma.stride + x * rfbi.dma.bytespp;
+	rfbi.dma.w = w;
+	rfbi.dma.lines_left = h;
+	rfbi.dma.callback = callback;
+	rfbi.dma.data = data;
+
+	rfbi_enable_clocks(1);
+	rfbi_dma_start_pass();
+
+	return 0;
+}
+EXPORT_SYMBOL(omap_rfbi_write_pixels_dma);
+
+static int rfbi_dma_init(void)
+{
+	int r;
+
+	rfbi.dma.buf = dma_alloc_coherent(NULL,
+			RFBI_DMA_BUF_WORDS * sizeof(u32),
+			&rfbi.dma.buf_phys, GFP_KERNEL);
+	if (!rfbi.dma.buf)
+		return -ENOMEM;
+	/* the fetch channel only ever writes the low bits */
+	memset(rfbi.dma.buf, 0, RFBI_DMA_BUF_WORDS * sizeof(u32));
+
+	r = omap_request_dma(OMAP_DMA_NO_DEVICE, "RFBI pixel fetch",
+			NULL, NULL, &rfbi.dma.fetch_ch);
+	if (r)
+		goto err0;
+
+	r = omap_request_dma(OMAP_DMA_NO_DEVICE, "RFBI pixel push",
+			rfbi_dma_callback, NULL, &rfbi.dma.push_ch);
+	if (r)
+		goto err1;
+
+	/* the push never changes except for its length */
+	omap_set_dma_src_params(rfbi.dma.push_ch, 0, OMAP_DMA_AMODE_POST_INC,
+			rfbi.dma.buf_phys, 0, 0);
+	omap_set_dma_dest_params(rfbi.dma.push_ch, 0, OMAP_DMA_AMODE_CONSTANT,
+			RFBI_BASE + RFBI_PARAM.idx, 0, 0);
+	omap_dma_link_lch(rfbi.dma.fetch_ch, rfbi.dma.push_ch);
+
+	return 0;
+err1:
+	omap_free_dma(rfbi.dma.fetch_ch);
+err0:
+	dma_free_coherent(NULL, RFBI_DMA_BUF_WORDS * sizeof(u32),
+			rfbi.dma.buf, rfbi.dma.buf_phys);
+	rfbi.dma.buf = NULL;
+	rfbi.dma.fetch_ch = rfbi.dma.push_ch = -1;
+	return r;
+}
+
+static void rfbi_dma_exit(void)
+{
+	if (rfbi.dma.push_ch < 0)
+		return;
+
+	omap_stop_dma(rfbi.dma.fetch_ch);
+	omap_stop_dma(rfbi.dma.push_ch);
+	omap_dma_unlink_lch(rfbi.dma.fetch_ch, rfbi.dma.push_ch);
+	omap_free_dma(rfbi.dma.push_ch);
+	omap_free_dma(rfbi.dma.fetch_ch);
+	rfbi.dma.fetch_ch = rfbi.dma.push_ch = -1;
+
+	dma_free_coherent(NULL, RFBI_DMA_BUF_WORDS * sizeof(u32),
+			rfbi.dma.buf, rfbi.dma.buf_phys);
+	rfbi.dma.buf = NULL;
+
+	if (rfbi.dma.busy) {
+		rfbi.dma.busy = false;
+		rfbi_enable_clocks(0);
+	}
+}
+
+static void rfbi_bench_done(void *data)
+{
+	complete(data);
+}
+
+/*
+ * debugfs: write the whole screen with the CPU and then with DMA and
+ * report how long each took.
+ */
+void rfbi_bench(struct seq_file *s)
+{
+	DECLARE_COMPLETION_ONSTACK(done);
+	struct omap_dss_device *dssdev = rfbi.dssdev[0];
+	struct omap_overlay *ovl;
+	ktime_t start;
+	s64 cpu_us, dma_us;
+	u16 w, h;
+	int r;
+
+	if (!dssdev || dssdev->state != OMAP_DSS_DISPLAY_ACTIVE ||
+	    !dssdev->manager) {
+		seq_printf(s, "no active RFBI display\n");
+		return;
+	}
+	if (rfbi.dma.busy || atomic_read(&rfbi.refresh_pending)) {
+		seq_printf(s, "display update in progress, try again\n");
+		return;
+	}
+
+	ovl = dssdev->manager->overlays[0];
+	dssdev->driver->get_resolution(dssdev, &w, &h);
+
+	start = ktime_get();
+	omap_rfbi_write_pixels(ovl->info.vaddr, ovl->info.screen_width,
+			0, 0, w, h);
+	cpu_us = ktime_us_delta(ktime_get(), start);
+
+	start = ktime_get();
+	r = omap_rfbi_write_pixels_dma(ovl->info.paddr, ovl->info.screen_width,
+			0, 0, w, h, rfbi_bench_done, &done);
+	if (r == 0 && !wait_for_completion_timeout(&done,
+				msecs_to_jiffies(1000)))
+		r = -ETIMEDOUT;
+	dma_us = ktime_us_delta(ktime_get(), start);
+
+	seq_printf(s, "%ux%u cpu: %lld us\n", w, h, cpu_us);
+	if (r)
+		seq_printf(s, "%ux%u dma: failed (%d)\n", w, h, r);
+	else
+		seq_printf(s, "%ux%u dma: %lld us\n", w, h, dma_us);
+}
+
 void rfbi_transfer_area(u16 width, u16 height,
 			     void (callback)(void *data), void *data)
 {
@@ -898,6 +1183,10 @@ int omap_rfbi_update(struct omap_dss_device *dssdev,
 		scr_width = ovl->info.screen_width;
 		addr = ovl->info.vaddr;
 
+		if (omap_rfbi_write_pixels_dma(ovl->info.paddr, scr_width,
+					x, y, w, h, callback, data) == 0)
+			return 0;
+
 		omap_rfbi_write_pixels(addr, scr_width, x, y, w, h);
 
 		callback(data);
@@ -954,6 +1243,8 @@ int rfbi_init(void)
 	DSSDBG("rfbi_init\n");
 
 	spin_lock_init(&rfbi.cmd_lock);
+	spin_lock_init(&rfbi.dma.lock);
+	rfbi.dma.fetch_ch = rfbi.dma.push_ch = -1;
 
 	init_completion(&rfbi.cmd_done);
 	atomic_set(&rfbi.refresh_pending, 0);
@@ -1033,6 +1324,10 @@ int omapdss_rfbi_display_enable(struct omap_dss_device *dssdev)
 	rfbi_set_timings(dssdev->phy.rfbi.channel,
 			 &dssdev->ctrl.rfbi_timings);
 
+	/* not fatal, omap_rfbi_write_pixels() still works */
+	if (rfbi_dma_init())
+		DSSWARN("no DMA for RFBI pixel writes\n");
+
 	rfbi_enable_clocks(1);
 	mdelay(10);
 	l = rfbi_read_reg(RFBI_SYSCONFIG);
@@ -1057,6 +1352,8 @@ void omapdss_rfbi_display_disable(struct omap_dss_device *dssdev)
 	omap_dispc_unregister_isr(framedone_callback, NULL,
 			DISPC_IRQ_FRAMEDONE);
 
+	rfbi_dma_exit();
+
 #ifdef CONFIG_OMAP2_DSS_USE_DSI_PLL
 	dss_select_dispc_clk_source(DSS_SRC_DSS1_ALWON_FCLK);
 	dsi_pll_uninit();
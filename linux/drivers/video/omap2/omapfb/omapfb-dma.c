@@ -0,0 +1,326 @@
+/*
+ * linux/drivers/video/omap2/omapfb-dma.c
+ *
+ * System DMA backed fill and copy for the framebuffers.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <linux/fb.h>
+#include <linux/device.h>
+#include <linux/delay.h>
+#include <linux/sched.h>
+#include <linux/omapfb.h>
+
+#include <plat/dma.h>
+
+#include "omapfb.h"
+
+/* below this the setup costs more than cfb_* spend on the pixels */
+#define OMAPFB_DMA_MIN_BYTES	4096
+#define OMAPFB_DMA_TIMEOUT_US	100000
+
+struct omapfb_dma_xfer {
+	bool fill;
+	u32 color;
+	int data_type;
+	u32 src;
+	u32 dst;
+	int src_fi;
+	int dst_fi;
+	unsigned elems;		/* per line */
+	unsigned lines;
+};
+
+static void omapfb_dma_callback(int lch, u16 ch_status, void *data)
+{
+	struct omapfb2_device *fbdev = data;
+
+	if (ch_status & ~OMAP_DMA_BLOCK_IRQ)
+		dev_err(fbdev->dev, "DMA error, status 0x%x\n", ch_status);
+
+	complete(&fbdev->dma.done);
+}
+
+static bool omapfb_dma_claim(struct omapfb2_device *fbdev)
+{
+	unsigned long flags;
+	bool claimed = false;
+
+	spin_lock_irqsave(&fbdev->dma.lock, flags);
+	if (!fbdev->dma.busy)
+		claimed = fbdev->dma.busy = true;
+	spin_unlock_irqrestore(&fbdev->dma.lock, flags);
+
+	return claimed;
+}
+
+static void omapfb_dma_release(struct omapfb2_device *fbdev)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&fbdev->dma.lock, flags);
+	fbdev->dma.busy = false;
+	spin_unlock_irqrestore(&fbdev->dma.lock, flags);
+
+	wake_up(&fbdev->dma.wq);
+}
+
+/*
+ * Runs one transfer, one frame per line. With can_sleep the caller
+ * waits for the DMA interrupt, otherwise (console drawing, possibly
+ * with interrupts off) the channel is polled and we give up right
+ * away if somebody else has it.
+ */
+static int omapfb_dma_run(struct omapfb2_device *fbdev,
+		const struct omapfb_dma_xfer *x, bool can_sleep)
+{
+	int lch = fbdev->dma.lch;
+	int r = 0;
+
+	if (lch < 0)
+		return -ENODEV;
+
+	if (can_sleep)
+		wait_event(fbdev->dma.wq, omapfb_dma_claim(fbdev));
+	else if (!omapfb_dma_claim(fbdev))
+		return -EBUSY;
+
+	omap_set_dma_transfer_params(lch, x->data_type, x->elems, x->lines,
+			OMAP_DMA_SYNC_ELEMENT, OMAP_DMA_NO_DEVICE, 0);
+
+	if (x->fill) {
+		omap_set_dma_color_mode(lch, OMAP_DMA_CONSTANT_FILL, x->color);
+		omap_set_dma_src_params(lch, 0, OMAP_DMA_AMODE_CONSTANT,
+				x->dst, 0, 0);
+	} else {
+		omap_set_dma_color_mode(lch, OMAP_DMA_COLOR_DIS, 0);
+		omap_set_dma_src_params(lch, 0, OMAP_DMA_AMODE_DOUBLE_IDX,
+				x->src, 1, x->src_fi);
+	}
+	omap_set_dma_dest_params(lch, 0, OMAP_DMA_AMODE_DOUBLE_IDX,
+			x->dst, 1, x->dst_fi);
+
+	if (can_sleep) {
+		INIT_COMPLETION(fbdev->dma.done);
+		omap_enable_dma_irq(lch, OMAP_DMA_BLOCK_IRQ);
+	} else {
+		omap_disable_dma_irq(lch, OMAP_DMA_BLOCK_IRQ);
+	}
+
+	/* the CPU may have drawn into the same area just before */
+	wmb();
+	omap_start_dma(lch);
+
+	if (can_sleep) {
+		if (!wait_for_completion_timeout(&fbdev->dma.done,
+				usecs_to_jiffies(OMAPFB_DMA_TIMEOUT_US)))
+			r = -ETIMEDOUT;
+	} else {
+		int t = OMAPFB_DMA_TIMEOUT_US;
+
+		while (omap_get_dma_active_status(lch) && --t)
+			udelay(1);
+		if (!t)
+			r = -ETIMEDOUT;
+	}
+
+	if (r) {
+		dev_err(fbdev->dev, "DMA timeout\n");
+		omap_stop_dma(lch);
+	}
+
+	omapfb_dma_release(fbdev);
+
+	return r;
+}
+
+static u32 omapfb_dma_addr(struct fb_info *fbi, u32 x, u32 y)
+{
+	return fbi->fix.smem_start + y * fbi->fix.line_length +
+		x * (fbi->var.bits_per_pixel >> 3);
+}
+
+/* frame index going from the end of one line to the start of another */
+static int omapfb_dma_frame_index(struct fb_info *fbi, unsigned bytes,
+		bool backwards)
+{
+	int stride = fbi->fix.line_length;
+
+	return backwards ? 1 - stride - bytes : 1 + stride - bytes;
+}
+
+/**
+ * omapfb_dma_fill - fill a rectangle of the virtual framebuffer
+ * @color: raw pixel value
+ *
+ * 8, 16 and 32 bpp only, the last one without alpha as the fill
+ * colour is 24 bits wide.
+ */
+int omapfb_dma_fill(struct fb_info *fbi, u32 x, u32 y, u32 w, u32 h,
+		u32 color, bool can_sleep)
+{
+	struct omapfb_info *ofbi = FB2OFB(fbi);
+	struct omapfb_dma_xfer xfer;
+	unsigned bytes;
+
+	switch (fbi->var.bits_per_pixel) {
+	case 8:
+		xfer.data_type = OMAP_DMA_DATA_TYPE_S8;
+		break;
+	case 16:
+		xfer.data_type = OMAP_DMA_DATA_TYPE_S16;
+		break;
+	case 32:
+		if (color >> 24)
+			return -EINVAL;
+		xfer.data_type = OMAP_DMA_DATA_TYPE_S32;
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	bytes = w * (fbi->var.bits_per_pixel >> 3);
+
+	xfer.fill = true;
+	xfer.color = color;
+	xfer.dst = omapfb_dma_addr(fbi, x, y);
+	xfer.dst_fi = omapfb_dma_frame_index(fbi, bytes, false);
+	xfer.elems = w;
+	xfer.lines = h;
+
+	return omapfb_dma_run(ofbi->fbdev, &xfer, can_sleep);
+}
+
+/**
+ * omapfb_dma_copy - copy a rectangle within the virtual framebuffer
+ *
+ * Overlapping areas are fine except for moving right along the same
+ * lines.
+ */
+int omapfb_dma_copy(struct fb_info *fbi, u32 sx, u32 sy, u32 dx, u32 dy,
+		u32 w, u32 h, bool can_sleep)
+{
+	struct omapfb_info *ofbi = FB2OFB(fbi);
+	struct omapfb_dma_xfer xfer;
+	unsigned bytes;
+	bool backwards;
+	u32 align;
+
+	if (fbi->var.bits_per_pixel & 7)
+		return -EINVAL;
+
+	if (dy == sy && dx > sx && dx < sx + w)
+		return -EINVAL;
+
+	/* moving down, start from the bottom line */
+	backwards = dy > sy;
+	if (backwards) {
+		sy += h - 1;
+		dy += h - 1;
+	}
+
+	bytes = w * (fbi->var.bits_per_pixel >> 3);
+
+	xfer.fill = false;
+	xfer.src = omapfb_dma_addr(fbi, sx, sy);
+	xfer.dst = omapfb_dma_addr(fbi, dx, dy);
+	xfer.src_fi = xfer.dst_fi =
+		omapfb_dma_frame_index(fbi, bytes, backwards);
+
+	align = xfer.src | xfer.dst | bytes | fbi->fix.line_length;
+	if (!(align & 3)) {
+		xfer.data_type = OMAP_DMA_DATA_TYPE_S32;
+		xfer.elems = bytes / 4;
+	} else if (!(align & 1)) {
+		xfer.data_type = OMAP_DMA_DATA_TYPE_S16;
+		xfer.elems = bytes / 2;
+	} else {
+		xfer.data_type = OMAP_DMA_DATA_TYPE_S8;
+		xfer.elems = bytes;
+	}
+	xfer.lines = h;
+
+	return omapfb_dma_run(ofbi->fbdev, &xfer, can_sleep);
+}
+
+static bool omapfb_dma_worth_it(struct fb_info *fbi, u32 w, u32 h)
+{
+	if (fbi->state != FBINFO_STATE_RUNNING || !fbi->fix.smem_len)
+		return false;
+
+	return w * h * (fbi->var.bits_per_pixel >> 3) >= OMAPFB_DMA_MIN_BYTES;
+}
+
+void omapfb_fillrect(struct fb_info *fbi, const struct fb_fillrect *rect)
+{
+	u32 color = rect->color;
+
+	if (!omapfb_dma_worth_it(fbi, rect->width, rect->height) ||
+			rect->rop != ROP_COPY)
+		goto cpu;
+
+	if (fbi->fix.visual == FB_VISUAL_TRUECOLOR ||
+			fbi->fix.visual == FB_VISUAL_DIRECTCOLOR)
+		color = ((u32 *)fbi->pseudo_palette)[rect->color];
+
+	if (omapfb_dma_fill(fbi, rect->dx, rect->dy, rect->width,
+				rect->height, color, false) == 0)
+		return;
+cpu:
+	cfb_fillrect(fbi, rect);
+}
+
+void omapfb_copyarea(struct fb_info *fbi, const struct fb_copyarea *area)
+{
+	if (!omapfb_dma_worth_it(fbi, area->width, area->height))
+		goto cpu;
+
+	if (omapfb_dma_copy(fbi, area->sx, area->sy, area->dx, area->dy,
+				area->width, area->height, false) == 0)
+		return;
+cpu:
+	cfb_copyarea(fbi, area);
+}
+
+int omapfb_dma_init(struct omapfb2_device *fbdev)
+{
+	int lch, r;
+
+	fbdev->dma.lch = -1;
+	spin_lock_init(&fbdev->dma.lock);
+	init_waitqueue_head(&fbdev->dma.wq);
+	init_completion(&fbdev->dma.done);
+
+	r = omap_request_dma(OMAP_DMA_NO_DEVICE, "omapfb",
+			omapfb_dma_callback, fbdev, &lch);
+	if (r)
+		return r;
+
+	omap_set_dma_src_burst_mode(lch, OMAP_DMA_DATA_BURST_16);
+	omap_set_dma_dest_burst_mode(lch, OMAP_DMA_DATA_BURST_16);
+
+	fbdev->dma.lch = lch;
+
+	return 0;
+}
+
+void omapfb_dma_exit(struct omapfb2_device *fbdev)
+{
+	if (fbdev->dma.lch < 0)
+		return;
+
+	wait_event(fbdev->dma.wq, omapfb_dma_claim(fbdev));
+	omap_free_dma(fbdev->dma.lch);
+	fbdev->dma.lch = -1;
+}
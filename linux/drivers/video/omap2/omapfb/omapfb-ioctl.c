@@ -27,6 +27,8 @@
 #include <linux/mm.h>
 #include <linux/omapfb.h>
 #include <linux/vmalloc.h>
+#include <linux/eventfd.h>
+#include <linux/console.h>
 
 #include <plat/display.h>
 #include <plat/vrfb.h>
@@ -590,6 +592,162 @@ static int omapfb_wait_for_go(struct fb_info *fbi)
 	return r;
 }
 
+static int omapfb_queue_flip(struct fb_info *fbi, struct omapfb_flip *flip)
+{
+	struct omapfb_info *ofbi = FB2OFB(fbi);
+	struct fb_var_screeninfo *var = &fbi->var;
+	struct eventfd_ctx *done = NULL;
+	unsigned long flags;
+	int r = 0;
+
+	if (flip->xoffset + var->xres > var->xres_virtual ||
+	    flip->yoffset + var->yres > var->yres_virtual)
+		return -EINVAL;
+
+	if (flip->eventfd >= 0) {
+		done = eventfd_ctx_fdget(flip->eventfd);
+		if (IS_ERR(done))
+			return PTR_ERR(done);
+	}
+
+	spin_lock_irqsave(&ofbi->flip.lock, flags);
+	if (ofbi->flip.count == OMAPFB_FLIP_QUEUE_LEN) {
+		r = -EBUSY;
+	} else {
+		struct omapfb_flip_req *req;
+
+		req = &ofbi->flip.q[(ofbi->flip.head + ofbi->flip.count) %
+			OMAPFB_FLIP_QUEUE_LEN];
+		req->xoffset = flip->xoffset;
+		req->yoffset = flip->yoffset;
+		req->done = done;
+		ofbi->flip.count++;
+	}
+	spin_unlock_irqrestore(&ofbi->flip.lock, flags);
+
+	if (r) {
+		if (done)
+			eventfd_ctx_put(done);
+		return r;
+	}
+
+	queue_work(ofbi->fbdev->flip_wq, &ofbi->flip.work);
+
+	return 0;
+}
+
+/* wait until the panned-to buffer is actually on the screen */
+static int omapfb_flip_wait(struct fb_info *fbi)
+{
+	struct omap_dss_device *display = fb2display(fbi);
+
+	if (!display)
+		return 0;
+
+	if (display->driver->get_update_mode &&
+	    display->driver->get_update_mode(display) ==
+			OMAP_DSS_UPDATE_MANUAL) {
+		if (display->driver->sync)
+			return display->driver->sync(display);
+		return 0;
+	}
+
+	return omapfb_wait_for_go(fbi);
+}
+
+/*
+ * Queued flips are done one at a time: pan like FBIOPAN_DISPLAY would,
+ * which sets the GO bit so DISPC picks the new address up at the next
+ * vsync, wait for that, then let userspace know.
+ */
+void omapfb_flip_work(struct work_struct *work)
+{
+	struct omapfb_info *ofbi = container_of(work, struct omapfb_info,
+			flip.work);
+	struct fb_info *fbi = ofbi->fbdev->fbs[ofbi->id];
+	struct omapfb_flip_req req;
+	struct fb_var_screeninfo var;
+	unsigned long flags;
+	int r;
+
+	for (;;) {
+		spin_lock_irqsave(&ofbi->flip.lock, flags);
+		if (!ofbi->flip.count) {
+			spin_unlock_irqrestore(&ofbi->flip.lock, flags);
+			break;
+		}
+		req = ofbi->flip.q[ofbi->flip.head];
+		spin_unlock_irqrestore(&ofbi->flip.lock, flags);
+
+		r = -ENODEV;
+		if (lock_fb_info(fbi)) {
+			var = fbi->var;
+			var.xoffset = req.xoffset;
+			var.yoffset = req.yoffset;
+
+			acquire_console_sem();
+			r = fb_pan_display(fbi, &var);
+			release_console_sem();
+			unlock_fb_info(fbi);
+		}
+
+		if (!r)
+			r = omapfb_flip_wait(fbi);
+		if (r)
+			dev_err(ofbi->fbdev->dev, "fb%d: flip failed: %d\n",
+					ofbi->id, r);
+
+		/* only now make room, the queue includes this flip */
+		spin_lock_irqsave(&ofbi->flip.lock, flags);
+		ofbi->flip.head = (ofbi->flip.head + 1) %
+			OMAPFB_FLIP_QUEUE_LEN;
+		ofbi->flip.count--;
+		spin_unlock_irqrestore(&ofbi->flip.lock, flags);
+
+		if (req.done) {
+			eventfd_signal(req.done, 1);
+			eventfd_ctx_put(req.done);
+		}
+	}
+}
+
+static int omapfb_blit(struct fb_info *fbi, struct omapfb_blit *blit)
+{
+	struct omapfb_info *ofbi = FB2OFB(fbi);
+	struct fb_var_screeninfo *var = &fbi->var;
+	bool fill = blit->flags & OMAPFB_BLIT_FILL;
+	int r;
+
+	if (blit->flags & ~OMAPFB_BLIT_FILL)
+		return -EINVAL;
+
+	if (blit->dx + blit->w > var->xres_virtual ||
+	    blit->dy + blit->h > var->yres_virtual)
+		return -EINVAL;
+
+	if (!fill && (blit->sx + blit->w > var->xres_virtual ||
+		      blit->sy + blit->h > var->yres_virtual))
+		return -EINVAL;
+
+	if (!blit->w || !blit->h)
+		return 0;
+
+	omapfb_get_mem_region(ofbi->region);
+
+	if (!fbi->fix.smem_len)
+		r = -EINVAL;
+	else if (fill)
+		r = omapfb_dma_fill(fbi, blit->dx, blit->dy, blit->w, blit->h,
+				blit->color, true);
+	else
+		r = omapfb_dma_copy(fbi, blit->sx, blit->sy, blit->dx,
+				blit->dy, blit->w, blit->h, true);
+
+	omapfb_put_mem_region(ofbi->region);
+
+	return r;
+}
+
 int omapfb_ioctl(struct fb_info *fbi, unsigned int cmd, unsigned long arg)
 {
 	struct omapfb_info *ofbi = FB2OFB(fbi);
@@ -610,6 +768,8 @@ int omapfb_ioctl(struct fb_info *fbi, unsigned int cmd, unsigned long arg)
 		struct omapfb_vram_info		vram_info;
 		struct omapfb_tearsync_info	tearsync_info;
 		struct omapfb_display_info	display_info;
+		struct omapfb_flip		flip;
+		struct omapfb_blit		blit;
 		u32				crt;
 	} p;
 
@@ -800,6 +960,28 @@ int omapfb_ioctl(struct fb_info *fbi, unsigned int cmd, unsigned long arg)
 		r = omapfb_wait_for_go(fbi);
 		break;
 
+	case OMAPFB_QUEUE_FLIP:
+		DBG("ioctl QUEUE_FLIP\n");
+		if (copy_from_user(&p.flip, (void __user *)arg,
+					sizeof(p.flip))) {
+			r = -EFAULT;
+			break;
+		}
+
+		r = omapfb_queue_flip(fbi, &p.flip);
+		break;
+
+	case OMAPFB_BLIT:
+		DBG("ioctl BLIT\n");
+		if (copy_from_user(&p.blit, (void __user *)arg,
+					sizeof(p.blit))) {
+			r = -EFAULT;
+			break;
+		}
+
+		r = omapfb_blit(fbi, &p.blit);
+		break;
+
 	/* LCD and CTRL tests do the same thing for backward
 	 * compatibility */
 	case OMAPFB_LCD_TEST:
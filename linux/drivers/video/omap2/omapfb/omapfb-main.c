@@ -1144,6 +1144,17 @@ static int omapfb_pan_display(struct fb_var_screeninfo *var,
 
 	omapfb_put_mem_region(ofbi->region);
 
+	/* A manual update display only shows the new buffer once sent */
+	if (r == 0 && display && display->driver->update &&
+			display->driver->get_update_mode &&
+			display->driver->get_update_mode(display) ==
+			OMAP_DSS_UPDATE_MANUAL) {
+		u16 dw, dh;
+
+		display->driver->get_resolution(display, &dw, &dh);
+		r = display->driver->update(display, 0, 0, dw, dh);
+	}
+
 	return r;
 }
 
@@ -1389,8 +1400,8 @@ static struct fb_ops omapfb_ops = {
 	.owner          = THIS_MODULE,
 	.fb_open        = omapfb_open,
 	.fb_release     = omapfb_release,
-	.fb_fillrect    = cfb_fillrect,
-	.fb_copyarea    = cfb_copyarea,
+	.fb_fillrect    = omapfb_fillrect,
+	.fb_copyarea    = omapfb_copyarea,
 	.fb_imageblit   = cfb_imageblit,
 	.fb_blank       = omapfb_blank,
 	.fb_ioctl       = omapfb_ioctl,
@@ -1944,6 +1955,11 @@ static void omapfb_free_resources(struct omapfb2_device *fbdev)
 	if (fbdev == NULL)
 		return;
 
+	if (fbdev->flip_wq)
+		destroy_workqueue(fbdev->flip_wq);
+
+	omapfb_dma_exit(fbdev);
+
 	for (i = 0; i < fbdev->num_fbs; i++)
 		unregister_framebuffer(fbdev->fbs[i]);
 
@@ -2005,6 +2021,9 @@ static int omapfb_create_framebuffers(struct omapfb2_device *fbdev)
 			OMAP_DSS_ROT_DMA;
 		ofbi->mirror = def_mirror;
 
+		spin_lock_init(&ofbi->flip.lock);
+		INIT_WORK(&ofbi->flip.work, omapfb_flip_work);
+
 		fbdev->num_fbs++;
 	}
 
@@ -2281,6 +2300,15 @@ static int omapfb_probe(struct platform_device *pdev)
 	fbdev->dev = &pdev->dev;
 	platform_set_drvdata(pdev, fbdev);
 
+	if (omapfb_dma_init(fbdev))
+		dev_warn(&pdev->dev, "no DMA channel, using CPU fill/copy\n");
+
+	fbdev->flip_wq = create_singlethread_workqueue("omapfb_flip");
+	if (fbdev->flip_wq == NULL) {
+		r = -ENOMEM;
+		goto cleanup;
+	}
+
 	r = 0;
 	fbdev->num_displays = 0;
 	dssdev = NULL;
@@ -28,6 +28,10 @@
 #endif
 
 #include <linux/rwsem.h>
+#include <linux/spinlock.h>
+#include <linux/wait.h>
+#include <linux/completion.h>
+#include <linux/workqueue.h>
 
 #include <plat/display.h>
 
@@ -45,6 +49,11 @@ extern unsigned int omapfb_debug;
 /* max number of overlays to which a framebuffer data can be direct */
 #define OMAPFB_MAX_OVL_PER_FB 3
 
+/* OMAPFB_QUEUE_FLIP requests not yet on screen, per fb */
+#define OMAPFB_FLIP_QUEUE_LEN 2
+
+struct eventfd_ctx;
+
 struct omapfb2_mem_region {
 	int             id;
 	u32		paddr;
@@ -72,6 +81,18 @@ struct omapfb_info {
 #ifdef CONFIG_FB_OMAP2_DEBUG_SUPPORT
 	int fps;
 #endif
+
+	struct {
+		spinlock_t lock;
+		struct omapfb_flip_req {
+			u32 xoffset;
+			u32 yoffset;
+			struct eventfd_ctx *done;
+		} q[OMAPFB_FLIP_QUEUE_LEN];
+		unsigned head;
+		unsigned count;
+		struct work_struct work;
+	} flip;
 };
 
 struct omapfb2_device {
@@ -98,6 +119,17 @@ struct omapfb2_device {
 		struct omap_dss_device *dssdev;
 		u8 bpp;
 	} bpp_overrides[10];
+
+	struct workqueue_struct *flip_wq;
+
+	/* fill/copy channel, see omapfb-dma.c */
+	struct {
+		int lch;
+		spinlock_t lock;
+		bool busy;
+		wait_queue_head_t wq;
+		struct completion done;
+	} dma;
 };
 
 struct omapfb_colormode {
@@ -119,6 +151,16 @@ int omapfb_create_sysfs(struct omapfb2_device *fbdev);
 void omapfb_remove_sysfs(struct omapfb2_device *fbdev);
 
 int omapfb_ioctl(struct fb_info *fbi, unsigned int cmd, unsigned long arg);
+void omapfb_flip_work(struct work_struct *work);
+
+int omapfb_dma_init(struct omapfb2_device *fbdev);
+void omapfb_dma_exit(struct omapfb2_device *fbdev);
+int omapfb_dma_fill(struct fb_info *fbi, u32 x, u32 y, u32 w, u32 h,
+		u32 color, bool can_sleep);
+int omapfb_dma_copy(struct fb_info *fbi, u32 sx, u32 sy, u32 dx, u32 dy,
+		u32 w, u32 h, bool can_sleep);
+void omapfb_fillrect(struct fb_info *fbi, const struct fb_fillrect *rect);
+void omapfb_copyarea(struct fb_info *fbi, const struct fb_copyarea *area);
 
 int omapfb_update_window(struct fb_info *fbi,
 		u32 x, u32 y, u32 w, u32 h);
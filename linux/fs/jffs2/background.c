@@ -17,18 +17,165 @@
 #include <linux/sched.h>
 #include <linux/freezer.h>
 #include <linux/kthread.h>
+#include <linux/fb.h>
+#include <linux/tick.h>
+#include <linux/cpumask.h>
 #include "nodelist.h"
 
+/*
+ * The GC thread runs in one of two modes. Below the GC trigger level
+ * (jffs2_thread_should_wake()) it collects as it always has, since
+ * writers are about to stall. Between that and resv_blocks_gcidle it
+ * reclaims ahead of need, but only when the CPU stayed idle while it
+ * slept between passes and, optionally, while the display is off, so
+ * that it never competes with the UI.
+ */
+enum {
+	JFFS2_GC_NONE = 0,	/* nothing worth doing */
+	JFFS2_GC_DEFERRED,	/* idle work pending, but the display is on */
+	JFFS2_GC_IDLE,		/* reclaim ahead of need */
+	JFFS2_GC_URGENT,	/* below the trigger level */
+};
+
+/* Retry an idle pass put off because the CPU was busy this often */
+#define JFFS2_GC_IDLE_POLL	HZ
+
+/* How much of the time between two passes the CPU must have been idle */
+#define JFFS2_GC_IDLE_PERCENT	90
 
 static int jffs2_garbage_collect_thread(void *);
 
+/* Assume the display is on until the first blank event says otherwise */
+static int jffs2_gc_display_active = 1;
+static DECLARE_WAIT_QUEUE_HEAD(jffs2_gc_display_wait);
+
+static int jffs2_gc_idle_wanted(struct jffs2_sb_info *c)
+{
+	uint32_t dirty;
+
+	if (c->nr_free_blocks + c->nr_erasing_blocks >= c->resv_blocks_gcidle)
+		return 0;
+
+	/* Same dirty space calculation as jffs2_thread_should_wake(). Don't
+	   churn the flash when there is not enough dirt to reclaim. */
+	dirty = c->dirty_size + c->erasing_size - c->nr_erasing_blocks * c->sector_size;
+	return dirty > c->nospc_dirty_size;
+}
+
+/* Called with erase_completion_lock held */
+static int jffs2_gc_wanted(struct jffs2_sb_info *c)
+{
+	if (jffs2_thread_should_wake(c))
+		return JFFS2_GC_URGENT;
+
+	if (!jffs2_gc_idle_wanted(c))
+		return JFFS2_GC_NONE;
+
+	if (c->gc_pause_on_display && jffs2_gc_display_active)
+		return JFFS2_GC_DEFERRED;
+
+	return JFFS2_GC_IDLE;
+}
+
+/* Sum of idle and wall time over all CPUs; false without NO_HZ accounting */
+static int jffs2_gc_cpu_time(u64 *idle, u64 *wall)
+{
+	u64 t, now;
+	int cpu;
+
+	*idle = *wall = 0;
+	for_each_online_cpu(cpu) {
+		t = get_cpu_idle_time_us(cpu, &now);
+		if (t == -1ULL)
+			return 0;
+		*idle += t;
+		*wall += now;
+	}
+	return 1;
+}
+
+static void jffs2_gc_idle_start(struct jffs2_sb_info *c)
+{
+	jffs2_gc_cpu_time(&c->gc_idle_us, &c->gc_wall_us);
+}
+
+/* Was the CPU idle since jffs2_gc_idle_start()? */
+static int jffs2_gc_idle_check(struct jffs2_sb_info *c)
+{
+	u64 idle, wall;
+
+	/* Without the accounting all we have is the nice level */
+	if (!jffs2_gc_cpu_time(&idle, &wall))
+		return 1;
+
+	idle -= c->gc_idle_us;
+	wall -= c->gc_wall_us;
+
+	return wall && idle * 100 >= wall * JFFS2_GC_IDLE_PERCENT;
+}
+
 void jffs2_garbage_collect_trigger(struct jffs2_sb_info *c)
 {
 	assert_spin_locked(&c->erase_completion_lock);
-	if (c->gc_task && jffs2_thread_should_wake(c))
+	if (c->gc_task && (jffs2_thread_should_wake(c) || jffs2_gc_idle_wanted(c)))
 		send_sig(SIGHUP, c->gc_task, 1);
 }
 
+/* A writer had to run @passes GC passes itself and was held up for @us */
+void jffs2_gc_account_stall(struct jffs2_sb_info *c, uint32_t us, int passes)
+{
+	struct jffs2_gc_stats *st = &c->gc_stats;
+	uint32_t ms = us / 1000;
+	int bucket = ms ? min(fls(ms), JFFS2_GC_STALL_BUCKETS - 1) : 0;
+
+	spin_lock(&c->erase_completion_lock);
+	st->fg_stalls++;
+	st->fg_passes += passes;
+	st->stall_hist[bucket]++;
+	if (us > st->stall_max_us)
+		st->stall_max_us = us;
+	spin_unlock(&c->erase_completion_lock);
+}
+
+#ifdef CONFIG_FB
+static int jffs2_gc_fb_notify(struct notifier_block *nb,
+			      unsigned long event, void *data)
+{
+	struct fb_event *evdata = data;
+
+	if (event == FB_EVENT_BLANK && evdata && evdata->data) {
+		jffs2_gc_display_active =
+			(*(int *)evdata->data == FB_BLANK_UNBLANK);
+		if (!jffs2_gc_display_active)
+			wake_up_interruptible(&jffs2_gc_display_wait);
+	}
+
+	return 0;
+}
+
+static struct notifier_block jffs2_gc_fb_notifier = {
+	.notifier_call = jffs2_gc_fb_notify,
+};
+
+void __init jffs2_gc_init(void)
+{
+	fb_register_client(&jffs2_gc_fb_notifier);
+}
+
+void jffs2_gc_exit(void)
+{
+	fb_unregister_client(&jffs2_gc_fb_notifier);
+}
+#else
+void __init jffs2_gc_init(void)
+{
+}
+
+void jffs2_gc_exit(void)
+{
+}
+#endif
+
 /* This must only ever be called when no GC thread is currently running */
 int jffs2_start_garbage_collect_thread(struct jffs2_sb_info *c)
 {
@@ -84,14 +231,26 @@ static int jffs2_garbage_collect_thread(void *_c)
 
 	set_freezable();
 	for (;;) {
+		int gc;
+
 		allow_signal(SIGHUP);
 	again:
 		spin_lock(&c->erase_completion_lock);
-		if (!jffs2_thread_should_wake(c)) {
+		gc = jffs2_gc_wanted(c);
+		if (gc == JFFS2_GC_NONE) {
 			set_current_state (TASK_INTERRUPTIBLE);
 			spin_unlock(&c->erase_completion_lock);
 			D1(printk(KERN_DEBUG "jffs2_garbage_collect_thread sleeping...\n"));
 			schedule();
+		} else if (gc == JFFS2_GC_DEFERRED) {
+			/* Sleep until the display goes off; running low on
+			   space wakes us with SIGHUP from the trigger. */
+			c->gc_stats.deferred++;
+			spin_unlock(&c->erase_completion_lock);
+			D1(printk(KERN_DEBUG "jffs2_garbage_collect_thread waiting for display off...\n"));
+			wait_event_interruptible(jffs2_gc_display_wait,
+						 !jffs2_gc_display_active ||
+						 !c->gc_pause_on_display);
 		} else
 			spin_unlock(&c->erase_completion_lock);
 			
@@ -105,8 +264,14 @@ static int jffs2_garbage_collect_thread(void *_c)
 		 * disk).
 		 * This forces the GCD to slow the hell down.   Pulling an
 		 * inode in with read_inode() is much preferable to having
-		 * the GC thread get there first. */
-		schedule_timeout_interruptible(msecs_to_jiffies(50));
+		 * the GC thread get there first. Passes run ahead of need
+		 * only happen when nothing else wants the CPU, so those
+		 * can use a shorter pause. */
+		if (gc == JFFS2_GC_IDLE) {
+			jffs2_gc_idle_start(c);
+			schedule_timeout_interruptible(msecs_to_jiffies(c->gc_idle_delay_ms));
+		} else
+			schedule_timeout_interruptible(msecs_to_jiffies(50));
 
 		if (kthread_should_stop()) {
 			D1(printk(KERN_DEBUG "jffs2_garbage_collect_thread():  kthread_stop() called.\n"));
@@ -145,6 +310,24 @@ static int jffs2_garbage_collect_thread(void *_c)
 		/* We don't want SIGHUP to interrupt us. STOP and KILL are OK though. */
 		disallow_signal(SIGHUP);
 
+		/* Things may have changed while we slept */
+		spin_lock(&c->erase_completion_lock);
+		gc = jffs2_gc_wanted(c);
+		if (gc == JFFS2_GC_IDLE && !jffs2_gc_idle_check(c)) {
+			/* Somebody else wanted the CPU; come back later */
+			c->gc_stats.deferred++;
+			spin_unlock(&c->erase_completion_lock);
+			schedule_timeout_interruptible(JFFS2_GC_IDLE_POLL);
+			continue;
+		}
+		if (gc == JFFS2_GC_URGENT)
+			c->gc_stats.urgent_passes++;
+		else if (gc == JFFS2_GC_IDLE)
+			c->gc_stats.idle_passes++;
+		spin_unlock(&c->erase_completion_lock);
+		if (gc != JFFS2_GC_URGENT && gc != JFFS2_GC_IDLE)
+			continue;
+
 		D1(printk(KERN_DEBUG "jffs2_garbage_collect_thread(): pass\n"));
 		if (jffs2_garbage_collect_pass(c) == -ENOSPC) {
 			printk(KERN_NOTICE "No space for garbage collection. Aborting GC thread\n");
@@ -14,6 +14,7 @@
 #include <linux/sched.h>
 #include <linux/slab.h>
 #include <linux/vmalloc.h>
+#include <linux/ktime.h>
 #include <linux/mtd/mtd.h>
 #include "nodelist.h"
 
@@ -303,6 +304,13 @@ static void jffs2_calc_trigger_levels(struct jffs2_sb_info *c)
 	if (jffs2_can_mark_obsolete(c))
 		c->vdirty_blocks_gctrigger *= 10;
 
+	/* How many free blocks do we let the GC thread reclaim ahead of
+	   need, while nothing else wants the CPU? Keeping this headroom
+	   is what stops writers from having to GC synchronously. */
+	c->resv_blocks_gcidle = c->resv_blocks_gctrigger * 2;
+	c->gc_idle_delay_ms = 10;
+	c->gc_pause_on_display = 1;
+
 	/* If there's less than this amount of dirty space, don't bother
 	   trying to GC to make more space. It'll be a fruitless task */
 	c->nospc_dirty_size = c->sector_size + (c->flash_size / 100);
@@ -315,6 +323,8 @@ static void jffs2_calc_trigger_levels(struct jffs2_sb_info *c)
 		  c->resv_blocks_write, c->resv_blocks_write*c->sector_size/1024);
 	dbg_fsbuild("Blocks required to quiesce GC thread: %d (%d KiB)\n",
 		  c->resv_blocks_gctrigger, c->resv_blocks_gctrigger*c->sector_size/1024);
+	dbg_fsbuild("Blocks required to stop idle GC:      %d (%d KiB)\n",
+		  c->resv_blocks_gcidle, c->resv_blocks_gcidle*c->sector_size/1024);
 	dbg_fsbuild("Blocks required to allow GC merges:   %d (%d KiB)\n",
 		  c->resv_blocks_gcmerge, c->resv_blocks_gcmerge*c->sector_size/1024);
 	dbg_fsbuild("Blocks required to GC bad blocks:     %d (%d KiB)\n",
@@ -327,6 +337,8 @@ static void jffs2_calc_trigger_levels(struct jffs2_sb_info *c)
 
 int jffs2_do_mount_fs(struct jffs2_sb_info *c)
 {
+	struct jffs2_scan_stats *st = &c->scan_stats;
+	ktime_t start = ktime_get();
 	int ret;
 	int i;
 	int size;
@@ -379,6 +391,13 @@ int jffs2_do_mount_fs(struct jffs2_sb_info *c)
 
 	jffs2_calc_trigger_levels(c);
 
+	st->mount_us = ktime_us_delta(ktime_get(), start);
+	printk(KERN_INFO "JFFS2: mtd%d (%s) mounted in %u ms: %u blocks, "
+	       "%u from summary, %u rejected, %u+%u nodes\n",
+	       c->mtd->index, c->mtd->name, st->mount_us / 1000,
+	       st->blocks, st->sum_blocks, st->sum_rejected,
+	       st->nodes, st->sum_nodes);
+
 	return 0;
 
  out_free:
@@ -12,6 +12,9 @@
  *
  */
 
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/seq_file.h>
 #include "compr.h"
 
 static DEFINE_SPINLOCK(jffs2_compressor_list_lock);
@@ -29,10 +32,10 @@ static uint32_t none_stat_compr_blocks=0,none_stat_decompr_blocks=0,none_stat_co
 /*
  * Return 1 to use this compression
  */
-static int jffs2_is_best_compression(struct jffs2_compressor *this,
+static int jffs2_is_best_compression(int mode, struct jffs2_compressor *this,
 		struct jffs2_compressor *best, uint32_t size, uint32_t bestsize)
 {
-	switch (jffs2_compression_mode) {
+	switch (mode) {
 	case JFFS2_COMPR_MODE_SIZE:
 		if (bestsize > size)
 			return 1;
@@ -53,6 +56,68 @@ static int jffs2_is_best_compression(struct jffs2_compressor *this,
 	return 0;
 }
 
+static void jffs2_compr_account(struct jffs2_compressor *this, ktime_t start)
+{
+	this->stat_compr_ns += ktime_to_ns(ktime_sub(ktime_get(), start));
+}
+
+/*
+ * jffs2_selected_compress - compress with one given compressor only
+ *
+ * Used by the forced compression modes. Returns the compression type
+ * used, or JFFS2_COMPR_NONE if that compressor is not available or
+ * could not compress the data.
+ */
+static int jffs2_selected_compress(uint8_t compr, unsigned char *data_in,
+		unsigned char **cpage_out, uint32_t *datalen, uint32_t *cdatalen)
+{
+	struct jffs2_compressor *this;
+	int compr_ret, ret = JFFS2_COMPR_NONE;
+	uint32_t orig_slen, orig_dlen;
+	unsigned char *output_buf;
+	ktime_t start;
+
+	output_buf = kmalloc(*cdatalen, GFP_KERNEL);
+	if (!output_buf) {
+		printk(KERN_WARNING "JFFS2: No memory for compressor allocation. Compression failed.\n");
+		return ret;
+	}
+	orig_slen = *datalen;
+	orig_dlen = *cdatalen;
+	spin_lock(&jffs2_compressor_list_lock);
+	list_for_each_entry(this, &jffs2_compressor_list, list) {
+		/* Skip decompress-only backwards-compatibility and disabled modules */
+		if ((!this->compress)||(this->disabled))
+			continue;
+		if (this->compr != compr)
+			continue;
+
+		this->usecount++;
+		spin_unlock(&jffs2_compressor_list_lock);
+		*datalen  = orig_slen;
+		*cdatalen = orig_dlen;
+		start = ktime_get();
+		compr_ret = this->compress(data_in, output_buf, datalen, cdatalen);
+		spin_lock(&jffs2_compressor_list_lock);
+		this->usecount--;
+		jffs2_compr_account(this, start);
+		if (!compr_ret) {
+			ret = this->compr;
+			this->stat_compr_blocks++;
+			this->stat_compr_orig_size += *datalen;
+			this->stat_compr_new_size  += *cdatalen;
+		}
+		break;
+	}
+	spin_unlock(&jffs2_compressor_list_lock);
+	if (ret == JFFS2_COMPR_NONE)
+		kfree(output_buf);
+	else
+		*cpage_out = output_buf;
+
+	return ret;
+}
+
 /* jffs2_compress:
  * @data_in: Pointer to uncompressed data
  * @cpage_out: Pointer to returned pointer to buffer for compressed data
@@ -70,6 +135,9 @@ static int jffs2_is_best_compression(struct jffs2_compressor *this,
  * If the cdata buffer isn't large enough to hold all the uncompressed data,
  * jffs2_compress should compress as much as will fit, and should set
  * *datalen accordingly to show the amount of data which were compressed.
+ *
+ * The compression mode comes from the compr= mount option if one was
+ * given, else from the compile time default.
  */
 uint16_t jffs2_compress(struct jffs2_sb_info *c, struct jffs2_inode_info *f,
 			unsigned char *data_in, unsigned char **cpage_out,
@@ -81,8 +149,15 @@ uint16_t jffs2_compress(struct jffs2_sb_info *c, struct jffs2_inode_info *f,
 	unsigned char *output_buf = NULL, *tmp_buf;
 	uint32_t orig_slen, orig_dlen;
 	uint32_t best_slen=0, best_dlen=0;
+	ktime_t start;
+	int mode;
+
+	if (c->mount_opts.override_compr)
+		mode = c->mount_opts.compr;
+	else
+		mode = jffs2_compression_mode;
 
-	switch (jffs2_compression_mode) {
+	switch (mode) {
 	case JFFS2_COMPR_MODE_NONE:
 		break;
 	case JFFS2_COMPR_MODE_PRIORITY:
@@ -103,9 +178,11 @@ uint16_t jffs2_compress(struct jffs2_sb_info *c, struct jffs2_inode_info *f,
 			spin_unlock(&jffs2_compressor_list_lock);
 			*datalen  = orig_slen;
 			*cdatalen = orig_dlen;
+			start = ktime_get();
 			compr_ret = this->compress(data_in, output_buf, datalen, cdatalen);
 			spin_lock(&jffs2_compressor_list_lock);
 			this->usecount--;
+			jffs2_compr_account(this, start);
 			if (!compr_ret) {
 				ret = this->compr;
 				this->stat_compr_blocks++;
@@ -152,11 +229,13 @@ uint16_t jffs2_compress(struct jffs2_sb_info *c, struct jffs2_inode_info *f,
 			spin_unlock(&jffs2_compressor_list_lock);
 			*datalen  = orig_slen;
 			*cdatalen = orig_dlen;
+			start = ktime_get();
 			compr_ret = this->compress(data_in, this->compr_buf, datalen, cdatalen);
 			spin_lock(&jffs2_compressor_list_lock);
 			this->usecount--;
+			jffs2_compr_account(this, start);
 			if (!compr_ret) {
-				if (((!best_dlen) || jffs2_is_best_compression(this, best, *cdatalen, best_dlen))
+				if (((!best_dlen) || jffs2_is_best_compression(mode, this, best, *cdatalen, best_dlen))
 						&& (*cdatalen < *datalen)) {
 					best_dlen = *cdatalen;
 					best_slen = *datalen;
@@ -177,6 +256,14 @@ uint16_t jffs2_compress(struct jffs2_sb_info *c, struct jffs2_inode_info *f,
 		}
 		spin_unlock(&jffs2_compressor_list_lock);
 		break;
+	case JFFS2_COMPR_MODE_FORCELZO:
+		ret = jffs2_selected_compress(JFFS2_COMPR_LZO, data_in,
+					      &output_buf, datalen, cdatalen);
+		break;
+	case JFFS2_COMPR_MODE_FORCEZLIB:
+		ret = jffs2_selected_compress(JFFS2_COMPR_ZLIB, data_in,
+					      &output_buf, datalen, cdatalen);
+		break;
 	default:
 		printk(KERN_ERR "JFFS2: unknown compression mode.\n");
 	}
@@ -198,6 +285,7 @@ int jffs2_decompress(struct jffs2_sb_info *c, struct jffs2_inode_info *f,
 		     unsigned char *data_out, uint32_t cdatalen, uint32_t datalen)
 {
 	struct jffs2_compressor *this;
+	ktime_t start;
 	int ret;
 
 	/* Older code had a bug where it would write non-zero 'usercompr'
@@ -220,13 +308,16 @@ int jffs2_decompress(struct jffs2_sb_info *c, struct jffs2_inode_info *f,
 			if (comprtype == this->compr) {
 				this->usecount++;
 				spin_unlock(&jffs2_compressor_list_lock);
+				start = ktime_get();
 				ret = this->decompress(cdata_in, data_out, cdatalen, datalen);
 				spin_lock(&jffs2_compressor_list_lock);
+				this->stat_decompr_ns += ktime_to_ns(ktime_sub(ktime_get(), start));
 				if (ret) {
 					printk(KERN_WARNING "Decompressor \"%s\" returned %d\n", this->name, ret);
 				}
 				else {
 					this->stat_decompr_blocks++;
+					this->stat_decompr_size += datalen;
 				}
 				this->usecount--;
 				spin_unlock(&jffs2_compressor_list_lock);
@@ -255,6 +346,9 @@ int jffs2_register_compressor(struct jffs2_compressor *comp)
 	comp->stat_compr_new_size=0;
 	comp->stat_compr_blocks=0;
 	comp->stat_decompr_blocks=0;
+	comp->stat_compr_ns=0;
+	comp->stat_decompr_ns=0;
+	comp->stat_decompr_size=0;
 	D1(printk(KERN_DEBUG "Registering JFFS2 compressor \"%s\"\n", comp->name));
 
 	spin_lock(&jffs2_compressor_list_lock);
@@ -304,6 +398,57 @@ void jffs2_free_comprbuf(unsigned char *comprbuf, unsigned char *orig)
 		kfree(comprbuf);
 }
 
+const char *jffs2_compr_mode_name(unsigned int mode)
+{
+	switch (mode) {
+	case JFFS2_COMPR_MODE_NONE:
+		return "none";
+	case JFFS2_COMPR_MODE_PRIORITY:
+		return "priority";
+	case JFFS2_COMPR_MODE_SIZE:
+		return "size";
+	case JFFS2_COMPR_MODE_FAVOURLZO:
+		return "favourlzo";
+	case JFFS2_COMPR_MODE_FORCELZO:
+		return "lzo";
+	case JFFS2_COMPR_MODE_FORCEZLIB:
+		return "zlib";
+	}
+	return "unknown";
+}
+
+/* Per-compressor statistics, shown in <debugfs>/jffs2/compressors */
+void jffs2_compr_stats_show(struct seq_file *m)
+{
+	struct jffs2_compressor *this;
+
+	seq_printf(m, "default mode: %s\n",
+		   jffs2_compr_mode_name(jffs2_compression_mode));
+	seq_printf(m, "%-10s %10s %10s %10s %10s %10s %10s %10s\n",
+		   "name", "cblocks", "in", "out", "c_us",
+		   "dblocks", "dout", "d_us");
+	seq_printf(m, "%-10s %10u %10u %10u %10s %10u %10s %10s\n",
+		   "none", none_stat_compr_blocks, none_stat_compr_size,
+		   none_stat_compr_size, "-", none_stat_decompr_blocks,
+		   "-", "-");
+
+	spin_lock(&jffs2_compressor_list_lock);
+	list_for_each_entry(this, &jffs2_compressor_list, list) {
+		seq_printf(m, "%-10s %10u %10u %10u %10llu %10u %10u %10llu%s\n",
+			   this->name, this->stat_compr_blocks,
+			   this->stat_compr_orig_size,
+			   this->stat_compr_new_size,
+			   (unsigned long long)div_u64(this->stat_compr_ns,
+						       NSEC_PER_USEC),
+			   this->stat_decompr_blocks,
+			   this->stat_decompr_size,
+			   (unsigned long long)div_u64(this->stat_decompr_ns,
+						       NSEC_PER_USEC),
+			   this->disabled ? " (disabled)" : "");
+	}
+	spin_unlock(&jffs2_compressor_list_lock);
+}
+
 int __init jffs2_compressors_init(void)
 {
 /* Registering compressors */
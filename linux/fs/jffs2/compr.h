@@ -40,6 +40,8 @@
 #define JFFS2_COMPR_MODE_PRIORITY   1
 #define JFFS2_COMPR_MODE_SIZE       2
 #define JFFS2_COMPR_MODE_FAVOURLZO  3
+#define JFFS2_COMPR_MODE_FORCELZO   4
+#define JFFS2_COMPR_MODE_FORCEZLIB  5
 
 #define FAVOUR_LZO_PERCENT 80
 
@@ -60,6 +62,9 @@ struct jffs2_compressor {
 	uint32_t stat_compr_new_size;
 	uint32_t stat_compr_blocks;
 	uint32_t stat_decompr_blocks;
+	uint64_t stat_compr_ns;		/* time spent in compress() */
+	uint64_t stat_decompr_ns;	/* time spent in decompress() */
+	uint32_t stat_decompr_size;	/* bytes produced by decompress() */
 };
 
 int jffs2_register_compressor(struct jffs2_compressor *comp);
@@ -78,6 +83,11 @@ int jffs2_decompress(struct jffs2_sb_info *c, struct jffs2_inode_info *f,
 
 void jffs2_free_comprbuf(unsigned char *comprbuf, unsigned char *orig);
 
+const char *jffs2_compr_mode_name(unsigned int mode);
+
+struct seq_file;
+void jffs2_compr_stats_show(struct seq_file *m);
+
 /* Compressor modules */
 /* These functions will be called by jffs2_compressors_init/exit */
 
@@ -44,18 +44,32 @@ static int __init alloc_workspace(void)
 static int jffs2_lzo_compress(unsigned char *data_in, unsigned char *cpage_out,
 			      uint32_t *sourcelen, uint32_t *dstlen)
 {
+	unsigned char *out = lzo_compress_buf;
 	size_t compress_size;
 	int ret;
 
+	if (*sourcelen > PAGE_SIZE)
+		return -1;
+
+	/*
+	 * lzo1x can overrun its output on incompressible data, so it only
+	 * gets the caller's buffer when that can hold the worst case.
+	 * Otherwise go through the bounce buffer and copy what fits.
+	 */
+	if (*dstlen >= lzo1x_worst_compress(*sourcelen))
+		out = cpage_out;
+
 	mutex_lock(&deflate_mutex);
-	ret = lzo1x_1_compress(data_in, *sourcelen, lzo_compress_buf, &compress_size, lzo_mem);
+	ret = lzo1x_1_compress(data_in, *sourcelen, out, &compress_size, lzo_mem);
 	if (ret != LZO_E_OK)
 		goto fail;
 
-	if (compress_size > *dstlen)
+	/* Not worth storing compressed */
+	if (compress_size >= *sourcelen || compress_size > *dstlen)
 		goto fail;
 
-	memcpy(cpage_out, lzo_compress_buf, compress_size);
+	if (out != cpage_out)
+		memcpy(cpage_out, lzo_compress_buf, compress_size);
 	mutex_unlock(&deflate_mutex);
 
 	*dstlen = compress_size;
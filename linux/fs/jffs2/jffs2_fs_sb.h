@@ -29,6 +29,39 @@
 
 struct jffs2_inodirty;
 
+/* What the last mount-time scan had to do; see stats.c */
+struct jffs2_scan_stats {
+	uint32_t blocks;	/* eraseblocks scanned */
+	uint32_t empty_blocks;	/* ... found erased */
+	uint32_t bad_blocks;	/* ... marked bad */
+	uint32_t sum_blocks;	/* ... classified from their summary node */
+	uint32_t sum_rejected;	/* ... whose summary node could not be used */
+	uint32_t nodes;		/* nodes found by the full scan */
+	uint32_t sum_nodes;	/* nodes taken from summary nodes */
+	uint32_t scan_us;	/* time spent in jffs2_scan_medium() */
+	uint32_t mount_us;	/* time spent in jffs2_do_mount_fs() */
+};
+
+/* Writer stalls in synchronous GC, bucketed by log2 of the stall in ms */
+#define JFFS2_GC_STALL_BUCKETS 12
+
+/* What the GC thread and GC-ing writers did; see background.c */
+struct jffs2_gc_stats {
+	uint32_t urgent_passes;	/* thread passes below the GC trigger level */
+	uint32_t idle_passes;	/* thread passes run ahead of need while idle */
+	uint32_t deferred;	/* idle passes put off (CPU busy, display on) */
+	uint32_t fg_passes;	/* passes run by writers in jffs2_reserve_space() */
+	uint32_t fg_stalls;	/* reservations which had to GC first */
+	uint32_t stall_max_us;
+	uint32_t stall_hist[JFFS2_GC_STALL_BUCKETS];
+};
+
+/* Options given at mount time */
+struct jffs2_mount_opts {
+	bool override_compr;	/* use compr instead of the default mode */
+	unsigned int compr;	/* JFFS2_COMPR_MODE_xxx */
+};
+
 /* A struct for the overall file system control.  Pointers to
    jffs2_sb_info structs are named `c' in the source code.
    Nee jffs_control
@@ -36,6 +69,8 @@ struct jffs2_inodirty;
 struct jffs2_sb_info {
 	struct mtd_info *mtd;
 
+	struct jffs2_mount_opts mount_opts;
+
 	uint32_t highest_ino;
 	uint32_t checked_ino;
 
@@ -72,6 +107,13 @@ struct jffs2_sb_info {
 	uint8_t resv_blocks_gcmerge;	/* ... merge pages when garbage collecting */
 	/* Number of 'very dirty' blocks before we trigger immediate GC */
 	uint8_t vdirty_blocks_gctrigger;
+	/* Number of free blocks the GC thread works towards while the system is idle */
+	uint8_t resv_blocks_gcidle;
+
+	uint32_t gc_idle_delay_ms;	/* pause between passes run ahead of need */
+	uint32_t gc_pause_on_display;	/* no passes ahead of need while the display is on */
+	u64 gc_idle_us, gc_wall_us;	/* CPU time sample taken before such a pass */
+	struct jffs2_gc_stats gc_stats;
 
 	uint32_t nospc_dirty_size;
 
@@ -126,6 +168,8 @@ struct jffs2_sb_info {
 #endif
 
 	struct jffs2_summary *summary;		/* Summary information */
+	struct jffs2_scan_stats scan_stats;	/* Mount-time scan statistics */
+	struct dentry *debugfs_dir;		/* Per-mount statistics in debugfs */
 
 #ifdef CONFIG_JFFS2_FS_XATTR
 #define XATTRINDEX_HASHSIZE	(57)
@@ -13,6 +13,7 @@
 #include <linux/mtd/mtd.h>
 #include <linux/compiler.h>
 #include <linux/sched.h> /* For cond_resched() */
+#include <linux/ktime.h>
 #include "nodelist.h"
 #include "debug.h"
 
@@ -38,8 +39,9 @@
 static int jffs2_do_reserve_space(struct jffs2_sb_info *c,  uint32_t minsize,
 				  uint32_t *len, uint32_t sumsize);
 
-int jffs2_reserve_space(struct jffs2_sb_info *c, uint32_t minsize,
-			uint32_t *len, int prio, uint32_t sumsize)
+static int __jffs2_reserve_space(struct jffs2_sb_info *c, uint32_t minsize,
+				 uint32_t *len, int prio, uint32_t sumsize,
+				 int *passes)
 {
 	int ret = -EAGAIN;
 	int blocksneeded = c->resv_blocks_write;
@@ -114,6 +116,7 @@ int jffs2_reserve_space(struct jffs2_sb_info *c, uint32_t minsize,
 				  c->free_size + c->dirty_size + c->wasted_size + c->used_size + c->erasing_size + c->bad_size, c->flash_size));
 			spin_unlock(&c->erase_completion_lock);
 
+			(*passes)++;
 			ret = jffs2_garbage_collect_pass(c);
 
 			if (ret == -EAGAIN) {
@@ -155,6 +158,22 @@ int jffs2_reserve_space(struct jffs2_sb_info *c, uint32_t minsize,
 	return ret;
 }
 
+int jffs2_reserve_space(struct jffs2_sb_info *c, uint32_t minsize,
+			uint32_t *len, int prio, uint32_t sumsize)
+{
+	ktime_t start = ktime_get();
+	int passes = 0;
+	int ret;
+
+	ret = __jffs2_reserve_space(c, minsize, len, prio, sumsize, &passes);
+
+	/* Record how long the caller was held up doing the GC thread's job */
+	if (passes)
+		jffs2_gc_account_stall(c, ktime_us_delta(ktime_get(), start), passes);
+
+	return ret;
+}
+
 int jffs2_reserve_space_gc(struct jffs2_sb_info *c, uint32_t minsize,
 			   uint32_t *len, uint32_t sumsize)
 {
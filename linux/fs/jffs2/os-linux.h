@@ -149,6 +149,9 @@ static inline void jffs2_dirty_trigger(struct jffs2_sb_info *c)
 int jffs2_start_garbage_collect_thread(struct jffs2_sb_info *c);
 void jffs2_stop_garbage_collect_thread(struct jffs2_sb_info *c);
 void jffs2_garbage_collect_trigger(struct jffs2_sb_info *c);
+void jffs2_gc_account_stall(struct jffs2_sb_info *c, uint32_t us, int passes);
+void jffs2_gc_init(void);
+void jffs2_gc_exit(void);
 
 /* dir.c */
 extern const struct file_operations jffs2_dir_operations;
@@ -176,7 +179,7 @@ void jffs2_dirty_inode(struct inode *inode);
 struct inode *jffs2_new_inode (struct inode *dir_i, int mode,
 			       struct jffs2_raw_inode *ri);
 int jffs2_statfs (struct dentry *, struct kstatfs *);
-int jffs2_remount_fs (struct super_block *, int *, char *);
+int jffs2_do_remount_fs(struct super_block *, int *, char *);
 int jffs2_do_fill_super(struct super_block *sb, void *data, int silent);
 void jffs2_gc_release_inode(struct jffs2_sb_info *c,
 			    struct jffs2_inode_info *f);
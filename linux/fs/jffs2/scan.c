@@ -16,6 +16,7 @@
 #include <linux/pagemap.h>
 #include <linux/crc32.h>
 #include <linux/compiler.h>
+#include <linux/ktime.h>
 #include "nodelist.h"
 #include "summary.h"
 #include "debug.h"
@@ -93,6 +94,7 @@ int jffs2_scan_medium(struct jffs2_sb_info *c)
 	unsigned char *flashbuf = NULL;
 	uint32_t buf_size = 0;
 	struct jffs2_summary *s = NULL; /* summary info collected by the scan process */
+	ktime_t start = ktime_get();
 #ifndef __ECOS
 	size_t pointlen, try_size;
 
@@ -153,6 +155,8 @@ int jffs2_scan_medium(struct jffs2_sb_info *c)
 		if (ret < 0)
 			goto out;
 
+		c->scan_stats.blocks++;
+
 		jffs2_dbg_acct_paranoia_check_nolock(c, jeb);
 
 		/* Now decide which list to put it on */
@@ -166,6 +170,7 @@ int jffs2_scan_medium(struct jffs2_sb_info *c)
 			 * for later checks.
 			 */
 			empty_blocks++;
+			c->scan_stats.empty_blocks++;
 			list_add(&jeb->list, &c->erase_pending_list);
 			c->nr_erasing_blocks++;
 			break;
@@ -228,6 +233,7 @@ int jffs2_scan_medium(struct jffs2_sb_info *c)
 			c->bad_size += c->sector_size;
 			c->free_size -= c->sector_size;
 			bad_blocks++;
+			c->scan_stats.bad_blocks++;
 			break;
 		default:
 			printk(KERN_WARNING "jffs2_scan_medium(): unknown block state\n");
@@ -278,9 +284,25 @@ int jffs2_scan_medium(struct jffs2_sb_info *c)
 	if (s)
 		kfree(s);
 
+	c->scan_stats.scan_us = ktime_us_delta(ktime_get(), start);
+
 	return ret;
 }
 
+/* The summary marker comes straight off the flash; don't trust its offset */
+static int jffs2_sum_marker_valid(struct jffs2_sb_info *c, struct jffs2_sum_marker *sm)
+{
+	uint32_t sum_ofs = je32_to_cpu(sm->offset);
+
+	if ((sum_ofs & 3) || sum_ofs > c->sector_size - JFFS2_SUMMARY_FRAME_SIZE ||
+	    c->sector_size - sum_ofs > MAX_SUMMARY_SIZE + sizeof(struct jffs2_raw_summary)) {
+		JFFS2_WARNING("Bogus summary marker offset 0x%08x in eraseblock, ignoring summary\n",
+			      sum_ofs);
+		return 0;
+	}
+	return 1;
+}
+
 static int jffs2_fill_scan_buf(struct jffs2_sb_info *c, void *buf,
 			       uint32_t ofs, uint32_t len)
 {
@@ -482,7 +504,8 @@ static int jffs2_scan_eraseblock (struct jffs2_sb_info *c, struct jffs2_eraseblo
 		if (!buf_size) {
 			/* XIP case. Just look, point at the summary if it's there */
 			sm = (void *)buf + c->sector_size - sizeof(*sm);
-			if (je32_to_cpu(sm->magic) == JFFS2_SUM_MAGIC) {
+			if (je32_to_cpu(sm->magic) == JFFS2_SUM_MAGIC &&
+			    jffs2_sum_marker_valid(c, sm)) {
 				sumptr = buf + je32_to_cpu(sm->offset);
 				sumlen = c->sector_size - je32_to_cpu(sm->offset);
 			}
@@ -501,7 +524,8 @@ static int jffs2_scan_eraseblock (struct jffs2_sb_info *c, struct jffs2_eraseblo
 				return err;
 
 			sm = (void *)buf + buf_size - sizeof(*sm);
-			if (je32_to_cpu(sm->magic) == JFFS2_SUM_MAGIC) {
+			if (je32_to_cpu(sm->magic) == JFFS2_SUM_MAGIC &&
+			    jffs2_sum_marker_valid(c, sm)) {
 				sumlen = c->sector_size - je32_to_cpu(sm->offset);
 				sumptr = buf + buf_size - sumlen;
 
@@ -518,9 +542,14 @@ static int jffs2_scan_eraseblock (struct jffs2_sb_info *c, struct jffs2_eraseblo
 					err = jffs2_fill_scan_buf(c, sumptr, 
 								  jeb->offset + c->sector_size - sumlen,
 								  sumlen - buf_len);				
-					if (err)
+					if (err) {
+						if (sumlen > buf_size)
+							kfree(sumptr);
 						return err;
+					}
 				}
+			} else if (je32_to_cpu(sm->magic) == JFFS2_SUM_MAGIC) {
+				c->scan_stats.sum_rejected++;
 			}
 
 		}
@@ -534,6 +563,10 @@ static int jffs2_scan_eraseblock (struct jffs2_sb_info *c, struct jffs2_eraseblo
 			   If it returns positive, that's a block classification
 			   (i.e. BLK_STATE_xxx) so return that too.
 			   If it returns zero, fall through to full scan. */
+			if (err > 0)
+				c->scan_stats.sum_blocks++;
+			else if (!err)
+				c->scan_stats.sum_rejected++;
 			if (err)
 				return err;
 		}
@@ -747,6 +780,8 @@ scan_more:
 			continue;
 		}
 
+		c->scan_stats.nodes++;
+
 		if (ofs + je32_to_cpu(node->totlen) > jeb->offset + c->sector_size) {
 			/* Eep. Node goes over the end of the erase block. */
 			printk(KERN_WARNING "Node at 0x%08x with length 0x%08x would run over the end of the erase block\n",
@@ -0,0 +1,175 @@
+/*
+ * JFFS2 -- Journalling Flash File System, Version 2.
+ *
+ * Copyright © 2001-2007 Red Hat, Inc.
+ *
+ * Created by David Woodhouse <dwmw2@infradead.org>
+ *
+ * For licensing information, see the file 'LICENCE' in this directory.
+ *
+ * Per-mount statistics, exported under <debugfs>/jffs2/mtdN/.
+ */
+
+#include <linux/kernel.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/mtd/mtd.h>
+#include "nodelist.h"
+#include "compr.h"
+
+static struct dentry *jffs2_debugfs_root;
+
+static int jffs2_stats_scan_show(struct seq_file *m, void *unused)
+{
+	struct jffs2_sb_info *c = m->private;
+	struct jffs2_scan_stats *st = &c->scan_stats;
+	uint32_t used = st->blocks - st->empty_blocks - st->bad_blocks;
+
+	seq_printf(m, "mtd:          %d (%s)\n", c->mtd->index, c->mtd->name);
+	seq_printf(m, "summary:      %s\n",
+		   jffs2_sum_active() ? "enabled" : "disabled");
+	seq_printf(m, "mount_us:     %u\n", st->mount_us);
+	seq_printf(m, "scan_us:      %u\n", st->scan_us);
+	seq_printf(m, "blocks:       %u\n", st->blocks);
+	seq_printf(m, "empty_blocks: %u\n", st->empty_blocks);
+	seq_printf(m, "bad_blocks:   %u\n", st->bad_blocks);
+	seq_printf(m, "sum_blocks:   %u\n", st->sum_blocks);
+	seq_printf(m, "sum_rejected: %u\n", st->sum_rejected);
+	seq_printf(m, "sum_hit_pct:  %u\n",
+		   used ? st->sum_blocks * 100 / used : 0);
+	seq_printf(m, "nodes:        %u\n", st->nodes);
+	seq_printf(m, "sum_nodes:    %u\n", st->sum_nodes);
+
+	return 0;
+}
+
+static int jffs2_stats_scan_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, jffs2_stats_scan_show, inode->i_private);
+}
+
+static const struct file_operations jffs2_stats_scan_fops = {
+	.owner		= THIS_MODULE,
+	.open		= jffs2_stats_scan_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int jffs2_stats_gc_show(struct seq_file *m, void *unused)
+{
+	struct jffs2_sb_info *c = m->private;
+	struct jffs2_gc_stats st;
+	uint32_t nr_free;
+	int i;
+
+	spin_lock(&c->erase_completion_lock);
+	st = c->gc_stats;
+	nr_free = c->nr_free_blocks + c->nr_erasing_blocks;
+	spin_unlock(&c->erase_completion_lock);
+
+	seq_printf(m, "free_blocks:   %u\n", nr_free);
+	seq_printf(m, "wmark_low:     %u\n", c->resv_blocks_gctrigger);
+	seq_printf(m, "wmark_idle:    %u\n", c->resv_blocks_gcidle);
+	seq_printf(m, "urgent_passes: %u\n", st.urgent_passes);
+	seq_printf(m, "idle_passes:   %u\n", st.idle_passes);
+	seq_printf(m, "deferred:      %u\n", st.deferred);
+	seq_printf(m, "fg_passes:     %u\n", st.fg_passes);
+	seq_printf(m, "fg_stalls:     %u\n", st.fg_stalls);
+	seq_printf(m, "stall_max_us:  %u\n", st.stall_max_us);
+
+	seq_printf(m, "stall_ms:\n");
+	seq_printf(m, "  <1\t%u\n", st.stall_hist[0]);
+	for (i = 1; i < JFFS2_GC_STALL_BUCKETS - 1; i++)
+		seq_printf(m, "  %u-%u\t%u\n", 1 << (i - 1), (1 << i) - 1,
+			   st.stall_hist[i]);
+	seq_printf(m, "  >=%u\t%u\n", 1 << (i - 1), st.stall_hist[i]);
+
+	return 0;
+}
+
+static int jffs2_stats_gc_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, jffs2_stats_gc_show, inode->i_private);
+}
+
+static const struct file_operations jffs2_stats_gc_fops = {
+	.owner		= THIS_MODULE,
+	.open		= jffs2_stats_gc_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int jffs2_stats_compr_show(struct seq_file *m, void *unused)
+{
+	jffs2_compr_stats_show(m);
+	return 0;
+}
+
+static int jffs2_stats_compr_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, jffs2_stats_compr_show, NULL);
+}
+
+static const struct file_operations jffs2_stats_compr_fops = {
+	.owner		= THIS_MODULE,
+	.open		= jffs2_stats_compr_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+void jffs2_stats_add_sb(struct jffs2_sb_info *c)
+{
+	char name[16];
+
+	if (!jffs2_debugfs_root)
+		return;
+
+	snprintf(name, sizeof(name), "mtd%d", c->mtd->index);
+	c->debugfs_dir = debugfs_create_dir(name, jffs2_debugfs_root);
+	if (IS_ERR_OR_NULL(c->debugfs_dir)) {
+		c->debugfs_dir = NULL;
+		return;
+	}
+
+	debugfs_create_file("scan", S_IRUGO, c->debugfs_dir, c,
+			    &jffs2_stats_scan_fops);
+	debugfs_create_file("gc", S_IRUGO, c->debugfs_dir, c,
+			    &jffs2_stats_gc_fops);
+
+	/* GC thread tunables; see background.c */
+	debugfs_create_u8("gc_wmark_low", S_IRUGO | S_IWUSR, c->debugfs_dir,
+			  &c->resv_blocks_gctrigger);
+	debugfs_create_u8("gc_wmark_idle", S_IRUGO | S_IWUSR, c->debugfs_dir,
+			  &c->resv_blocks_gcidle);
+	debugfs_create_u32("gc_idle_delay_ms", S_IRUGO | S_IWUSR,
+			   c->debugfs_dir, &c->gc_idle_delay_ms);
+	debugfs_create_u32("gc_pause_on_display", S_IRUGO | S_IWUSR,
+			   c->debugfs_dir, &c->gc_pause_on_display);
+}
+
+void jffs2_stats_del_sb(struct jffs2_sb_info *c)
+{
+	debugfs_remove_recursive(c->debugfs_dir);
+	c->debugfs_dir = NULL;
+}
+
+void jffs2_stats_init(void)
+{
+	jffs2_debugfs_root = debugfs_create_dir("jffs2", NULL);
+	if (IS_ERR_OR_NULL(jffs2_debugfs_root)) {
+		jffs2_debugfs_root = NULL;
+		return;
+	}
+
+	debugfs_create_file("compressors", S_IRUGO, jffs2_debugfs_root, NULL,
+			    &jffs2_stats_compr_fops);
+}
+
+void jffs2_stats_exit(void)
+{
+	debugfs_remove_recursive(jffs2_debugfs_root);
+	jffs2_debugfs_root = NULL;
+}
@@ -0,0 +1,33 @@
+/*
+ * JFFS2 -- Journalling Flash File System, Version 2.
+ *
+ * Copyright © 2001-2007 Red Hat, Inc.
+ *
+ * Created by David Woodhouse <dwmw2@infradead.org>
+ *
+ * For licensing information, see the file 'LICENCE' in this directory.
+ *
+ */
+
+#ifndef _JFFS2_STATS_H_
+#define _JFFS2_STATS_H_
+
+struct jffs2_sb_info;
+
+#ifdef CONFIG_DEBUG_FS
+
+void jffs2_stats_init(void);
+void jffs2_stats_exit(void);
+void jffs2_stats_add_sb(struct jffs2_sb_info *c);
+void jffs2_stats_del_sb(struct jffs2_sb_info *c);
+
+#else
+
+#define jffs2_stats_init()
+#define jffs2_stats_exit()
+#define jffs2_stats_add_sb(c)
+#define jffs2_stats_del_sb(c)
+
+#endif /* CONFIG_DEBUG_FS */
+
+#endif /* _JFFS2_STATS_H_ */
@@ -563,6 +563,77 @@ static int jffs2_sum_process_sum_data(struct jffs2_sb_info *c, struct jffs2_eras
 	return 0;
 }
 
+/* Make sure every summary entry lies inside the summary node and describes
+   a node inside the eraseblock, before we start linking any of them in. A
+   summary that fails this is ignored and the eraseblock is scanned in full. */
+
+static int jffs2_sum_check_entries(struct jffs2_sb_info *c,
+				   struct jffs2_raw_summary *summary, uint32_t sumsize)
+{
+	void *sp = summary->sum;
+	void *end = (void *)summary + sumsize - sizeof(struct jffs2_sum_marker);
+	uint32_t ofs, len;
+	int i;
+
+	for (i=0; i<je32_to_cpu(summary->sum_num); i++) {
+		if (sp + sizeof(struct jffs2_sum_unknown_flash) > end)
+			return -EINVAL;
+
+		switch (je16_to_cpu(((struct jffs2_sum_unknown_flash *)sp)->nodetype)) {
+			case JFFS2_NODETYPE_INODE: {
+				struct jffs2_sum_inode_flash *spi = sp;
+
+				if (sp + JFFS2_SUMMARY_INODE_SIZE > end)
+					return -EINVAL;
+				ofs = je32_to_cpu(spi->offset);
+				len = je32_to_cpu(spi->totlen);
+				sp += JFFS2_SUMMARY_INODE_SIZE;
+				break;
+			}
+			case JFFS2_NODETYPE_DIRENT: {
+				struct jffs2_sum_dirent_flash *spd = sp;
+
+				if (sp + JFFS2_SUMMARY_DIRENT_SIZE(0) > end ||
+				    sp + JFFS2_SUMMARY_DIRENT_SIZE(spd->nsize) > end)
+					return -EINVAL;
+				ofs = je32_to_cpu(spd->offset);
+				len = je32_to_cpu(spd->totlen);
+				sp += JFFS2_SUMMARY_DIRENT_SIZE(spd->nsize);
+				break;
+			}
+#ifdef CONFIG_JFFS2_FS_XATTR
+			case JFFS2_NODETYPE_XATTR: {
+				struct jffs2_sum_xattr_flash *spx = sp;
+
+				if (sp + JFFS2_SUMMARY_XATTR_SIZE > end)
+					return -EINVAL;
+				ofs = je32_to_cpu(spx->offset);
+				len = je32_to_cpu(spx->totlen);
+				sp += JFFS2_SUMMARY_XATTR_SIZE;
+				break;
+			}
+			case JFFS2_NODETYPE_XREF: {
+				struct jffs2_sum_xref_flash *spr = sp;
+
+				if (sp + JFFS2_SUMMARY_XREF_SIZE > end)
+					return -EINVAL;
+				ofs = je32_to_cpu(spr->offset);
+				len = PAD(sizeof(struct jffs2_raw_xref));
+				sp += JFFS2_SUMMARY_XREF_SIZE;
+				break;
+			}
+#endif
+			default:
+				/* jffs2_sum_process_sum_data() deals with these */
+				return 0;
+		}
+
+		if (ofs >= c->sector_size || len > c->sector_size - ofs)
+			return -EINVAL;
+	}
+	return 0;
+}
+
 /* Process the summary node - called from jffs2_scan_eraseblock() */
 int jffs2_sum_scan_sumnode(struct jffs2_sb_info *c, struct jffs2_eraseblock *jeb,
 			   struct jffs2_raw_summary *summary, uint32_t sumsize,
@@ -608,6 +679,12 @@ int jffs2_sum_scan_sumnode(struct jffs2_sb_info *c, struct jffs2_eraseblock *jeb
 		goto crc_err;
 	}
 
+	if (jffs2_sum_check_entries(c, summary, sumsize)) {
+		JFFS2_WARNING("Summary node at 0x%08x has bogus entries, skipping summary information.\n",
+			      jeb->offset + ofs);
+		return 0;
+	}
+
 	if ( je32_to_cpu(summary->cln_mkr) ) {
 
 		dbg_summary("Summary : CLEANMARKER node \n");
@@ -640,6 +717,8 @@ int jffs2_sum_scan_sumnode(struct jffs2_sb_info *c, struct jffs2_eraseblock *jeb
 	if (ret)
 		return ret;		/* real error */
 
+	c->scan_stats.sum_nodes += je32_to_cpu(summary->sum_num);
+
 	/* for PARANOIA_CHECK */
 	ret = jffs2_prealloc_raw_node_refs(c, jeb, 2);
 	if (ret)
@@ -33,6 +33,16 @@ struct adbs_a330_platform_data {
 	unsigned int shutdown_gpio;
 	int direction;
 	int mode;
+
+	/*
+	 * Optional acceleration curve. Below accel_threshold counts/s the
+	 * gain is 1; above it the gain grows by accel_slope percent per
+	 * 1000 counts/s, capped at accel_max percent. A zero slope disables
+	 * acceleration.
+	 */
+	unsigned int accel_threshold;
+	unsigned int accel_slope;
+	unsigned int accel_max;
 };
 
 #endif /* __ADBS_A330_INLUDED_H__ */
@@ -0,0 +1,38 @@
+/*
+ * Boot timeline: start and end times of initcalls, driver probes and
+ * board bring-up steps, readable from debugfs once the system is up.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#ifndef _LINUX_BOOT_TIMELINE_H
+#define _LINUX_BOOT_TIMELINE_H
+
+#ifdef CONFIG_BOOT_TIMELINE
+
+extern int boot_timeline_begin(const char *fmt, ...)
+	__attribute__ ((format (printf, 1, 2)));
+extern void boot_timeline_end(int event);
+extern void boot_timeline_mark(const char *fmt, ...)
+	__attribute__ ((format (printf, 1, 2)));
+
+#else
+
+static inline int boot_timeline_begin(const char *fmt, ...)
+{
+	return -1;
+}
+
+static inline void boot_timeline_end(int event)
+{
+}
+
+static inline void boot_timeline_mark(const char *fmt, ...)
+{
+}
+
+#endif /* CONFIG_BOOT_TIMELINE */
+
+#endif /* _LINUX_BOOT_TIMELINE_H */
@@ -2,6 +2,9 @@
 #define __I2C_OMAP_H__
 
 #include <linux/platform_device.h>
+#include <linux/i2c.h>
+#include <linux/ktime.h>
+#include <linux/list.h>
 
 struct omap_i2c_bus_platform_data {
 	u32		clkrate;
@@ -11,4 +14,27 @@ struct omap_i2c_bus_platform_data {
 	int		(*device_idle) (struct platform_device *pdev);
 };
 
+/**
+ * struct omap_i2c_request - an asynchronous transfer
+ * @msgs: the messages, as passed to i2c_transfer()
+ * @num: number of messages
+ * @status: what i2c_transfer() returned, valid in @complete
+ * @complete: called from the adapter's thread once the transfer is done
+ * @context: for the submitter
+ */
+struct omap_i2c_request {
+	struct i2c_msg	*msgs;
+	int		num;
+	int		status;
+	void		(*complete)(struct omap_i2c_request *req);
+	void		*context;
+
+	/* private to i2c-omap */
+	struct list_head node;
+	ktime_t		queued;
+};
+
+extern int omap_i2c_submit(struct i2c_adapter *adap,
+			   struct omap_i2c_request *req);
+
 #endif
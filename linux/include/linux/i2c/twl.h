@@ -180,6 +180,20 @@ int twl_i2c_read_u8(u8 mod_no, u8 *val, u8 reg);
 int twl_i2c_write(u8 mod_no, u8 *value, u8 reg, unsigned num_bytes);
 int twl_i2c_read(u8 mod_no, u8 *value, u8 reg, unsigned num_bytes);
 
+/*
+ * Read-modify-write a register, served from the register cache when
+ * the register is cached.
+ */
+int twl_i2c_update_bits(u8 mod_no, u8 reg, u8 mask, u8 value);
+
+/*
+ * Batch writes to cached registers of a module: between these, they
+ * only update the cache, the commit writes them out with one transfer
+ * per run of consecutive registers.
+ */
+void twl_i2c_cache_begin(u8 mod_no);
+int twl_i2c_cache_commit(u8 mod_no);
+
 int twl6030_interrupt_unmask(u8 bit_mask, u8 offset);
 int twl6030_interrupt_mask(u8 bit_mask, u8 offset);
 
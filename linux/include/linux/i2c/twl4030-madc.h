@@ -124,6 +124,21 @@ enum sample_type {
 #define TWL4030_GPBR1_MADC_HFCLK_EN     (0x1 << 7)
 #define TWL4030_GPBR1_DFLT_MADC_CLK_EN  (0x1 << 4)
 
+/*
+ * twl4030_madc_sample - one continuous-sampling result, as returned by
+ * read() on /dev/twl4030-madc
+ * @tv_sec, @tv_nsec: CLOCK_MONOTONIC time the conversion completed
+ * @channels: bitmap of channels present in @values
+ * @values: converted channel values in mV, indexed by channel
+ */
+struct twl4030_madc_sample {
+   __u32 tv_sec;
+   __u32 tv_nsec;
+   __u16 channels;
+   __u16 reserved;
+   __s32 values[TWL4030_MADC_MAX_CHANNELS];
+};
+
 struct twl4030_madc_user_parms {
    int channel;
    int average;
@@ -27,10 +27,13 @@
 struct platform_pwm_beeper_data {
 	int pwm_id;
 	int (*init)(struct device *dev);
+	/* may be called from atomic context */
 	void (*notify)(struct device *dev, int hz);
 	int (*suspend)(struct device *dev);
 	int (*resume)(struct device *dev);
 	void (*exit)(struct device *dev);
 };
 
+extern void pwm_beeper_click(void);
+
 #endif /* __LINUX_INPUT_PWM_BEEPER_H__ */
@@ -131,4 +131,9 @@ struct lm3530_platform_data {
 	char* wait_for_framebuffer;
 };
 
+struct backlight_device;
+
+extern int lm3530_fade(struct backlight_device *bl, int brightness,
+		unsigned int duration_ms);
+
 #endif	/* _LINUX_LED_LM3530_H__ */
@@ -89,6 +89,17 @@ struct mmc_host_ops {
 	int (*enable)(struct mmc_host *host);
 	int (*disable)(struct mmc_host *host, int lazy);
 	void	(*request)(struct mmc_host *host, struct mmc_request *req);
+	/*
+	 * Optional: pre_req is called for a request before it is passed to
+	 * request(), with is_first_req false when another request is still
+	 * in flight, so the host can map and set up its DMA in the
+	 * meantime. post_req is called once the request is done, or with
+	 * err set when a prepared request is never issued, to undo that.
+	 */
+	void	(*pre_req)(struct mmc_host *host, struct mmc_request *req,
+			   bool is_first_req);
+	void	(*post_req)(struct mmc_host *host, struct mmc_request *req,
+			    int err);
 	/*
 	 * Avoid calling these three functions too often or in a "fast path",
 	 * since underlaying controller might implement them in an expensive
@@ -58,6 +58,8 @@
 #define OMAPFB_GET_VRAM_INFO	OMAP_IOR(61, struct omapfb_vram_info)
 #define OMAPFB_SET_TEARSYNC	OMAP_IOW(62, struct omapfb_tearsync_info)
 #define OMAPFB_GET_DISPLAY_INFO	OMAP_IOR(63, struct omapfb_display_info)
+#define OMAPFB_QUEUE_FLIP	OMAP_IOW(64, struct omapfb_flip)
+#define OMAPFB_BLIT		OMAP_IOW(65, struct omapfb_blit)
 
 #define OMAPFB_CAPS_GENERIC_MASK	0x00000fff
 #define OMAPFB_CAPS_LCDC_MASK		0x00fff000
@@ -218,6 +220,37 @@ struct omapfb_display_info {
 	__u32 reserved[5];
 };
 
+/*
+ * Pan to xoffset/yoffset at the next vsync without waiting for it. The
+ * eventfd, if not -1, is signalled once the new buffer is being shown.
+ * EBUSY if too many flips are queued already.
+ */
+struct omapfb_flip {
+	__u32 xoffset;
+	__u32 yoffset;
+	__s32 eventfd;
+	__u32 reserved[5];
+};
+
+#define OMAPFB_BLIT_FILL	0x0001
+
+/*
+ * Copy (sx, sy) to (dx, dy), or fill (dx, dy) with the raw pixel value
+ * color with OMAPFB_BLIT_FILL, w x h pixels within the virtual
+ * resolution. Returns when done.
+ */
+struct omapfb_blit {
+	__u16 sx;
+	__u16 sy;
+	__u16 dx;
+	__u16 dy;
+	__u16 w;
+	__u16 h;
+	__u32 flags;
+	__u32 color;
+	__u32 reserved[4];
+};
+
 #ifdef __KERNEL__
 
 #include <plat/board.h>
@@ -7,6 +7,9 @@ struct rotary_encoder_lite_platform_data {
 	unsigned int gpio_clear;
 	unsigned int steps;
 	bool rollover;
+	unsigned int report_window_us;	/* coalescing window, 0 for default */
+	/* called from the IRQ handler on every edge, before coalescing */
+	void (*edge)(struct device *dev, int direction);
 };
 
 #endif /* __ROTARY_ENCODER_LITE_H__ */
@@ -1,10 +1,28 @@
 #ifndef __SI1143_H__
 #define __SI1143_H__
 
+#include <linux/types.h>
+
+/*
+ * Sample record returned by read(2) on /dev/si1143 while the part is
+ * in autonomous mode. One record is queued per measurement interrupt.
+ */
+struct si1143_sample {
+	__u32 tv_sec;		/* CLOCK_MONOTONIC timestamp of the IRQ */
+	__u32 tv_nsec;
+	__u8  irq_status;	/* IRQ_STATUS bits that produced the sample */
+	__u8  reserved;
+	__u16 als_visible;
+	__u16 als_infrared;
+	__u16 proximity;
+};
+
+#ifdef __KERNEL__
 struct si1143_platform_data {
 	unsigned int proximity_tx_led1;
 	unsigned int proximity_tx_led2;
 	unsigned int proximity_tx_led3;
 };
+#endif /* __KERNEL__ */
 
 #endif /* __SI1143_H__ */
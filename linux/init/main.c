@@ -67,6 +67,7 @@
 #include <linux/sfi.h>
 #include <linux/shmem_fs.h>
 #include <linux/slab.h>
+#include <linux/boot_timeline.h>
 
 #include <asm/io.h>
 #include <asm/bugs.h>
@@ -739,13 +740,18 @@ static int __init_or_module do_one_initcall_debug(initcall_t fn)
 int __init_or_module do_one_initcall(initcall_t fn)
 {
 	int count = preempt_count();
+	int event;
 	int ret;
 
+	event = boot_timeline_begin("%pf", fn);
+
 	if (initcall_debug)
 		ret = do_one_initcall_debug(fn);
 	else
 		ret = fn();
 
+	boot_timeline_end(event);
+
 	msgbuf[0] = 0;
 
 	if (ret && ret != -ENODEV && initcall_debug)
@@ -0,0 +1,209 @@
+/*
+ * boot_timeline.c: Timeline of initcalls, probes and board bring-up
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2
+ * of the License.
+ */
+
+/*
+ * Every initcall, every driver probe and whatever else calls
+ * boot_timeline_begin()/boot_timeline_end() gets an entry with its
+ * start and end time in microseconds, on the same clock as the printk
+ * timestamps, and the pid it ran in, so work overlapping in async
+ * threads shows up as such. User space can add instant events
+ * ("first frame on screen") by writing "mark <name>" to
+ * <debugfs>/boot_timeline and stops recording by writing "stop".
+ *
+ * The table is fixed size and recording stops by itself once it is
+ * full, so later hotplug and module loading do not push the
+ * interesting part out.
+ */
+
+#include <linux/boot_timeline.h>
+#include <linux/debugfs.h>
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/sched.h>
+#include <linux/seq_file.h>
+#include <linux/spinlock.h>
+#include <linux/string.h>
+#include <linux/uaccess.h>
+
+#define BOOT_TIMELINE_EVENTS	CONFIG_BOOT_TIMELINE_EVENTS
+#define BOOT_TIMELINE_NAME_LEN	40
+
+/* end_us of an event that has not finished yet */
+#define BOOT_TIMELINE_OPEN	((u32)-1)
+
+struct boot_timeline_event {
+	u32	start_us;
+	u32	end_us;
+	pid_t	pid;
+	char	name[BOOT_TIMELINE_NAME_LEN];
+};
+
+static struct boot_timeline_event events[BOOT_TIMELINE_EVENTS];
+static unsigned int nevents;
+static bool stopped;
+static DEFINE_SPINLOCK(timeline_lock);
+
+static u32 boot_timeline_now(void)
+{
+	u64 ns = local_clock();
+
+	do_div(ns, NSEC_PER_USEC);
+
+	return ns;
+}
+
+static int boot_timeline_add(const char *fmt, va_list args, bool instant)
+{
+	struct boot_timeline_event *e;
+	unsigned long flags;
+	int event = -1;
+
+	spin_lock_irqsave(&timeline_lock, flags);
+	if (!stopped && nevents < BOOT_TIMELINE_EVENTS) {
+		event = nevents++;
+		e = &events[event];
+		e->start_us = boot_timeline_now();
+		e->end_us = instant ? e->start_us : BOOT_TIMELINE_OPEN;
+		e->pid = task_pid_nr(current);
+	}
+	spin_unlock_irqrestore(&timeline_lock, flags);
+
+	/* the slot is ours now, name it outside the lock */
+	if (event >= 0)
+		vsnprintf(events[event].name, BOOT_TIMELINE_NAME_LEN,
+				fmt, args);
+
+	return event;
+}
+
+/**
+ * boot_timeline_begin - record the start of a timeline event
+ *
+ * Returns a handle to pass to boot_timeline_end(), negative when the
+ * timeline is no longer recording.
+ */
+int boot_timeline_begin(const char *fmt, ...)
+{
+	va_list args;
+	int event;
+
+	va_start(args, fmt);
+	event = boot_timeline_add(fmt, args, false);
+	va_end(args);
+
+	return event;
+}
+EXPORT_SYMBOL_GPL(boot_timeline_begin);
+
+void boot_timeline_end(int event)
+{
+	if (event < 0 || event >= BOOT_TIMELINE_EVENTS)
+		return;
+
+	events[event].end_us = boot_timeline_now();
+}
+EXPORT_SYMBOL_GPL(boot_timeline_end);
+
+/**
+ * boot_timeline_mark - record an instant event
+ */
+void boot_timeline_mark(const char *fmt, ...)
+{
+	va_list args;
+
+	va_start(args, fmt);
+	boot_timeline_add(fmt, args, true);
+	va_end(args);
+}
+EXPORT_SYMBOL_GPL(boot_timeline_mark);
+
+static void *boot_timeline_start(struct seq_file *m, loff_t *pos)
+{
+	if (*pos == 0)
+		seq_puts(m, "#  start_us     end_us    dur_us    pid  event\n");
+
+	return *pos < nevents ? &events[*pos] : NULL;
+}
+
+static void *boot_timeline_next(struct seq_file *m, void *v, loff_t *pos)
+{
+	++*pos;
+	return boot_timeline_start(m, pos);
+}
+
+static void boot_timeline_stop(struct seq_file *m, void *v)
+{
+}
+
+static int boot_timeline_show(struct seq_file *m, void *v)
+{
+	const struct boot_timeline_event *e = v;
+
+	if (e->end_us == BOOT_TIMELINE_OPEN)
+		seq_printf(m, "%10u          -         -  %5d  %s\n",
+				e->start_us, e->pid, e->name);
+	else
+		seq_printf(m, "%10u %10u %9u  %5d  %s\n",
+				e->start_us, e->end_us,
+				e->end_us - e->start_us, e->pid, e->name);
+
+	return 0;
+}
+
+static const struct seq_operations boot_timeline_sops = {
+	.start	= boot_timeline_start,
+	.next	= boot_timeline_next,
+	.stop	= boot_timeline_stop,
+	.show	= boot_timeline_show,
+};
+
+static int boot_timeline_open(struct inode *inode, struct file *file)
+{
+	return seq_open(file, &boot_timeline_sops);
+}
+
+static ssize_t boot_timeline_write(struct file *file, const char __user *ubuf,
+		size_t count, loff_t *ppos)
+{
+	char buf[BOOT_TIMELINE_NAME_LEN + 8];
+	size_t len = min(count, sizeof(buf) - 1);
+
+	if (copy_from_user(buf, ubuf, len))
+		return -EFAULT;
+	buf[len] = '\0';
+	strim(buf);
+
+	if (!strncmp(buf, "mark ", 5))
+		boot_timeline_mark("%s", buf + 5);
+	else if (!strcmp(buf, "stop"))
+		stopped = true;
+	else
+		return -EINVAL;
+
+	return count;
+}
+
+static const struct file_operations boot_timeline_fops = {
+	.open		= boot_timeline_open,
+	.read		= seq_read,
+	.write		= boot_timeline_write,
+	.llseek		= seq_lseek,
+	.release	= seq_release,
+};
+
+static int __init boot_timeline_init(void)
+{
+	if (!debugfs_create_file("boot_timeline", 0644, NULL, NULL,
+				&boot_timeline_fops))
+		return -ENOMEM;
+
+	return 0;
+}
+late_initcall(boot_timeline_init);